@@ -0,0 +1,135 @@
+#include "AnimKeys.h"
+#include <math.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_IX86)
+#include <emmintrin.h>
+#define ANIMKEYS_SSE2
+#endif
+
+namespace AnimKeys_private
+{
+    // the rounding range, -32768.5 rounds to even and 32767.5 would round up
+    const float MIN_STEPS = -32768.5f;
+    const float MAX_STEPS = 32767.5f;
+
+    int16 LoadKey(const uint8* aKey)
+    {
+        return int16(uint16((aKey[0] << 8) | aKey[1]));
+    }
+
+    void StoreKey(uint8* aKey, int16 aValue)
+    {
+        aKey[0] = uint8(uint16(aValue) >> 8);
+        aKey[1] = uint8(aValue);
+    }
+
+    // same rounding as cvtps2dq, nearest with ties to even
+    bool QuantiseOne(float aSteps, int16& aOut)
+    {
+        if (!(aSteps >= MIN_STEPS && aSteps < MAX_STEPS))
+        {
+            aOut = aSteps >= MAX_STEPS ? 32767 : -32768;
+            return false;
+        }
+
+        aOut = int16(nearbyintf(aSteps));
+        return true;
+    }
+
+#if defined(ANIMKEYS_SSE2)
+    __m128i SwapBytes(__m128i aValue)
+    {
+        return _mm_or_si128(_mm_slli_epi16(aValue, 8), _mm_srli_epi16(aValue, 8));
+    }
+
+    // 8 keys at a time, sign extended by unpacking into the high half and shifting down
+    int DequantiseSSE2(const uint8* aKeys, int aCount, float aScale, float* aOut)
+    {
+        const __m128 scale = _mm_set1_ps(aScale);
+        int i = 0;
+
+        for (; i + 8 <= aCount; i += 8)
+        {
+            const __m128i keys = SwapBytes(_mm_loadu_si128((const __m128i*)(aKeys + i * 2)));
+            const __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(keys, keys), 16);
+            const __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(keys, keys), 16);
+            _mm_storeu_ps(aOut + i, _mm_mul_ps(_mm_cvtepi32_ps(lo), scale));
+            _mm_storeu_ps(aOut + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), scale));
+        }
+
+        return i;
+    }
+
+    // nan converts to 0x80000000 and packs to -32768 like the scalar path
+    int QuantiseSSE2(const float* aValues, int aCount, float aInvScale, uint8* aOutKeys, int& aOutClamped)
+    {
+        const __m128 invScale = _mm_set1_ps(aInvScale);
+        const __m128 minSteps = _mm_set1_ps(MIN_STEPS);
+        const __m128 maxSteps = _mm_set1_ps(MAX_STEPS);
+        int i = 0;
+
+        for (; i + 8 <= aCount; i += 8)
+        {
+            const __m128 lo = _mm_mul_ps(_mm_loadu_ps(aValues + i), invScale);
+            const __m128 hi = _mm_mul_ps(_mm_loadu_ps(aValues + i + 4), invScale);
+
+            const int inRange = _mm_movemask_ps(_mm_and_ps(_mm_cmpge_ps(lo, minSteps), _mm_cmplt_ps(lo, maxSteps))) |
+                (_mm_movemask_ps(_mm_and_ps(_mm_cmpge_ps(hi, minSteps), _mm_cmplt_ps(hi, maxSteps))) << 4);
+
+            if (inRange != 0xFF)
+            {
+                // rare, the scalar path sorts out which way each one clamps
+                for (int k = 0; k < 8; ++k)
+                {
+                    int16 key;
+                    aOutClamped += QuantiseOne(aValues[i + k] * aInvScale, key) ? 0 : 1;
+                    StoreKey(aOutKeys + (i + k) * 2, key);
+                }
+
+                continue;
+            }
+
+            const __m128i keys = _mm_packs_epi32(_mm_cvtps_epi32(lo), _mm_cvtps_epi32(hi));
+            _mm_storeu_si128((__m128i*)(aOutKeys + i * 2), SwapBytes(keys));
+        }
+
+        return i;
+    }
+#endif
+}
+
+void AnimKeys::Dequantise(const uint8* aKeys, int aCount, float aScale, float* aOut)
+{
+    using namespace AnimKeys_private;
+
+    int i = 0;
+
+#if defined(ANIMKEYS_SSE2)
+    i = DequantiseSSE2(aKeys, aCount, aScale, aOut);
+#endif
+
+    for (; i < aCount; ++i)
+        aOut[i] = float(LoadKey(aKeys + i * 2)) * aScale;
+}
+
+int AnimKeys::Quantise(const float* aValues, int aCount, float aScale, uint8* aOutKeys)
+{
+    using namespace AnimKeys_private;
+
+    const float invScale = 1.0f / aScale;
+    int clamped = 0;
+    int i = 0;
+
+#if defined(ANIMKEYS_SSE2)
+    i = QuantiseSSE2(aValues, aCount, invScale, aOutKeys, clamped);
+#endif
+
+    for (; i < aCount; ++i)
+    {
+        int16 key;
+        clamped += QuantiseOne(aValues[i] * invScale, key) ? 0 : 1;
+        StoreKey(aOutKeys + i * 2, key);
+    }
+
+    return clamped;
+}
@@ -0,0 +1,19 @@
+#ifndef _AnimKeys_h_
+#define _AnimKeys_h_
+
+#include "C_Base.h"
+
+// animation keys are big endian s16 steps of a channel scale, an angle channel steps 360/65536 degrees
+namespace AnimKeys
+{
+    const float ANGLE_SCALE = 360.0f / 65536.0f;
+
+    // aCount keys to aOut[i] = key * aScale
+    void Dequantise(const uint8* aKeys, int aCount, float aScale, float* aOut);
+
+    // back to keys rounded to the nearest step, values out of range (or nan) are clamped.
+    // returns how many were clamped
+    int Quantise(const float* aValues, int aCount, float aScale, uint8* aOutKeys);
+}
+
+#endif // _AnimKeys_h_
@@ -0,0 +1,170 @@
+#ifndef _BigEndian_h_
+#define _BigEndian_h_
+
+#include "C_Base.h"
+#include "ByteSwap.h"
+#include <string.h>
+
+// big-endian codec with the byte order fixed at compile time, for fixed-layout records.
+// use this over C_Stream's runtime endian swap when decoding whole tables
+namespace BigEndian
+{
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+    static const bool IS_HOST_ORDER = true;
+#else
+    static const bool IS_HOST_ORDER = false;
+#endif
+
+    template<int SIZE> struct UIntOfSize;
+    template<> struct UIntOfSize<1> { typedef uint8 Type; static uint8 Swap(uint8 v) { return v; } };
+    template<> struct UIntOfSize<2> { typedef uint16 Type; static uint16 Swap(uint16 v) { return uint16((v >> 8) | (v << 8)); } };
+    template<> struct UIntOfSize<4> { typedef uint32 Type; static uint32 Swap(uint32 v) { return (v >> 24) | ((v >> 8) & 0xFF00) | ((v << 8) & 0xFF0000) | (v << 24); } };
+    template<> struct UIntOfSize<8> { typedef uint64 Type; static uint64 Swap(uint64 v) { return (uint64(UIntOfSize<4>::Swap(uint32(v))) << 32) | UIntOfSize<4>::Swap(uint32(v >> 32)); } };
+
+    template<typename T>
+    T Load(const void* aData)
+    {
+        typedef UIntOfSize<sizeof(T)> U;
+        typename U::Type raw;
+        memcpy(&raw, aData, sizeof(T));
+
+        if (!IS_HOST_ORDER)
+            raw = U::Swap(raw);
+
+        T val;
+        memcpy(&val, &raw, sizeof(T));
+        return val;
+    }
+
+    template<typename T>
+    void Store(void* aData, T aValue)
+    {
+        typedef UIntOfSize<sizeof(T)> U;
+        typename U::Type raw;
+        memcpy(&raw, &aValue, sizeof(T));
+
+        if (!IS_HOST_ORDER)
+            raw = U::Swap(raw);
+
+        memcpy(aData, &raw, sizeof(T));
+    }
+
+    // converts an array between big-endian and host order in place
+    template<typename T>
+    void SwapArray(T* aData, uint32 aCount)
+    {
+        if (IS_HOST_ORDER || sizeof(T) == 1)
+            return;
+
+        if (sizeof(T) == 2)
+            ByteSwap::Swap16(aData, aCount);
+        else if (sizeof(T) == 4)
+            ByteSwap::Swap32(aData, aCount);
+        else
+        {
+            for (uint32 i = 0; i < aCount; ++i)
+                aData[i] = Load<T>(&aData[i]);
+        }
+    }
+
+    template<typename T>
+    void LoadArray(const void* aSrc, T* aDst, uint32 aCount)
+    {
+        memcpy(aDst, aSrc, aCount * sizeof(T));
+        SwapArray(aDst, aCount);
+    }
+
+    template<typename T>
+    void StoreArray(void* aDst, const T* aSrc, uint32 aCount)
+    {
+        memcpy(aDst, aSrc, aCount * sizeof(T));
+        SwapArray((T*)aDst, aCount);
+    }
+
+    // sequential reader over a buffer, bounds are checked by the caller through GetRemaining
+    class Reader
+    {
+    public:
+        Reader(const void* aData, uint32 aSize)
+            : mData((const uint8*)aData)
+            , mSize(aSize)
+        {}
+
+        template<typename T>
+        T Read()
+        {
+            WAR_CHECK(mPos + sizeof(T) <= mSize);
+            const T val = Load<T>(mData + mPos);
+            mPos += sizeof(T);
+            return val;
+        }
+
+        template<typename T>
+        Reader& operator>>(T& aOut)
+        {
+            aOut = Read<T>();
+            return *this;
+        }
+
+        void ReadBytes(void* aOut, uint32 aSize)
+        {
+            WAR_CHECK(mPos + aSize <= mSize);
+            memcpy(aOut, mData + mPos, aSize);
+            mPos += aSize;
+        }
+
+        void Skip(uint32 aSize) { mPos += aSize; }
+        void Seek(uint32 aPos) { mPos = aPos; }
+
+        const uint8* GetData() const { return mData; }
+        const uint8* GetCurrent() const { return mData + mPos; }
+        uint32 GetPosition() const { return mPos; }
+        uint32 GetSize() const { return mSize; }
+        uint32 GetRemaining() const { return mPos < mSize ? mSize - mPos : 0; }
+
+    private:
+        const uint8* mData;
+        uint32 mSize;
+        uint32 mPos = 0;
+    };
+
+    class Writer
+    {
+    public:
+        Writer(void* aData, uint32 aSize)
+            : mData((uint8*)aData)
+            , mSize(aSize)
+        {}
+
+        template<typename T>
+        void Write(T aValue)
+        {
+            WAR_CHECK(mPos + sizeof(T) <= mSize);
+            Store<T>(mData + mPos, aValue);
+            mPos += sizeof(T);
+        }
+
+        template<typename T>
+        Writer& operator<<(T aValue)
+        {
+            Write<T>(aValue);
+            return *this;
+        }
+
+        void WriteBytes(const void* aData, uint32 aSize)
+        {
+            WAR_CHECK(mPos + aSize <= mSize);
+            memcpy(mData + mPos, aData, aSize);
+            mPos += aSize;
+        }
+
+        uint32 GetPosition() const { return mPos; }
+
+    private:
+        uint8* mData;
+        uint32 mSize;
+        uint32 mPos = 0;
+    };
+}
+
+#endif // _BigEndian_h_
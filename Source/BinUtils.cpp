@@ -1,9 +1,29 @@
 #include "BinUtils.h"
 #include "C_Stream.h"
 #include "C_MemBlock.h"
+#include "C_FileSystem.h"
+#include <atomic>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+#include <stdio.h>
 
 namespace BinUtils_private
 {
+    const uint32 CACHE_MAGIC = 0x31484357; // "WCH1"
+
+    struct CacheHeader
+    {
+        uint32 mMagic;
+        uint32 mSize;
+        uint64 mHash;
+    };
+
     template<typename T>
     void ReadOffsets(C_Stream& aHandle, C_Vector<T>& aOut, int aStride)
     {
@@ -19,6 +39,58 @@ namespace BinUtils_private
             aOut.Add(val);
         }
     }
+
+    struct CRC32Table
+    {
+        CRC32Table()
+        {
+            for (uint32 i = 0; i < 256; ++i)
+            {
+                uint32 crc = i;
+
+                for (int j = 0; j < 8; ++j)
+                    crc = (crc & 1) ? (crc >> 1) ^ 0xEDB88320 : (crc >> 1);
+
+                mTable[i] = crc;
+            }
+        }
+
+        uint32 mTable[256];
+    };
+
+    static const CRC32Table sCRC32Table;
+
+    const uint64 PRIME64_1 = 0x9E3779B185EBCA87ULL;
+    const uint64 PRIME64_2 = 0xC2B2AE3D27D4EB4FULL;
+    const uint64 PRIME64_3 = 0x165667B19E3779F9ULL;
+    const uint64 PRIME64_4 = 0x85EBCA77C2B2AE63ULL;
+    const uint64 PRIME64_5 = 0x27D4EB2F165667C5ULL;
+
+    inline uint64 Rotl64(uint64 v, int r) { return (v << r) | (v >> (64 - r)); }
+
+    // little-endian loads so hashes match across hosts
+    inline uint64 Read64(const uint8* p)
+    {
+        return uint64(p[0]) | (uint64(p[1]) << 8) | (uint64(p[2]) << 16) | (uint64(p[3]) << 24) |
+            (uint64(p[4]) << 32) | (uint64(p[5]) << 40) | (uint64(p[6]) << 48) | (uint64(p[7]) << 56);
+    }
+
+    inline uint32 Read32(const uint8* p)
+    {
+        return uint32(p[0]) | (uint32(p[1]) << 8) | (uint32(p[2]) << 16) | (uint32(p[3]) << 24);
+    }
+
+    inline uint64 Round64(uint64 aAcc, uint64 aInput)
+    {
+        aAcc += aInput * PRIME64_2;
+        return Rotl64(aAcc, 31) * PRIME64_1;
+    }
+
+    inline uint64 MergeRound64(uint64 aAcc, uint64 aVal)
+    {
+        aAcc ^= Round64(0, aVal);
+        return aAcc * PRIME64_1 + PRIME64_4;
+    }
 }
 
 void BinUtils::ReadOffsets32(C_Stream& aHandle, C_Vector<int32>& aOut, int aStride /*= 4*/)
@@ -59,3 +131,217 @@ void BinUtils::SplitFile(C_Stream& aHandle, C_Vector<int32>& aOffsetsAndEndSize,
     }
 }
 
+
+void BinUtils::ReadRemaining(C_Stream& aHandle, C_Vector<uint8>& aOut)
+{
+    aOut.Resize(int(aHandle.GetRemaining()));
+
+    if (aOut.Count() > 0)
+        aHandle.ReadBytes(aOut.GetBuffer(), aOut.Count());
+}
+
+string BinUtils::ToHex(const uint8* aData, int aSize)
+{
+    static const char* sDigits = "0123456789ABCDEF";
+
+    string hex;
+    hex.resize(aSize * 2);
+
+    for (int i = 0; i < aSize; ++i)
+    {
+        hex[i * 2] = sDigits[aData[i] >> 4];
+        hex[i * 2 + 1] = sDigits[aData[i] & 0xF];
+    }
+
+    return hex;
+}
+
+bool BinUtils::FromHex(const char* aHex, C_Vector<uint8>& aOut)
+{
+    aOut.Clear();
+
+    const int len = int(strlen(aHex));
+
+    if (len & 1)
+        return false;
+
+    for (int i = 0; i < len; i += 2)
+    {
+        int byte = 0;
+
+        for (int j = 0; j < 2; ++j)
+        {
+            const char c = aHex[i + j];
+            int v;
+
+            if (c >= '0' && c <= '9')
+                v = c - '0';
+            else if (c >= 'A' && c <= 'F')
+                v = c - 'A' + 10;
+            else if (c >= 'a' && c <= 'f')
+                v = c - 'a' + 10;
+            else
+                return false;
+
+            byte = (byte << 4) | v;
+        }
+
+        aOut.Add(uint8(byte));
+    }
+
+    return true;
+}
+
+uint32 BinUtils::CRC32(const void* aData, uint32 aSize, uint32 aCrc /*= 0*/)
+{
+    const uint32* table = BinUtils_private::sCRC32Table.mTable;
+    const uint8* data = (const uint8*)aData;
+
+    uint32 crc = ~aCrc;
+
+    for (uint32 i = 0; i < aSize; ++i)
+        crc = (crc >> 8) ^ table[(crc ^ data[i]) & 0xFF];
+
+    return ~crc;
+}
+
+uint64 BinUtils::Hash64(const void* aData, uint32 aSize, uint64 aSeed /*= 0*/)
+{
+    using namespace BinUtils_private;
+
+    const uint8* p = (const uint8*)aData;
+    const uint8* end = p + aSize;
+    uint64 h;
+
+    if (aSize >= 32)
+    {
+        uint64 v1 = aSeed + PRIME64_1 + PRIME64_2;
+        uint64 v2 = aSeed + PRIME64_2;
+        uint64 v3 = aSeed;
+        uint64 v4 = aSeed - PRIME64_1;
+
+        do
+        {
+            v1 = Round64(v1, Read64(p));
+            v2 = Round64(v2, Read64(p + 8));
+            v3 = Round64(v3, Read64(p + 16));
+            v4 = Round64(v4, Read64(p + 24));
+            p += 32;
+        } while (p + 32 <= end);
+
+        h = Rotl64(v1, 1) + Rotl64(v2, 7) + Rotl64(v3, 12) + Rotl64(v4, 18);
+        h = MergeRound64(h, v1);
+        h = MergeRound64(h, v2);
+        h = MergeRound64(h, v3);
+        h = MergeRound64(h, v4);
+    }
+    else
+    {
+        h = aSeed + PRIME64_5;
+    }
+
+    h += aSize;
+
+    for (; p + 8 <= end; p += 8)
+        h = Rotl64(h ^ Round64(0, Read64(p)), 27) * PRIME64_1 + PRIME64_4;
+
+    if (p + 4 <= end)
+    {
+        h = Rotl64(h ^ (uint64(Read32(p)) * PRIME64_1), 23) * PRIME64_2 + PRIME64_3;
+        p += 4;
+    }
+
+    for (; p < end; ++p)
+        h = Rotl64(h ^ (*p * PRIME64_5), 11) * PRIME64_1;
+
+    h ^= h >> 33;
+    h *= PRIME64_2;
+    h ^= h >> 29;
+    h *= PRIME64_3;
+    h ^= h >> 32;
+
+    return h;
+}
+
+string BinUtils::TempPath(const char* aPath)
+{
+    static std::atomic<uint32> sCounter(0);
+
+#ifdef _WIN32
+    const uint32 pid = uint32(GetCurrentProcessId());
+#else
+    const uint32 pid = uint32(getpid());
+#endif
+
+    return string(aPath) + C_Strfmt<32>(".%u-%u.tmp", pid, uint32(++sCounter)).GetBuffer();
+}
+
+bool BinUtils::ReplaceFile(const char* aTempPath, const char* aPath)
+{
+#ifdef _WIN32
+    const bool ok = MoveFileExA(aTempPath, aPath, MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+    const bool ok = rename(aTempPath, aPath) == 0;
+#endif
+
+    if (!ok)
+        remove(aTempPath);
+
+    return ok;
+}
+
+bool BinUtils::WriteFileAtomic(const char* aPath, const void* aData, uint32 aSize)
+{
+    const string temp = TempPath(aPath);
+
+    if (!C_FileSystem::WriteFile(temp.c_str(), (void*)aData, aSize))
+    {
+        remove(temp.c_str());
+        return false;
+    }
+
+    return ReplaceFile(temp.c_str(), aPath);
+}
+
+bool BinUtils::WriteCacheFile(const char* aPath, const void* aData, uint32 aSize)
+{
+    using namespace BinUtils_private;
+
+    C_Vector<uint8> file;
+    file.Resize(sizeof(CacheHeader) + aSize);
+
+    CacheHeader header = { CACHE_MAGIC, aSize, Hash64(aData, aSize) };
+    memcpy(file.GetBuffer(), &header, sizeof(header));
+
+    if (aSize > 0)
+        memcpy(file.GetBuffer() + sizeof(header), aData, aSize);
+
+    return WriteFileAtomic(aPath, file.GetBuffer(), file.Count());
+}
+
+bool BinUtils::ReadCacheFile(const char* aPath, C_Vector<uint8>& aOut)
+{
+    using namespace BinUtils_private;
+
+    if (!C_FileSystem::Exists(aPath))
+        return false;
+
+    C_Ptr<C_MemBlock> file = C_FileSystem::ReadFile(aPath);
+    if (!file || file->mSize < sizeof(CacheHeader))
+        return false;
+
+    CacheHeader header;
+    memcpy(&header, file->mBlock, sizeof(header));
+
+    const uint8* data = (const uint8*)file->mBlock + sizeof(header);
+
+    if (header.mMagic != CACHE_MAGIC || header.mSize != file->mSize - sizeof(header) || header.mHash != Hash64(data, header.mSize))
+        return false;
+
+    aOut.Resize(header.mSize);
+
+    if (header.mSize > 0)
+        memcpy(aOut.GetBuffer(), data, header.mSize);
+
+    return true;
+}
@@ -12,6 +12,32 @@ namespace BinUtils
     void ReadOffsets32(C_Stream& aHandle, C_Vector<int32>& aOut, int aStride = 4);
 
     void SplitFile(C_Stream& aHandle, C_Vector<int32>& aOffsetsAndEndSize, const function<void(int, C_FilePath&)>& aFmtFilenameFunc, const function<void(int, C_Stream&)>& aEndWriteFunc = {});
+
+    // reads everything from the current position to the end of the stream
+    void ReadRemaining(C_Stream& aHandle, C_Vector<uint8>& aOut);
+
+    // hex strings for small binary blobs kept in json
+    string ToHex(const uint8* aData, int aSize);
+    bool FromHex(const char* aHex, C_Vector<uint8>& aOut);
+
+    // standard (zlib) crc32, pass the previous result in aCrc to continue a running checksum
+    uint32 CRC32(const void* aData, uint32 aSize, uint32 aCrc = 0);
+
+    // xxHash64 of a block, for content keyed caches
+    uint64 Hash64(const void* aData, uint32 aSize, uint64 aSeed = 0);
+
+    // a name next to aPath that no other writer (thread or process) uses, written and then moved over aPath
+    // with ReplaceFile so a reader never sees half a file, and the file being replaced can still be read meanwhile
+    string TempPath(const char* aPath);
+    bool ReplaceFile(const char* aTempPath, const char* aPath);
+
+    // C_FileSystem::WriteFile through a temp file
+    bool WriteFileAtomic(const char* aPath, const void* aData, uint32 aSize);
+
+    // files of the .zcache/.acache dirs: the data behind a header with its size and hash, written with
+    // WriteFileAtomic. a file cut short or damaged reads as missing and gets written again
+    bool WriteCacheFile(const char* aPath, const void* aData, uint32 aSize);
+    bool ReadCacheFile(const char* aPath, C_Vector<uint8>& aOut);
 }
 
 
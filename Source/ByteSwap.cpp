@@ -0,0 +1,99 @@
+#include "ByteSwap.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define BYTESWAP_AVX2
+#elif defined(__SSSE3__)
+#include <tmmintrin.h>
+#define BYTESWAP_SSSE3
+#elif defined(__SSE2__) || defined(_M_X64) || defined(_M_IX86)
+#include <emmintrin.h>
+#define BYTESWAP_SSE2
+#endif
+
+void ByteSwap::Swap16(void* aData, uint32 aCount)
+{
+    uint8* data = (uint8*)aData;
+    const uint32 size = aCount * 2;
+    uint32 i = 0;
+
+#if defined(BYTESWAP_AVX2)
+    const __m256i shuffle = _mm256_setr_epi8(
+        1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14,
+        1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+
+    for (; i + 32 <= size; i += 32)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(data + i));
+        _mm256_storeu_si256((__m256i*)(data + i), _mm256_shuffle_epi8(v, shuffle));
+    }
+#elif defined(BYTESWAP_SSSE3)
+    const __m128i shuffle = _mm_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+
+    for (; i + 16 <= size; i += 16)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i*)(data + i));
+        _mm_storeu_si128((__m128i*)(data + i), _mm_shuffle_epi8(v, shuffle));
+    }
+#elif defined(BYTESWAP_SSE2)
+    for (; i + 16 <= size; i += 16)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i*)(data + i));
+        v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+        _mm_storeu_si128((__m128i*)(data + i), v);
+    }
+#endif
+
+    for (; i + 2 <= size; i += 2)
+    {
+        const uint8 t = data[i];
+        data[i] = data[i + 1];
+        data[i + 1] = t;
+    }
+}
+
+void ByteSwap::Swap32(void* aData, uint32 aCount)
+{
+    uint8* data = (uint8*)aData;
+    const uint32 size = aCount * 4;
+    uint32 i = 0;
+
+#if defined(BYTESWAP_AVX2)
+    const __m256i shuffle = _mm256_setr_epi8(
+        3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+        3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+
+    for (; i + 32 <= size; i += 32)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(data + i));
+        _mm256_storeu_si256((__m256i*)(data + i), _mm256_shuffle_epi8(v, shuffle));
+    }
+#elif defined(BYTESWAP_SSSE3)
+    const __m128i shuffle = _mm_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+
+    for (; i + 16 <= size; i += 16)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i*)(data + i));
+        _mm_storeu_si128((__m128i*)(data + i), _mm_shuffle_epi8(v, shuffle));
+    }
+#elif defined(BYTESWAP_SSE2)
+    // swap the halfwords, then the bytes within them
+    for (; i + 16 <= size; i += 16)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i*)(data + i));
+        v = _mm_or_si128(_mm_slli_epi32(v, 16), _mm_srli_epi32(v, 16));
+        v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+        _mm_storeu_si128((__m128i*)(data + i), v);
+    }
+#endif
+
+    for (; i + 4 <= size; i += 4)
+    {
+        const uint8 t0 = data[i];
+        const uint8 t1 = data[i + 1];
+        data[i] = data[i + 3];
+        data[i + 1] = data[i + 2];
+        data[i + 2] = t1;
+        data[i + 3] = t0;
+    }
+}
@@ -0,0 +1,13 @@
+#ifndef _ByteSwap_h_
+#define _ByteSwap_h_
+
+#include "C_Base.h"
+
+// in place bulk byte swapping, aCount is the number of elements
+namespace ByteSwap
+{
+    void Swap16(void* aData, uint32 aCount);
+    void Swap32(void* aData, uint32 aCount);
+}
+
+#endif // _ByteSwap_h_
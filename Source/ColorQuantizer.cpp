@@ -0,0 +1,333 @@
+#include "ColorQuantizer.h"
+#include "JobPool.h"
+#include <algorithm>
+
+namespace ColorQuantizer_private
+{
+    // transparent and opaque colors never share an entry, this is above any rgb distance
+    const int ALPHA_PENALTY = 4096;
+    const int REFINE_ITERATIONS = 4;
+    // distance evaluations per job when assigning in parallel. batches are sized from
+    // colors * palette entries, a 256 entry palette splits after 64 colors
+    const int ASSIGN_WORK = 16384;
+    const int ASSIGN_MIN_BATCH = 16;
+
+    struct Color
+    {
+        int mC[4];  // r, g, b 0-31, a 0-1
+        uint32 mCount;
+        uint16 mValue;
+    };
+
+    struct Box
+    {
+        int mStart;
+        int mEnd;
+    };
+
+    inline void Unpack(uint16 aValue, int* aOut)
+    {
+        aOut[0] = aValue >> 11;
+        aOut[1] = (aValue >> 6) & 0x1F;
+        aOut[2] = (aValue >> 1) & 0x1F;
+        aOut[3] = aValue & 1;
+    }
+
+    inline uint16 Pack(const int* aC)
+    {
+        return uint16((aC[0] << 11) | (aC[1] << 6) | (aC[2] << 1) | aC[3]);
+    }
+
+    inline int Distance(const int* a, const int* b)
+    {
+        const int dr = a[0] - b[0];
+        const int dg = a[1] - b[1];
+        const int db = a[2] - b[2];
+        return dr * dr + dg * dg + db * db + (a[3] != b[3] ? ALPHA_PENALTY : 0);
+    }
+
+    void GetRange(const C_Vector<Color>& aColors, const Box& aBox, int* aOutMin, int* aOutMax)
+    {
+        for (int c = 0; c < 4; ++c)
+        {
+            aOutMin[c] = 255;
+            aOutMax[c] = -1;
+        }
+
+        for (int i = aBox.mStart; i < aBox.mEnd; ++i)
+        {
+            for (int c = 0; c < 4; ++c)
+            {
+                aOutMin[c] = C_Min(aOutMin[c], aColors[i].mC[c]);
+                aOutMax[c] = C_Max(aOutMax[c], aColors[i].mC[c]);
+            }
+        }
+    }
+
+    void MedianCut(C_Vector<Color>& aColors, int aMaxColors, C_Vector<Box>& aOutBoxes)
+    {
+        aOutBoxes.Clear();
+        aOutBoxes.Add({ 0, aColors.Count() });
+
+        while (aOutBoxes.Count() < aMaxColors)
+        {
+            // split the box with the most pixels times its widest extent, alpha first
+            int best = -1;
+            int bestChannel = 0;
+            uint64 bestScore = 0;
+
+            for (int b = 0; b < aOutBoxes.Count(); ++b)
+            {
+                const Box& box = aOutBoxes[b];
+
+                if (box.mEnd - box.mStart < 2)
+                    continue;
+
+                int lo[4];
+                int hi[4];
+                GetRange(aColors, box, lo, hi);
+
+                int channel = 0;
+                int extent = 0;
+
+                if (hi[3] != lo[3])
+                {
+                    channel = 3;
+                    extent = 32;
+                }
+                else
+                {
+                    for (int c = 0; c < 3; ++c)
+                    {
+                        if (hi[c] - lo[c] > extent)
+                        {
+                            extent = hi[c] - lo[c];
+                            channel = c;
+                        }
+                    }
+                }
+
+                uint64 weight = 0;
+                for (int i = box.mStart; i < box.mEnd; ++i)
+                    weight += aColors[i].mCount;
+
+                const uint64 score = weight * uint64(extent);
+
+                if (score > bestScore)
+                {
+                    bestScore = score;
+                    best = b;
+                    bestChannel = channel;
+                }
+            }
+
+            if (best < 0)
+                break;
+
+            Box box = aOutBoxes[best];
+            Color* colors = aColors.GetBuffer();
+            std::sort(colors + box.mStart, colors + box.mEnd, [bestChannel](const Color& a, const Color& b)
+                {
+                    return a.mC[bestChannel] < b.mC[bestChannel];
+                });
+
+            uint64 total = 0;
+            for (int i = box.mStart; i < box.mEnd; ++i)
+                total += colors[i].mCount;
+
+            // weighted median, both halves keep at least one color
+            uint64 acc = 0;
+            int split = box.mStart + 1;
+
+            for (int i = box.mStart; i < box.mEnd - 1; ++i)
+            {
+                acc += colors[i].mCount;
+                split = i + 1;
+
+                if (acc * 2 >= total)
+                    break;
+            }
+
+            aOutBoxes[best].mEnd = split;
+            aOutBoxes.Add({ split, box.mEnd });
+        }
+    }
+
+    struct Accum
+    {
+        uint64 mSum[4] = { 0, 0, 0, 0 };
+        uint64 mCount = 0;
+
+        void Add(const Color& aColor)
+        {
+            for (int c = 0; c < 4; ++c)
+                mSum[c] += uint64(aColor.mC[c]) * aColor.mCount;
+
+            mCount += aColor.mCount;
+        }
+
+        // rounded mean, alpha by majority
+        bool GetMean(int* aOut) const
+        {
+            if (mCount == 0)
+                return false;
+
+            for (int c = 0; c < 3; ++c)
+                aOut[c] = int((mSum[c] + mCount / 2) / mCount);
+
+            aOut[3] = mSum[3] * 2 >= mCount ? 1 : 0;
+            return true;
+        }
+    };
+
+    void Assign(const C_Vector<Color>& aColors, const C_Vector<uint16>& aPalette, C_Vector<uint8>& aOutNearest)
+    {
+        C_Vector<int> entries;
+        entries.Resize(aPalette.Count() * 4);
+
+        for (int p = 0; p < aPalette.Count(); ++p)
+            Unpack(aPalette[p], &entries[p * 4]);
+
+        auto assignRange = [&](int aStart, int aEnd)
+        {
+            for (int i = aStart; i < aEnd; ++i)
+            {
+                int best = 0;
+                int bestDist = 0x7FFFFFFF;
+
+                for (int p = 0; p < aPalette.Count(); ++p)
+                {
+                    const int d = Distance(aColors[i].mC, &entries[p * 4]);
+
+                    if (d < bestDist)
+                    {
+                        bestDist = d;
+                        best = p;
+                    }
+                }
+
+                aOutNearest[i] = uint8(best);
+            }
+        };
+
+        aOutNearest.Resize(aColors.Count());
+
+        // textures already compile in parallel per archive entry, so this only splits what is
+        // large enough to pay for a job. nesting is safe, the caller always works its own batch
+        const int batchSize = C_Max(ASSIGN_MIN_BATCH, ASSIGN_WORK / C_Max(1, aPalette.Count()));
+        const int numBatches = (aColors.Count() + batchSize - 1) / batchSize;
+
+        if (numBatches <= 1)
+        {
+            assignRange(0, aColors.Count());
+            return;
+        }
+
+        JobPool::GetInstance().ParallelFor(numBatches, [&](int b)
+            {
+                assignRange(b * batchSize, C_Min((b + 1) * batchSize, aColors.Count()));
+            });
+    }
+}
+
+void ColorQuantizer::Quantize5551(const uint16* aPixels, int aCount, int aMaxColors, C_Vector<uint16>& aOutPalette, C_Vector<uint8>& aOutIndices)
+{
+    using namespace ColorQuantizer_private;
+
+    WAR_ASSERT(aMaxColors > 0 && aMaxColors <= 256, "Invalid palette size");
+
+    // distinct colors with their pixel counts
+    C_Vector<uint16> sorted;
+    sorted.Resize(aCount);
+
+    if (aCount > 0)
+        memcpy(sorted.GetBuffer(), aPixels, aCount * sizeof(uint16));
+
+    std::sort(sorted.GetBuffer(), sorted.GetBuffer() + aCount);
+
+    C_Vector<Color> colors;
+
+    for (int i = 0; i < aCount;)
+    {
+        int run = 1;
+        while (i + run < aCount && sorted[i + run] == sorted[i])
+            ++run;
+
+        Color& c = colors.Add();
+        Unpack(sorted[i], c.mC);
+        c.mCount = uint32(run);
+        c.mValue = sorted[i];
+        i += run;
+    }
+
+    aOutPalette.Clear();
+    C_Vector<uint8> nearest;
+
+    if (colors.Count() <= aMaxColors)
+    {
+        nearest.Resize(colors.Count());
+
+        for (int i = 0; i < colors.Count(); ++i)
+        {
+            aOutPalette.Add(colors[i].mValue);
+            nearest[i] = uint8(i);
+        }
+    }
+    else
+    {
+        C_Vector<Box> boxes;
+        MedianCut(colors, aMaxColors, boxes);
+
+        for (const Box& box : boxes)
+        {
+            Accum accum;
+            for (int i = box.mStart; i < box.mEnd; ++i)
+                accum.Add(colors[i]);
+
+            int mean[4];
+            accum.GetMean(mean);
+            aOutPalette.Add(Pack(mean));
+        }
+
+        for (int iter = 0; iter < REFINE_ITERATIONS; ++iter)
+        {
+            Assign(colors, aOutPalette, nearest);
+
+            C_Vector<Accum> accums;
+            accums.Resize(aOutPalette.Count());
+
+            for (int i = 0; i < colors.Count(); ++i)
+                accums[nearest[i]].Add(colors[i]);
+
+            bool changed = false;
+
+            for (int p = 0; p < aOutPalette.Count(); ++p)
+            {
+                int mean[4];
+
+                if (accums[p].GetMean(mean) && Pack(mean) != aOutPalette[p])
+                {
+                    aOutPalette[p] = Pack(mean);
+                    changed = true;
+                }
+            }
+
+            if (!changed)
+                break;
+        }
+
+        Assign(colors, aOutPalette, nearest);
+    }
+
+    // median cut reorders the colors, map pixels through a table
+    C_Vector<uint8> lut;
+    lut.Resize(0x10000, 0);
+
+    for (int i = 0; i < colors.Count(); ++i)
+        lut[colors[i].mValue] = nearest[i];
+
+    aOutIndices.Resize(aCount);
+
+    for (int i = 0; i < aCount; ++i)
+        aOutIndices[i] = lut[aPixels[i]];
+}
@@ -0,0 +1,15 @@
+#ifndef _ColorQuantizer_h_
+#define _ColorQuantizer_h_
+
+#include "C_Base.h"
+#include "C_Vector.h"
+
+// palette generation for n64 ci textures, colors are rgba5551
+namespace ColorQuantizer
+{
+    // picks up to aMaxColors colors and maps every pixel to one of them. the result is exact when the
+    // image has no more distinct colors than that, otherwise median cut refined with k-means
+    void Quantize5551(const uint16* aPixels, int aCount, int aMaxColors, C_Vector<uint16>& aOutPalette, C_Vector<uint8>& aOutIndices);
+}
+
+#endif // _ColorQuantizer_h_
@@ -9,6 +9,8 @@
 
 #include "mips_def.h"
 #include "DefsFile.h"
+#include "DepFile.h"
+#include "BigEndian.h"
 #include "elfio/elfio.hpp"
 #include "elfio/elfio_dump.hpp"
 #include "elfio/elfio_symbols.hpp"
@@ -597,10 +599,9 @@ namespace DLLCompiler_private
             if (const ELFIO::section* sec = elf.sections[".got"])
             {
                 mMem.CreateSection(RELSEC_GOT, sec);
-                C_MemoryStream strm((void*)sec->get_data(), sec->get_size());
-                strm.SetEndianSwap(true);
-                for (int i = 0; i < sec->get_size() / 4; ++i)
-                    mGOT.Add(strm.ReadUInt32());
+                const int numGOT = int(sec->get_size() / 4);
+                mGOT.Resize(numGOT);
+                BigEndian::LoadArray(sec->get_data(), mGOT.GetBuffer(), numGOT);
             }
 
             MemoryHelper::Section rodataSec;
@@ -646,7 +647,7 @@ namespace DLLCompiler_private
             return true;
         }
 
-        void Write(C_Stream& handle, DefsFile& defs)
+        void Write(C_Stream& handle, const DefsFile& defs)
         {
             BinInfo info;
             info.mFuncs.Resize(NumFuncs());
@@ -807,7 +808,7 @@ namespace DLLCompiler_private
             }
         }
 
-        void ResolveGOT(BinInfo& info, DefsFile& defs)
+        void ResolveGOT(BinInfo& info, const DefsFile& defs)
         {
             if (mGOT.Count() == 0)
                 return;
@@ -1014,7 +1015,7 @@ namespace DLLCompiler_private
     };
 }
 
-bool DLLCompiler::ConvertELFtoDLL(const char* aELFPath, const char* aDLLPath, const char* aDefsPath)
+bool DLLCompiler::ConvertELFtoDLL(const char* aELFPath, const char* aDLLPath, const char* aDefsPath, DepFile* aDeps /*= NULL*/)
 {
     using namespace DLLCompiler_private;
 
@@ -1029,8 +1030,9 @@ bool DLLCompiler::ConvertELFtoDLL(const char* aELFPath, const char* aDLLPath, co
     if (!dll.LoadFromElf(elf))
         return false;
 
-    DefsFile defs;
-    if (!defs.Read(aDefsPath))
+    // shared with the other jobs of a batch
+    std::shared_ptr<const DefsFile> defs = DefsFile::ReadShared(aDefsPath);
+    if (!defs)
         return false;
 
     C_FilePath ofname;
@@ -1048,7 +1050,13 @@ bool DLLCompiler::ConvertELFtoDLL(const char* aELFPath, const char* aDLLPath, co
     C_Stream ostrm(ohandle);
     ostrm.SetEndianSwap(true);
 
-    dll.Write(ostrm, defs);
+    dll.Write(ostrm, *defs);
+
+    if (aDeps)
+    {
+        aDeps->Add(aELFPath);
+        aDeps->Add(aDefsPath);
+    }
 
     return true;
 }
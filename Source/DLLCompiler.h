@@ -1,9 +1,12 @@
 #ifndef _DLLCompiler_h_
 #define _DLLCompiler_h_
 
+class DepFile;
+
 namespace DLLCompiler
 {
-    bool ConvertELFtoDLL(const char* aELFPath, const char* aDLLPath, const char* aDefsPath);
+    // the .elf and the defs file are added to aDeps
+    bool ConvertELFtoDLL(const char* aELFPath, const char* aDLLPath, const char* aDefsPath, DepFile* aDeps = NULL);
 }
 
 #endif // _DLLCompiler_h_
@@ -0,0 +1,1098 @@
+#include "Deflate.h"
+#include "BigEndian.h"
+#include <string.h>
+
+namespace Deflate_private
+{
+    static const uint16 sLengthBase[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+    static const uint8 sLengthExtra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+    static const uint16 sDistBase[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+    static const uint8 sDistExtra[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+    static const uint8 sCodeLengthOrder[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+    const int MAX_BITS = 15;
+    const int MAX_SYMBOLS = 288;
+    // codes up to this length are decoded with one table lookup
+    const int FAST_BITS = 9;
+
+    // lsb-first bit reader keeping at least 56 bits buffered after a refill
+    class BitReader
+    {
+    public:
+        BitReader(const uint8* aData, uint32 aSize)
+            : mData(aData)
+            , mSize(aSize)
+        {}
+
+        void Refill()
+        {
+            if (!BigEndian::IS_HOST_ORDER && mPos + 8 <= mSize)
+            {
+                uint64 v;
+                memcpy(&v, mData + mPos, 8);
+                mBits |= v << mCount;
+                mPos += (63 - mCount) >> 3;
+                mCount |= 56;
+                return;
+            }
+
+            // reads past the end give zeros, GetConsumed() tells if they were used
+            while (mCount <= 56)
+            {
+                if (mPos < mSize)
+                    mBits |= uint64(mData[mPos]) << mCount;
+
+                ++mPos;
+                mCount += 8;
+            }
+        }
+
+        uint32 Peek(int aNum) const { return uint32(mBits & ((uint64(1) << aNum) - 1)); }
+        void Drop(int aNum) { mBits >>= aNum; mCount -= aNum; }
+
+        uint32 Get(int aNum)
+        {
+            const uint32 v = Peek(aNum);
+            Drop(aNum);
+            return v;
+        }
+
+        // discards the buffered bits and returns the byte position of the next whole byte
+        uint32 AlignToByte()
+        {
+            const uint32 pos = GetConsumed();
+            mPos = pos;
+            mBits = 0;
+            mCount = 0;
+            return pos;
+        }
+
+        void SetPosition(uint32 aPos) { mPos = aPos; }
+        uint32 GetConsumed() const { return mPos - uint32(mCount >> 3); }
+
+    private:
+        const uint8* mData;
+        uint32 mSize;
+        uint32 mPos = 0;
+        uint64 mBits = 0;
+        int mCount = 0;
+    };
+
+    struct Huffman
+    {
+        // (symbol << 4) | length for codes of up to FAST_BITS, 0 for longer codes
+        uint16 mFast[1 << FAST_BITS];
+        uint16 mCount[MAX_BITS + 1];
+        uint16 mSymbols[MAX_SYMBOLS];
+
+        bool Build(const uint8* aLengths, int aNum)
+        {
+            WAR_ZeroMem(mCount, sizeof(mCount));
+
+            for (int i = 0; i < aNum; ++i)
+                ++mCount[aLengths[i]];
+
+            mCount[0] = 0;
+
+            // over-subscribed sets are invalid, incomplete ones are allowed (single distance code)
+            int left = 1;
+            for (int len = 1; len <= MAX_BITS; ++len)
+            {
+                left = (left << 1) - mCount[len];
+
+                if (left < 0)
+                    return false;
+            }
+
+            uint16 offsets[MAX_BITS + 2];
+            offsets[1] = 0;
+
+            for (int len = 1; len <= MAX_BITS; ++len)
+                offsets[len + 1] = offsets[len] + mCount[len];
+
+            for (int i = 0; i < aNum; ++i)
+            {
+                if (aLengths[i] != 0)
+                    mSymbols[offsets[aLengths[i]]++] = uint16(i);
+            }
+
+            WAR_ZeroMem(mFast, sizeof(mFast));
+
+            uint32 code = 0;
+            int index = 0;
+
+            for (int len = 1; len <= FAST_BITS; ++len)
+            {
+                for (int i = 0; i < mCount[len]; ++i, ++index, ++code)
+                {
+                    // codes are stored msb-first, the table is indexed by the lsb-first bits
+                    uint32 rev = 0;
+                    for (int b = 0; b < len; ++b)
+                        rev |= ((code >> b) & 1) << (len - 1 - b);
+
+                    const uint16 entry = uint16((mSymbols[index] << 4) | len);
+
+                    for (uint32 j = rev; j < (1u << FAST_BITS); j += 1u << len)
+                        mFast[j] = entry;
+                }
+
+                code <<= 1;
+            }
+
+            return true;
+        }
+
+        // needs MAX_BITS buffered bits, returns -1 for an unassigned code
+        int Decode(BitReader& aReader) const
+        {
+            const uint16 entry = mFast[aReader.Peek(FAST_BITS)];
+
+            if (entry != 0)
+            {
+                aReader.Drop(entry & 15);
+                return entry >> 4;
+            }
+
+            // canonical decode one bit at a time for the long codes
+            const uint32 bits = aReader.Peek(MAX_BITS);
+            int code = 0;
+            int first = 0;
+            int index = 0;
+
+            for (int len = 1; len <= MAX_BITS; ++len)
+            {
+                code |= (bits >> (len - 1)) & 1;
+                const int count = mCount[len];
+
+                if (code - first < count)
+                {
+                    aReader.Drop(len);
+                    return mSymbols[index + (code - first)];
+                }
+
+                index += count;
+                first = (first + count) << 1;
+                code <<= 1;
+            }
+
+            return -1;
+        }
+    };
+
+    struct FixedTables
+    {
+        FixedTables()
+        {
+            uint8 lengths[MAX_SYMBOLS];
+
+            for (int i = 0; i < 144; ++i) lengths[i] = 8;
+            for (int i = 144; i < 256; ++i) lengths[i] = 9;
+            for (int i = 256; i < 280; ++i) lengths[i] = 7;
+            for (int i = 280; i < 288; ++i) lengths[i] = 8;
+            mLitLen.Build(lengths, 288);
+
+            for (int i = 0; i < 30; ++i) lengths[i] = 5;
+            mDist.Build(lengths, 30);
+        }
+
+        Huffman mLitLen;
+        Huffman mDist;
+    };
+
+    bool ReadDynamicTables(BitReader& aReader, Huffman& aLitLen, Huffman& aDist)
+    {
+        aReader.Refill();
+        const int numLitLen = aReader.Get(5) + 257;
+        const int numDist = aReader.Get(5) + 1;
+        const int numCodeLen = aReader.Get(4) + 4;
+
+        if (numLitLen > 286 || numDist > 30)
+            return false;
+
+        uint8 codeLengths[19] = { 0 };
+
+        for (int i = 0; i < numCodeLen; ++i)
+        {
+            aReader.Refill();
+            codeLengths[sCodeLengthOrder[i]] = uint8(aReader.Get(3));
+        }
+
+        Huffman codeLenTable;
+        if (!codeLenTable.Build(codeLengths, 19))
+            return false;
+
+        uint8 lengths[286 + 30];
+        const int total = numLitLen + numDist;
+        int n = 0;
+
+        while (n < total)
+        {
+            aReader.Refill();
+            const int sym = codeLenTable.Decode(aReader);
+
+            if (sym < 0)
+                return false;
+
+            if (sym < 16)
+            {
+                lengths[n++] = uint8(sym);
+                continue;
+            }
+
+            uint8 value = 0;
+            int repeat;
+
+            if (sym == 16)
+            {
+                if (n == 0)
+                    return false;
+
+                value = lengths[n - 1];
+                repeat = 3 + aReader.Get(2);
+            }
+            else if (sym == 17)
+            {
+                repeat = 3 + aReader.Get(3);
+            }
+            else
+            {
+                repeat = 11 + aReader.Get(7);
+            }
+
+            if (n + repeat > total)
+                return false;
+
+            memset(lengths + n, value, repeat);
+            n += repeat;
+        }
+
+        // a block needs its end code
+        if (lengths[256] == 0)
+            return false;
+
+        return aLitLen.Build(lengths, numLitLen) && aDist.Build(lengths + numLitLen, numDist);
+    }
+
+    bool InflateBlock(BitReader& aReader, const Huffman& aLitLen, const Huffman& aDist, uint8* aOutStart, uint8*& aOut, uint8* aOutEnd)
+    {
+        uint8* out = aOut;
+
+        for (;;)
+        {
+            // 56 bits cover the longest length/distance pair (15 + 5 + 15 + 13)
+            aReader.Refill();
+            int sym = aLitLen.Decode(aReader);
+
+            if (sym < 256)
+            {
+                if (sym < 0 || out == aOutEnd)
+                    return false;
+
+                *out++ = uint8(sym);
+                continue;
+            }
+
+            if (sym == 256)
+                break;
+
+            sym -= 257;
+            if (sym >= 29)
+                return false;
+
+            const uint32 len = sLengthBase[sym] + aReader.Get(sLengthExtra[sym]);
+
+            const int distSym = aDist.Decode(aReader);
+            if (distSym < 0 || distSym >= 30)
+                return false;
+
+            const uint32 dist = sDistBase[distSym] + aReader.Get(sDistExtra[distSym]);
+
+            if (dist > uint32(out - aOutStart) || len > uint32(aOutEnd - out))
+                return false;
+
+            const uint8* src = out - dist;
+
+            if (dist >= 8 && uint32(aOutEnd - out) >= len + 8)
+            {
+                // whole words, may write up to 7 bytes past the match which get overwritten later
+                uint8* end = out + len;
+
+                do
+                {
+                    memcpy(out, src, 8);
+                    out += 8;
+                    src += 8;
+                } while (out < end);
+
+                out = end;
+            }
+            else
+            {
+                for (uint32 i = 0; i < len; ++i)
+                    out[i] = src[i];
+
+                out += len;
+            }
+        }
+
+        aOut = out;
+        return true;
+    }
+}
+
+bool Deflate::Inflate(const uint8* aIn, uint32 aInSize, uint8* aOut, uint32 aOutSize, uint32* aOutConsumed)
+{
+    using namespace Deflate_private;
+
+    static const FixedTables sFixed;
+
+    BitReader reader(aIn, aInSize);
+    uint8* out = aOut;
+    uint8* outEnd = aOut + aOutSize;
+    bool final = false;
+
+    while (!final)
+    {
+        reader.Refill();
+        final = reader.Get(1) != 0;
+        const uint32 type = reader.Get(2);
+
+        if (type == 0)
+        {
+            const uint32 pos = reader.AlignToByte();
+
+            if (pos + 4 > aInSize)
+                return false;
+
+            const uint32 len = aIn[pos] | (aIn[pos + 1] << 8);
+            const uint32 nlen = aIn[pos + 2] | (aIn[pos + 3] << 8);
+
+            if ((len ^ 0xFFFF) != nlen || pos + 4 + len > aInSize || len > uint32(outEnd - out))
+                return false;
+
+            memcpy(out, aIn + pos + 4, len);
+            out += len;
+            reader.SetPosition(pos + 4 + len);
+        }
+        else if (type == 1)
+        {
+            if (!InflateBlock(reader, sFixed.mLitLen, sFixed.mDist, aOut, out, outEnd))
+                return false;
+        }
+        else if (type == 2)
+        {
+            Huffman litLen;
+            Huffman dist;
+
+            if (!ReadDynamicTables(reader, litLen, dist) || !InflateBlock(reader, litLen, dist, aOut, out, outEnd))
+                return false;
+        }
+        else
+        {
+            return false;
+        }
+
+        if (reader.GetConsumed() > aInSize)
+            return false;
+    }
+
+    if (out != outEnd)
+        return false;
+
+    if (aOutConsumed)
+        *aOutConsumed = reader.GetConsumed();
+
+    return true;
+}
+
+namespace Deflate_private
+{
+    const uint32 WINDOW_SIZE = 32768;
+    const uint32 WINDOW_MASK = WINDOW_SIZE - 1;
+    const int HASH_BITS = 15;
+    const uint32 HASH_SIZE = 1 << HASH_BITS;
+    const uint32 MIN_MATCH = 3;
+    const uint32 MAX_MATCH = 258;
+    // length 3 matches further back than this cost more than the literals
+    const uint32 TOO_FAR = 4096;
+    const int SYMBOLS_PER_BLOCK = 16384;
+    const uint32 MAX_STORED = 65535;
+
+    // zlib's tuning per level
+    struct LevelConfig
+    {
+        uint32 mGoodLength;  // reduce the search above this length
+        uint32 mLazyLength;  // no lazy search above this length, max insert length for greedy levels
+        uint32 mNiceLength;  // stop the search above this length
+        int mMaxChain;
+        bool mLazy;
+    };
+
+    static const LevelConfig sLevels[Deflate::MAX_LEVEL + 1] =
+    {
+        { 0, 0, 0, 0, false },
+        { 4, 4, 8, 4, false },
+        { 4, 5, 16, 8, false },
+        { 4, 6, 32, 32, false },
+        { 4, 4, 16, 16, true },
+        { 8, 16, 32, 32, true },
+        { 8, 16, 128, 128, true },
+        { 8, 32, 128, 256, true },
+        { 32, 128, 258, 1024, true },
+        { 32, 258, 258, 4096, true },
+    };
+
+    // literal when mDist is 0, otherwise a match of length mLitLen
+    struct Symbol
+    {
+        uint16 mLitLen;
+        uint16 mDist;
+    };
+
+    struct CodeTables
+    {
+        CodeTables()
+        {
+            for (int code = 0; code < 29; ++code)
+            {
+                for (int i = 0; i < (1 << sLengthExtra[code]); ++i)
+                    mLengthCode[sLengthBase[code] + i] = uint8(code);
+            }
+
+            // 258 has its own code, 227 + 31 would also reach it
+            mLengthCode[258] = 28;
+
+            for (int code = 0; code < 30; ++code)
+            {
+                for (int i = 0; i < (1 << sDistExtra[code]); ++i)
+                    mDistCode[sDistBase[code] - 1 + i] = uint8(code);
+            }
+
+            for (int i = 0; i < 288; ++i)
+                mFixedLitLen[i] = i < 144 ? 8 : i < 256 ? 9 : i < 280 ? 7 : 8;
+
+            for (int i = 0; i < 30; ++i)
+                mFixedDist[i] = 5;
+        }
+
+        uint8 mLengthCode[MAX_MATCH + 1];
+        uint8 mDistCode[WINDOW_SIZE];
+        uint8 mFixedLitLen[288];
+        uint8 mFixedDist[30];
+    };
+
+    static const CodeTables sCodes;
+
+    class BitWriter
+    {
+    public:
+        BitWriter(C_Vector<uint8>& aOut)
+            : mOut(aOut)
+        {}
+
+        void Put(uint32 aBits, int aNum)
+        {
+            mBits |= uint64(aBits) << mCount;
+            mCount += aNum;
+
+            while (mCount >= 8)
+            {
+                mOut.Add(uint8(mBits));
+                mBits >>= 8;
+                mCount -= 8;
+            }
+        }
+
+        void AlignToByte()
+        {
+            if (mCount > 0)
+                Put(0, 8 - mCount);
+        }
+
+    private:
+        C_Vector<uint8>& mOut;
+        uint64 mBits = 0;
+        int mCount = 0;
+    };
+
+    // code lengths limited to aMaxBits, at least two codes are always assigned so every tree is complete
+    void BuildLengths(const uint32* aFreqs, int aNum, int aMaxBits, uint8* aOutLengths)
+    {
+        struct Node
+        {
+            uint32 mFreq;
+            int mParent;
+        };
+
+        C_Vector<Node> nodes;
+        C_Vector<int> leaves;
+        nodes.Reserve(aNum * 2);
+
+        for (int i = 0; i < aNum; ++i)
+        {
+            aOutLengths[i] = 0;
+
+            if (aFreqs[i] > 0)
+            {
+                leaves.Add(i);
+                nodes.Add({ aFreqs[i], -1 });
+            }
+        }
+
+        for (int i = 0; leaves.Count() < 2; ++i)
+        {
+            if (aFreqs[i] == 0)
+            {
+                leaves.Add(i);
+                nodes.Add({ 1, -1 });
+            }
+        }
+
+        // leaves sorted by frequency, merged nodes come out in increasing order so two queues do
+        C_Vector<int> order;
+        for (int i = 0; i < leaves.Count(); ++i)
+            order.Add(i);
+
+        order.Sort([&](int a, int b) { return nodes[a].mFreq < nodes[b].mFreq || (nodes[a].mFreq == nodes[b].mFreq && a < b); });
+
+        int leafPos = 0;
+        int mergedPos = leaves.Count();
+
+        auto takeSmallest = [&]() -> int
+        {
+            if (leafPos < order.Count() && (mergedPos >= nodes.Count() || nodes[order[leafPos]].mFreq <= nodes[mergedPos].mFreq))
+                return order[leafPos++];
+
+            return mergedPos++;
+        };
+
+        for (int i = 0; i < leaves.Count() - 1; ++i)
+        {
+            const int a = takeSmallest();
+            const int b = takeSmallest();
+            const int parent = nodes.Count();
+            nodes.Add({ nodes[a].mFreq + nodes[b].mFreq, -1 });
+            nodes[a].mParent = parent;
+            nodes[b].mParent = parent;
+        }
+
+        // depth of every leaf, clamped and then fixed up so the kraft sum stays at one
+        int countPerLength[33] = { 0 };
+        C_Vector<int> depths;
+        depths.Resize(nodes.Count(), 0);
+
+        for (int i = nodes.Count() - 2; i >= 0; --i)
+            depths[i] = depths[nodes[i].mParent] + 1;
+
+        for (int i = 0; i < leaves.Count(); ++i)
+            ++countPerLength[C_Min(depths[i], aMaxBits)];
+
+        uint32 total = 0;
+        for (int len = 1; len <= aMaxBits; ++len)
+            total += uint32(countPerLength[len]) << (aMaxBits - len);
+
+        while (total != (1u << aMaxBits))
+        {
+            --countPerLength[aMaxBits];
+
+            for (int len = aMaxBits - 1; len > 0; --len)
+            {
+                if (countPerLength[len] > 0)
+                {
+                    --countPerLength[len];
+                    countPerLength[len + 1] += 2;
+                    break;
+                }
+            }
+
+            --total;
+        }
+
+        // shortest codes go to the most frequent symbols
+        int len = 1;
+        for (int i = order.Count() - 1; i >= 0; --i)
+        {
+            while (countPerLength[len] == 0)
+                ++len;
+
+            aOutLengths[leaves[order[i]]] = uint8(len);
+            --countPerLength[len];
+        }
+    }
+
+    // canonical codes, bit reversed for the lsb-first writer
+    void BuildCodes(const uint8* aLengths, int aNum, uint16* aOutCodes)
+    {
+        uint16 count[MAX_BITS + 1] = { 0 };
+        uint16 next[MAX_BITS + 2];
+
+        for (int i = 0; i < aNum; ++i)
+            ++count[aLengths[i]];
+
+        count[0] = 0;
+        uint32 code = 0;
+
+        for (int len = 1; len <= MAX_BITS; ++len)
+        {
+            code = (code + count[len - 1]) << 1;
+            next[len] = uint16(code);
+        }
+
+        for (int i = 0; i < aNum; ++i)
+        {
+            const int len = aLengths[i];
+
+            if (len == 0)
+                continue;
+
+            const uint32 c = next[len]++;
+            uint32 rev = 0;
+
+            for (int b = 0; b < len; ++b)
+                rev |= ((c >> b) & 1) << (len - 1 - b);
+
+            aOutCodes[i] = uint16(rev);
+        }
+    }
+
+    class Encoder
+    {
+    public:
+        Encoder(const uint8* aIn, uint32 aSize, const LevelConfig& aConfig, bool aFinal, C_Vector<uint8>& aOut)
+            : mIn(aIn)
+            , mSize(aSize)
+            , mConfig(aConfig)
+            , mFinal(aFinal)
+            , mWriter(aOut)
+        {
+            mHead.Resize(HASH_SIZE, -1);
+            mPrev.Resize(WINDOW_SIZE, -1);
+            mSymbols.Reserve(SYMBOLS_PER_BLOCK);
+        }
+
+        void Run()
+        {
+            if (mConfig.mMaxChain == 0)
+            {
+                WriteStored(0, mSize, mFinal);
+            }
+            else
+            {
+                if (mConfig.mLazy)
+                    RunLazy();
+                else
+                    RunGreedy();
+
+                FlushBlock(mSize, mFinal);
+
+                // an open stream ends on a byte boundary for the next call
+                if (!mFinal)
+                    WriteStored(mSize, 0, false);
+            }
+
+            mWriter.AlignToByte();
+        }
+
+    private:
+        uint32 Hash(uint32 aPos) const
+        {
+            const uint8* p = mIn + aPos;
+            return ((uint32(p[0]) << 10) ^ (uint32(p[1]) << 5) ^ p[2]) & (HASH_SIZE - 1);
+        }
+
+        void Insert(uint32 aPos)
+        {
+            if (aPos + MIN_MATCH > mSize)
+                return;
+
+            const uint32 h = Hash(aPos);
+            mPrev[aPos & WINDOW_MASK] = mHead[h];
+            mHead[h] = int32(aPos);
+        }
+
+        // best match for aPos among the positions already inserted
+        uint32 FindMatch(uint32 aPos, uint32 aPrevLength, uint32& aOutDist) const
+        {
+            const uint32 maxLen = C_Min(MAX_MATCH, mSize - aPos);
+
+            if (maxLen < MIN_MATCH)
+                return 0;
+
+            if (aPrevLength >= maxLen)
+                return 0;
+
+            int chain = mConfig.mMaxChain;
+            if (aPrevLength >= mConfig.mGoodLength)
+                chain >>= 2;
+
+            const uint32 niceLen = C_Min(mConfig.mNiceLength, maxLen);
+            const uint8* cur = mIn + aPos;
+            uint32 bestLen = C_Max(aPrevLength, MIN_MATCH - 1);
+            int32 candidate = mHead[Hash(aPos)];
+
+            while (candidate >= 0 && aPos - uint32(candidate) <= WINDOW_SIZE && chain-- > 0)
+            {
+                const uint8* match = mIn + candidate;
+
+                // the byte past the best length has to match to improve on it
+                if (match[bestLen] == cur[bestLen] && match[0] == cur[0] && match[1] == cur[1])
+                {
+                    uint32 len = 2;
+
+                    while (len + 8 <= maxLen)
+                    {
+                        uint64 a;
+                        uint64 b;
+                        memcpy(&a, match + len, 8);
+                        memcpy(&b, cur + len, 8);
+
+                        if (a != b)
+                            break;
+
+                        len += 8;
+                    }
+
+                    while (len < maxLen && match[len] == cur[len])
+                        ++len;
+
+                    if (len > bestLen)
+                    {
+                        bestLen = len;
+                        aOutDist = aPos - uint32(candidate);
+
+                        if (len >= niceLen)
+                            break;
+                    }
+                }
+
+                const int32 next = mPrev[candidate & WINDOW_MASK];
+
+                // slots get reused once the window wraps
+                if (next >= candidate)
+                    break;
+
+                candidate = next;
+            }
+
+            if (bestLen <= aPrevLength || bestLen < MIN_MATCH || (bestLen == MIN_MATCH && aOutDist > TOO_FAR))
+                return 0;
+
+            return bestLen;
+        }
+
+        void EmitLiteral(uint32 aPos)
+        {
+            mSymbols.Add({ mIn[aPos], 0 });
+
+            if (mSymbols.Count() >= SYMBOLS_PER_BLOCK)
+                FlushBlock(aPos + 1, false);
+        }
+
+        void EmitMatch(uint32 aPos, uint32 aLength, uint32 aDist)
+        {
+            mSymbols.Add({ uint16(aLength), uint16(aDist) });
+
+            if (mSymbols.Count() >= SYMBOLS_PER_BLOCK)
+                FlushBlock(aPos + aLength, false);
+        }
+
+        void RunGreedy()
+        {
+            uint32 pos = 0;
+
+            while (pos < mSize)
+            {
+                uint32 dist = 0;
+                const uint32 len = FindMatch(pos, 0, dist);
+                Insert(pos);
+
+                if (len == 0)
+                {
+                    EmitLiteral(pos);
+                    ++pos;
+                    continue;
+                }
+
+                EmitMatch(pos, len, dist);
+
+                // long matches are skipped without hashing, like zlib's max insert length
+                if (len <= mConfig.mLazyLength)
+                {
+                    for (uint32 i = 1; i < len; ++i)
+                        Insert(pos + i);
+                }
+
+                pos += len;
+            }
+        }
+
+        void RunLazy()
+        {
+            uint32 prevLen = 0;
+            uint32 prevDist = 0;
+            bool havePrev = false;
+            uint32 pos = 0;
+
+            while (pos < mSize)
+            {
+                uint32 dist = 0;
+                uint32 len = 0;
+
+                if (prevLen < mConfig.mLazyLength)
+                    len = FindMatch(pos, prevLen, dist);
+
+                Insert(pos);
+
+                // the match from the previous position wins unless this one is longer
+                if (havePrev && prevLen >= MIN_MATCH && len == 0)
+                {
+                    EmitMatch(pos - 1, prevLen, prevDist);
+
+                    for (uint32 i = 1; i < prevLen - 1; ++i)
+                        Insert(pos + i);
+
+                    pos += prevLen - 1;
+                    havePrev = false;
+                    prevLen = 0;
+                    continue;
+                }
+
+                if (havePrev)
+                    EmitLiteral(pos - 1);
+
+                prevLen = len;
+                prevDist = dist;
+                havePrev = true;
+                ++pos;
+            }
+
+            if (havePrev)
+                EmitLiteral(pos - 1);
+        }
+
+        void FlushBlock(uint32 aEnd, bool aFinal)
+        {
+            WriteBlock(mBlockStart, aEnd - mBlockStart, aFinal);
+            mSymbols.Clear();
+            mBlockStart = aEnd;
+        }
+
+        void WriteBlock(uint32 aStart, uint32 aSize, bool aFinal)
+        {
+            uint32 litFreqs[286] = { 0 };
+            uint32 distFreqs[30] = { 0 };
+            uint32 extraBits = 0;
+
+            for (const Symbol& s : mSymbols)
+            {
+                if (s.mDist == 0)
+                {
+                    ++litFreqs[s.mLitLen];
+                    continue;
+                }
+
+                const int lc = sCodes.mLengthCode[s.mLitLen];
+                const int dc = sCodes.mDistCode[s.mDist - 1];
+                ++litFreqs[257 + lc];
+                ++distFreqs[dc];
+                extraBits += sLengthExtra[lc] + sDistExtra[dc];
+            }
+
+            litFreqs[256] = 1;
+
+            uint8 litLengths[286];
+            uint8 distLengths[30];
+            BuildLengths(litFreqs, 286, MAX_BITS, litLengths);
+            BuildLengths(distFreqs, 30, MAX_BITS, distLengths);
+
+            int numLit = 286;
+            while (numLit > 257 && litLengths[numLit - 1] == 0)
+                --numLit;
+
+            int numDist = 30;
+            while (numDist > 1 && distLengths[numDist - 1] == 0)
+                --numDist;
+
+            // run length coded lengths of both trees
+            uint8 allLengths[286 + 30];
+            memcpy(allLengths, litLengths, numLit);
+            memcpy(allLengths + numLit, distLengths, numDist);
+
+            C_Vector<uint16> runs;  // (extra << 5) | symbol
+            const int total = numLit + numDist;
+
+            for (int i = 0; i < total;)
+            {
+                const uint8 len = allLengths[i];
+                int run = 1;
+
+                while (i + run < total && allLengths[i + run] == len)
+                    ++run;
+
+                if (len == 0 && run >= 3)
+                {
+                    run = C_Min(run, 138);
+                    runs.Add(run >= 11 ? uint16(((run - 11) << 5) | 18) : uint16(((run - 3) << 5) | 17));
+                }
+                else if (len != 0 && run >= 4)
+                {
+                    runs.Add(len);
+                    run = 1 + C_Min(run - 1, 6);
+                    runs.Add(uint16(((run - 4) << 5) | 16));
+                }
+                else
+                {
+                    run = 1;
+                    runs.Add(len);
+                }
+
+                i += run;
+            }
+
+            uint32 codeLenFreqs[19] = { 0 };
+            for (uint16 r : runs)
+                ++codeLenFreqs[r & 31];
+
+            uint8 codeLenLengths[19];
+            BuildLengths(codeLenFreqs, 19, 7, codeLenLengths);
+
+            int numCodeLen = 19;
+            while (numCodeLen > 4 && codeLenLengths[sCodeLengthOrder[numCodeLen - 1]] == 0)
+                --numCodeLen;
+
+            // pick the cheapest block type
+            uint32 dynamicBits = 3 + 14 + numCodeLen * 3 + extraBits;
+            uint32 fixedBits = 3 + extraBits;
+
+            for (int i = 0; i < 286; ++i)
+            {
+                dynamicBits += litFreqs[i] * litLengths[i];
+                fixedBits += litFreqs[i] * sCodes.mFixedLitLen[i];
+            }
+
+            for (int i = 0; i < 30; ++i)
+            {
+                dynamicBits += distFreqs[i] * distLengths[i];
+                fixedBits += distFreqs[i] * sCodes.mFixedDist[i];
+            }
+
+            for (uint16 r : runs)
+            {
+                const int sym = r & 31;
+                dynamicBits += codeLenLengths[sym] + (sym == 16 ? 2 : sym == 17 ? 3 : sym == 18 ? 7 : 0);
+            }
+
+            const uint32 numStored = C_Max(1u, (aSize + MAX_STORED - 1) / MAX_STORED);
+            const uint32 storedBits = (aSize + numStored * 5) * 8 + 7;
+
+            if (storedBits <= C_Min(dynamicBits, fixedBits))
+            {
+                WriteStored(aStart, aSize, aFinal);
+            }
+            else if (fixedBits <= dynamicBits)
+            {
+                mWriter.Put(aFinal ? 1 : 0, 1);
+                mWriter.Put(1, 2);
+                WriteSymbols(sCodes.mFixedLitLen, 288, sCodes.mFixedDist);
+            }
+            else
+            {
+                mWriter.Put(aFinal ? 1 : 0, 1);
+                mWriter.Put(2, 2);
+                mWriter.Put(numLit - 257, 5);
+                mWriter.Put(numDist - 1, 5);
+                mWriter.Put(numCodeLen - 4, 4);
+
+                for (int i = 0; i < numCodeLen; ++i)
+                    mWriter.Put(codeLenLengths[sCodeLengthOrder[i]], 3);
+
+                uint16 codeLenCodes[19];
+                BuildCodes(codeLenLengths, 19, codeLenCodes);
+
+                for (uint16 r : runs)
+                {
+                    const int sym = r & 31;
+                    mWriter.Put(codeLenCodes[sym], codeLenLengths[sym]);
+
+                    if (sym == 16)
+                        mWriter.Put(r >> 5, 2);
+                    else if (sym == 17)
+                        mWriter.Put(r >> 5, 3);
+                    else if (sym == 18)
+                        mWriter.Put(r >> 5, 7);
+                }
+
+                WriteSymbols(litLengths, 286, distLengths);
+            }
+        }
+
+        // aNumLit is the size of the whole code, the fixed one has 288 lengths and its codes depend on all of them
+        void WriteSymbols(const uint8* aLitLengths, int aNumLit, const uint8* aDistLengths)
+        {
+            uint16 litCodes[288];
+            uint16 distCodes[30];
+            BuildCodes(aLitLengths, aNumLit, litCodes);
+            BuildCodes(aDistLengths, 30, distCodes);
+
+            for (const Symbol& s : mSymbols)
+            {
+                if (s.mDist == 0)
+                {
+                    mWriter.Put(litCodes[s.mLitLen], aLitLengths[s.mLitLen]);
+                    continue;
+                }
+
+                const int lc = sCodes.mLengthCode[s.mLitLen];
+                const int dc = sCodes.mDistCode[s.mDist - 1];
+
+                mWriter.Put(litCodes[257 + lc], aLitLengths[257 + lc]);
+                mWriter.Put(s.mLitLen - sLengthBase[lc], sLengthExtra[lc]);
+                mWriter.Put(distCodes[dc], aDistLengths[dc]);
+                mWriter.Put(s.mDist - sDistBase[dc], sDistExtra[dc]);
+            }
+
+            mWriter.Put(litCodes[256], aLitLengths[256]);
+        }
+
+        void WriteStored(uint32 aStart, uint32 aSize, bool aFinal)
+        {
+            do
+            {
+                const uint32 n = C_Min(aSize, MAX_STORED);
+                const bool last = aFinal && n == aSize;
+
+                mWriter.Put(last ? 1 : 0, 1);
+                mWriter.Put(0, 2);
+                mWriter.AlignToByte();
+                mWriter.Put(n, 16);
+                mWriter.Put(n ^ 0xFFFF, 16);
+
+                for (uint32 i = 0; i < n; ++i)
+                    mWriter.Put(mIn[aStart + i], 8);
+
+                aStart += n;
+                aSize -= n;
+            } while (aSize > 0);
+        }
+
+        const uint8* mIn;
+        uint32 mSize;
+        const LevelConfig& mConfig;
+        const bool mFinal;
+        BitWriter mWriter;
+        C_Vector<int32> mHead;
+        C_Vector<int32> mPrev;
+        C_Vector<Symbol> mSymbols;
+        uint32 mBlockStart = 0;
+    };
+}
+
+void Deflate::Compress(const uint8* aIn, uint32 aSize, int aLevel, C_Vector<uint8>& aOut, bool aFinal /*= true*/)
+{
+    using namespace Deflate_private;
+
+    aLevel = C_Max(MIN_LEVEL, C_Min(aLevel, MAX_LEVEL));
+
+    Encoder encoder(aIn, aSize, sLevels[aLevel], aFinal, aOut);
+    encoder.Run();
+}
@@ -0,0 +1,24 @@
+#ifndef _Deflate_h_
+#define _Deflate_h_
+
+#include "C_Base.h"
+#include "C_Vector.h"
+
+// raw deflate streams (RFC 1951) without zlib or gzip framing
+namespace Deflate
+{
+    // inflates into exactly aOutSize bytes, fails on corrupt data or if the stream doesn't end there.
+    // aOutConsumed receives the number of input bytes the stream used
+    bool Inflate(const uint8* aIn, uint32 aInSize, uint8* aOut, uint32 aOutSize, uint32* aOutConsumed = NULL);
+
+    const int MIN_LEVEL = 0;
+    const int MAX_LEVEL = 9;
+    const int DEFAULT_LEVEL = 9;
+
+    // compresses aIn and appends the stream to aOut. levels follow zlib, 0 stores, 9 is the slowest and smallest.
+    // without aFinal the stream is left open, ending on an empty stored block like zlib's sync flush, and the next
+    // call continues it. matches don't reach back into the data of earlier calls
+    void Compress(const uint8* aIn, uint32 aSize, int aLevel, C_Vector<uint8>& aOut, bool aFinal = true);
+}
+
+#endif // _Deflate_h_
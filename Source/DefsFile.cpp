@@ -5,6 +5,70 @@
 #include "C_TextReader.h"
 #include "CL_Log.h"
 #include "C_Hash.h"
+#include "BigEndian.h"
+#include "C_OS.h"
+#include "C_FilePath.h"
+#include <algorithm>
+#include <mutex>
+#include <unordered_map>
+
+namespace DefsFile_private
+{
+    static std::mutex sSharedMutex;
+    static std::unordered_map<string, std::shared_ptr<const DefsFile>> sShared;
+
+    // one key per file however its path was written: absolute, / separated, without . and ..
+    string GetSharedKey(const char* aPath)
+    {
+        const bool isAbsolute = aPath[0] == '/' || aPath[0] == '\\' || (aPath[0] && aPath[1] == ':');
+        string path = aPath;
+
+        if (!isAbsolute)
+        {
+            C_FilePath fullPath(C_OS::GetInstance()->GetWorkingDirectory());
+            fullPath.Combine(aPath);
+            path = (const char*)fullPath;
+        }
+
+        std::replace(path.begin(), path.end(), '\\', '/');
+
+#if defined(_WIN32)
+        std::transform(path.begin(), path.end(), path.begin(), ::tolower);
+#endif
+
+        string key;
+        size_t start = 0;
+
+        while (start <= path.length())
+        {
+            size_t end = path.find('/', start);
+            if (end == string::npos)
+                end = path.length();
+
+            const string part = path.substr(start, end - start);
+
+            if (part == "..")
+            {
+                const size_t slash = key.rfind('/');
+                if (slash != string::npos)
+                    key.resize(slash);
+            }
+            else if (start == 0)
+            {
+                // the drive, or empty before the root's /
+                key = part;
+            }
+            else if (part.length() > 0 && part != ".")
+            {
+                key += "/" + part;
+            }
+
+            start = end + 1;
+        }
+
+        return key;
+    }
+}
 
 bool DefsFile::Read(const char* fpath)
 {
@@ -77,13 +141,19 @@ void DefsFile::ReadBinaryAddresses(C_Stream& handle)
 {
     mEntries.Clear();
 
-    while (handle.GetRemaining() >= 4)
-    {
-        uint32 offs;
-        handle >> offs;
-        Entry& e = mEntries.Add();
-        e.mAddr = offs;
-    }
+    C_Vector<uint32> addrs;
+    addrs.Resize(int(handle.GetRemaining() / 4));
+
+    if (addrs.Count() == 0)
+        return;
+
+    handle.ReadBytes(addrs.GetBuffer(), addrs.Count() * 4);
+    BigEndian::SwapArray(addrs.GetBuffer(), addrs.Count());
+
+    mEntries.Resize(addrs.Count());
+
+    for (int i = 0; i < addrs.Count(); ++i)
+        mEntries[i].mAddr = addrs[i];
 }
 
 void DefsFile::WriteBinaryAddresses(C_Stream& handle)
@@ -114,9 +184,43 @@ void DefsFile::Write(const char* fpath)
     }
 
     C_FileSystem::WriteFile(fpath, (void*)defs.data(), defs.size()); //fixme, writefile should take const data
+
+    // the next reader parses what was just written
+    std::lock_guard<std::mutex> lock(DefsFile_private::sSharedMutex);
+    DefsFile_private::sShared.erase(DefsFile_private::GetSharedKey(fpath));
+}
+
+void DefsFile::ClearShared()
+{
+    std::lock_guard<std::mutex> lock(DefsFile_private::sSharedMutex);
+    DefsFile_private::sShared.clear();
+}
+
+std::shared_ptr<const DefsFile> DefsFile::ReadShared(const char* fpath)
+{
+    using namespace DefsFile_private;
+
+    const string key = GetSharedKey(fpath);
+
+    {
+        std::lock_guard<std::mutex> lock(sSharedMutex);
+        auto it = sShared.find(key);
+
+        if (it != sShared.end())
+            return it->second;
+    }
+
+    // parsed outside the lock, two jobs asking at once both parse it and the first one is kept
+    std::shared_ptr<DefsFile> defs = std::make_shared<DefsFile>();
+
+    if (!defs->Read(fpath))
+        return NULL;
+
+    std::lock_guard<std::mutex> lock(sSharedMutex);
+    return sShared.emplace(key, defs).first->second;
 }
 
-int DefsFile::FindByName(const char* aSym)
+int DefsFile::FindByName(const char* aSym) const
 {
     uint32 hash = C_Hash(aSym);
 
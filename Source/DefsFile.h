@@ -2,6 +2,7 @@
 #define _DefsFile_h_
 
 #include "C_Vector.h"
+#include <memory>
 
 class C_Stream;
 
@@ -15,13 +16,18 @@ struct DefsFile
     };
 
     bool Read(const char* fpath);
+
+    // parsed once per path and shared between jobs until that file is written again, NULL if it can't be read
+    static std::shared_ptr<const DefsFile> ReadShared(const char* fpath);
+    static void ClearShared();
+
     Entry* FindEntry(uint32 aAddr);
     Entry& GetOrInsert(uint32 aAddr);
     void ReadBinaryAddresses(C_Stream& handle);
     void WriteBinaryAddresses(C_Stream& handle);
     void TryAnnotate(uint32 aAddr, const char* aDesc);
     void Write(const char* fpath);
-    int FindByName(const char* aSym);
+    int FindByName(const char* aSym) const;
 
     C_Vector<Entry> mEntries;
 };
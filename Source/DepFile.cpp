@@ -0,0 +1,78 @@
+#include "DepFile.h"
+#include "C_FileSystem.h"
+#include "CL_Log.h"
+#include <string.h>
+
+namespace DepFile_private
+{
+    // make's escapes, which ninja reads too
+    void AppendEscaped(string& aOut, const char* aPath)
+    {
+        for (const char* c = aPath; *c; ++c)
+        {
+            if (*c == ' ' || *c == '#')
+                aOut += '\\';
+            else if (*c == '$')
+                aOut += '$';
+
+            aOut += *c;
+        }
+    }
+}
+
+void DepFile::Add(const char* aPath)
+{
+    C_FilePath path(aPath);
+
+    while (!C_FileSystem::Exists(path) && !C_FileSystem::DirectoryExists(path))
+    {
+        C_FilePath dirPath;
+        C_PathUtils::GetDirectoryPath(path, dirPath);
+
+        // up to the root, nothing to depend on
+        if (dirPath.GetBuffer()[0] == 0 || strlen(dirPath) >= strlen(path))
+            return;
+
+        path = dirPath;
+    }
+
+    std::lock_guard<std::mutex> lock(mMutex);
+    mPaths.insert(string(path.GetBuffer()));
+}
+
+bool DepFile::Write(const char* aPath) const
+{
+    using namespace DepFile_private;
+
+    string text;
+
+    for (int i = 0; i < mTargets.Count(); ++i)
+    {
+        if (i > 0)
+            text += " ";
+
+        AppendEscaped(text, mTargets[i].c_str());
+    }
+
+    text += ":";
+
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+
+        for (const string& path : mPaths)
+        {
+            text += " \\\n  ";
+            AppendEscaped(text, path.c_str());
+        }
+    }
+
+    text += "\n";
+
+    if (!C_FileSystem::WriteFile(aPath, (void*)text.c_str(), uint32(text.length())))
+    {
+        WAR_LOG_ERROR(CAT_GENERAL, "Failed to write depfile %s", aPath);
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,28 @@
+#ifndef _DepFile_h_
+#define _DepFile_h_
+
+#include "C_Base.h"
+#include "C_Vector.h"
+#include <mutex>
+#include <set>
+
+// the files a build step read, written as a makefile rule ("out: in in ...") that make and ninja's depfile = read.
+// Add() can be called from any thread
+class DepFile
+{
+public:
+    // an output of the step, the left side of the rule
+    void AddTarget(const char* aPath) { mTargets.Add(aPath); }
+
+    // a file that isn't there is recorded as the closest dir that is, creating the file changes the dir's time
+    void Add(const char* aPath);
+
+    bool Write(const char* aPath) const;
+
+private:
+    C_Vector<string> mTargets;
+    mutable std::mutex mMutex;
+    std::set<string> mPaths;
+};
+
+#endif // _DepFile_h_
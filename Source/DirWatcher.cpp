@@ -0,0 +1,283 @@
+#include "DirWatcher.h"
+#include "CL_Log.h"
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#elif defined(__linux__)
+#include <sys/inotify.h>
+#include <poll.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <errno.h>
+#endif
+
+void DirWatcher::AddChange(const string& aPath, C_Vector<string>& aOut) const
+{
+    // hidden files and dirs at any depth
+    if (aPath.empty() || aPath[0] == '.' || aPath.find("/.") != string::npos)
+        return;
+
+    for (int i = 0; i < aOut.Count(); ++i)
+    {
+        if (aOut[i] == aPath)
+            return;
+    }
+
+    aOut.Add(aPath);
+}
+
+bool DirWatcher::Wait(C_Vector<string>& aOutChanged, bool& aOutLost, int aQuietMs /*= 200*/)
+{
+    aOutChanged.Clear();
+    mLost = false;
+
+    while (aOutChanged.Count() == 0 && !mLost)
+    {
+        if (!ReadChanges(aOutChanged, -1))
+            return false;
+    }
+
+    // ReadChanges returns false on a timeout too, either way the batch is done
+    while (ReadChanges(aOutChanged, aQuietMs))
+    {
+    }
+
+    aOutLost = mLost;
+    return true;
+}
+
+#if defined(_WIN32)
+
+bool DirWatcher::Start(const char* aDir)
+{
+    Stop();
+
+    mDir = CreateFileA(aDir, FILE_LIST_DIRECTORY, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, NULL);
+
+    if (mDir == INVALID_HANDLE_VALUE)
+    {
+        mDir = NULL;
+        WAR_LOG_ERROR(CAT_GENERAL, "Failed to watch %s", aDir);
+        return false;
+    }
+
+    mEvent = CreateEventA(NULL, TRUE, FALSE, NULL);
+    mBuffer.Resize(64 * 1024);
+    return true;
+}
+
+void DirWatcher::Stop()
+{
+    if (mDir)
+        CloseHandle(mDir);
+
+    if (mEvent)
+        CloseHandle(mEvent);
+
+    mDir = NULL;
+    mEvent = NULL;
+}
+
+bool DirWatcher::ReadChanges(C_Vector<string>& aOut, int aTimeoutMs)
+{
+    OVERLAPPED overlapped = {};
+    overlapped.hEvent = mEvent;
+    ResetEvent(mEvent);
+
+    const DWORD filter = FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_DIR_NAME | FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_SIZE;
+
+    if (!ReadDirectoryChangesW(mDir, mBuffer.GetBuffer(), DWORD(mBuffer.Count()), TRUE, filter, NULL, &overlapped, NULL))
+        return false;
+
+    if (WaitForSingleObject(mEvent, aTimeoutMs < 0 ? INFINITE : DWORD(aTimeoutMs)) != WAIT_OBJECT_0)
+    {
+        CancelIo(mDir);
+
+        DWORD ignored;
+        GetOverlappedResult(mDir, &overlapped, &ignored, TRUE);
+        return false;
+    }
+
+    DWORD size;
+    if (!GetOverlappedResult(mDir, &overlapped, &size, FALSE))
+        return false;
+
+    // 0 bytes means the buffer overflowed and the changes were lost
+    if (size == 0)
+    {
+        mLost = true;
+        return true;
+    }
+
+    const uint8* entry = mBuffer.GetBuffer();
+
+    while (size > 0)
+    {
+        const FILE_NOTIFY_INFORMATION* info = (const FILE_NOTIFY_INFORMATION*)entry;
+
+        char name[MAX_PATH * 3];
+        const int n = WideCharToMultiByte(CP_UTF8, 0, info->FileName, int(info->FileNameLength / sizeof(WCHAR)), name, sizeof(name) - 1, NULL, NULL);
+
+        string path(name, n);
+        for (char& c : path)
+            c = c == '\\' ? '/' : c;
+
+        AddChange(path, aOut);
+
+        if (info->NextEntryOffset == 0)
+            break;
+
+        entry += info->NextEntryOffset;
+    }
+
+    return true;
+}
+
+#elif defined(__linux__)
+
+namespace DirWatcher_private
+{
+    const uint32 WATCH_MASK = IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO;
+}
+
+bool DirWatcher::Start(const char* aDir)
+{
+    Stop();
+
+    mFd = inotify_init1(IN_CLOEXEC);
+
+    if (mFd < 0)
+    {
+        WAR_LOG_ERROR(CAT_GENERAL, "Failed to watch %s", aDir);
+        return false;
+    }
+
+    mRoot = aDir;
+
+    if (!AddWatches(""))
+    {
+        WAR_LOG_ERROR(CAT_GENERAL, "Failed to watch %s", aDir);
+        Stop();
+        return false;
+    }
+
+    return true;
+}
+
+void DirWatcher::Stop()
+{
+    if (mFd >= 0)
+        close(mFd);
+
+    mFd = -1;
+    mWatches.Clear();
+}
+
+bool DirWatcher::AddWatches(const string& aRelDir)
+{
+    using namespace DirWatcher_private;
+
+    const string dir = aRelDir.empty() ? mRoot : mRoot + "/" + aRelDir;
+    const int wd = inotify_add_watch(mFd, dir.c_str(), WATCH_MASK | IN_ONLYDIR);
+
+    if (wd < 0)
+        return false;
+
+    mWatches.Add(std::make_pair(wd, aRelDir));
+
+    DIR* d = opendir(dir.c_str());
+    if (!d)
+        return true;
+
+    while (dirent* e = readdir(d))
+    {
+        if (e->d_name[0] == '.')
+            continue;
+
+        const string rel = aRelDir.empty() ? string(e->d_name) : aRelDir + "/" + e->d_name;
+
+        // d_type isn't filled in by every file system, IN_ONLYDIR rejects files then
+        if (e->d_type == DT_DIR || e->d_type == DT_UNKNOWN)
+            AddWatches(rel);
+    }
+
+    closedir(d);
+    return true;
+}
+
+bool DirWatcher::ReadChanges(C_Vector<string>& aOut, int aTimeoutMs)
+{
+    pollfd pfd = { mFd, POLLIN, 0 };
+
+    int ready;
+    do
+    {
+        ready = poll(&pfd, 1, aTimeoutMs);
+    } while (ready < 0 && errno == EINTR);
+
+    if (ready <= 0)
+        return false;
+
+    alignas(inotify_event) char buffer[16 * 1024];
+    const ssize_t size = read(mFd, buffer, sizeof(buffer));
+
+    if (size <= 0)
+        return false;
+
+    for (ssize_t pos = 0; pos < size;)
+    {
+        const inotify_event* e = (const inotify_event*)(buffer + pos);
+        pos += sizeof(inotify_event) + e->len;
+
+        // the queue overflowed, the lost events may have been new dirs so everything is watched again.
+        // inotify_add_watch gives back the same descriptor for a dir that's already watched
+        if (e->mask & IN_Q_OVERFLOW)
+        {
+            mLost = true;
+            mWatches.Clear();
+            AddWatches("");
+            continue;
+        }
+
+        if (e->len == 0)
+            continue;
+
+        string dir;
+        for (int i = 0; i < mWatches.Count(); ++i)
+        {
+            if (mWatches[i].first == e->wd)
+                dir = mWatches[i].second;
+        }
+
+        const string path = dir.empty() ? string(e->name) : dir + "/" + e->name;
+
+        // new dirs are watched as well
+        if ((e->mask & IN_ISDIR) && (e->mask & (IN_CREATE | IN_MOVED_TO)) && e->name[0] != '.')
+            AddWatches(path);
+
+        AddChange(path, aOut);
+    }
+
+    return true;
+}
+
+#else
+
+bool DirWatcher::Start(const char* aDir)
+{
+    WAR_LOG_ERROR(CAT_GENERAL, "Watching %s isn't supported on this platform", aDir);
+    return false;
+}
+
+void DirWatcher::Stop()
+{
+}
+
+bool DirWatcher::ReadChanges(C_Vector<string>& aOut, int aTimeoutMs)
+{
+    return false;
+}
+
+#endif
@@ -0,0 +1,49 @@
+#ifndef _DirWatcher_h_
+#define _DirWatcher_h_
+
+#include "C_Vector.h"
+
+// files changing under a directory tree, inotify on linux and ReadDirectoryChangesW on windows.
+// anything under a name starting with '.' (the .zcache/.acache dirs, editor swap files) is left out
+class DirWatcher
+{
+public:
+    DirWatcher() {}
+    ~DirWatcher() { Stop(); }
+
+    bool Start(const char* aDir);
+    void Stop();
+
+    // blocks until something changes, then until aQuietMs go by without another change so a save touching several
+    // files is one batch. paths are relative to the watched dir with '/' separators. aOutLost is set when the system
+    // dropped changes (its queue overflowed), anything may have changed then
+    bool Wait(C_Vector<string>& aOutChanged, bool& aOutLost, int aQuietMs = 200);
+
+private:
+    DirWatcher(const DirWatcher&) = delete;
+    DirWatcher& operator=(const DirWatcher&) = delete;
+
+    void AddChange(const string& aPath, C_Vector<string>& aOut) const;
+
+    bool mLost = false;
+
+#ifdef _WIN32
+    // true once a change came in, false after aTimeoutMs (-1 waits forever)
+    bool ReadChanges(C_Vector<string>& aOut, int aTimeoutMs);
+
+    void* mDir = NULL;
+    void* mEvent = NULL;
+    C_Vector<uint8> mBuffer;
+#else
+    bool AddWatches(const string& aRelDir);
+    bool ReadChanges(C_Vector<string>& aOut, int aTimeoutMs);
+
+    int mFd = -1;
+    string mRoot;
+
+    // watch descriptor -> dir relative to the root, inotify watches aren't recursive
+    C_Vector<std::pair<int, string>> mWatches;
+#endif
+};
+
+#endif // _DirWatcher_h_
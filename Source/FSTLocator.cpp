@@ -0,0 +1,187 @@
+#include "FSTLocator.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || defined(_M_IX86)
+#include <emmintrin.h>
+#define FSTLOCATOR_SSE2
+#endif
+
+namespace FSTLocator_private
+{
+    // how far the file count may differ from the expected one, builds can add or drop files
+    const int FILE_COUNT_SLACK = 32;
+
+    uint32 ReadBE32(const uint8* aData)
+    {
+        return (uint32(aData[0]) << 24) | (aData[1] << 16) | (aData[2] << 8) | aData[3];
+    }
+
+    struct CountRange
+    {
+        CountRange(int aExpectedFiles)
+        {
+            mMin = C_Max(1, aExpectedFiles - FILE_COUNT_SLACK);
+            // the candidate filter only looks at the low byte of the count
+            mMax = C_Min(255, aExpectedFiles + FILE_COUNT_SLACK);
+        }
+
+        int mMin;
+        int mMax;
+    };
+
+    // header ranking, an exact file count and a table starting at 0 is what CompileFST writes
+    int ScoreHeader(const uint8* aRom, uint32 aOffset, int aExpectedFiles)
+    {
+        int score = 1;
+
+        if (int(ReadBE32(aRom + aOffset)) == aExpectedFiles)
+            score += 2;
+
+        if (ReadBE32(aRom + aOffset + 4) == 0)
+            score += 1;
+
+        return score;
+    }
+
+    const int PERFECT_SCORE = 4;
+
+    // calls aFunc for every 4-byte aligned word that is a big-endian value in [aMin, aMax], returns
+    // false if aFunc requested to stop
+    template<typename FUNC>
+    bool ScanCounts(const uint8* aRom, uint32 aRomSize, int aMin, int aMax, const FUNC& aFunc)
+    {
+        uint32 offset = 0;
+
+#if defined(__AVX2__)
+        // as little-endian lanes: low three bytes zero, top byte within range
+        const __m256i lowMask = _mm256_set1_epi32(0x00FFFFFF);
+        const __m256i zero = _mm256_setzero_si256();
+        const __m256i minVal = _mm256_set1_epi32(aMin - 1);
+        const __m256i maxVal = _mm256_set1_epi32(aMax + 1);
+
+        for (; offset + 32 <= aRomSize; offset += 32)
+        {
+            const __m256i v = _mm256_loadu_si256((const __m256i*)(aRom + offset));
+            const __m256i top = _mm256_srli_epi32(v, 24);
+            __m256i hit = _mm256_cmpeq_epi32(_mm256_and_si256(v, lowMask), zero);
+            hit = _mm256_and_si256(hit, _mm256_cmpgt_epi32(top, minVal));
+            hit = _mm256_and_si256(hit, _mm256_cmpgt_epi32(maxVal, top));
+
+            const int mask = _mm256_movemask_ps(_mm256_castsi256_ps(hit));
+
+            if (mask == 0)
+                continue;
+
+            for (int lane = 0; lane < 8; ++lane)
+            {
+                if ((mask & (1 << lane)) && !aFunc(offset + lane * 4))
+                    return false;
+            }
+        }
+#elif defined(FSTLOCATOR_SSE2)
+        const __m128i lowMask = _mm_set1_epi32(0x00FFFFFF);
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i minVal = _mm_set1_epi32(aMin - 1);
+        const __m128i maxVal = _mm_set1_epi32(aMax + 1);
+
+        for (; offset + 16 <= aRomSize; offset += 16)
+        {
+            const __m128i v = _mm_loadu_si128((const __m128i*)(aRom + offset));
+            const __m128i top = _mm_srli_epi32(v, 24);
+            __m128i hit = _mm_cmpeq_epi32(_mm_and_si128(v, lowMask), zero);
+            hit = _mm_and_si128(hit, _mm_cmpgt_epi32(top, minVal));
+            hit = _mm_and_si128(hit, _mm_cmpgt_epi32(maxVal, top));
+
+            const int mask = _mm_movemask_ps(_mm_castsi128_ps(hit));
+
+            if (mask == 0)
+                continue;
+
+            for (int lane = 0; lane < 4; ++lane)
+            {
+                if ((mask & (1 << lane)) && !aFunc(offset + lane * 4))
+                    return false;
+            }
+        }
+#endif
+
+        for (; offset + 4 <= aRomSize; offset += 4)
+        {
+            const uint32 v = ReadBE32(aRom + offset);
+
+            if (v >= uint32(aMin) && v <= uint32(aMax) && !aFunc(offset))
+                return false;
+        }
+
+        return true;
+    }
+}
+
+bool FSTLocator::IsValidHeader(const uint8* aRom, uint32 aRomSize, uint32 aOffset, int aExpectedFiles)
+{
+    using namespace FSTLocator_private;
+
+    if ((aOffset & 3) != 0 || aOffset >= aRomSize || aRomSize - aOffset < 8)
+        return false;
+
+    const CountRange range(aExpectedFiles);
+    const uint32 numFiles = ReadBE32(aRom + aOffset);
+
+    if (numFiles < uint32(range.mMin) || numFiles > uint32(range.mMax))
+        return false;
+
+    // count + offsets + end offset
+    const uint32 tableEnd = aOffset + 4 + (numFiles + 1) * 4;
+
+    if (tableEnd > aRomSize)
+        return false;
+
+    const uint8* table = aRom + aOffset + 4;
+    const uint32 first = ReadBE32(table);
+    uint32 prev = first;
+
+    for (uint32 i = 1; i <= numFiles; ++i)
+    {
+        const uint32 v = ReadBE32(table + i * 4);
+
+        if (v < prev)
+            return false;
+
+        prev = v;
+    }
+
+    // prev is the content size
+    return prev > first && prev <= aRomSize - tableEnd;
+}
+
+uint32 FSTLocator::Find(const uint8* aRom, uint32 aRomSize, int aExpectedFiles, uint32 aPreferredOffset)
+{
+    using namespace FSTLocator_private;
+
+    if (IsValidHeader(aRom, aRomSize, aPreferredOffset, aExpectedFiles))
+        return aPreferredOffset;
+
+    const CountRange range(aExpectedFiles);
+
+    uint32 bestOffset = NOT_FOUND;
+    int bestScore = 0;
+
+    ScanCounts(aRom, aRomSize, range.mMin, range.mMax, [&](uint32 aOffset)
+        {
+            if (!IsValidHeader(aRom, aRomSize, aOffset, aExpectedFiles))
+                return true;
+
+            const int score = ScoreHeader(aRom, aOffset, aExpectedFiles);
+
+            if (score > bestScore)
+            {
+                bestScore = score;
+                bestOffset = aOffset;
+            }
+
+            return score < PERFECT_SCORE;
+        });
+
+    return bestOffset;
+}
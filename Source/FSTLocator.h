@@ -0,0 +1,19 @@
+#ifndef _FSTLocator_h_
+#define _FSTLocator_h_
+
+#include "C_Base.h"
+
+namespace FSTLocator
+{
+    static const uint32 NOT_FOUND = uint32(-1);
+
+    // checks if a plausible FST header starts at aOffset: a file count close to aExpectedFiles,
+    // followed by non-decreasing big-endian offsets that end inside the rom
+    bool IsValidHeader(const uint8* aRom, uint32 aRomSize, uint32 aOffset, int aExpectedFiles);
+
+    // returns the offset of the FST header in a big-endian rom. aPreferredOffset is checked first,
+    // after that the whole rom is scanned
+    uint32 Find(const uint8* aRom, uint32 aRomSize, int aExpectedFiles, uint32 aPreferredOffset);
+}
+
+#endif // _FSTLocator_h_
@@ -0,0 +1,181 @@
+#include "FileFilter.h"
+#include "CL_Log.h"
+#include "Formats.h"
+#include <ctype.h>
+
+namespace FileFilter_private
+{
+    bool Match(const char* aPattern, const char* aName)
+    {
+        // backtracks to the last * only, enough for globs without character classes
+        const char* star = NULL;
+        const char* starName = NULL;
+
+        while (*aName)
+        {
+            if (*aPattern == '*')
+            {
+                star = aPattern++;
+                starName = aName;
+            }
+            else if (*aPattern == '?' || toupper((unsigned char)*aPattern) == toupper((unsigned char)*aName))
+            {
+                aPattern++;
+                aName++;
+            }
+            else if (star)
+            {
+                aPattern = star + 1;
+                aName = ++starName;
+            }
+            else
+            {
+                return false;
+            }
+        }
+
+        while (*aPattern == '*')
+            aPattern++;
+
+        return *aPattern == 0;
+    }
+
+    // aName is the part of aFileName before its extension, without case
+    bool IsBaseName(const string& aName, const string& aFileName)
+    {
+        if (aName.empty() || aFileName.length() <= aName.length() || aFileName[aName.length()] != '.')
+            return false;
+
+        for (size_t i = 0; i < aName.length(); ++i)
+        {
+            if (toupper((unsigned char)aName[i]) != toupper((unsigned char)aFileName[i]))
+                return false;
+        }
+
+        return true;
+    }
+
+    bool MatchFile(const char* aPattern, int aFile)
+    {
+        const string fileName = ROMFST::GetFileName(ROMFST::File(aFile));
+        const size_t dot = fileName.find('.');
+
+        // TEX0.tab -> TEX0 and TEX0_TAB
+        string enumName = fileName;
+        for (char& c : enumName)
+            c = c == '.' ? '_' : char(toupper((unsigned char)c));
+
+        return Match(aPattern, fileName.c_str()) || Match(aPattern, fileName.substr(0, dot).c_str()) || Match(aPattern, enumName.c_str());
+    }
+}
+
+bool FileFilter::Parse(const char* aOnly, const char* aExclude)
+{
+    const bool hasOnly = aOnly && aOnly[0];
+
+    for (int i = 0; i < ROMFST::NUM_FILES; ++i)
+        mSelected[i] = !hasOnly;
+
+    return (!hasOnly || Apply(aOnly, true)) && (!aExclude || !aExclude[0] || Apply(aExclude, false));
+}
+
+void FileFilter::Clear()
+{
+    for (int i = 0; i < ROMFST::NUM_FILES; ++i)
+        mSelected[i] = false;
+}
+
+bool FileFilter::SelectInput(const char* aRelPath)
+{
+    // TEX0/0001.png and TEX0/index.json -> TEX0, DLLSIMPORTTAB.def -> DLLSIMPORTTAB
+    const string path = aRelPath;
+    const string top = path.substr(0, path.find_first_of("/\\"));
+    const string base = top.substr(0, top.find('.'));
+
+    bool matched = false;
+
+    for (int i = 0; i < ROMFST::NUM_FILES; ++i)
+    {
+        if (!FileFilter_private::IsBaseName(base, ROMFST::GetFileName(ROMFST::File(i))))
+            continue;
+
+        mSelected[i] = true;
+        matched = true;
+
+        C_Vector<int> dependents;
+        Formats::GetDependentFiles(i, dependents);
+
+        for (int j = 0; j < dependents.Count(); ++j)
+            mSelected[dependents[j]] = true;
+    }
+
+    return matched;
+}
+
+void FileFilter::Intersect(const FileFilter& aOther)
+{
+    for (int i = 0; i < ROMFST::NUM_FILES; ++i)
+        mSelected[i] = mSelected[i] && aOther.mSelected[i];
+}
+
+bool FileFilter::SelectsNone() const
+{
+    for (int i = 0; i < ROMFST::NUM_FILES; ++i)
+    {
+        if (mSelected[i])
+            return false;
+    }
+
+    return true;
+}
+
+bool FileFilter::SelectsAll() const
+{
+    for (int i = 0; i < ROMFST::NUM_FILES; ++i)
+    {
+        if (!mSelected[i])
+            return false;
+    }
+
+    return true;
+}
+
+bool FileFilter::Apply(const char* aPatterns, bool aSelect)
+{
+    using namespace FileFilter_private;
+
+    const string patterns = aPatterns;
+    size_t start = 0;
+
+    while (start <= patterns.length())
+    {
+        size_t end = patterns.find(',', start);
+        if (end == string::npos)
+            end = patterns.length();
+
+        const string pattern = patterns.substr(start, end - start);
+        start = end + 1;
+
+        if (pattern.empty())
+            continue;
+
+        bool matched = false;
+
+        for (int i = 0; i < ROMFST::NUM_FILES; ++i)
+        {
+            if (MatchFile(pattern.c_str(), i))
+            {
+                mSelected[i] = aSelect;
+                matched = true;
+            }
+        }
+
+        if (!matched)
+        {
+            WAR_LOG_ERROR(CAT_GENERAL, "%s doesn't match any fst file", pattern.c_str());
+            return false;
+        }
+    }
+
+    return true;
+}
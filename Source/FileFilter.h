@@ -0,0 +1,35 @@
+#ifndef _FileFilter_h_
+#define _FileFilter_h_
+
+#include "ROMFST.h"
+
+// the fst files a run is limited to. patterns are comma separated names or globs (* and ?) matched without case
+// against the file name, its name without extension and its ROMFST::File name, so DLLS* selects DLLS.bin,
+// DLLS.tab and DLLSIMPORTTAB.bin and TEX0_TAB only TEX0.tab
+class FileFilter
+{
+public:
+    // no -only selects every file before -exclude is applied. a pattern that matches nothing is an error
+    bool Parse(const char* aOnly, const char* aExclude);
+
+    // selects nothing, SelectInput() then adds files one input at a time
+    void Clear();
+
+    // the files an input of an extracted tree is compiled into, aRelPath is relative to the tree (TEX0/0001.png,
+    // GLOBALMAP.json). false if it isn't the input of any file
+    bool SelectInput(const char* aRelPath);
+
+    // deselects what aOther doesn't select
+    void Intersect(const FileFilter& aOther);
+
+    bool IsSelected(int aFile) const { return mSelected[aFile]; }
+    bool SelectsAll() const;
+    bool SelectsNone() const;
+
+private:
+    bool Apply(const char* aPatterns, bool aSelect);
+
+    bool mSelected[ROMFST::NUM_FILES] = { false };
+};
+
+#endif // _FileFilter_h_
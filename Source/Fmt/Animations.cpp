@@ -0,0 +1,297 @@
+#include "C_FileSystem.h"
+#include "TabBinArchive.h"
+#include "C_DataPack.h"
+#include "BigEndian.h"
+#include "CL_Log.h"
+#include "AnimKeys.h"
+
+namespace FormatsInternal
+{
+    const TabBinArchive::Desc* FindArchive(const char* aName);
+
+    // u16 kept as is, u16 frame count, then a row of s16 angle keys per frame
+    const uint32 ANIM_HEADER_SIZE = 4;
+    const uint32 ANIM_NUM_FRAMES = 2;
+
+    // anything longer or wider is taken for data of another kind
+    const int ANIM_MAX_FRAMES = 4096;
+    const int ANIM_MAX_CHANNELS = 3 * 128;
+    // angle curves turn a little per frame, random keys average a quarter turn
+    const int ANIM_MAX_AVERAGE_STEP = 0x1000;
+
+    // the layout is inferred, so an entry only counts as an animation if its size is exactly frames * channels keys
+    // and its channels are continuous curves. anything else is left raw
+    struct AnimLayout
+    {
+        int mNumFrames = 0;
+        int mNumChannels = 0;
+
+        bool Read(const uint8* aData, uint32 aSize)
+        {
+            if (aSize <= ANIM_HEADER_SIZE)
+                return false;
+
+            const uint32 keyBytes = aSize - ANIM_HEADER_SIZE;
+            mNumFrames = BigEndian::Load<uint16>(aData + ANIM_NUM_FRAMES);
+
+            // a single frame has no curve to check
+            if (mNumFrames < 2 || mNumFrames > ANIM_MAX_FRAMES || keyBytes % (mNumFrames * 2) != 0)
+                return false;
+
+            mNumChannels = int(keyBytes / (mNumFrames * 2));
+
+            if (mNumChannels > ANIM_MAX_CHANNELS)
+                return false;
+
+            // steps wrap around like the angles do
+            const uint8* keys = aData + ANIM_HEADER_SIZE;
+            uint64 totalStep = 0;
+
+            for (int i = mNumChannels; i < mNumFrames * mNumChannels; ++i)
+            {
+                const int16 step = int16(BigEndian::Load<uint16>(keys + i * 2) - BigEndian::Load<uint16>(keys + (i - mNumChannels) * 2));
+                totalStep += uint64(step < 0 ? -int(step) : int(step));
+            }
+
+            return totalStep <= uint64(ANIM_MAX_AVERAGE_STEP) * uint64((mNumFrames - 1) * mNumChannels);
+        }
+    };
+
+    // ANIM entries to <entry>.json with a row of degrees per frame
+    bool ExportAnimation(const uint8* aData, uint32 aSize, const char* aBasePath, C_DataPack& aOutInfo)
+    {
+        AnimLayout layout;
+
+        if (!layout.Read(aData, aSize))
+            return false;
+
+        C_Vector<float> values;
+        values.Resize(layout.mNumFrames * layout.mNumChannels);
+        AnimKeys::Dequantise(aData + ANIM_HEADER_SIZE, values.Count(), AnimKeys::ANGLE_SCALE, values.GetBuffer());
+
+        C_DataPack frames;
+
+        for (int f = 0; f < layout.mNumFrames; ++f)
+        {
+            C_DataPack frame;
+
+            for (int c = 0; c < layout.mNumChannels; ++c)
+                frame.Set(c, values[f * layout.mNumChannels + c]);
+
+            frames.Set(f, frame);
+        }
+
+        C_DataPack anim;
+        anim.Set("Channels", layout.mNumChannels);
+        anim.Set("Frames", frames);
+
+        const string path = string(aBasePath) + ".json";
+
+        if (!anim.ToFileJson(path.c_str()))
+            return false;
+
+        C_FilePath fileName;
+        C_PathUtils::GetFilename(path.c_str(), fileName);
+
+        aOutInfo.Set("Keys", string(fileName));
+        return true;
+    }
+
+    // requantises the edited frames, the channel count is fixed by the model but frames can be added or removed
+    bool CompileAnimation(FSTContext* aCtx, const C_DataPack& aInfo, const char* aDir, C_Vector<uint8>& aData, bool& aOutModified)
+    {
+        string keysFile;
+        aInfo.Get("Keys", keysFile);
+
+        C_FilePath path(aDir);
+        path.Combine(keysFile.c_str());
+
+        if (keysFile.length() == 0)
+            return true;
+
+        aCtx->AddDependency(path);
+
+        if (!C_FileSystem::Exists(path))
+            return true;
+
+        AnimLayout layout;
+
+        if (!layout.Read(aData.GetBuffer(), aData.Count()))
+        {
+            WAR_LOG_ERROR(CAT_GENERAL, "%s: the extracted animation it belongs to is invalid", (const char*)path);
+            return false;
+        }
+
+        C_DataPack anim;
+        C_DataPack frames;
+
+        if (!anim.FromFileJson(path) || !anim.Get("Frames", frames))
+        {
+            WAR_LOG_ERROR(CAT_GENERAL, "Failed to read %s", (const char*)path);
+            return false;
+        }
+
+        const int numFrames = frames.NumEntries();
+        const int numChannels = layout.mNumChannels;
+
+        if (numFrames == 0 || numFrames > 0xFFFF)
+        {
+            WAR_LOG_ERROR(CAT_GENERAL, "%s: an animation has 1 to 65535 frames, not %i", (const char*)path, numFrames);
+            return false;
+        }
+
+        C_Vector<float> values;
+        values.Resize(numFrames * numChannels);
+
+        for (int f = 0; f < numFrames; ++f)
+        {
+            C_DataPack frame;
+            frames.Get(f, frame);
+
+            if (frame.NumEntries() != numChannels)
+            {
+                WAR_LOG_ERROR(CAT_GENERAL, "%s: frame %i has %i channels, the animation has %i", (const char*)path, f, frame.NumEntries(), numChannels);
+                return false;
+            }
+
+            for (int c = 0; c < numChannels; ++c)
+                frame.Get(c, values[f * numChannels + c]);
+        }
+
+        C_Vector<uint8> out;
+        out.Resize(ANIM_HEADER_SIZE + values.Count() * 2);
+        memcpy(out.GetBuffer(), aData.GetBuffer(), ANIM_HEADER_SIZE);
+        BigEndian::Store<uint16>(out.GetBuffer() + ANIM_NUM_FRAMES, uint16(numFrames));
+
+        const int clamped = AnimKeys::Quantise(values.GetBuffer(), values.Count(), AnimKeys::ANGLE_SCALE, out.GetBuffer() + ANIM_HEADER_SIZE);
+
+        if (clamped > 0)
+            WAR_LOG_WARNING(CAT_GENERAL, "%s: %i keys were out of range and clamped", (const char*)path, clamped);
+
+        // unchanged keys requantise to the original data, the entry stays as it was
+        if (out.Count() == aData.Count() && memcmp(out.GetBuffer(), aData.GetBuffer(), out.Count()) == 0)
+            return true;
+
+        aData = out;
+        aOutModified = true;
+        return true;
+    }
+
+    // a path from the extract root to an entry of an archive, with aExt in place of the entry's extension
+    static string GetEntryPath(const TabBinArchive::Desc& aDesc, int aIndex, const char* aExt = NULL)
+    {
+        C_FilePath file;
+
+        if (aExt)
+            C_PathUtils::GetFilenameWithoutExtension(C_Strfmt<64>(aDesc.mEntryFormat, aIndex), file);
+
+        return string(aDesc.mName) + "/" + (aExt ? string(file) + aExt : string(C_Strfmt<64>(aDesc.mEntryFormat, aIndex)));
+    }
+
+    // MODANIM entries list the ANIM ids of the model with the same index, which also has its bone map in AMAP.
+    // writes them to one file so a model's animations can be found without going through the ids. ANIM and AMAP
+    // are extracted by then, ids are resolved against their files: ids without an entry are dropped, decoded
+    // animations get their keys file and channel count. paths are from the extract root
+    bool ExportAnimSets(const C_Vector<TabBinArchive::EntryData>& aEntries, const char* aDir, C_DataPack& aOutInfo)
+    {
+        const TabBinArchive::Desc* anims = FindArchive("ANIM");
+        const TabBinArchive::Desc* maps = FindArchive("AMAP");
+        WAR_ASSERT(anims && maps);
+
+        C_FilePath root;
+        C_PathUtils::GetDirectoryPath(aDir, root);
+
+        auto getPath = [&](const string& aRelPath)
+        {
+            C_FilePath path(root);
+            path.Combine(aRelPath.c_str());
+            return path;
+        };
+
+        C_DataPack sets;
+        int numMissing = 0;
+        int numMixed = 0;
+
+        for (int m = 0; m < aEntries.Count(); ++m)
+        {
+            const TabBinArchive::EntryData& entry = aEntries[m];
+
+            if (entry.mSize == 0 || (entry.mSize & 1))
+                continue;
+
+            C_DataPack animsPack;
+            int channels = -1;
+            bool mixed = false;
+
+            for (uint32 i = 0; i < entry.mSize / 2; ++i)
+            {
+                const int16 id = BigEndian::Load<int16>(entry.mData + i * 2);
+
+                if (id < 0)
+                    continue;
+
+                const string file = GetEntryPath(*anims, id);
+
+                if (!C_FileSystem::Exists(getPath(file)))
+                {
+                    ++numMissing;
+                    continue;
+                }
+
+                C_DataPack animPack;
+                animPack.Set("Id", int(id));
+                animPack.Set("File", file);
+
+                const string keysFile = GetEntryPath(*anims, id, ".json");
+                C_DataPack keys;
+                int animChannels = 0;
+
+                if (C_FileSystem::Exists(getPath(keysFile)) && keys.FromFileJson(getPath(keysFile)) && keys.Get("Channels", animChannels))
+                {
+                    animPack.Set("Keys", keysFile);
+                    animPack.Set("Channels", animChannels);
+
+                    // the bones of one model, every animation of it drives the same channels
+                    mixed |= channels >= 0 && channels != animChannels;
+                    channels = animChannels;
+                }
+
+                animsPack.Set(animsPack.NumEntries(), animPack);
+            }
+
+            numMixed += mixed ? 1 : 0;
+
+            C_DataPack set;
+            set.Set("Model", m);
+
+            const string mapFile = GetEntryPath(*maps, m);
+
+            if (C_FileSystem::Exists(getPath(mapFile)))
+                set.Set("AnimMap", mapFile);
+
+            if (channels >= 0 && !mixed)
+                set.Set("Channels", channels);
+
+            set.Set("Anims", animsPack);
+            sets.Set(sets.NumEntries(), set);
+        }
+
+        if (numMissing > 0)
+            WAR_LOG_WARNING(CAT_GENERAL, "%s: %i animation ids have no ANIM entry", aDir, numMissing);
+
+        if (numMixed > 0)
+            WAR_LOG_WARNING(CAT_GENERAL, "%s: %i models have animations with different channel counts", aDir, numMixed);
+
+        C_DataPack pack;
+        pack.Set("Sets", sets);
+
+        C_FilePath path(aDir);
+        path.Combine("animsets.json");
+
+        if (!pack.ToFileJson(path))
+            return false;
+
+        aOutInfo.Set("AnimSets", string("animsets.json"));
+        return true;
+    }
+}
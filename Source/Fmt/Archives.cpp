@@ -0,0 +1,80 @@
+#include "ROMFST.h"
+#include "TabBinArchive.h"
+#include "C_DataPack.h"
+
+namespace FormatsInternal
+{
+    bool ExportTexture(const uint8* aData, uint32 aSize, const char* aBasePath, C_DataPack& aOutInfo);
+    bool CompileTexture(FSTContext* aCtx, const C_DataPack& aInfo, const char* aDir, C_Vector<uint8>& aData, bool& aOutModified);
+    bool ExportScreen(const uint8* aData, uint32 aSize, const char* aBasePath, C_DataPack& aOutInfo);
+    bool ExportAnimation(const uint8* aData, uint32 aSize, const char* aBasePath, C_DataPack& aOutInfo);
+    bool CompileAnimation(FSTContext* aCtx, const C_DataPack& aInfo, const char* aDir, C_Vector<uint8>& aData, bool& aOutModified);
+    bool ExportAnimSets(const C_Vector<TabBinArchive::EntryData>& aEntries, const char* aDir, C_DataPack& aOutInfo);
+    bool ExportModels(const C_Vector<TabBinArchive::EntryData>& aEntries, const char* aDir, C_DataPack& aOutInfo);
+    bool ExportBlock(const uint8* aData, uint32 aSize, const char* aBasePath, C_DataPack& aOutInfo);
+    bool ExportTextBank(const uint8* aData, uint32 aSize, const char* aBasePath, C_DataPack& aOutInfo);
+    bool CompileTextBank(FSTContext* aCtx, const C_DataPack& aInfo, const char* aDir, C_Vector<uint8>& aData, bool& aOutModified);
+    bool ExportSoundBank(const C_Vector<TabBinArchive::EntryData>& aEntries, const char* aDir, C_DataPack& aOutInfo);
+    bool CompileSoundBank(FSTContext* aCtx, const C_DataPack& aInfo, const char* aDir, const C_Vector<TabBinArchive::EntryData>& aEntries, C_Vector<C_Vector<uint8>>& aOutData);
+
+    // paired archives that are split into one file per entry, anything that doesn't match its layout is exported raw
+    static const TabBinArchive::Desc sArchives[] =
+    {
+        // name         tab                     bin                     stride  offset mask     scale   terminator      entry name  compressed  entry converters              archive converters
+        { "TEX0",       ROMFST::TEX0_TAB,       ROMFST::TEX0_BIN,       4,      0x00FFFFFF,     1,      0xFFFFFFFF,     "%04i.bin", true,       ExportTexture, CompileTexture,  NULL, NULL },
+        { "TEX1",       ROMFST::TEX1_TAB,       ROMFST::TEX1_BIN,       4,      0x00FFFFFF,     1,      0xFFFFFFFF,     "%04i.bin", true,       ExportTexture, CompileTexture,  NULL, NULL },
+        // after TEX0, the models' glbs use its pngs
+        { "MODELS",     ROMFST::MODELS_TAB,     ROMFST::MODELS_BIN,     4,      0xFFFFFFFF,     1,      0xFFFFFFFF,     "%04i.bin", true,       NULL, NULL,                    ExportModels, NULL },
+        { "ANIM",       ROMFST::ANIM_TAB,       ROMFST::ANIM_BIN,       4,      0xFFFFFFFF,     1,      0xFFFFFFFF,     "%04i.bin", true,       ExportAnimation, CompileAnimation, NULL, NULL },
+        { "AMAP",       ROMFST::AMAP_TAB,       ROMFST::AMAP_BIN,       4,      0xFFFFFFFF,     1,      0xFFFFFFFF,     "%04i.bin", false,      NULL, NULL,                    NULL, NULL },
+        { "MODANIM",    ROMFST::MODANIM_TAB,    ROMFST::MODANIM_BIN,    4,      0xFFFFFFFF,     1,      0xFFFFFFFF,     "%04i.bin", false,      NULL, NULL,                    ExportAnimSets, NULL },
+        { "ANIMCURVES", ROMFST::ANIMCURVES_TAB, ROMFST::ANIMCURVES_BIN, 4,      0xFFFFFFFF,     1,      0xFFFFFFFF,     "%04i.bin", false,      NULL, NULL,                    NULL, NULL },
+        { "BLOCKS",     ROMFST::BLOCKS_TAB,     ROMFST::BLOCKS_BIN,     4,      0xFFFFFFFF,     1,      0xFFFFFFFF,     "%04i.bin", true,       ExportBlock, NULL,             NULL, NULL },
+        { "HITS",       ROMFST::HITS_TAB,       ROMFST::HITS_BIN,       4,      0xFFFFFFFF,     1,      0xFFFFFFFF,     "%04i.bin", false,      NULL, NULL,                    NULL, NULL },
+        { "OBJSEQ",     ROMFST::OBJSEQ_TAB,     ROMFST::OBJSEQ_BIN,     4,      0xFFFFFFFF,     1,      0xFFFFFFFF,     "%04i.bin", false,      NULL, NULL,                    NULL, NULL },
+        { "OBJECTS",    ROMFST::OBJECTS_TAB,    ROMFST::OBJECTS_BIN,    4,      0xFFFFFFFF,     1,      0xFFFFFFFF,     "%04i.bin", false,      NULL, NULL,                    NULL, NULL },
+        { "VOXOBJ",     ROMFST::VOXOBJ_TAB,     ROMFST::VOXOBJ_BIN,     4,      0xFFFFFFFF,     1,      0xFFFFFFFF,     "%04i.bin", false,      NULL, NULL,                    NULL, NULL },
+        { "MODLINES",   ROMFST::MODLINES_TAB,   ROMFST::MODLINES_BIN,   4,      0xFFFFFFFF,     1,      0xFFFFFFFF,     "%04i.bin", false,      NULL, NULL,                    NULL, NULL },
+        { "SCREENS",    ROMFST::SCREENS_TAB,    ROMFST::SCREENS_BIN,    4,      0xFFFFFFFF,     1,      0xFFFFFFFF,     "%04i.bin", false,      ExportScreen, NULL,            NULL, NULL },
+        { "MPEG",       ROMFST::MPEG_TAB,       ROMFST::MPEG_BIN,       4,      0xFFFFFFFF,     1,      0xFFFFFFFF,     "%04i.bin", false,      NULL, NULL,                    NULL, NULL },
+        { "TABLES",     ROMFST::TABLES_TAB,     ROMFST::TABLES_BIN,     4,      0xFFFFFFFF,     1,      0xFFFFFFFF,     "%04i.bin", false,      NULL, NULL,                    NULL, NULL },
+        { "GAMETEXT",   ROMFST::GAMETEXT_TAB,   ROMFST::GAMETEXT_BIN,   4,      0xFFFFFFFF,     1,      0xFFFFFFFF,     "%04i.bin", false,      ExportTextBank, CompileTextBank, NULL, NULL },
+        { "AUDIO",      ROMFST::AUDIO_TAB,      ROMFST::AUDIO_BIN,      4,      0xFFFFFFFF,     1,      0xFFFFFFFF,     "%04i.bin", false,      NULL, NULL,                    ExportSoundBank, NULL },
+        { "SFX",        ROMFST::SFX_TAB,        ROMFST::SFX_BIN,        4,      0xFFFFFFFF,     1,      0xFFFFFFFF,     "%04i.bin", false,      NULL, NULL,                    ExportSoundBank, CompileSoundBank },
+        { "AMBIENT",    ROMFST::AMBIENT_TAB,    ROMFST::AMBIENT_BIN,    4,      0xFFFFFFFF,     1,      0xFFFFFFFF,     "%04i.bin", false,      NULL, NULL,                    ExportSoundBank, CompileSoundBank },
+        { "MUSIC",      ROMFST::MUSIC_TAB,      ROMFST::MUSIC_BIN,      4,      0xFFFFFFFF,     1,      0xFFFFFFFF,     "%04i.bin", false,      NULL, NULL,                    ExportSoundBank, CompileSoundBank },
+    };
+
+    const TabBinArchive::Desc* FindArchive(const char* aName)
+    {
+        for (const TabBinArchive::Desc& desc : sArchives)
+        {
+            if (strcmp(desc.mName, aName) == 0)
+                return &desc;
+        }
+
+        return NULL;
+    }
+
+    bool ExportArchives(FSTContext* aCtx)
+    {
+        for (const TabBinArchive::Desc& desc : sArchives)
+        {
+            if (!TabBinArchive::Export(aCtx, desc))
+                return false;
+        }
+
+        return true;
+    }
+
+    bool CompileArchives(FSTContext* aCtx)
+    {
+        for (const TabBinArchive::Desc& desc : sArchives)
+        {
+            if (!TabBinArchive::Compile(aCtx, desc))
+                return false;
+        }
+
+        return true;
+    }
+}
@@ -0,0 +1,372 @@
+#include "C_Stream.h"
+#include "C_FileSystem.h"
+#include "ROMFST.h"
+#include "TabBinArchive.h"
+#include "C_DataPack.h"
+#include "BigEndian.h"
+#include "BinUtils.h"
+#include "CL_Log.h"
+#include <climits>
+
+namespace FormatsInternal
+{
+    const TabBinArchive::Desc* FindArchive(const char* aName);
+
+    // world units covered by a block, maps are grids of blocks
+    const int BLOCK_CELL_SIZE = 640;
+    // far more blocks than the world covers, a larger grid means a stray GLOBALMAP coordinate
+    const int64 MAX_WORLD_GRID_CELLS = 1 << 20;
+    // keeps coordinate + block offset in an int
+    const int MAX_WORLD_COORD = 1 << 24;
+
+    // block header, the pointers are offsets from the block start until it's loaded
+    const uint32 BLOCK_VERTICES = 0x00;
+    const uint32 BLOCK_TRIS = 0x04;
+    const uint32 BLOCK_SHAPES = 0x08;
+    const uint32 BLOCK_VERTEX_COUNT = 0x90;
+    const uint32 BLOCK_TRI_COUNT = 0x92;
+    const uint32 BLOCK_SHAPE_COUNT = 0x9A;
+    const uint32 BLOCK_HEADER_SIZE = 0x9C;
+
+    // Vtx: s16 xyz, u16 flag, s16 st, u8 rgba
+    const uint32 BLOCK_VERTEX_SIZE = 0x10;
+    // u8 flags, u8 vertex indices[3] relative to the shape's first vertex, then texture coordinates
+    const uint32 BLOCK_TRI_SIZE = 0x10;
+    // u16 first vertex at 4, u16 first tri at 6, a shape's tris run up to the next shape's first tri
+    const uint32 BLOCK_SHAPE_SIZE = 0x14;
+
+    // MAPS.tab has this many offsets per map, the header is the first and the block grid the second
+    const int MAP_TAB_STRIDE = 7;
+    // s16 grid width/depth, s16 origin x/z in cells
+    const uint32 MAP_HEADER_SIZE = 8;
+
+    struct BlockMesh
+    {
+        struct Shape
+        {
+            int mFirstVertex;
+            int mFirstTri;
+            int mNumTris;
+        };
+
+        const uint8* mVertices = NULL;
+        const uint8* mTris = NULL;
+        int mNumVertices = 0;
+        int mNumTris = 0;
+        C_Vector<Shape> mShapes;
+
+        bool Read(const uint8* aData, uint32 aSize)
+        {
+            if (aSize < BLOCK_HEADER_SIZE)
+                return false;
+
+            const uint32 vertices = BigEndian::Load<uint32>(aData + BLOCK_VERTICES);
+            const uint32 tris = BigEndian::Load<uint32>(aData + BLOCK_TRIS);
+            const uint32 shapes = BigEndian::Load<uint32>(aData + BLOCK_SHAPES);
+            mNumVertices = BigEndian::Load<uint16>(aData + BLOCK_VERTEX_COUNT);
+            mNumTris = BigEndian::Load<uint16>(aData + BLOCK_TRI_COUNT);
+            const int numShapes = aData[BLOCK_SHAPE_COUNT];
+
+            if (mNumVertices == 0 || mNumTris == 0)
+                return false;
+
+            auto inBlock = [&](uint32 aOffset, uint32 aCount, uint32 aStride)
+            {
+                return aOffset >= BLOCK_HEADER_SIZE && aOffset <= aSize && aCount * aStride <= aSize - aOffset;
+            };
+
+            if (!inBlock(vertices, mNumVertices, BLOCK_VERTEX_SIZE) || !inBlock(tris, mNumTris, BLOCK_TRI_SIZE))
+                return false;
+
+            mVertices = aData + vertices;
+            mTris = aData + tris;
+
+            // without shapes the indices are from the first vertex
+            if (numShapes == 0)
+            {
+                mShapes.Add({ 0, 0, mNumTris });
+            }
+            else
+            {
+                if (!inBlock(shapes, numShapes, BLOCK_SHAPE_SIZE))
+                    return false;
+
+                for (int i = 0; i < numShapes; ++i)
+                {
+                    const uint8* shape = aData + shapes + i * BLOCK_SHAPE_SIZE;
+                    mShapes.Add({ BigEndian::Load<uint16>(shape + 4), BigEndian::Load<uint16>(shape + 6), 0 });
+                }
+
+                for (int i = 0; i < numShapes; ++i)
+                {
+                    const int end = i + 1 < numShapes ? mShapes[i + 1].mFirstTri : mNumTris;
+
+                    if (mShapes[i].mFirstTri > end || end > mNumTris || mShapes[i].mFirstVertex >= mNumVertices)
+                        return false;
+
+                    mShapes[i].mNumTris = end - mShapes[i].mFirstTri;
+                }
+            }
+
+            for (const Shape& shape : mShapes)
+            {
+                for (int i = 0; i < shape.mNumTris; ++i)
+                {
+                    const uint8* tri = mTris + (shape.mFirstTri + i) * BLOCK_TRI_SIZE;
+
+                    if (shape.mFirstVertex + C_Max(tri[1], C_Max(tri[2], tri[3])) >= mNumVertices)
+                        return false;
+                }
+            }
+
+            return true;
+        }
+    };
+
+    // BLOCKS entries to a wavefront .obj per block, in block space with vertex colors and a group per shape
+    bool ExportBlock(const uint8* aData, uint32 aSize, const char* aBasePath, C_DataPack& aOutInfo)
+    {
+        BlockMesh mesh;
+
+        if (!mesh.Read(aData, aSize))
+            return false;
+
+        string obj;
+        obj.reserve(mesh.mNumVertices * 48 + mesh.mNumTris * 24);
+
+        for (int i = 0; i < mesh.mNumVertices; ++i)
+        {
+            const uint8* vertex = mesh.mVertices + i * BLOCK_VERTEX_SIZE;
+
+            obj += C_Strfmt<96>("v %i %i %i %.4f %.4f %.4f\n",
+                BigEndian::Load<int16>(vertex + 0), BigEndian::Load<int16>(vertex + 2), BigEndian::Load<int16>(vertex + 4),
+                vertex[12] / 255.0f, vertex[13] / 255.0f, vertex[14] / 255.0f);
+        }
+
+        for (int s = 0; s < mesh.mShapes.Count(); ++s)
+        {
+            const BlockMesh::Shape& shape = mesh.mShapes[s];
+            obj += C_Strfmt<32>("g shape%i\n", s);
+
+            // obj indices start at 1
+            const int base = shape.mFirstVertex + 1;
+
+            for (int i = 0; i < shape.mNumTris; ++i)
+            {
+                const uint8* tri = mesh.mTris + (shape.mFirstTri + i) * BLOCK_TRI_SIZE;
+                obj += C_Strfmt<48>("f %i %i %i\n", base + tri[1], base + tri[2], base + tri[3]);
+            }
+        }
+
+        const string path = string(aBasePath) + ".obj";
+
+        if (!C_FileSystem::WriteFile(path.c_str(), (void*)obj.c_str(), uint32(obj.length())))
+            return false;
+
+        C_FilePath fileName;
+        C_PathUtils::GetFilename(path.c_str(), fileName);
+
+        aOutInfo.Set("Mesh", string(fileName));
+        aOutInfo.Set("Vertices", mesh.mNumVertices);
+        aOutInfo.Set("Triangles", mesh.mNumTris);
+        return true;
+    }
+
+    void GetWholeFile(FSTContext* aCtx, ROMFST::File aFile, C_Vector<uint8>& aStorage, const uint8*& aOutData, uint32& aOutSize)
+    {
+        if (aCtx->GetFileData(aFile, aOutData, aOutSize))
+            return;
+
+        C_Stream& handle = aCtx->GetFileStream(aFile);
+        handle.Seek(C_FileSystem::SeekSet, 0);
+        BinUtils::ReadRemaining(handle, aStorage);
+
+        aOutData = aStorage.GetBuffer();
+        aOutSize = aStorage.Count();
+    }
+
+    struct GridBlock
+    {
+        int mX;
+        int mZ;
+        int mMap;
+        int mBlock;
+    };
+
+    // the blocks of every map in GLOBALMAP.json laid out on one world grid. cells are stored as ranges of a
+    // cell sorted block list so a tool finds what's under a world position with two lookups
+    bool ExportWorldGrid(FSTContext* aCtx)
+    {
+        const ROMFST::File sources[] = { ROMFST::GLOBALMAP_BIN, ROMFST::MAPS_TAB, ROMFST::MAPS_BIN, ROMFST::TRKBLK_BIN };
+
+        for (ROMFST::File file : sources)
+        {
+            if (!aCtx->IsFileSelected(file))
+                return true;
+        }
+
+        C_DataPack globalMap;
+
+        if (!aCtx->ReadJson(globalMap, "GLOBALMAP.json"))
+            return false;
+
+        const TabBinArchive::Desc* blocksDesc = FindArchive("BLOCKS");
+        WAR_ASSERT(blocksDesc);
+
+        FSTContext::FileRef tabRef(aCtx, ROMFST::MAPS_TAB);
+        FSTContext::FileRef binRef(aCtx, ROMFST::MAPS_BIN);
+        FSTContext::FileRef trkRef(aCtx, ROMFST::TRKBLK_BIN);
+
+        C_Vector<uint8> tabStorage, binStorage, trkStorage;
+        const uint8* tab;
+        const uint8* bin;
+        const uint8* trk;
+        uint32 tabSize, binSize, trkSize;
+        GetWholeFile(aCtx, ROMFST::MAPS_TAB, tabStorage, tab, tabSize);
+        GetWholeFile(aCtx, ROMFST::MAPS_BIN, binStorage, bin, binSize);
+        GetWholeFile(aCtx, ROMFST::TRKBLK_BIN, trkStorage, trk, trkSize);
+
+        const int numMaps = int(tabSize / (MAP_TAB_STRIDE * 4));
+        const int numTracks = int(trkSize / 2);
+
+        // world cells first, the grid's bounds aren't known until every map is placed
+        C_Vector<GridBlock> placed;
+        int minX = INT_MAX, minZ = INT_MAX, maxX = INT_MIN, maxZ = INT_MIN;
+        int skippedMaps = 0;
+
+        for (int m = 0; m < globalMap.NumEntries(); ++m)
+        {
+            C_DataPack mapPack;
+            globalMap.Get(m, mapPack);
+
+            int coordX = 0, coordZ = 0, mapIndex = -1;
+            mapPack.Get("CoordX", coordX);
+            mapPack.Get("CoordZ", coordZ);
+            mapPack.Get("MapIndex", mapIndex);
+
+            if (mapIndex < 0 || mapIndex >= numMaps)
+            {
+                ++skippedMaps;
+                continue;
+            }
+
+            if (coordX < -MAX_WORLD_COORD || coordX > MAX_WORLD_COORD || coordZ < -MAX_WORLD_COORD || coordZ > MAX_WORLD_COORD)
+            {
+                WAR_LOG_ERROR(CAT_GENERAL, "WORLDGRID: map %i of GLOBALMAP.json is at %i, %i, out of range", mapIndex, coordX, coordZ);
+                return false;
+            }
+
+            const uint8* mapTab = tab + mapIndex * MAP_TAB_STRIDE * 4;
+            const uint32 header = BigEndian::Load<uint32>(mapTab);
+            const uint32 grid = BigEndian::Load<uint32>(mapTab + 4);
+
+            if (header > binSize || binSize - header < MAP_HEADER_SIZE)
+            {
+                ++skippedMaps;
+                continue;
+            }
+
+            const int sizeX = BigEndian::Load<int16>(bin + header);
+            const int sizeZ = BigEndian::Load<int16>(bin + header + 2);
+            const int originX = BigEndian::Load<int16>(bin + header + 4);
+            const int originZ = BigEndian::Load<int16>(bin + header + 6);
+
+            if (sizeX <= 0 || sizeZ <= 0 || grid > binSize || uint64(sizeX) * uint64(sizeZ) * 4 > binSize - grid)
+            {
+                ++skippedMaps;
+                continue;
+            }
+
+            for (int z = 0; z < sizeZ; ++z)
+            {
+                for (int x = 0; x < sizeX; ++x)
+                {
+                    // track in the top 9 bits (negative for none), block of the track in the next 6
+                    const int32 cell = BigEndian::Load<int32>(bin + grid + (z * sizeX + x) * 4);
+                    const int track = cell >> 23;
+                    const int sub = (cell >> 17) & 0x3F;
+
+                    if (track < 0 || track >= numTracks)
+                        continue;
+
+                    const int block = BigEndian::Load<int16>(trk + track * 2) + sub;
+                    const int worldX = coordX + x - originX;
+                    const int worldZ = coordZ + z - originZ;
+
+                    placed.Add({ worldX, worldZ, mapIndex, block });
+                    minX = C_Min(minX, worldX);
+                    minZ = C_Min(minZ, worldZ);
+                    maxX = C_Max(maxX, worldX);
+                    maxZ = C_Max(maxZ, worldZ);
+                }
+            }
+        }
+
+        if (skippedMaps > 0)
+            WAR_LOG_WARNING(CAT_GENERAL, "WORLDGRID: %i maps of GLOBALMAP have no readable block grid", skippedMaps);
+
+        const int64 sizeX = placed.Count() > 0 ? int64(maxX) - minX + 1 : 0;
+        const int64 sizeZ = placed.Count() > 0 ? int64(maxZ) - minZ + 1 : 0;
+
+        if (sizeX * sizeZ > MAX_WORLD_GRID_CELLS)
+        {
+            WAR_LOG_ERROR(CAT_GENERAL, "WORLDGRID: the maps of GLOBALMAP.json span %lld x %lld blocks, check their CoordX/CoordZ",
+                (long long)sizeX, (long long)sizeZ);
+            return false;
+        }
+
+        const int gridX = int(sizeX);
+        const int gridZ = int(sizeZ);
+        const int numCells = gridX * gridZ;
+
+        // counting sort by cell, blocks of a cell keep the GLOBALMAP order
+        C_Vector<int> cellStart;
+        cellStart.Resize(numCells + 1, 0);
+
+        for (const GridBlock& p : placed)
+            ++cellStart[(p.mZ - minZ) * gridX + (p.mX - minX) + 1];
+
+        for (int i = 0; i < numCells; ++i)
+            cellStart[i + 1] += cellStart[i];
+
+        C_Vector<int> fill;
+        fill.Resize(numCells);
+
+        if (numCells > 0)
+            memcpy(fill.GetBuffer(), cellStart.GetBuffer(), numCells * sizeof(int));
+
+        C_Vector<GridBlock> blocks;
+        blocks.Resize(placed.Count());
+
+        for (const GridBlock& p : placed)
+            blocks[fill[(p.mZ - minZ) * gridX + (p.mX - minX)]++] = p;
+
+        C_DataPack startsPack;
+
+        for (int i = 0; i < cellStart.Count(); ++i)
+            startsPack.Set(i, cellStart[i]);
+
+        C_DataPack blocksPack;
+
+        for (int i = 0; i < blocks.Count(); ++i)
+        {
+            C_DataPack blockPack;
+            blockPack.Set("Map", blocks[i].mMap);
+            blockPack.Set("Block", blocks[i].mBlock);
+            blockPack.Set("File", string(C_Strfmt<64>(blocksDesc->mEntryFormat, blocks[i].mBlock)));
+            blocksPack.Set(i, blockPack);
+        }
+
+        C_DataPack pack;
+        pack.Set("CellSize", BLOCK_CELL_SIZE);
+        pack.Set("MinX", gridX > 0 ? minX : 0);
+        pack.Set("MinZ", gridZ > 0 ? minZ : 0);
+        pack.Set("SizeX", gridX);
+        pack.Set("SizeZ", gridZ);
+        pack.Set("CellStart", startsPack);
+        pack.Set("Blocks", blocksPack);
+
+        // MAPS/TRKBLK stay raw, this is only a view of them
+        return aCtx->WriteJson(pack, "WORLDGRID.json");
+    }
+}
@@ -15,6 +15,9 @@ namespace FormatsInternal
 {
     bool ExportDLLSIMPORTTAB(FSTContext* aCtx)
     {
+        if (!aCtx->IsFileSelected(ROMFST::DLLSIMPORTTAB_BIN))
+            return true;
+
         C_Stream& handleTab = aCtx->GetFileStream(ROMFST::DLLSIMPORTTAB_BIN);
 
         C_FilePath defaultDefsPath;
@@ -29,14 +32,15 @@ namespace FormatsInternal
             defaultDefsPath.Combine("DLLSIMPORTTAB.def");
         }
 
-        DefsFile defaultDefs;
-        defaultDefs.Read(defaultDefsPath);
+        std::shared_ptr<const DefsFile> defaultDefs = DefsFile::ReadShared(defaultDefsPath);
 
         DefsFile expDefs;
         expDefs.ReadBinaryAddresses(handleTab);
 
-        for (DefsFile::Entry& e : defaultDefs.mEntries)
+        for (int i = 0; defaultDefs && i < defaultDefs->mEntries.Count(); ++i)
         {
+            const DefsFile::Entry& e = defaultDefs->mEntries[i];
+
             if (e.mName.length() > 0)
                 expDefs.TryAnnotate(e.mAddr, e.mName.c_str());
         }
@@ -52,6 +56,9 @@ namespace FormatsInternal
 
     bool CompileDLLSIMPORTTAB(FSTContext* aCtx)
     {
+        if (!aCtx->IsFileSelected(ROMFST::DLLSIMPORTTAB_BIN))
+            return true;
+
         C_FilePath ipath;
         aCtx->FixFilePath("DLLSIMPORTTAB.def", ipath);
 
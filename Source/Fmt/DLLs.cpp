@@ -114,6 +114,9 @@ namespace FormatsInternal
 
     bool ExportDLLs(FSTContext* aCtx)
     {
+        if (!aCtx->IsFileSelected(ROMFST::DLLS_TAB) || !aCtx->IsFileSelected(ROMFST::DLLS_BIN))
+            return true;
+
         C_Stream& handleTab = aCtx->GetFileStream(ROMFST::DLLS_TAB);
         C_Stream& handleBin = aCtx->GetFileStream(ROMFST::DLLS_BIN);
 
@@ -184,6 +187,9 @@ namespace FormatsInternal
 
     bool CompileDLLs(FSTContext* aCtx)
     {
+        if (!aCtx->IsFileSelected(ROMFST::DLLS_TAB) || !aCtx->IsFileSelected(ROMFST::DLLS_BIN))
+            return true;
+
         C_FilePath dirPath = aCtx->GetBaseDir();
         dirPath.Combine("DLLS");
 
@@ -191,6 +197,9 @@ namespace FormatsInternal
         if (!C_FileSystem::GetFilesInDirectory(dirPath, dllFiles))
             return false;
 
+        // adding or removing a dll changes the dir
+        aCtx->AddDependency(dirPath);
+
         char bankName[256];
         WAR_ZeroMem(bankName);
         char dllName[256];
@@ -264,7 +273,7 @@ namespace FormatsInternal
         {
             C_FilePath dllFilePath(dirPath);
             dllFilePath.Combine(e.mFileName.c_str());
-            C_Ptr<C_MemBlock> dllFile = C_FileSystem::ReadFile(dllFilePath);
+            C_Ptr<C_MemBlock> dllFile = aCtx->ReadFile(dllFilePath);
             if (!dllFile)
                 return false;
             e.mOffset = handleBin.GetPosition();
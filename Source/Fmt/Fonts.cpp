@@ -0,0 +1,593 @@
+#include "C_Stream.h"
+#include "C_FileSystem.h"
+#include "C_MemBlock.h"
+#include "ROMFST.h"
+#include "C_DataPack.h"
+#include "BigEndian.h"
+#include "BinUtils.h"
+#include "N64Texture.h"
+#include "PNG.h"
+#include "CL_Log.h"
+#include <algorithm>
+#include <climits>
+
+namespace FormatsInternal
+{
+    N64Texture::Format GetTextureFormat(uint8 aCode);
+
+    // glyph sets: u16 glyph count, u8 texture format code, u8 kept, u16 atlas width and height, a record per
+    // glyph and the atlas texels 8 byte aligned after the records
+    const uint32 FONT_HEADER_SIZE = 8;
+    // u16 char code, u16 atlas x and y, u8 width and height, s8 bearing x and y, u8 advance, u8 kept
+    const uint32 FONT_GLYPH_SIZE = 12;
+    const uint32 FONT_TMEM_SIZE = 4096;
+
+    struct FontFile
+    {
+        const char* mName;
+        ROMFST::File mFile;
+    };
+
+    static const FontFile sFontFiles[] =
+    {
+        { "FONTS",      ROMFST::FONTS_BIN },
+        { "CACHEFON",   ROMFST::CACHEFON_BIN },
+        { "CACHEFON2",  ROMFST::CACHEFON2_BIN },
+    };
+
+    struct Glyph
+    {
+        int mCode = 0;
+        int mX = 0;
+        int mY = 0;
+        int mWidth = 0;
+        int mHeight = 0;
+        int mBearingX = 0;
+        int mBearingY = 0;
+        int mAdvance = 0;
+        int mKept = 0;
+        C_Vector<uint8> mRGBA;
+    };
+
+    struct GlyphSet
+    {
+        uint8 mFormatCode = 0;
+        uint8 mKept = 0;
+        N64Texture::Format mFormat = N64Texture::NUM_FORMATS;
+        int mWidth = 0;
+        int mHeight = 0;
+        C_Vector<Glyph> mGlyphs;
+
+        static uint32 GetDataStart(int aNumGlyphs) { return (FONT_HEADER_SIZE + aNumGlyphs * FONT_GLYPH_SIZE + 7) & ~7; }
+
+        bool Read(const uint8* aData, uint32 aSize)
+        {
+            if (aSize < FONT_HEADER_SIZE)
+                return false;
+
+            const int numGlyphs = BigEndian::Load<uint16>(aData);
+            mFormatCode = aData[2];
+            mKept = aData[3];
+            mFormat = GetTextureFormat(mFormatCode);
+            mWidth = BigEndian::Load<uint16>(aData + 4);
+            mHeight = BigEndian::Load<uint16>(aData + 6);
+
+            // the atlas has no tlut, so no ci formats
+            if (numGlyphs == 0 || mWidth == 0 || mHeight == 0 || mFormat == N64Texture::NUM_FORMATS || N64Texture::GetNumTlutEntries(mFormat) > 0)
+                return false;
+
+            const uint32 dataStart = GetDataStart(numGlyphs);
+            const uint32 dataEnd = dataStart + N64Texture::GetDataSize(mFormat, mWidth, mHeight);
+
+            // anything past the atlas can only be alignment
+            if (dataEnd > aSize || aSize - dataEnd >= 16)
+                return false;
+
+            for (uint32 i = dataEnd; i < aSize; ++i)
+            {
+                if (aData[i] != 0)
+                    return false;
+            }
+
+            C_Vector<uint8> atlas;
+            atlas.Resize(mWidth * mHeight * 4);
+            N64Texture::Decode(mFormat, aData + dataStart, mWidth, mHeight, NULL, atlas.GetBuffer());
+
+            mGlyphs.Resize(numGlyphs);
+
+            for (int i = 0; i < numGlyphs; ++i)
+            {
+                const uint8* rec = aData + FONT_HEADER_SIZE + i * FONT_GLYPH_SIZE;
+                Glyph& g = mGlyphs[i];
+                g.mCode = BigEndian::Load<uint16>(rec);
+                g.mX = BigEndian::Load<uint16>(rec + 2);
+                g.mY = BigEndian::Load<uint16>(rec + 4);
+                g.mWidth = rec[6];
+                g.mHeight = rec[7];
+                g.mBearingX = int8(rec[8]);
+                g.mBearingY = int8(rec[9]);
+                g.mAdvance = rec[10];
+                g.mKept = rec[11];
+
+                // a glyph without texels is only metrics
+                if (g.mWidth == 0 || g.mHeight == 0)
+                {
+                    g.mWidth = 0;
+                    g.mHeight = 0;
+                }
+
+                if (g.mX + g.mWidth > mWidth || g.mY + g.mHeight > mHeight)
+                    return false;
+
+                g.mRGBA.Resize(g.mWidth * g.mHeight * 4);
+
+                for (int y = 0; y < g.mHeight; ++y)
+                    memcpy(g.mRGBA.GetBuffer() + y * g.mWidth * 4, atlas.GetBuffer() + ((g.mY + y) * mWidth + g.mX) * 4, g.mWidth * 4);
+            }
+
+            return true;
+        }
+
+        void Write(C_Vector<uint8>& aOut) const
+        {
+            C_Vector<uint8> atlas;
+            atlas.Resize(mWidth * mHeight * 4, 0);
+
+            for (const Glyph& g : mGlyphs)
+            {
+                for (int y = 0; y < g.mHeight; ++y)
+                    memcpy(atlas.GetBuffer() + ((g.mY + y) * mWidth + g.mX) * 4, g.mRGBA.GetBuffer() + y * g.mWidth * 4, g.mWidth * 4);
+            }
+
+            const uint32 dataStart = GetDataStart(mGlyphs.Count());
+            aOut.Resize(dataStart + N64Texture::GetDataSize(mFormat, mWidth, mHeight), 0);
+
+            uint8* dst = aOut.GetBuffer();
+            BigEndian::Store<uint16>(dst, uint16(mGlyphs.Count()));
+            dst[2] = mFormatCode;
+            dst[3] = mKept;
+            BigEndian::Store<uint16>(dst + 4, uint16(mWidth));
+            BigEndian::Store<uint16>(dst + 6, uint16(mHeight));
+
+            for (int i = 0; i < mGlyphs.Count(); ++i)
+            {
+                const Glyph& g = mGlyphs[i];
+                uint8* rec = dst + FONT_HEADER_SIZE + i * FONT_GLYPH_SIZE;
+                BigEndian::Store<uint16>(rec, uint16(g.mCode));
+                BigEndian::Store<uint16>(rec + 2, uint16(g.mX));
+                BigEndian::Store<uint16>(rec + 4, uint16(g.mY));
+                rec[6] = uint8(g.mWidth);
+                rec[7] = uint8(g.mHeight);
+                rec[8] = uint8(int8(g.mBearingX));
+                rec[9] = uint8(int8(g.mBearingY));
+                rec[10] = uint8(g.mAdvance);
+                rec[11] = uint8(g.mKept);
+            }
+
+            N64Texture::Encode(mFormat, atlas.GetBuffer(), mWidth, mHeight, dst + dataStart, NULL);
+        }
+    };
+
+    // skyline bottom-left packing into a fixed width: every glyph goes where its top ends lowest, tallest
+    // glyphs first. returns the height used, -1 if a glyph is wider than the atlas
+    int PackGlyphs(C_Vector<Glyph>& aGlyphs, int aWidth)
+    {
+        struct Segment
+        {
+            int mX;
+            int mY;
+            int mWidth;
+        };
+
+        C_Vector<int> order;
+        order.Resize(aGlyphs.Count());
+
+        for (int i = 0; i < order.Count(); ++i)
+            order[i] = i;
+
+        std::stable_sort(order.GetBuffer(), order.GetBuffer() + order.Count(), [&](int a, int b)
+            {
+                if (aGlyphs[a].mHeight != aGlyphs[b].mHeight)
+                    return aGlyphs[a].mHeight > aGlyphs[b].mHeight;
+
+                return aGlyphs[a].mWidth > aGlyphs[b].mWidth;
+            });
+
+        C_Vector<Segment> skyline;
+        skyline.Add({ 0, 0, aWidth });
+        int height = 0;
+
+        for (int index : order)
+        {
+            Glyph& g = aGlyphs[index];
+
+            if (g.mWidth > aWidth)
+                return -1;
+
+            // empty glyphs only carry metrics
+            if (g.mWidth == 0 || g.mHeight == 0)
+            {
+                g.mX = 0;
+                g.mY = 0;
+                continue;
+            }
+
+            int bestSegment = -1;
+            int bestY = INT_MAX;
+
+            for (int s = 0; s < skyline.Count(); ++s)
+            {
+                if (skyline[s].mX + g.mWidth > aWidth)
+                    break;
+
+                // the glyph rests on the highest segment it spans
+                int y = 0;
+                int covered = 0;
+
+                for (int k = s; covered < g.mWidth; ++k)
+                {
+                    y = C_Max(y, skyline[k].mY);
+                    covered += skyline[k].mWidth;
+                }
+
+                if (y < bestY)
+                {
+                    bestY = y;
+                    bestSegment = s;
+                }
+            }
+
+            g.mX = skyline[bestSegment].mX;
+            g.mY = bestY;
+            height = C_Max(height, bestY + g.mHeight);
+
+            // the spanned segments become one at the glyph's top, a partly covered one keeps its right side
+            const int right = g.mX + g.mWidth;
+            int end = bestSegment;
+
+            while (end < skyline.Count() && skyline[end].mX + skyline[end].mWidth <= right)
+                ++end;
+
+            C_Vector<Segment> next;
+
+            for (int s = 0; s < bestSegment; ++s)
+                next.Add(skyline[s]);
+
+            next.Add({ g.mX, bestY + g.mHeight, g.mWidth });
+
+            if (end < skyline.Count() && skyline[end].mX < right)
+            {
+                next.Add({ right, skyline[end].mY, skyline[end].mX + skyline[end].mWidth - right });
+                ++end;
+            }
+
+            for (int s = end; s < skyline.Count(); ++s)
+                next.Add(skyline[s]);
+
+            // neighbours at the same height merge so wide glyphs find room
+            skyline.Clear();
+
+            for (const Segment& seg : next)
+            {
+                if (skyline.Count() > 0 && skyline[skyline.Count() - 1].mY == seg.mY)
+                    skyline[skyline.Count() - 1].mWidth += seg.mWidth;
+                else
+                    skyline.Add(seg);
+            }
+        }
+
+        return height;
+    }
+
+    string GetGlyphFile(int aIndex, int aCode)
+    {
+        return string(C_Strfmt<32>("%03i_%04X.png", aIndex, aCode));
+    }
+
+    uint64 HashGlyph(const Glyph& aGlyph, uint64 aHash)
+    {
+        const int metrics[] = { aGlyph.mCode, aGlyph.mWidth, aGlyph.mHeight, aGlyph.mBearingX, aGlyph.mBearingY, aGlyph.mAdvance, aGlyph.mKept };
+        aHash = BinUtils::Hash64(metrics, sizeof(metrics), aHash);
+        return BinUtils::Hash64(aGlyph.mRGBA.GetBuffer(), aGlyph.mRGBA.Count(), aHash);
+    }
+
+    string HashToString(uint64 aHash)
+    {
+        return string(C_Strfmt<32>("%08X%08X", uint32(aHash >> 32), uint32(aHash)));
+    }
+
+    string GetGlyphSetHash(const C_Vector<Glyph>& aGlyphs)
+    {
+        uint64 hash = 0;
+
+        for (const Glyph& g : aGlyphs)
+            hash = HashGlyph(g, hash);
+
+        return HashToString(hash);
+    }
+
+    // a glyph as it is in font.json and its png file, before decoding. the set's files hash matching the exported
+    // one means nothing was touched and no png has to be decoded
+    uint64 HashGlyphFile(const Glyph& aGlyph, const void* aPng, uint32 aPngSize, uint64 aHash)
+    {
+        const int metrics[] = { aGlyph.mCode, aGlyph.mBearingX, aGlyph.mBearingY, aGlyph.mAdvance, aGlyph.mKept };
+        aHash = BinUtils::Hash64(metrics, sizeof(metrics), aHash);
+        return aPngSize > 0 ? BinUtils::Hash64(aPng, aPngSize, aHash) : aHash;
+    }
+
+    // each glyph set to <NAME>/font.json with a png per glyph and the atlas for reference. the raw file is
+    // still written and used as is until a glyph changes
+    bool ExportFonts(FSTContext* aCtx)
+    {
+        for (const FontFile& font : sFontFiles)
+        {
+            if (!aCtx->IsFileSelected(font.mFile))
+                continue;
+
+            const uint8* data;
+            uint32 size;
+            C_Vector<uint8> storage;
+
+            if (!aCtx->GetFileData(font.mFile, data, size))
+            {
+                C_Stream& handle = aCtx->GetFileStream(font.mFile);
+                handle.Seek(C_FileSystem::SeekSet, 0);
+                BinUtils::ReadRemaining(handle, storage);
+                data = storage.GetBuffer();
+                size = storage.Count();
+            }
+
+            GlyphSet set;
+
+            if (!set.Read(data, size))
+            {
+                WAR_LOG_WARNING(CAT_GENERAL, "%s: unexpected glyph set layout, exporting the raw file only", font.mName);
+                continue;
+            }
+
+            C_FilePath dir(aCtx->GetBaseDir());
+            dir.Combine(font.mName);
+            C_FileSystem::DirectoryCreate(dir);
+
+            C_DataPack glyphsPack;
+            uint64 filesHash = 0;
+
+            for (int i = 0; i < set.mGlyphs.Count(); ++i)
+            {
+                const Glyph& g = set.mGlyphs[i];
+                const string file = GetGlyphFile(i, g.mCode);
+                C_Vector<uint8> encoded;
+
+                if (g.mWidth > 0 && g.mHeight > 0)
+                {
+                    PNG::Encode(g.mRGBA.GetBuffer(), g.mWidth, g.mHeight, 6, encoded);
+
+                    C_FilePath path(dir);
+                    path.Combine(file.c_str());
+
+                    if (!C_FileSystem::WriteFile(path, encoded.GetBuffer(), encoded.Count()))
+                    {
+                        WAR_LOG_ERROR(CAT_GENERAL, "Failed to write %s", (const char*)path);
+                        return false;
+                    }
+                }
+
+                filesHash = HashGlyphFile(g, encoded.GetBuffer(), encoded.Count(), filesHash);
+
+                C_DataPack glyphPack;
+                glyphPack.Set("Code", g.mCode);
+
+                if (g.mWidth > 0 && g.mHeight > 0)
+                    glyphPack.Set("Image", file);
+
+                glyphPack.Set("BearingX", g.mBearingX);
+                glyphPack.Set("BearingY", g.mBearingY);
+                glyphPack.Set("Advance", g.mAdvance);
+
+                if (g.mKept != 0)
+                    glyphPack.Set("Kept", g.mKept);
+
+                glyphsPack.Set(i, glyphPack);
+            }
+
+            C_Vector<uint8> atlas;
+            atlas.Resize(set.mWidth * set.mHeight * 4);
+            N64Texture::Decode(set.mFormat, data + GlyphSet::GetDataStart(set.mGlyphs.Count()), set.mWidth, set.mHeight, NULL, atlas.GetBuffer());
+
+            C_FilePath atlasPath(dir);
+            atlasPath.Combine("atlas.png");
+            PNG::Write(atlasPath, atlas.GetBuffer(), set.mWidth, set.mHeight);
+
+            C_DataPack pack;
+            pack.Set("Format", string(N64Texture::GetFormatName(set.mFormat)));
+            pack.Set("FormatCode", uint32(set.mFormatCode));
+            pack.Set("Kept", uint32(set.mKept));
+            pack.Set("Width", set.mWidth);
+            pack.Set("Hash", GetGlyphSetHash(set.mGlyphs));
+            pack.Set("FilesHash", HashToString(filesHash));
+            pack.Set("Glyphs", glyphsPack);
+
+            aCtx->WriteJson(pack, C_Strfmt<64>("%s/font.json", font.mName));
+        }
+
+        return true;
+    }
+
+    bool CompileFont(FSTContext* aCtx, const FontFile& aFont)
+    {
+        const C_Strfmt<64> jsonName("%s/font.json", aFont.mName);
+
+        C_FilePath dir(aCtx->GetBaseDir());
+        dir.Combine(aFont.mName);
+
+        C_FilePath jsonPath;
+        aCtx->FixFilePath(jsonName, jsonPath);
+
+        if (!C_FileSystem::Exists(jsonPath))
+            return true;
+
+        C_DataPack pack;
+
+        if (!aCtx->ReadJson(pack, jsonName))
+            return false;
+
+        GlyphSet set;
+        uint32 formatCode = 0;
+        uint32 kept = 0;
+        string hash;
+        string filesHash;
+        C_DataPack glyphsPack;
+        pack.Get("FormatCode", formatCode);
+        pack.Get("Kept", kept);
+        pack.Get("Width", set.mWidth);
+        pack.Get("Hash", hash);
+        pack.Get("FilesHash", filesHash);
+        pack.Get("Glyphs", glyphsPack);
+
+        set.mFormatCode = uint8(formatCode);
+        set.mKept = uint8(kept);
+        set.mFormat = GetTextureFormat(set.mFormatCode);
+
+        if (set.mFormat == N64Texture::NUM_FORMATS || N64Texture::GetNumTlutEntries(set.mFormat) > 0 || set.mWidth <= 0 || set.mWidth > 0xFFFF)
+        {
+            WAR_LOG_ERROR(CAT_GENERAL, "%s: bad atlas format or width", (const char*)jsonPath);
+            return false;
+        }
+
+        if (glyphsPack.NumEntries() == 0 || glyphsPack.NumEntries() > 0xFFFF)
+        {
+            WAR_LOG_ERROR(CAT_GENERAL, "%s: a glyph set holds 1 to 65535 glyphs, not %i", (const char*)jsonPath, glyphsPack.NumEntries());
+            return false;
+        }
+
+        set.mGlyphs.Resize(glyphsPack.NumEntries());
+
+        C_Vector<C_Ptr<C_MemBlock>> files;
+        files.Resize(set.mGlyphs.Count());
+
+        C_Vector<string> images;
+        images.Resize(set.mGlyphs.Count());
+
+        uint64 newFilesHash = 0;
+
+        for (int i = 0; i < set.mGlyphs.Count(); ++i)
+        {
+            C_DataPack glyphPack;
+            glyphsPack.Get(i, glyphPack);
+
+            Glyph& g = set.mGlyphs[i];
+            string& image = images[i];
+            glyphPack.Get("Code", g.mCode);
+            glyphPack.Get("Image", image);
+            glyphPack.Get("BearingX", g.mBearingX);
+            glyphPack.Get("BearingY", g.mBearingY);
+            glyphPack.Get("Advance", g.mAdvance);
+            glyphPack.Get("Kept", g.mKept);
+
+            if (g.mCode < 0 || g.mCode > 0xFFFF || g.mBearingX < -128 || g.mBearingX > 127 || g.mBearingY < -128 || g.mBearingY > 127 ||
+                g.mAdvance < 0 || g.mAdvance > 255 || g.mKept < 0 || g.mKept > 255)
+            {
+                WAR_LOG_ERROR(CAT_GENERAL, "%s: glyph %i has metrics out of range", (const char*)jsonPath, i);
+                return false;
+            }
+
+            if (image.length() > 0)
+            {
+                C_FilePath path(dir);
+                path.Combine(image.c_str());
+                files[i] = aCtx->ReadFile(path);
+
+                if (!files[i])
+                {
+                    WAR_LOG_ERROR(CAT_GENERAL, "Failed to read %s", (const char*)path);
+                    return false;
+                }
+            }
+
+            const C_MemBlock* file = files[i];
+            newFilesHash = HashGlyphFile(g, file ? file->mBlock : NULL, file ? file->mSize : 0, newFilesHash);
+        }
+
+        // untouched since the export, the raw file is kept without decoding any png
+        if (HashToString(newFilesHash) == filesHash)
+            return true;
+
+        for (int i = 0; i < set.mGlyphs.Count(); ++i)
+        {
+            Glyph& g = set.mGlyphs[i];
+            const C_Ptr<C_MemBlock>& file = files[i];
+
+            if (!file)
+                continue;
+
+            C_FilePath path(dir);
+            path.Combine(images[i].c_str());
+
+            if (!PNG::Decode((const uint8*)file->mBlock, file->mSize, g.mRGBA, g.mWidth, g.mHeight))
+            {
+                WAR_LOG_ERROR(CAT_GENERAL, "Failed to read %s", (const char*)path);
+                return false;
+            }
+
+            if (g.mWidth > 255 || g.mHeight > 255)
+            {
+                WAR_LOG_ERROR(CAT_GENERAL, "%s is %ix%i, glyphs are at most 255x255", (const char*)path, g.mWidth, g.mHeight);
+                return false;
+            }
+        }
+
+        // unchanged sets keep the raw file and its layout
+        if (GetGlyphSetHash(set.mGlyphs) == hash)
+            return true;
+
+        const int height = PackGlyphs(set.mGlyphs, set.mWidth);
+
+        if (height < 0)
+        {
+            WAR_LOG_ERROR(CAT_GENERAL, "%s: a glyph is wider than the %i texel atlas", (const char*)jsonPath, set.mWidth);
+            return false;
+        }
+
+        // whole tmem words
+        set.mHeight = C_Max(height, 1);
+
+        while (N64Texture::GetDataSize(set.mFormat, set.mWidth, set.mHeight) % 8 != 0)
+            ++set.mHeight;
+
+        if (set.mHeight > 0xFFFF)
+        {
+            WAR_LOG_ERROR(CAT_GENERAL, "%s: the glyphs need a %i texel high atlas", (const char*)jsonPath, set.mHeight);
+            return false;
+        }
+
+        const uint32 atlasSize = N64Texture::GetDataSize(set.mFormat, set.mWidth, set.mHeight);
+
+        if (atlasSize > FONT_TMEM_SIZE)
+            WAR_LOG_WARNING(CAT_GENERAL, "%s: the %ix%i atlas is %u bytes, more than tmem holds", (const char*)jsonPath, set.mWidth, set.mHeight, atlasSize);
+
+        C_Vector<uint8> data;
+        set.Write(data);
+
+        C_Stream& handle = aCtx->GetFileStream(aFont.mFile);
+        handle.WriteBytes(data.GetBuffer(), data.Count());
+
+        aCtx->MarkFileHandled(aFont.mFile);
+
+        WAR_LOG_INFO(CAT_GENERAL, "%s: packed %i glyphs into %ix%i", aFont.mName, set.mGlyphs.Count(), set.mWidth, set.mHeight);
+        return true;
+    }
+
+    bool CompileFonts(FSTContext* aCtx)
+    {
+        for (const FontFile& font : sFontFiles)
+        {
+            if (!aCtx->IsFileSelected(font.mFile))
+                continue;
+
+            if (!CompileFont(aCtx, font))
+                return false;
+        }
+
+        return true;
+    }
+}
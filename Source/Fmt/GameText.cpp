@@ -0,0 +1,299 @@
+#include "ROMFST.h"
+#include "C_DataPack.h"
+#include "C_FileSystem.h"
+#include "CL_Log.h"
+#include "BigEndian.h"
+#include "BinUtils.h"
+#include <algorithm>
+
+namespace FormatsInternal
+{
+    // text banks: u16 string count, u16 kept as is, a u32 offset per string from the bank start, then whatever
+    // sits before the strings (kept) and the nul terminated strings. offsets may point into another string
+    const uint32 TEXT_HEADER_SIZE = 4;
+
+    // printable ascii is kept, other bytes become <XX> and a literal < is <<
+    string EscapeText(const char* aText, uint32 aLength)
+    {
+        string out;
+
+        for (uint32 i = 0; i < aLength; ++i)
+        {
+            const uint8 c = uint8(aText[i]);
+
+            if (c == '<')
+                out += "<<";
+            else if (c >= 0x20 && c < 0x7F)
+                out += char(c);
+            else
+                out += C_Strfmt<8>("<%02X>", c);
+        }
+
+        return out;
+    }
+
+    bool UnescapeText(const string& aText, string& aOut)
+    {
+        aOut.clear();
+
+        for (size_t i = 0; i < aText.length(); ++i)
+        {
+            if (aText[i] != '<')
+            {
+                aOut += aText[i];
+                continue;
+            }
+
+            if (i + 1 < aText.length() && aText[i + 1] == '<')
+            {
+                aOut += '<';
+                ++i;
+                continue;
+            }
+
+            C_Vector<uint8> c;
+            if (i + 3 >= aText.length() || aText[i + 3] != '>' || !BinUtils::FromHex(aText.substr(i + 1, 2).c_str(), c) || c[0] == 0)
+                return false;
+
+            aOut += char(c[0]);
+            i += 3;
+        }
+
+        return true;
+    }
+
+    string GetTextHash(const C_Vector<string>& aStrings)
+    {
+        uint64 hash = 0;
+
+        for (const string& s : aStrings)
+            hash = BinUtils::Hash64(s.c_str(), uint32(s.length()) + 1, hash);
+
+        return string(C_Strfmt<32>("%08X%08X", uint32(hash >> 32), uint32(hash)));
+    }
+
+    struct TextBank
+    {
+        C_Vector<string> mStrings;
+        // from the end of the offset table to the first string
+        uint32 mPrefixStart = 0;
+        uint32 mPrefixEnd = 0;
+
+        bool Read(const uint8* aData, uint32 aSize)
+        {
+            if (aSize < TEXT_HEADER_SIZE)
+                return false;
+
+            const uint32 numStrings = BigEndian::Load<uint16>(aData);
+            const uint32 tableEnd = TEXT_HEADER_SIZE + numStrings * 4;
+
+            if (numStrings == 0 || tableEnd > aSize)
+                return false;
+
+            mPrefixStart = tableEnd;
+            mPrefixEnd = aSize;
+            mStrings.Resize(numStrings);
+
+            for (uint32 i = 0; i < numStrings; ++i)
+            {
+                const uint32 offset = BigEndian::Load<uint32>(aData + TEXT_HEADER_SIZE + i * 4);
+
+                if (offset < tableEnd || offset >= aSize)
+                    return false;
+
+                const uint8* end = (const uint8*)memchr(aData + offset, 0, aSize - offset);
+
+                if (!end)
+                    return false;
+
+                mStrings[i].assign((const char*)aData + offset, end - (aData + offset));
+                mPrefixEnd = C_Min(mPrefixEnd, offset);
+            }
+
+            // anything but padding between the strings would be lost on rebuild
+            C_Vector<uint8> used;
+            used.Resize(aSize - mPrefixEnd, 0);
+
+            for (uint32 i = 0; i < numStrings; ++i)
+            {
+                const uint32 offset = BigEndian::Load<uint32>(aData + TEXT_HEADER_SIZE + i * 4);
+                memset(used.GetBuffer() + offset - mPrefixEnd, 1, mStrings[i].length() + 1);
+            }
+
+            for (uint32 i = mPrefixEnd; i < aSize; ++i)
+            {
+                if (!used[i - mPrefixEnd] && aData[i] != 0)
+                    return false;
+            }
+
+            return true;
+        }
+    };
+
+    // lays the strings out once each, a string that ends another one points into it. aOutOffsets are from aOut's start
+    void PoolStrings(const C_Vector<string>& aStrings, C_Vector<uint8>& aOut, C_Vector<uint32>& aOutOffsets)
+    {
+        // reversed, a string sorts right before the strings it's a suffix of
+        C_Vector<string> reversed;
+        reversed.Resize(aStrings.Count());
+
+        for (int i = 0; i < aStrings.Count(); ++i)
+            reversed[i].assign(aStrings[i].rbegin(), aStrings[i].rend());
+
+        C_Vector<int> order;
+        order.Resize(aStrings.Count());
+
+        for (int i = 0; i < order.Count(); ++i)
+            order[i] = i;
+
+        std::stable_sort(order.GetBuffer(), order.GetBuffer() + order.Count(), [&](int a, int b) { return reversed[a] < reversed[b]; });
+
+        // the longest string ending with each one
+        C_Vector<int> host;
+        host.Resize(aStrings.Count());
+
+        for (int i = order.Count() - 1; i >= 0; --i)
+        {
+            const string& s = reversed[order[i]];
+            const bool shared = i + 1 < order.Count() && reversed[order[i + 1]].compare(0, s.length(), s) == 0;
+            host[order[i]] = shared ? host[order[i + 1]] : order[i];
+        }
+
+        // hosts go in first use order
+        C_Vector<int> hostOffsets;
+        hostOffsets.Resize(aStrings.Count(), -1);
+        aOutOffsets.Resize(aStrings.Count());
+
+        for (int i = 0; i < aStrings.Count(); ++i)
+        {
+            const int h = host[i];
+
+            if (hostOffsets[h] < 0)
+            {
+                hostOffsets[h] = aOut.Count();
+                const string& s = aStrings[h];
+                aOut.Resize(aOut.Count() + int(s.length()) + 1, 0);
+                memcpy(aOut.GetBuffer() + hostOffsets[h], s.c_str(), s.length());
+            }
+
+            aOutOffsets[i] = uint32(hostOffsets[h] + aStrings[h].length() - aStrings[i].length());
+        }
+    }
+
+    // GAMETEXT entries to <entry>.json
+    bool ExportTextBank(const uint8* aData, uint32 aSize, const char* aBasePath, C_DataPack& aOutInfo)
+    {
+        TextBank bank;
+
+        if (!bank.Read(aData, aSize))
+            return false;
+
+        C_DataPack strings;
+
+        for (int i = 0; i < bank.mStrings.Count(); ++i)
+            strings.Set(i, EscapeText(bank.mStrings[i].c_str(), uint32(bank.mStrings[i].length())));
+
+        C_DataPack text;
+        text.Set("Strings", strings);
+
+        const string path = string(aBasePath) + ".json";
+
+        if (!text.ToFileJson(path.c_str()))
+            return false;
+
+        C_FilePath fileName;
+        C_PathUtils::GetFilename(path.c_str(), fileName);
+
+        aOutInfo.Set("Text", string(fileName));
+        aOutInfo.Set("TextHash", GetTextHash(bank.mStrings));
+        return true;
+    }
+
+    // edited text banks are rebuilt with every distinct string stored once and suffixes shared
+    bool CompileTextBank(FSTContext* aCtx, const C_DataPack& aInfo, const char* aDir, C_Vector<uint8>& aData, bool& aOutModified)
+    {
+        string textFile;
+        string textHash;
+        aInfo.Get("Text", textFile);
+        aInfo.Get("TextHash", textHash);
+
+        C_FilePath path(aDir);
+        path.Combine(textFile.c_str());
+
+        if (textFile.length() == 0)
+            return true;
+
+        aCtx->AddDependency(path);
+
+        if (!C_FileSystem::Exists(path))
+            return true;
+
+        C_DataPack text;
+        C_DataPack stringsPack;
+
+        if (!text.FromFileJson(path) || !text.Get("Strings", stringsPack))
+        {
+            WAR_LOG_ERROR(CAT_GENERAL, "Failed to read %s", (const char*)path);
+            return false;
+        }
+
+        C_Vector<string> strings;
+        strings.Resize(stringsPack.NumEntries());
+
+        for (int i = 0; i < strings.Count(); ++i)
+        {
+            string escaped;
+            stringsPack.Get(i, escaped);
+
+            if (!UnescapeText(escaped, strings[i]))
+            {
+                WAR_LOG_ERROR(CAT_GENERAL, "%s: string %i has a bad <XX> escape", (const char*)path, i);
+                return false;
+            }
+        }
+
+        // unchanged banks keep their original layout
+        if (GetTextHash(strings) == textHash)
+            return true;
+
+        TextBank bank;
+
+        if (!bank.Read(aData.GetBuffer(), aData.Count()))
+        {
+            WAR_LOG_ERROR(CAT_GENERAL, "%s: the extracted bank it belongs to is invalid", (const char*)path);
+            return false;
+        }
+
+        if (strings.Count() == 0 || strings.Count() > 0xFFFF)
+        {
+            WAR_LOG_ERROR(CAT_GENERAL, "%s: a bank holds 1 to 65535 strings, not %i", (const char*)path, strings.Count());
+            return false;
+        }
+
+        const uint32 prefixSize = bank.mPrefixEnd - bank.mPrefixStart;
+        const uint32 poolStart = TEXT_HEADER_SIZE + strings.Count() * 4 + prefixSize;
+
+        C_Vector<uint8> pool;
+        C_Vector<uint32> offsets;
+        PoolStrings(strings, pool, offsets);
+
+        C_Vector<uint8> out;
+        out.Resize((poolStart + pool.Count() + 3) & ~3, 0);
+
+        uint8* dst = out.GetBuffer();
+        BigEndian::Store<uint16>(dst, uint16(strings.Count()));
+        memcpy(dst + 2, aData.GetBuffer() + 2, 2);
+
+        for (int i = 0; i < strings.Count(); ++i)
+            BigEndian::Store<uint32>(dst + TEXT_HEADER_SIZE + i * 4, poolStart + offsets[i]);
+
+        if (prefixSize > 0)
+            memcpy(dst + TEXT_HEADER_SIZE + strings.Count() * 4, aData.GetBuffer() + bank.mPrefixStart, prefixSize);
+
+        memcpy(dst + poolStart, pool.GetBuffer(), pool.Count());
+
+        aData = out;
+        aOutModified = true;
+        return true;
+    }
+}
@@ -1,6 +1,8 @@
 #include "C_Stream.h"
 #include "ROMFST.h"
 #include "C_DataPack.h"
+#include "BinUtils.h"
+#include "RecordSchema.h"
 
 namespace FormatsInternal
 {
@@ -13,67 +15,52 @@ namespace FormatsInternal
         int16 mNum0 = -1;
         int16 mNum1 = -1;
 
-        void Read(C_Stream& handle)
-        {
-            handle >> mCoordX;
-            handle >> mCoordZ;
-            handle >> mUnused;
-            handle >> mMapIndex;
-            handle >> mNum0;
-            handle >> mNum1;
-        }
+        // position of MapIndex in the schema's columns
+        static const int MAP_INDEX_COLUMN = 3;
 
-        void Write(C_Stream& handle) const
+        static const auto& GetSchema()
         {
-            handle << mCoordX;
-            handle << mCoordZ;
-            handle << mUnused;
-            handle << mMapIndex;
-            handle << mNum0;
-            handle << mNum1;
-        }
-
-        void Pack(C_DataPack& pack) const
-        {
-            pack.Set("CoordX", mCoordX);
-            pack.Set("CoordZ", mCoordZ);
-            pack.Set("Unk0", mUnused);
-            pack.Set("MapIndex", mMapIndex);
-            pack.Set("Unk1", mNum0);
-            pack.Set("Unk2", mNum1);
-        }
-
-        void Unpack(const C_DataPack& pack)
-        {
-            pack.Get("CoordX", mCoordX);
-            pack.Get("CoordZ", mCoordZ);
-            pack.Get("Unk0", mUnused);
-            pack.Get("MapIndex", mMapIndex);
-            pack.Get("Unk1", mNum0);
-            pack.Get("Unk2", mNum1);
+            static const auto sSchema = RecordSchema::Make<GlobalMapEntry>(
+                RecordSchema::MakeField("CoordX", &GlobalMapEntry::mCoordX),
+                RecordSchema::MakeField("CoordZ", &GlobalMapEntry::mCoordZ),
+                RecordSchema::MakeField("Unk0", &GlobalMapEntry::mUnused),
+                RecordSchema::MakeField("MapIndex", &GlobalMapEntry::mMapIndex),
+                RecordSchema::MakeField("Unk1", &GlobalMapEntry::mNum0),
+                RecordSchema::MakeField("Unk2", &GlobalMapEntry::mNum1));
+            return sSchema;
         }
     };
 
     bool ExportGlobalMap(FSTContext* aCtx)
     {
+        if (!aCtx->IsFileSelected(ROMFST::GLOBALMAP_BIN))
+            return true;
+
+        const auto& schema = GlobalMapEntry::GetSchema();
+
         C_Stream& handle = aCtx->GetFileStream(ROMFST::GLOBALMAP_BIN);
 
-        C_DataPack pack;
-        int id = 0;
+        C_Vector<uint8> data;
+        BinUtils::ReadRemaining(handle, data);
 
-        while (true)
-        {
-            GlobalMapEntry entry;
-            handle >> entry;
+        RecordSchema::ColumnsOf<decltype(schema)> columns;
+        schema.DecodeColumns(data.GetBuffer(), data.Count() / schema.SIZE, columns);
 
-            if (entry.mMapIndex == -1)
-                break;
+        // the table ends with an entry without a map
+        const C_Vector<int16>& mapIndex = std::get<GlobalMapEntry::MAP_INDEX_COLUMN>(columns);
 
-            C_DataPack packEntry;
-            entry.Pack(packEntry);
-            pack.Set(id++, packEntry);
+        for (int i = 0; i < mapIndex.Count(); ++i)
+        {
+            if (mapIndex[i] == -1)
+            {
+                schema.ResizeColumns(columns, i);
+                break;
+            }
         }
 
+        C_DataPack pack;
+        schema.PackColumns(pack, columns);
+
         aCtx->WriteJson(pack, "GLOBALMAP.json");
         aCtx->MarkFileHandled(ROMFST::GLOBALMAP_BIN);
 
@@ -82,33 +69,31 @@ namespace FormatsInternal
 
     bool CompileGlobalMap(FSTContext* aCtx)
     {
+        if (!aCtx->IsFileSelected(ROMFST::GLOBALMAP_BIN))
+            return true;
+
+        const auto& schema = GlobalMapEntry::GetSchema();
+
         C_DataPack pack;
 
         if (!aCtx->ReadJson(pack, "GLOBALMAP.json"))
             return false;
 
-        C_Vector<GlobalMapEntry> entries;
-        for (int i = 0; i < pack.NumEntries(); ++i)
-        {
-            GlobalMapEntry& mapEntry = entries.Add();
+        RecordSchema::ColumnsOf<decltype(schema)> columns;
+        schema.UnpackColumns(pack, columns);
 
-            C_DataPack packEntry;
-            pack.Get(i, packEntry);
-            mapEntry.Unpack(packEntry);
-        }
-
-        C_Stream& handle = aCtx->GetFileStream(ROMFST::GLOBALMAP_BIN);
+        C_Vector<uint8> data;
+        schema.EncodeColumns(columns, data);
 
-        for (GlobalMapEntry& entry : entries)
-        {
-            entry.Write(handle);
-        }
+        // terminator
+        data.Resize(data.Count() + schema.SIZE);
+        schema.Encode(data.GetBuffer() + data.Count() - schema.SIZE, GlobalMapEntry());
 
-        GlobalMapEntry eofEntry;
-        handle << eofEntry;
+        C_Stream& handle = aCtx->GetFileStream(ROMFST::GLOBALMAP_BIN);
+        handle.WriteBytes(data.GetBuffer(), data.Count());
 
         aCtx->MarkFileHandled(ROMFST::GLOBALMAP_BIN);
 
         return true;
     }
-}
\ No newline at end of file
+}
@@ -0,0 +1,267 @@
+#include "C_Stream.h"
+#include "C_FileSystem.h"
+#include "ROMFST.h"
+#include "TabBinArchive.h"
+#include "C_DataPack.h"
+#include "BigEndian.h"
+#include "BinUtils.h"
+#include "CL_Log.h"
+#include <unordered_map>
+
+namespace FormatsInternal
+{
+    const TabBinArchive::Desc* FindArchive(const char* aName);
+
+    // s16 tables indexed by id that point into an archive, -1 for unused ids
+    struct IndexTable
+    {
+        const char* mName;
+        ROMFST::File mFile;
+        const char* mArchive;
+    };
+
+    static const IndexTable sIndexTables[] =
+    {
+        { "OBJINDEX",   ROMFST::OBJINDEX_BIN,   "OBJECTS" },
+        { "MODELIND",   ROMFST::MODELIND_BIN,   "MODELS" },
+        { "TEXTABLE",   ROMFST::TEXTABLE_BIN,   "TEX0" },
+    };
+
+    const int16 NO_ENTRY = -1;
+
+    // the tables are compiled from their archive's index.json, so the archive's input feeds them too
+    void GetIndexTableDependents(int aFile, C_Vector<int>& aOut)
+    {
+        for (const IndexTable& table : sIndexTables)
+        {
+            const TabBinArchive::Desc* desc = FindArchive(table.mArchive);
+
+            if (desc && (desc->mTab == aFile || desc->mBin == aFile))
+                aOut.Add(table.mFile);
+        }
+    }
+
+    // ids naming an archive entry are stored as its file name, anything else as the raw value
+    bool ExportIndexTables(FSTContext* aCtx)
+    {
+        for (const IndexTable& table : sIndexTables)
+        {
+            if (!aCtx->IsFileSelected(table.mFile))
+                continue;
+
+            const TabBinArchive::Desc* desc = FindArchive(table.mArchive);
+            WAR_ASSERT(desc);
+
+            const int numEntries = TabBinArchive::GetNumEntries(aCtx, *desc);
+
+            C_Stream& handle = aCtx->GetFileStream(table.mFile);
+
+            C_Vector<uint8> data;
+            BinUtils::ReadRemaining(handle, data);
+
+            const int count = data.Count() / 2;
+
+            C_DataPack entries;
+            C_DataPack raw;
+
+            for (int i = 0; i < count; ++i)
+            {
+                const int16 value = BigEndian::Load<int16>(data.GetBuffer() + i * 2);
+
+                if (value == NO_ENTRY)
+                    continue;
+
+                C_DataPack entryPack;
+                entryPack.Set("Id", i);
+
+                if (value >= 0 && value < numEntries)
+                {
+                    entryPack.Set("File", string(C_Strfmt<64>(desc->mEntryFormat, int(value))));
+                    entries.Set(entries.NumEntries(), entryPack);
+                }
+                else
+                {
+                    entryPack.Set("Value", int(value));
+                    raw.Set(raw.NumEntries(), entryPack);
+                }
+            }
+
+            C_DataPack pack;
+            pack.Set("Archive", string(table.mArchive));
+            pack.Set("Count", count);
+            pack.Set("Entries", entries);
+            pack.Set("Raw", raw);
+
+            if (data.Count() & 1)
+                pack.Set("Tail", BinUtils::ToHex(data.GetBuffer() + count * 2, 1));
+
+            aCtx->WriteJson(pack, C_Strfmt<64>("%s.json", table.mName));
+            aCtx->MarkFileHandled(table.mFile);
+        }
+
+        return true;
+    }
+
+    // rebuilds a table against the archive's current entry list, ids past the original count grow the table
+    bool CompileIndexTable(FSTContext* aCtx, const IndexTable& aTable)
+    {
+        const C_Strfmt<64> jsonName("%s.json", aTable.mName);
+
+        // extractions made before the tables were converted still have the raw file
+        C_FilePath jsonPath;
+        aCtx->FixFilePath(jsonName, jsonPath);
+
+        if (!C_FileSystem::Exists(jsonPath))
+            return true;
+
+        C_DataPack pack;
+
+        if (!aCtx->ReadJson(pack, jsonName))
+            return false;
+
+        const TabBinArchive::Desc* desc = FindArchive(aTable.mArchive);
+        WAR_ASSERT(desc);
+
+        C_DataPack entries;
+        C_DataPack raw;
+        int count = 0;
+        string tail;
+        pack.Get("Entries", entries);
+        pack.Get("Raw", raw);
+        pack.Get("Count", count);
+        pack.Get("Tail", tail);
+
+        // file name to archive index, in one pass over the archive's index
+        std::unordered_map<string, int> indices;
+        C_Vector<string> files;
+
+        if (entries.NumEntries() > 0)
+        {
+            if (!TabBinArchive::GetEntryFiles(aCtx, *desc, files))
+            {
+                WAR_LOG_ERROR(CAT_GENERAL, "%s: %s was not split into entries, its names can't be resolved", aTable.mName, desc->mName);
+                return false;
+            }
+
+            indices.reserve(files.Count());
+
+            for (int i = 0; i < files.Count(); ++i)
+                indices.emplace(files[i], i);
+        }
+
+        C_Vector<int16> values;
+        values.Resize(C_Max(count, 0), NO_ENTRY);
+
+        bool valid = true;
+
+        auto setValue = [&](int aId, int aValue)
+        {
+            if (aId < 0 || aId > 0x7FFF)
+            {
+                WAR_LOG_ERROR(CAT_GENERAL, "%s: id %i is out of range", aTable.mName, aId);
+                valid = false;
+                return;
+            }
+
+            if (aId >= values.Count())
+                values.Resize(aId + 1, NO_ENTRY);
+
+            if (values[aId] != NO_ENTRY)
+            {
+                WAR_LOG_ERROR(CAT_GENERAL, "%s: id %i is set twice", aTable.mName, aId);
+                valid = false;
+                return;
+            }
+
+            values[aId] = int16(aValue);
+        };
+
+        for (int i = 0; i < entries.NumEntries(); ++i)
+        {
+            C_DataPack entryPack;
+            entries.Get(i, entryPack);
+
+            int id = -1;
+            string file;
+            entryPack.Get("Id", id);
+            entryPack.Get("File", file);
+
+            const auto it = indices.find(file);
+
+            if (it == indices.end())
+            {
+                WAR_LOG_ERROR(CAT_GENERAL, "%s: id %i names %s which is not in %s", aTable.mName, id, file.c_str(), desc->mName);
+                valid = false;
+                continue;
+            }
+
+            if (it->second > 0x7FFF)
+            {
+                WAR_LOG_ERROR(CAT_GENERAL, "%s: id %i names %s whose index %i doesn't fit", aTable.mName, id, file.c_str(), it->second);
+                valid = false;
+                continue;
+            }
+
+            setValue(id, it->second);
+        }
+
+        for (int i = 0; i < raw.NumEntries(); ++i)
+        {
+            C_DataPack entryPack;
+            raw.Get(i, entryPack);
+
+            int id = -1;
+            int value = NO_ENTRY;
+            entryPack.Get("Id", id);
+            entryPack.Get("Value", value);
+
+            if (value < -0x8000 || value > 0x7FFF)
+            {
+                WAR_LOG_ERROR(CAT_GENERAL, "%s: id %i has value %i which doesn't fit in 16 bits", aTable.mName, id, value);
+                valid = false;
+                continue;
+            }
+
+            setValue(id, value);
+        }
+
+        if (!valid)
+            return false;
+
+        C_Vector<uint8> data;
+        data.Resize(values.Count() * 2);
+
+        for (int i = 0; i < values.Count(); ++i)
+            BigEndian::Store<int16>(data.GetBuffer() + i * 2, values[i]);
+
+        // the odd trailing byte only survives when the table didn't grow
+        C_Vector<uint8> tailData;
+
+        if (values.Count() == count && tail.length() > 0 && BinUtils::FromHex(tail.c_str(), tailData))
+        {
+            for (int i = 0; i < tailData.Count(); ++i)
+                data.Add(tailData[i]);
+        }
+
+        C_Stream& handle = aCtx->GetFileStream(aTable.mFile);
+        handle.WriteBytes(data.GetBuffer(), data.Count());
+
+        aCtx->MarkFileHandled(aTable.mFile);
+
+        return true;
+    }
+
+    bool CompileIndexTables(FSTContext* aCtx)
+    {
+        for (const IndexTable& table : sIndexTables)
+        {
+            if (!aCtx->IsFileSelected(table.mFile))
+                continue;
+
+            if (!CompileIndexTable(aCtx, table))
+                return false;
+        }
+
+        return true;
+    }
+}
@@ -1,6 +1,8 @@
 #include "C_Stream.h"
 #include "ROMFST.h"
 #include "C_DataPack.h"
+#include "BinUtils.h"
+#include "RecordSchema.h"
 
 namespace FormatsInternal
 {
@@ -11,59 +13,34 @@ namespace FormatsInternal
         uint8 mUnk0 = 0x45;
         uint16 mUnk1 = 0;
 
-        void Read(C_Stream& handle)
+        static const auto& GetSchema()
         {
-            char nameBuff[29] = { 0 };
-            handle.ReadBytes(nameBuff, 28);
-            mName = nameBuff;
-            handle >> mMapType;
-            handle >> mUnk0;
-            handle >> mUnk1;
-        }
-
-        void Write(C_Stream& handle) const
-        {
-            char nameBuff[29] = { 0 };
-            strncpy(nameBuff, mName.c_str(), sizeof(nameBuff));
-            handle.WriteBytes(nameBuff, 28);
-            handle << mMapType;
-            handle << mUnk0;
-            handle << mUnk1;
-        }
-
-        void Pack(C_DataPack& pack) const
-        {
-            pack.Set("Name", mName);
-            pack.Set("Type", mMapType);
-            pack.Set("Unk0", mUnk0);
-            pack.Set("Unk1", mUnk1);
-        }
-
-        void Unpack(const C_DataPack& pack)
-        {
-            pack.Get("Name", mName);
-            pack.Get("Type", mMapType);
-            pack.Get("Unk0", mUnk0);
-            pack.Get("Unk1", mUnk1);
+            static const auto sSchema = RecordSchema::Make<MapInfoEntry>(
+                RecordSchema::MakeFixedString<28>("Name", &MapInfoEntry::mName),
+                RecordSchema::MakeField("Type", &MapInfoEntry::mMapType),
+                RecordSchema::MakeField("Unk0", &MapInfoEntry::mUnk0),
+                RecordSchema::MakeField("Unk1", &MapInfoEntry::mUnk1));
+            return sSchema;
         }
     };
 
     bool ExportMAPINFO(FSTContext* aCtx)
     {
+        if (!aCtx->IsFileSelected(ROMFST::MAPINFO_BIN))
+            return true;
+
+        const auto& schema = MapInfoEntry::GetSchema();
+
         C_Stream& handle = aCtx->GetFileStream(ROMFST::MAPINFO_BIN);
 
-        C_DataPack pack;
-        int id = 0;
+        C_Vector<uint8> data;
+        BinUtils::ReadRemaining(handle, data);
 
-        while (handle.GetRemaining() > 0)
-        {
-            MapInfoEntry entry;
-            handle >> entry;
+        RecordSchema::ColumnsOf<decltype(schema)> columns;
+        schema.DecodeColumns(data.GetBuffer(), data.Count() / schema.SIZE, columns);
 
-            C_DataPack packEntry;
-            entry.Pack(packEntry);
-            pack.Set(id++, packEntry);
-        }
+        C_DataPack pack;
+        schema.PackColumns(pack, columns);
 
         aCtx->WriteJson(pack, "MAPINFO.json");
         aCtx->MarkFileHandled(ROMFST::MAPINFO_BIN);
@@ -73,30 +50,27 @@ namespace FormatsInternal
 
     bool CompileMAPINFO(FSTContext* aCtx)
     {
+        if (!aCtx->IsFileSelected(ROMFST::MAPINFO_BIN))
+            return true;
+
+        const auto& schema = MapInfoEntry::GetSchema();
+
         C_DataPack pack;
 
         if (!aCtx->ReadJson(pack, "MAPINFO.json"))
             return false;
 
-        C_Vector<MapInfoEntry> entries;
-        for (int i = 0; i < pack.NumEntries(); ++i)
-        {
-            MapInfoEntry& mapEntry = entries.Add();
+        RecordSchema::ColumnsOf<decltype(schema)> columns;
+        schema.UnpackColumns(pack, columns);
 
-            C_DataPack packEntry;
-            pack.Get(i, packEntry);
-            mapEntry.Unpack(packEntry);
-        }
+        C_Vector<uint8> data;
+        schema.EncodeColumns(columns, data);
 
         C_Stream& handle = aCtx->GetFileStream(ROMFST::MAPINFO_BIN);
-
-        for (MapInfoEntry& entry : entries)
-        {
-            entry.Write(handle);
-        }
+        handle.WriteBytes(data.GetBuffer(), data.Count());
 
         aCtx->MarkFileHandled(ROMFST::MAPINFO_BIN);
 
         return true;
     }
-}
\ No newline at end of file
+}
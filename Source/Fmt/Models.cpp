@@ -0,0 +1,487 @@
+#include "C_FileSystem.h"
+#include "TabBinArchive.h"
+#include "C_DataPack.h"
+#include "BigEndian.h"
+#include "CL_Log.h"
+#include "JobPool.h"
+#include "MappedFile.h"
+#include <atomic>
+#include <unordered_map>
+
+namespace FormatsInternal
+{
+    const TabBinArchive::Desc* FindArchive(const char* aName);
+
+    // model header, the pointers are offsets from the model start until it's loaded
+    const uint32 MODEL_TEXTURES = 0x20;
+    const uint32 MODEL_VERTICES = 0x28;
+    const uint32 MODEL_DISPLAY_LIST = 0x30;
+    const uint32 MODEL_HEADER_SIZE = 0x34;
+
+    // Vtx: s16 xyz, u16 flag, s16 st in 10.5, u8 rgba
+    const uint32 MODEL_VERTEX_SIZE = 0x10;
+
+    // f3dex2 commands the mesh is built from, the rest is render state
+    const uint8 G_VTX = 0x01;
+    const uint8 G_TRI1 = 0x05;
+    const uint8 G_TRI2 = 0x06;
+    const uint8 G_QUAD = 0x07;
+    const uint8 G_ENDDL = 0xDF;
+    const uint8 G_SETTIMG = 0xFD;
+    const int VERTEX_CACHE_SIZE = 32;
+
+    // the display list walk of one model. G_VTX addresses are offsets into the model's vertices and G_SETTIMG
+    // addresses are slots of its texture list
+    struct ModelMesh
+    {
+        struct Primitive
+        {
+            int mTexture = -1;
+            C_Vector<uint16> mIndices;
+        };
+
+        const uint8* mVertices = NULL;
+        int mNumVertices = 0;
+        C_Vector<Primitive> mPrimitives;
+        C_Vector<uint32> mTextureIds;
+
+        bool Read(const uint8* aData, uint32 aSize)
+        {
+            if (aSize < MODEL_HEADER_SIZE)
+                return false;
+
+            const uint32 textures = BigEndian::Load<uint32>(aData + MODEL_TEXTURES);
+            const uint32 vertices = BigEndian::Load<uint32>(aData + MODEL_VERTICES);
+            const uint32 displayList = BigEndian::Load<uint32>(aData + MODEL_DISPLAY_LIST);
+
+            if (vertices < MODEL_HEADER_SIZE || vertices >= aSize || displayList < MODEL_HEADER_SIZE || displayList >= aSize)
+                return false;
+
+            mVertices = aData + vertices;
+            const uint32 maxVertices = C_Min((aSize - vertices) / MODEL_VERTEX_SIZE, uint32(0x10000));
+
+            int cache[VERTEX_CACHE_SIZE];
+            for (int& slot : cache)
+                slot = -1;
+
+            int texture = -1;
+            int maxTexture = -1;
+            int primitive = -1;
+            bool ended = false;
+
+            auto addTri = [&](uint32 aWord)
+            {
+                const uint32 a = ((aWord >> 16) & 0xFF) / 2;
+                const uint32 b = ((aWord >> 8) & 0xFF) / 2;
+                const uint32 c = (aWord & 0xFF) / 2;
+
+                if (a >= VERTEX_CACHE_SIZE || b >= VERTEX_CACHE_SIZE || c >= VERTEX_CACHE_SIZE || cache[a] < 0 || cache[b] < 0 || cache[c] < 0)
+                    return false;
+
+                if (primitive < 0 || mPrimitives[primitive].mTexture != texture)
+                {
+                    primitive = -1;
+
+                    for (int i = 0; i < mPrimitives.Count() && primitive < 0; ++i)
+                        primitive = mPrimitives[i].mTexture == texture ? i : -1;
+
+                    if (primitive < 0)
+                    {
+                        primitive = mPrimitives.Count();
+                        mPrimitives.Add().mTexture = texture;
+                    }
+                }
+
+                C_Vector<uint16>& indices = mPrimitives[primitive].mIndices;
+                indices.Add(uint16(cache[a]));
+                indices.Add(uint16(cache[b]));
+                indices.Add(uint16(cache[c]));
+                return true;
+            };
+
+            for (uint32 pos = displayList; pos + 8 <= aSize && !ended; pos += 8)
+            {
+                const uint32 w0 = BigEndian::Load<uint32>(aData + pos);
+                const uint32 w1 = BigEndian::Load<uint32>(aData + pos + 4);
+
+                switch (w0 >> 24)
+                {
+                    case G_VTX:
+                    {
+                        const uint32 count = (w0 >> 12) & 0xFF;
+                        const uint32 end = (w0 >> 1) & 0x7F;
+                        const uint32 offset = w1 & 0x00FFFFFF;
+
+                        if (count > end || end > VERTEX_CACHE_SIZE || offset % MODEL_VERTEX_SIZE != 0)
+                            return false;
+
+                        const uint32 first = offset / MODEL_VERTEX_SIZE;
+
+                        if (first + count > maxVertices)
+                            return false;
+
+                        for (uint32 i = 0; i < count; ++i)
+                            cache[end - count + i] = int(first + i);
+
+                        mNumVertices = C_Max(mNumVertices, int(first + count));
+                        break;
+                    }
+
+                    case G_TRI1:
+                    {
+                        if (!addTri(w0))
+                            return false;
+
+                        break;
+                    }
+
+                    case G_TRI2:
+                    case G_QUAD:
+                    {
+                        if (!addTri(w0) || !addTri(w1))
+                            return false;
+
+                        break;
+                    }
+
+                    case G_SETTIMG:
+                    {
+                        texture = int(w1 & 0x00FFFFFF);
+                        maxTexture = C_Max(maxTexture, texture);
+                        break;
+                    }
+
+                    case G_ENDDL:
+                    {
+                        ended = true;
+                        break;
+                    }
+                }
+            }
+
+            if (!ended || mPrimitives.Count() == 0)
+                return false;
+
+            // the texture list is as long as the highest slot used
+            if (maxTexture >= 0)
+            {
+                if (textures < MODEL_HEADER_SIZE || textures > aSize || uint32(maxTexture + 1) > (aSize - textures) / 4)
+                    return false;
+
+                mTextureIds.Resize(maxTexture + 1);
+
+                for (int i = 0; i <= maxTexture; ++i)
+                    mTextureIds[i] = BigEndian::Load<uint32>(aData + textures + i * 4);
+            }
+
+            return true;
+        }
+    };
+
+    struct ModelTexture
+    {
+        string mImage;
+        int mWidth = 0;
+        int mHeight = 0;
+    };
+
+    // TEXTABLE id to the TEX0 png it names, from what was extracted before the models
+    void ReadModelTextures(const char* aDir, C_Vector<ModelTexture>& aOut)
+    {
+        C_FilePath tablePath(aDir);
+        tablePath.Combine("../TEXTABLE.json");
+
+        C_FilePath texIndexPath(aDir);
+        texIndexPath.Combine("../TEX0/index.json");
+
+        C_DataPack table;
+        C_DataPack texIndex;
+
+        if (!C_FileSystem::Exists(tablePath) || !C_FileSystem::Exists(texIndexPath) || !table.FromFileJson(tablePath) || !texIndex.FromFileJson(texIndexPath))
+            return;
+
+        std::unordered_map<string, ModelTexture> images;
+        C_DataPack texEntries;
+        texIndex.Get("Entries", texEntries);
+
+        for (int i = 0; i < texEntries.NumEntries(); ++i)
+        {
+            C_DataPack entryPack;
+            C_DataPack converted;
+            texEntries.Get(i, entryPack);
+
+            if (!entryPack.Get("Converted", converted))
+                continue;
+
+            string file;
+            ModelTexture tex;
+            entryPack.Get("File", file);
+            converted.Get("Image", tex.mImage);
+            converted.Get("Width", tex.mWidth);
+            converted.Get("Height", tex.mHeight);
+            tex.mImage = "../TEX0/" + tex.mImage;
+            images.emplace(file, tex);
+        }
+
+        C_DataPack tableEntries;
+        table.Get("Entries", tableEntries);
+
+        for (int i = 0; i < tableEntries.NumEntries(); ++i)
+        {
+            C_DataPack entryPack;
+            tableEntries.Get(i, entryPack);
+
+            int id = -1;
+            string file;
+            entryPack.Get("Id", id);
+            entryPack.Get("File", file);
+
+            const auto it = images.find(file);
+
+            if (id < 0 || it == images.end() || it->second.mWidth <= 0 || it->second.mHeight <= 0)
+                continue;
+
+            if (id >= aOut.Count())
+                aOut.Resize(id + 1);
+
+            aOut[id] = it->second;
+        }
+    }
+
+    void StoreLE32(uint8* aDst, uint32 aValue)
+    {
+        aDst[0] = uint8(aValue);
+        aDst[1] = uint8(aValue >> 8);
+        aDst[2] = uint8(aValue >> 16);
+        aDst[3] = uint8(aValue >> 24);
+    }
+
+    void StoreLEFloat(uint8* aDst, float aValue)
+    {
+        uint32 bits;
+        memcpy(&bits, &aValue, 4);
+        StoreLE32(aDst, bits);
+    }
+
+    uint32 Align4(uint32 aValue)
+    {
+        return (aValue + 3) & ~3;
+    }
+
+    // one mesh with a primitive per texture. uvs stay in texels and the material scales them with
+    // KHR_texture_transform, so a vertex shared by textures of different sizes stays one vertex
+    bool WriteModelGLB(const ModelMesh& aMesh, const C_Vector<ModelTexture>& aTextures, const char* aPath)
+    {
+        const uint32 numVertices = uint32(aMesh.mNumVertices);
+        const uint32 posOffset = 0;
+        const uint32 colorOffset = posOffset + numVertices * 12;
+        const uint32 uvOffset = colorOffset + numVertices * 4;
+        uint32 binSize = uvOffset + numVertices * 8;
+
+        C_Vector<uint32> indexOffsets;
+
+        for (const ModelMesh::Primitive& prim : aMesh.mPrimitives)
+        {
+            indexOffsets.Add(binSize);
+            binSize = Align4(binSize + prim.mIndices.Count() * 2);
+        }
+
+        float minPos[3] = { 0, 0, 0 };
+        float maxPos[3] = { 0, 0, 0 };
+
+        for (uint32 i = 0; i < numVertices; ++i)
+        {
+            for (int k = 0; k < 3; ++k)
+            {
+                const float v = BigEndian::Load<int16>(aMesh.mVertices + i * MODEL_VERTEX_SIZE + k * 2);
+                minPos[k] = i == 0 ? v : C_Min(minPos[k], v);
+                maxPos[k] = i == 0 ? v : C_Max(maxPos[k], v);
+            }
+        }
+
+        // materials and images in first use order
+        string materials;
+        string images;
+        string textures;
+        C_Vector<int> primMaterials;
+        std::unordered_map<int, int> slotMaterials;
+        std::unordered_map<string, int> imageIndices;
+        int numMaterials = 0;
+        bool transformed = false;
+
+        for (const ModelMesh::Primitive& prim : aMesh.mPrimitives)
+        {
+            const auto found = slotMaterials.find(prim.mTexture);
+
+            if (found != slotMaterials.end())
+            {
+                primMaterials.Add(found->second);
+                continue;
+            }
+
+            const uint32 id = prim.mTexture >= 0 ? aMesh.mTextureIds[prim.mTexture] : 0xFFFFFFFF;
+            const ModelTexture* tex = id < uint32(aTextures.Count()) && aTextures[id].mWidth > 0 ? &aTextures[id] : NULL;
+
+            if (numMaterials > 0)
+                materials += ",";
+
+            if (tex)
+            {
+                auto image = imageIndices.find(tex->mImage);
+
+                if (image == imageIndices.end())
+                {
+                    const int index = int(imageIndices.size());
+                    image = imageIndices.emplace(tex->mImage, index).first;
+                    images += C_Strfmt<256>("%s{\"uri\":\"%s\"}", index > 0 ? "," : "", tex->mImage.c_str());
+                    textures += C_Strfmt<64>("%s{\"source\":%i}", index > 0 ? "," : "", index);
+                }
+
+                materials += C_Strfmt<384>("{\"pbrMetallicRoughness\":{\"baseColorTexture\":{\"index\":%i,\"extensions\":{\"KHR_texture_transform\":"
+                    "{\"scale\":[%.9g,%.9g]}}},\"metallicFactor\":0},\"doubleSided\":true}", image->second, 1.0 / tex->mWidth, 1.0 / tex->mHeight);
+                transformed = true;
+            }
+            else
+            {
+                materials += "{\"pbrMetallicRoughness\":{\"metallicFactor\":0},\"doubleSided\":true}";
+            }
+
+            slotMaterials.emplace(prim.mTexture, numMaterials);
+            primMaterials.Add(numMaterials++);
+        }
+
+        string json;
+        json += "{\"asset\":{\"version\":\"2.0\",\"generator\":\"dinofst\"},";
+
+        if (transformed)
+            json += "\"extensionsUsed\":[\"KHR_texture_transform\"],";
+
+        json += "\"scene\":0,\"scenes\":[{\"nodes\":[0]}],\"nodes\":[{\"mesh\":0}],\"meshes\":[{\"primitives\":[";
+
+        // accessors 0-2 are the vertex attributes, then the indices of each primitive
+        for (int p = 0; p < aMesh.mPrimitives.Count(); ++p)
+        {
+            json += C_Strfmt<160>("%s{\"attributes\":{\"POSITION\":0,\"COLOR_0\":1,\"TEXCOORD_0\":2},\"indices\":%i,\"material\":%i}",
+                p > 0 ? "," : "", 3 + p, primMaterials[p]);
+        }
+
+        json += "]}],\"materials\":[" + materials + "]";
+
+        if (images.length() > 0)
+            json += ",\"textures\":[" + textures + "],\"images\":[" + images + "]";
+
+        json += C_Strfmt<64>(",\"buffers\":[{\"byteLength\":%u}],\"bufferViews\":[", binSize);
+        json += C_Strfmt<96>("{\"buffer\":0,\"byteOffset\":%u,\"byteLength\":%u,\"target\":34962},", posOffset, numVertices * 12);
+        json += C_Strfmt<96>("{\"buffer\":0,\"byteOffset\":%u,\"byteLength\":%u,\"target\":34962},", colorOffset, numVertices * 4);
+        json += C_Strfmt<96>("{\"buffer\":0,\"byteOffset\":%u,\"byteLength\":%u,\"target\":34962}", uvOffset, numVertices * 8);
+
+        for (int p = 0; p < aMesh.mPrimitives.Count(); ++p)
+            json += C_Strfmt<96>(",{\"buffer\":0,\"byteOffset\":%u,\"byteLength\":%u,\"target\":34963}", indexOffsets[p], aMesh.mPrimitives[p].mIndices.Count() * 2);
+
+        json += "],\"accessors\":[";
+        json += C_Strfmt<256>("{\"bufferView\":0,\"componentType\":5126,\"count\":%u,\"type\":\"VEC3\",\"min\":[%g,%g,%g],\"max\":[%g,%g,%g]},",
+            numVertices, minPos[0], minPos[1], minPos[2], maxPos[0], maxPos[1], maxPos[2]);
+        json += C_Strfmt<128>("{\"bufferView\":1,\"componentType\":5121,\"normalized\":true,\"count\":%u,\"type\":\"VEC4\"},", numVertices);
+        json += C_Strfmt<128>("{\"bufferView\":2,\"componentType\":5126,\"count\":%u,\"type\":\"VEC2\"}", numVertices);
+
+        for (int p = 0; p < aMesh.mPrimitives.Count(); ++p)
+            json += C_Strfmt<128>(",{\"bufferView\":%i,\"componentType\":5123,\"count\":%i,\"type\":\"SCALAR\"}", 3 + p, aMesh.mPrimitives[p].mIndices.Count());
+
+        json += "]}";
+
+        // glb: header, json chunk padded with spaces, bin chunk
+        const uint32 jsonSize = Align4(uint32(json.length()));
+        const uint32 binStart = 12 + 8 + jsonSize + 8;
+        const uint32 totalSize = binStart + binSize;
+
+        MappedFile file;
+
+        if (!file.Create(aPath, totalSize))
+            return false;
+
+        uint8* out = file.GetData();
+        StoreLE32(out, 0x46546C67);
+        StoreLE32(out + 4, 2);
+        StoreLE32(out + 8, totalSize);
+        StoreLE32(out + 12, jsonSize);
+        StoreLE32(out + 16, 0x4E4F534A);
+        memcpy(out + 20, json.c_str(), json.length());
+        memset(out + 20 + json.length(), ' ', jsonSize - json.length());
+        StoreLE32(out + binStart - 8, binSize);
+        StoreLE32(out + binStart - 4, 0x004E4942);
+
+        // vertices go straight into the mapping, the file is as big as it'll be
+        uint8* bin = out + binStart;
+
+        for (uint32 i = 0; i < numVertices; ++i)
+        {
+            const uint8* vertex = aMesh.mVertices + i * MODEL_VERTEX_SIZE;
+
+            for (int k = 0; k < 3; ++k)
+                StoreLEFloat(bin + posOffset + i * 12 + k * 4, BigEndian::Load<int16>(vertex + k * 2));
+
+            memcpy(bin + colorOffset + i * 4, vertex + 12, 4);
+            StoreLEFloat(bin + uvOffset + i * 8, BigEndian::Load<int16>(vertex + 8) / 32.0f);
+            StoreLEFloat(bin + uvOffset + i * 8 + 4, BigEndian::Load<int16>(vertex + 10) / 32.0f);
+        }
+
+        for (int p = 0; p < aMesh.mPrimitives.Count(); ++p)
+        {
+            const C_Vector<uint16>& indices = aMesh.mPrimitives[p].mIndices;
+            uint8* dst = bin + indexOffsets[p];
+
+            for (int i = 0; i < indices.Count(); ++i)
+            {
+                dst[i * 2] = uint8(indices[i]);
+                dst[i * 2 + 1] = uint8(indices[i] >> 8);
+            }
+
+            // padding up to the next view
+            memset(dst + indices.Count() * 2, 0, Align4(indices.Count() * 2) - indices.Count() * 2);
+        }
+
+        return true;
+    }
+
+    // MODELS entries to a .glb per model, one model per job. texture slots resolve through TEXTABLE to the
+    // TEX0 pngs, so both have to be extracted before the models
+    bool ExportModels(const C_Vector<TabBinArchive::EntryData>& aEntries, const char* aDir, C_DataPack& aOutInfo)
+    {
+        const TabBinArchive::Desc* desc = FindArchive("MODELS");
+        WAR_ASSERT(desc);
+
+        C_Vector<ModelTexture> textures;
+        ReadModelTextures(aDir, textures);
+
+        if (textures.Count() == 0)
+            WAR_LOG_WARNING(CAT_GENERAL, "%s: no TEXTABLE.json or TEX0 images, models are exported untextured", aDir);
+
+        std::atomic<int> numWritten(0);
+
+        JobPool::GetInstance().ParallelFor(aEntries.Count(), [&](int i)
+            {
+                C_Vector<uint8> storage;
+                const uint8* data;
+                uint32 size;
+
+                ModelMesh mesh;
+
+                if (!aEntries[i].Get(storage, data, size) || !mesh.Read(data, size))
+                    return;
+
+                C_FilePath baseName;
+                C_PathUtils::GetFilenameWithoutExtension(C_Strfmt<64>(desc->mEntryFormat, i), baseName);
+
+                C_FilePath path(aDir);
+                path.Combine(C_Strfmt<64>("%s.glb", (const char*)baseName));
+
+                if (WriteModelGLB(mesh, textures, path))
+                    ++numWritten;
+            });
+
+        WAR_LOG_INFO(CAT_GENERAL, "%s: converted %i of %i models to glb", aDir, int(numWritten), aEntries.Count());
+
+        aOutInfo.Set("Models", int(numWritten));
+        return true;
+    }
+}
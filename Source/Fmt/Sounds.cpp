@@ -0,0 +1,652 @@
+#include "ROMFST.h"
+#include "TabBinArchive.h"
+#include "C_DataPack.h"
+#include "C_FileSystem.h"
+#include "C_MemBlock.h"
+#include "CL_Log.h"
+#include "BigEndian.h"
+#include "BinUtils.h"
+#include "JobPool.h"
+#include "VADPCM.h"
+#include "WAV.h"
+#include <atomic>
+
+namespace FormatsInternal
+{
+    // libultra sound banks. a .ctl entry (ALBankFile) is followed by the .tbl entry holding its wave data,
+    // offsets inside the .ctl are relative to its start and wave bases to the start of the .tbl
+    const uint16 BANK_FILE_REVISION = 0x4231;
+
+    const uint32 BANK_HEADER_SIZE = 12;
+    const uint32 INSTRUMENT_HEADER_SIZE = 16;
+    const uint32 SOUND_SIZE = 16;
+    const uint32 WAVETABLE_SIZE = 20;
+    const uint32 ADPCM_LOOP_SIZE = 44;
+    const uint32 RAW_LOOP_SIZE = 12;
+
+    enum WaveType
+    {
+        WAVE_ADPCM,
+        WAVE_RAW16,
+    };
+
+    static const char* sWaveDir = "wav";
+    // encoded sounds keyed by the wav and the book they were made for, kept between builds
+    static const char* sWaveCacheDir = ".acache";
+
+    struct Wave
+    {
+        int mCtl = 0;
+        uint32 mOffset = 0;
+        uint32 mSampleRate = 0;
+        string mFile;
+    };
+
+    // bounds checked big-endian reads from a .ctl
+    struct CtlReader
+    {
+        const uint8* mData;
+        uint32 mSize;
+
+        bool Has(uint32 aOffset, uint32 aSize) const { return aOffset <= mSize && aSize <= mSize - aOffset; }
+
+        uint8 U8(uint32 aOffset) const { return mData[aOffset]; }
+        uint16 U16(uint32 aOffset) const { return BigEndian::Load<uint16>(mData + aOffset); }
+        uint32 U32(uint32 aOffset) const { return BigEndian::Load<uint32>(mData + aOffset); }
+    };
+
+    bool IsBankFile(const TabBinArchive::EntryData& aEntry)
+    {
+        return aEntry.mSize >= 4 && BigEndian::Load<uint16>(aEntry.mData) == BANK_FILE_REVISION;
+    }
+
+    void AddWave(int aCtl, uint32 aOffset, uint32 aSampleRate, C_Vector<Wave>& aWaves, int aFirstWave)
+    {
+        for (int i = aFirstWave; i < aWaves.Count(); ++i)
+        {
+            if (aWaves[i].mOffset == aOffset)
+                return;
+        }
+
+        Wave& wave = aWaves.Add();
+        wave.mCtl = aCtl;
+        wave.mOffset = aOffset;
+        wave.mSampleRate = aSampleRate;
+        wave.mFile = string(C_Strfmt<64>("%s/%04i_%03i.wav", sWaveDir, aCtl, aWaves.Count() - 1 - aFirstWave));
+    }
+
+    bool AddInstrumentWaves(const CtlReader& aCtl, int aCtlIndex, uint32 aOffset, uint32 aSampleRate, C_Vector<Wave>& aWaves, int aFirstWave)
+    {
+        if (!aCtl.Has(aOffset, INSTRUMENT_HEADER_SIZE))
+            return false;
+
+        const int numSounds = aCtl.U16(aOffset + 14);
+
+        if (!aCtl.Has(aOffset + INSTRUMENT_HEADER_SIZE, numSounds * 4))
+            return false;
+
+        for (int s = 0; s < numSounds; ++s)
+        {
+            const uint32 sound = aCtl.U32(aOffset + INSTRUMENT_HEADER_SIZE + s * 4);
+
+            if (!aCtl.Has(sound, SOUND_SIZE))
+                return false;
+
+            const uint32 wave = aCtl.U32(sound + 8);
+
+            if (!aCtl.Has(wave, WAVETABLE_SIZE))
+                return false;
+
+            AddWave(aCtlIndex, wave, aSampleRate, aWaves, aFirstWave);
+        }
+
+        return true;
+    }
+
+    // every distinct wavetable of the banks in a .ctl
+    bool GetBankWaves(const CtlReader& aCtl, int aCtlIndex, C_Vector<Wave>& aWaves)
+    {
+        const int firstWave = aWaves.Count();
+        const int numBanks = aCtl.U16(2);
+
+        if (!aCtl.Has(4, numBanks * 4))
+            return false;
+
+        for (int b = 0; b < numBanks; ++b)
+        {
+            const uint32 bank = aCtl.U32(4 + b * 4);
+
+            if (!aCtl.Has(bank, BANK_HEADER_SIZE))
+                return false;
+
+            const int numInstruments = aCtl.U16(bank);
+            const uint32 sampleRate = aCtl.U32(bank + 4);
+            const uint32 percussion = aCtl.U32(bank + 8);
+
+            if (!aCtl.Has(bank + BANK_HEADER_SIZE, numInstruments * 4))
+                return false;
+
+            if (percussion != 0 && !AddInstrumentWaves(aCtl, aCtlIndex, percussion, sampleRate, aWaves, firstWave))
+                return false;
+
+            for (int i = 0; i < numInstruments; ++i)
+            {
+                // unused program slots are null
+                const uint32 inst = aCtl.U32(bank + BANK_HEADER_SIZE + i * 4);
+
+                if (inst != 0 && !AddInstrumentWaves(aCtl, aCtlIndex, inst, sampleRate, aWaves, firstWave))
+                    return false;
+            }
+        }
+
+        return true;
+    }
+
+    bool ReadBook(const CtlReader& aCtl, uint32 aOffset, VADPCM::Book& aOut)
+    {
+        if (!aCtl.Has(aOffset, 8))
+            return false;
+
+        aOut.mOrder = int(aCtl.U32(aOffset));
+        aOut.mNumPredictors = int(aCtl.U32(aOffset + 4));
+
+        if (aOut.mOrder <= 0 || aOut.mOrder > VADPCM::MAX_ORDER ||
+            aOut.mNumPredictors <= 0 || aOut.mNumPredictors > VADPCM::MAX_PREDICTORS)
+            return false;
+
+        const int numCoefs = aOut.mOrder * aOut.mNumPredictors * 8;
+
+        if (!aCtl.Has(aOffset + 8, numCoefs * 2))
+            return false;
+
+        aOut.mCoefs.Resize(numCoefs);
+
+        for (int i = 0; i < numCoefs; ++i)
+            aOut.mCoefs[i] = int16(aCtl.U16(aOffset + 8 + i * 2));
+
+        return aOut.IsValid();
+    }
+
+    // decodes a wavetable to pcm, fills aOutLoop and returns true in aOutHasLoop when it loops
+    bool DecodeWave(const CtlReader& aCtl, const TabBinArchive::EntryData& aTbl, uint32 aOffset,
+        C_Vector<int16>& aOutSamples, WAV::Loop& aOutLoop, bool& aOutHasLoop)
+    {
+        const uint32 base = aCtl.U32(aOffset);
+        const uint32 len = aCtl.U32(aOffset + 4);
+        const uint8 type = aCtl.U8(aOffset + 8);
+        const uint32 loop = aCtl.U32(aOffset + 12);
+
+        if (base > aTbl.mSize || len > aTbl.mSize - base)
+            return false;
+
+        const uint8* data = aTbl.mData + base;
+
+        if (type == WAVE_ADPCM)
+        {
+            VADPCM::Book book;
+
+            if (!ReadBook(aCtl, aCtl.U32(aOffset + 16), book))
+                return false;
+
+            const int numFrames = len / VADPCM::FRAME_SIZE;
+            aOutSamples.Resize(numFrames * VADPCM::FRAME_SAMPLES);
+            VADPCM::Decode(book, data, numFrames, aOutSamples.GetBuffer());
+        }
+        else if (type == WAVE_RAW16)
+        {
+            aOutSamples.Resize(len / 2);
+
+            for (int i = 0; i < aOutSamples.Count(); ++i)
+                aOutSamples[i] = int16(BigEndian::Load<uint16>(data + i * 2));
+        }
+        else
+        {
+            return false;
+        }
+
+        aOutHasLoop = false;
+
+        if (loop != 0 && aCtl.Has(loop, type == WAVE_ADPCM ? ADPCM_LOOP_SIZE : RAW_LOOP_SIZE))
+        {
+            aOutLoop.mStart = aCtl.U32(loop);
+            aOutLoop.mEnd = aCtl.U32(loop + 4);
+
+            // libultra counts -1 as forever
+            const uint32 count = aCtl.U32(loop + 8);
+            aOutLoop.mCount = count == 0xFFFFFFFF ? 0 : count;
+
+            aOutHasLoop = count != 0 && aOutLoop.mEnd > aOutLoop.mStart && aOutLoop.mEnd <= uint32(aOutSamples.Count());
+        }
+
+        return true;
+    }
+
+    // AUDIO/SFX/AMBIENT/MUSIC banks to one wav per wavetable
+    bool ExportSoundBank(const C_Vector<TabBinArchive::EntryData>& aEntries, const char* aDir, C_DataPack& aOutInfo)
+    {
+        C_Vector<Wave> waves;
+        int numBanks = 0;
+
+        for (int i = 0; i + 1 < aEntries.Count(); ++i)
+        {
+            if (!IsBankFile(aEntries[i]))
+                continue;
+
+            const CtlReader ctl = { aEntries[i].mData, aEntries[i].mSize };
+            const int firstWave = waves.Count();
+
+            if (!GetBankWaves(ctl, i, waves))
+            {
+                WAR_LOG_WARNING(CAT_GENERAL, "%s: entry %i looks like a sound bank but doesn't parse, skipping it", aDir, i);
+                waves.Resize(firstWave);
+                continue;
+            }
+
+            // the next entry is this bank's .tbl
+            ++numBanks;
+            ++i;
+        }
+
+        if (waves.Count() == 0)
+            return false;
+
+        C_FilePath waveDir(aDir);
+        waveDir.Combine(sWaveDir);
+        C_FileSystem::DirectoryCreate(waveDir);
+
+        C_Vector<string> hashes;
+        hashes.Resize(waves.Count());
+        std::atomic<int> numFailed(0);
+
+        JobPool::GetInstance().ParallelFor(waves.Count(), [&](int i)
+            {
+                const Wave& wave = waves[i];
+                const CtlReader ctl = { aEntries[wave.mCtl].mData, aEntries[wave.mCtl].mSize };
+
+                C_Vector<int16> samples;
+                WAV::Loop loop;
+                bool hasLoop = false;
+
+                if (!DecodeWave(ctl, aEntries[wave.mCtl + 1], wave.mOffset, samples, loop, hasLoop))
+                {
+                    ++numFailed;
+                    return;
+                }
+
+                C_Vector<uint8> wav;
+                WAV::Encode(samples.GetBuffer(), samples.Count(), wave.mSampleRate, hasLoop ? &loop : NULL, wav);
+
+                C_FilePath path(aDir);
+                path.Combine(wave.mFile.c_str());
+
+                if (!C_FileSystem::WriteFile(path, wav.GetBuffer(), wav.Count()))
+                {
+                    ++numFailed;
+                    return;
+                }
+
+                const uint64 hash = BinUtils::Hash64(wav.GetBuffer(), wav.Count());
+                hashes[i] = string(C_Strfmt<32>("%08X%08X", uint32(hash >> 32), uint32(hash)));
+            });
+
+        C_DataPack wavesPack;
+        int numWritten = 0;
+
+        for (int i = 0; i < waves.Count(); ++i)
+        {
+            if (hashes[i].length() == 0)
+                continue;
+
+            C_DataPack wavePack;
+            wavePack.Set("File", waves[i].mFile);
+            wavePack.Set("Ctl", waves[i].mCtl);
+            wavePack.Set("WaveTable", waves[i].mOffset);
+            wavePack.Set("SampleRate", waves[i].mSampleRate);
+            wavePack.Set("Hash", hashes[i]);
+            wavesPack.Set(numWritten++, wavePack);
+        }
+
+        if (numFailed > 0)
+            WAR_LOG_WARNING(CAT_GENERAL, "%s: %i sounds couldn't be decoded", aDir, int(numFailed));
+
+        WAR_LOG_INFO(CAT_GENERAL, "%s: decoded %i sounds from %i banks", aDir, numWritten, numBanks);
+
+        aOutInfo.Set("Sounds", wavesPack);
+        return numWritten > 0;
+    }
+
+    // an exported wav and the wavetable it goes back into
+    struct WaveEdit
+    {
+        string mFile;
+        int mCtl = 0;
+        uint32 mOffset = 0;
+        uint32 mSampleRate = 0;
+        string mHash;
+
+        uint8 mType = WAVE_ADPCM;
+        uint32 mBase = 0;
+        uint32 mBookOffset = 0;
+        uint32 mLoopOffset = 0;
+        // parts other wavetables point at as well are kept as they are
+        bool mSharedBase = false;
+        bool mSharedBook = false;
+        bool mSharedLoop = false;
+
+        bool mModified = false;
+        bool mFromCache = false;
+        bool mWriteCache = false;
+        string mCacheFile;
+        C_Vector<uint8> mData;
+        VADPCM::Book mBook;
+        WAV::Loop mLoop;
+        bool mHasLoop = false;
+        int16 mLoopState[VADPCM::FRAME_SAMPLES];
+    };
+
+    // cache files hold the book's order, predictor count and coefficients followed by the frames
+    void WriteWaveCache(const WaveEdit& aEdit)
+    {
+        C_Vector<uint8> data;
+        data.Resize(8 + aEdit.mBook.mCoefs.Count() * 2 + aEdit.mData.Count());
+
+        uint8* dst = data.GetBuffer();
+        BigEndian::Store<uint32>(dst, uint32(aEdit.mBook.mOrder));
+        BigEndian::Store<uint32>(dst + 4, uint32(aEdit.mBook.mNumPredictors));
+
+        for (int i = 0; i < aEdit.mBook.mCoefs.Count(); ++i)
+            BigEndian::Store<int16>(dst + 8 + i * 2, aEdit.mBook.mCoefs[i]);
+
+        memcpy(dst + 8 + aEdit.mBook.mCoefs.Count() * 2, aEdit.mData.GetBuffer(), aEdit.mData.Count());
+        BinUtils::WriteCacheFile(aEdit.mCacheFile.c_str(), data.GetBuffer(), data.Count());
+    }
+
+    bool ReadWaveCache(WaveEdit& aEdit, const VADPCM::Book& aBook, uint32 aNumFrames)
+    {
+        C_Vector<uint8> block;
+
+        if (!BinUtils::ReadCacheFile(aEdit.mCacheFile.c_str(), block))
+            return false;
+
+        const uint8* src = block.GetBuffer();
+        const uint32 coefSize = aBook.mCoefs.Count() * 2;
+
+        if (uint32(block.Count()) != 8 + coefSize + aNumFrames * VADPCM::FRAME_SIZE ||
+            int(BigEndian::Load<uint32>(src)) != aBook.mOrder || int(BigEndian::Load<uint32>(src + 4)) != aBook.mNumPredictors)
+            return false;
+
+        aEdit.mBook = aBook;
+
+        for (int i = 0; i < aEdit.mBook.mCoefs.Count(); ++i)
+            aEdit.mBook.mCoefs[i] = BigEndian::Load<int16>(src + 8 + i * 2);
+
+        aEdit.mData.Resize(aNumFrames * VADPCM::FRAME_SIZE);
+        memcpy(aEdit.mData.GetBuffer(), src + 8 + coefSize, aEdit.mData.Count());
+        return true;
+    }
+
+    // reads the wav and encodes it if it changed since it was exported
+    bool EncodeWave(FSTContext* aCtx, const CtlReader& aCtl, const char* aDir, WaveEdit& aEdit)
+    {
+        C_FilePath path(aDir);
+        path.Combine(aEdit.mFile.c_str());
+
+        // a removed wav keeps the extracted sound, until it's back
+        if (!C_FileSystem::Exists(path))
+        {
+            aCtx->AddDependency(path);
+            return true;
+        }
+
+        C_Ptr<C_MemBlock> wav = aCtx->ReadFile(path);
+
+        if (!wav)
+            return false;
+
+        const uint64 hash = BinUtils::Hash64(wav->mBlock, wav->mSize);
+
+        if (string(C_Strfmt<32>("%08X%08X", uint32(hash >> 32), uint32(hash))) == aEdit.mHash)
+            return true;
+
+        C_Vector<int16> samples;
+        uint32 sampleRate = 0;
+
+        if (!WAV::Decode((const uint8*)wav->mBlock, wav->mSize, samples, sampleRate, aEdit.mLoop, aEdit.mHasLoop))
+        {
+            WAR_LOG_ERROR(CAT_GENERAL, "%s: only 8 or 16-bit pcm wavs are supported", (const char*)path);
+            return false;
+        }
+
+        // the bank has one rate for all its sounds
+        if (sampleRate != aEdit.mSampleRate)
+            WAR_LOG_WARNING(CAT_GENERAL, "%s is %u Hz but plays at the bank's %u Hz", (const char*)path, sampleRate, aEdit.mSampleRate);
+
+        aEdit.mModified = true;
+
+        if (aEdit.mType == WAVE_RAW16)
+        {
+            aEdit.mData.Resize(samples.Count() * 2);
+
+            for (int i = 0; i < samples.Count(); ++i)
+                BigEndian::Store<int16>(aEdit.mData.GetBuffer() + i * 2, samples[i]);
+        }
+        else
+        {
+            // the new book takes the old one's place so it keeps its size
+            VADPCM::Book book;
+
+            if (!ReadBook(aCtl, aEdit.mBookOffset, book))
+                return false;
+
+            const uint64 seed = aEdit.mSharedBook ?
+                BinUtils::Hash64(book.mCoefs.GetBuffer(), book.mCoefs.Count() * 2) :
+                (uint64(book.mOrder) << 8) | uint64(book.mNumPredictors);
+            const uint64 key = BinUtils::Hash64(wav->mBlock, wav->mSize, seed);
+
+            C_FilePath cachePath(aDir);
+            cachePath.Combine(C_Strfmt<256>("%s/%08X%08X.bin", sWaveCacheDir, uint32(key >> 32), uint32(key)));
+            aEdit.mCacheFile = string(cachePath);
+
+            const int numFrames = VADPCM::GetNumFrames(samples.Count());
+
+            if (ReadWaveCache(aEdit, book, numFrames))
+            {
+                aEdit.mFromCache = true;
+            }
+            else
+            {
+                if (aEdit.mSharedBook)
+                    aEdit.mBook = book;
+                else
+                    VADPCM::TrainBook(samples.GetBuffer(), samples.Count(), book.mOrder, book.mNumPredictors, aEdit.mBook);
+
+                aEdit.mData.Resize(numFrames * VADPCM::FRAME_SIZE);
+                VADPCM::Encode(aEdit.mBook, samples.GetBuffer(), samples.Count(), aEdit.mData.GetBuffer());
+                aEdit.mWriteCache = true;
+            }
+        }
+
+        const uint32 numSamples = aEdit.mType == WAVE_RAW16 ? samples.Count() : VADPCM::GetNumFrames(samples.Count()) * VADPCM::FRAME_SAMPLES;
+
+        if (aEdit.mHasLoop && (aEdit.mLoop.mEnd > numSamples || aEdit.mLoop.mStart >= aEdit.mLoop.mEnd))
+        {
+            WAR_LOG_WARNING(CAT_GENERAL, "%s: loop %u-%u is outside the sound, dropping it", (const char*)path, aEdit.mLoop.mStart, aEdit.mLoop.mEnd);
+            aEdit.mHasLoop = false;
+        }
+
+        WAR_ZeroMem(aEdit.mLoopState, sizeof(aEdit.mLoopState));
+
+        // the decoder restarts the loop's frame from the samples before it
+        if (aEdit.mHasLoop && aEdit.mType == WAVE_ADPCM)
+        {
+            const uint32 loopFrame = aEdit.mLoop.mStart / VADPCM::FRAME_SAMPLES;
+
+            if (loopFrame > 0)
+            {
+                C_Vector<int16> decoded;
+                decoded.Resize(loopFrame * VADPCM::FRAME_SAMPLES);
+                VADPCM::Decode(aEdit.mBook, aEdit.mData.GetBuffer(), loopFrame, decoded.GetBuffer());
+                memcpy(aEdit.mLoopState, decoded.GetBuffer() + decoded.Count() - VADPCM::FRAME_SAMPLES, sizeof(aEdit.mLoopState));
+            }
+        }
+
+        return true;
+    }
+
+    // writes an encoded wav into copies of its .ctl and .tbl
+    void ApplyWave(const WaveEdit& aEdit, C_Vector<uint8>& aCtl, C_Vector<uint8>& aTbl)
+    {
+        uint8* ctl = aCtl.GetBuffer();
+        const uint32 oldLen = BigEndian::Load<uint32>(ctl + aEdit.mOffset + 4);
+        uint32 base = aEdit.mBase;
+
+        // overwritten in place when it fits, appended otherwise
+        if (aEdit.mSharedBase || uint32(aEdit.mData.Count()) > oldLen)
+        {
+            base = (aTbl.Count() + 15) & ~15;
+            aTbl.Resize(base, 0);
+            aTbl.Resize(base + aEdit.mData.Count());
+        }
+
+        memcpy(aTbl.GetBuffer() + base, aEdit.mData.GetBuffer(), aEdit.mData.Count());
+
+        BigEndian::Store<uint32>(ctl + aEdit.mOffset, base);
+        BigEndian::Store<uint32>(ctl + aEdit.mOffset + 4, uint32(aEdit.mData.Count()));
+
+        if (aEdit.mType == WAVE_ADPCM && !aEdit.mSharedBook)
+        {
+            for (int i = 0; i < aEdit.mBook.mCoefs.Count(); ++i)
+                BigEndian::Store<int16>(ctl + aEdit.mBookOffset + 8 + i * 2, aEdit.mBook.mCoefs[i]);
+        }
+
+        if (aEdit.mLoopOffset == 0 || aEdit.mSharedLoop)
+            return;
+
+        uint8* loop = ctl + aEdit.mLoopOffset;
+
+        BigEndian::Store<uint32>(loop, aEdit.mHasLoop ? aEdit.mLoop.mStart : 0);
+        BigEndian::Store<uint32>(loop + 4, aEdit.mHasLoop ? aEdit.mLoop.mEnd : 0);
+        BigEndian::Store<uint32>(loop + 8, !aEdit.mHasLoop ? 0 : aEdit.mLoop.mCount == 0 ? 0xFFFFFFFF : aEdit.mLoop.mCount);
+
+        if (aEdit.mType == WAVE_ADPCM)
+        {
+            for (int i = 0; i < VADPCM::FRAME_SAMPLES; ++i)
+                BigEndian::Store<int16>(loop + 12 + i * 2, aEdit.mLoopState[i]);
+        }
+    }
+
+    // edited wavs back into their banks, sounds are encoded in parallel and patched in one by one
+    bool CompileSoundBank(FSTContext* aCtx, const C_DataPack& aInfo, const char* aDir, const C_Vector<TabBinArchive::EntryData>& aEntries, C_Vector<C_Vector<uint8>>& aOutData)
+    {
+        C_DataPack wavesPack;
+        aInfo.Get("Sounds", wavesPack);
+
+        C_Vector<WaveEdit> edits;
+        edits.Resize(wavesPack.NumEntries());
+
+        for (int i = 0; i < edits.Count(); ++i)
+        {
+            WaveEdit& e = edits[i];
+
+            C_DataPack wavePack;
+            wavesPack.Get(i, wavePack);
+            wavePack.Get("File", e.mFile);
+            wavePack.Get("Ctl", e.mCtl);
+            wavePack.Get("WaveTable", e.mOffset);
+            wavePack.Get("SampleRate", e.mSampleRate);
+            wavePack.Get("Hash", e.mHash);
+
+            if (e.mCtl < 0 || e.mCtl + 1 >= aEntries.Count() || !IsBankFile(aEntries[e.mCtl]))
+            {
+                WAR_LOG_ERROR(CAT_GENERAL, "%s: %s belongs to entry %i, which isn't a sound bank", aDir, e.mFile.c_str(), e.mCtl);
+                return false;
+            }
+
+            const CtlReader ctl = { aEntries[e.mCtl].mData, aEntries[e.mCtl].mSize };
+
+            if (!ctl.Has(e.mOffset, WAVETABLE_SIZE))
+            {
+                WAR_LOG_ERROR(CAT_GENERAL, "%s: %s has no wavetable at 0x%X", aDir, e.mFile.c_str(), e.mOffset);
+                return false;
+            }
+
+            e.mBase = ctl.U32(e.mOffset);
+            e.mType = ctl.U8(e.mOffset + 8);
+            e.mLoopOffset = ctl.U32(e.mOffset + 12);
+            e.mBookOffset = e.mType == WAVE_ADPCM ? ctl.U32(e.mOffset + 16) : 0;
+        }
+
+        for (int i = 0; i < edits.Count(); ++i)
+        {
+            for (int j = 0; j < edits.Count(); ++j)
+            {
+                if (i == j || edits[i].mCtl != edits[j].mCtl)
+                    continue;
+
+                edits[i].mSharedBase |= edits[i].mBase == edits[j].mBase;
+                edits[i].mSharedBook |= edits[i].mBookOffset != 0 && edits[i].mBookOffset == edits[j].mBookOffset;
+                edits[i].mSharedLoop |= edits[i].mLoopOffset != 0 && edits[i].mLoopOffset == edits[j].mLoopOffset;
+            }
+        }
+
+        C_FilePath cacheDir(aDir);
+        cacheDir.Combine(sWaveCacheDir);
+        C_FileSystem::DirectoryCreate(cacheDir);
+
+        std::atomic<bool> encodeOk(true);
+
+        JobPool::GetInstance().ParallelFor(edits.Count(), [&](int i)
+            {
+                const CtlReader ctl = { aEntries[edits[i].mCtl].mData, aEntries[edits[i].mCtl].mSize };
+
+                if (!EncodeWave(aCtx, ctl, aDir, edits[i]))
+                {
+                    WAR_LOG_ERROR(CAT_GENERAL, "%s: failed to encode %s", aDir, edits[i].mFile.c_str());
+                    encodeOk = false;
+                }
+            });
+
+        if (!encodeOk)
+            return false;
+
+        int numModified = 0;
+        int numCached = 0;
+
+        for (const WaveEdit& e : edits)
+        {
+            if (!e.mModified)
+                continue;
+
+            C_Vector<uint8>& ctl = aOutData[e.mCtl];
+            C_Vector<uint8>& tbl = aOutData[e.mCtl + 1];
+
+            if (ctl.Count() == 0)
+            {
+                ctl.Resize(aEntries[e.mCtl].mSize);
+                memcpy(ctl.GetBuffer(), aEntries[e.mCtl].mData, ctl.Count());
+            }
+
+            if (tbl.Count() == 0 && aEntries[e.mCtl + 1].mSize > 0)
+            {
+                tbl.Resize(aEntries[e.mCtl + 1].mSize);
+                memcpy(tbl.GetBuffer(), aEntries[e.mCtl + 1].mData, tbl.Count());
+            }
+
+            if (e.mHasLoop && (e.mLoopOffset == 0 || e.mSharedLoop))
+                WAR_LOG_WARNING(CAT_GENERAL, "%s: the wavetable of %s has no loop of its own, its loop is ignored", aDir, e.mFile.c_str());
+
+            ApplyWave(e, ctl, tbl);
+
+            if (e.mWriteCache)
+                WriteWaveCache(e);
+
+            ++numModified;
+            numCached += e.mFromCache ? 1 : 0;
+        }
+
+        if (numModified > 0)
+            WAR_LOG_INFO(CAT_GENERAL, "%s: encoded %i sounds, %i from cache", aDir, numModified, numCached);
+
+        return true;
+    }
+}
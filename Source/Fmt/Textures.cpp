@@ -0,0 +1,269 @@
+#include "ROMFST.h"
+#include "C_DataPack.h"
+#include "C_FileSystem.h"
+#include "C_MemBlock.h"
+#include "N64Texture.h"
+#include "PNG.h"
+#include "BinUtils.h"
+#include "CL_Log.h"
+
+namespace FormatsInternal
+{
+    // texture entries start with a header, the texels follow and then the tlut for the ci formats
+    const uint32 TEXTURE_HEADER_SIZE = 0x20;
+
+    // low nibble of the header's format byte
+    static const N64Texture::Format sTextureFormats[16] =
+    {
+        N64Texture::FMT_RGBA32,
+        N64Texture::FMT_RGBA16,
+        N64Texture::FMT_I8,
+        N64Texture::FMT_I4,
+        N64Texture::FMT_IA16,
+        N64Texture::FMT_IA8,
+        N64Texture::FMT_IA4,
+        N64Texture::FMT_CI4,
+        N64Texture::FMT_CI8,
+        N64Texture::NUM_FORMATS, N64Texture::NUM_FORMATS, N64Texture::NUM_FORMATS,
+        N64Texture::NUM_FORMATS, N64Texture::NUM_FORMATS, N64Texture::NUM_FORMATS, N64Texture::NUM_FORMATS,
+    };
+
+    // also used by the glyph sets
+    N64Texture::Format GetTextureFormat(uint8 aCode)
+    {
+        return sTextureFormats[aCode & 0xF];
+    }
+
+    struct TextureHeader
+    {
+        int mWidth = 0;
+        int mHeight = 0;
+        N64Texture::Format mFormat = N64Texture::NUM_FORMATS;
+
+        bool Read(const uint8* aData, uint32 aSize)
+        {
+            if (aSize < TEXTURE_HEADER_SIZE)
+                return false;
+
+            mWidth = aData[0];
+            mHeight = aData[1];
+            mFormat = GetTextureFormat(aData[2]);
+
+            if (mWidth == 0 || mHeight == 0 || mFormat == N64Texture::NUM_FORMATS)
+                return false;
+
+            return GetEnd() <= aSize;
+        }
+
+        uint32 GetDataSize() const { return N64Texture::GetDataSize(mFormat, mWidth, mHeight); }
+        uint32 GetTlutOffset() const { return TEXTURE_HEADER_SIZE + GetDataSize(); }
+        uint32 GetEnd() const { return GetTlutOffset() + N64Texture::GetNumTlutEntries(mFormat) * 2; }
+    };
+
+    // the game loads a texture into tmem in one go
+    const uint32 TMEM_SIZE = 4096;
+
+    static string GetImageHash(const uint8* aData, uint32 aSize)
+    {
+        const uint64 hash = BinUtils::Hash64(aData, aSize);
+        return string(C_Strfmt<32>("%08X%08X", uint32(hash >> 32), uint32(hash)));
+    }
+
+    // TEX0/TEX1 entries to png, runs per entry on the job pool
+    bool ExportTexture(const uint8* aData, uint32 aSize, const char* aBasePath, C_DataPack& aOutInfo)
+    {
+        TextureHeader header;
+        if (!header.Read(aData, aSize))
+            return false;
+
+        C_Vector<uint8> rgba;
+        rgba.Resize(header.mWidth * header.mHeight * 4);
+        N64Texture::Decode(header.mFormat, aData + TEXTURE_HEADER_SIZE, header.mWidth, header.mHeight, aData + header.GetTlutOffset(), rgba.GetBuffer());
+
+        C_Vector<uint8> png;
+        PNG::Encode(rgba.GetBuffer(), header.mWidth, header.mHeight, 6, png);
+
+        const string path = string(aBasePath) + ".png";
+
+        if (!C_FileSystem::WriteFile(path.c_str(), png.GetBuffer(), png.Count()))
+            return false;
+
+        C_FilePath fileName;
+        C_PathUtils::GetFilename(path.c_str(), fileName);
+
+        // only edited images are encoded again
+        aOutInfo.Set("Image", string(fileName));
+        aOutInfo.Set("ImageHash", GetImageHash(png.GetBuffer(), png.Count()));
+        aOutInfo.Set("Format", string(N64Texture::GetFormatName(header.mFormat)));
+        aOutInfo.Set("Width", header.mWidth);
+        aOutInfo.Set("Height", header.mHeight);
+        return true;
+    }
+
+    // screens are strips of textures with the same width stacked top to bottom, each starting 8 byte aligned
+    const uint32 SCREEN_TILE_ALIGN = 8;
+    // rows of tiles gathered before they go to the png, more compress a bit better
+    const int SCREEN_BAND_ROWS = 64;
+
+    // SCREENS entries to one png, streamed a band of tiles at a time so only a band is ever decoded. export only,
+    // the entries are built from the raw files
+    bool ExportScreen(const uint8* aData, uint32 aSize, const char* aBasePath, C_DataPack& aOutInfo)
+    {
+        C_Vector<uint32> tileOffsets;
+        int width = 0;
+        int height = 0;
+        uint32 offset = 0;
+
+        while (offset + TEXTURE_HEADER_SIZE <= aSize)
+        {
+            TextureHeader header;
+
+            if (!header.Read(aData + offset, aSize - offset) || (width != 0 && header.mWidth != width))
+                break;
+
+            tileOffsets.Add(offset);
+            width = header.mWidth;
+            height += header.mHeight;
+            offset = (offset + header.GetEnd() + SCREEN_TILE_ALIGN - 1) & ~(SCREEN_TILE_ALIGN - 1);
+        }
+
+        // anything left over has to be padding, otherwise it isn't a screen
+        for (uint32 i = offset; i < aSize; ++i)
+        {
+            if (aData[i] != 0)
+                return false;
+        }
+
+        if (tileOffsets.Count() == 0 || height == 0)
+            return false;
+
+        const string path = string(aBasePath) + ".png";
+
+        PNG::Writer png;
+        if (!png.Open(path.c_str(), width, height))
+            return false;
+
+        C_Vector<uint8> band;
+        int bandRows = 0;
+
+        for (int i = 0; i < tileOffsets.Count(); ++i)
+        {
+            const uint8* tile = aData + tileOffsets[i];
+
+            TextureHeader header;
+            header.Read(tile, aSize - tileOffsets[i]);
+
+            band.Resize((bandRows + header.mHeight) * width * 4);
+            N64Texture::Decode(header.mFormat, tile + TEXTURE_HEADER_SIZE, header.mWidth, header.mHeight, tile + header.GetTlutOffset(), band.GetBuffer() + bandRows * width * 4);
+            bandRows += header.mHeight;
+
+            if (bandRows > 0 && (bandRows >= SCREEN_BAND_ROWS || i == tileOffsets.Count() - 1))
+            {
+                if (!png.WriteRows(band.GetBuffer(), bandRows))
+                    break;
+
+                bandRows = 0;
+            }
+        }
+
+        if (!png.Close())
+            return false;
+
+        C_FilePath fileName;
+        C_PathUtils::GetFilename(path.c_str(), fileName);
+
+        aOutInfo.Set("Image", string(fileName));
+        aOutInfo.Set("Tiles", tileOffsets.Count());
+        aOutInfo.Set("Width", width);
+        aOutInfo.Set("Height", height);
+        return true;
+    }
+
+    // png back to the entry's texel format, the header and anything after the texture is kept
+    bool CompileTexture(FSTContext* aCtx, const C_DataPack& aInfo, const char* aDir, C_Vector<uint8>& aData, bool& aOutModified)
+    {
+        string image;
+        string imageHash;
+        aInfo.Get("Image", image);
+        aInfo.Get("ImageHash", imageHash);
+
+        C_FilePath path(aDir);
+        path.Combine(image.c_str());
+
+        if (image.length() == 0)
+            return true;
+
+        // a removed image keeps the extracted texture, until it's back
+        if (!C_FileSystem::Exists(path))
+        {
+            aCtx->AddDependency(path);
+            return true;
+        }
+
+        C_Ptr<C_MemBlock> png = aCtx->ReadFile(path);
+
+        if (!png)
+            return false;
+
+        if (GetImageHash((const uint8*)png->mBlock, png->mSize) == imageHash)
+            return true;
+
+        TextureHeader header;
+        if (!header.Read(aData.GetBuffer(), aData.Count()))
+        {
+            WAR_LOG_ERROR(CAT_GENERAL, "%s: the extracted texture it belongs to is invalid", (const char*)path);
+            return false;
+        }
+
+        C_Vector<uint8> rgba;
+        int width;
+        int height;
+
+        if (!PNG::Decode((const uint8*)png->mBlock, png->mSize, rgba, width, height))
+        {
+            WAR_LOG_ERROR(CAT_GENERAL, "Failed to decode %s", (const char*)path);
+            return false;
+        }
+
+        if (width > 0xFF || height > 0xFF)
+        {
+            WAR_LOG_ERROR(CAT_GENERAL, "%s: %ix%i is too big, textures are at most 255x255", (const char*)path, width, height);
+            return false;
+        }
+
+        TextureHeader newHeader = header;
+        newHeader.mWidth = width;
+        newHeader.mHeight = height;
+
+        const uint32 oldSize = header.GetEnd() - TEXTURE_HEADER_SIZE;
+        const uint32 newSize = newHeader.GetEnd() - TEXTURE_HEADER_SIZE;
+
+        if (newSize > oldSize)
+        {
+            WAR_LOG_WARNING(CAT_GENERAL, "%s: %s texture grew from %u to %u bytes (%ix%i -> %ix%i)", (const char*)path,
+                N64Texture::GetFormatName(header.mFormat), oldSize, newSize, header.mWidth, header.mHeight, width, height);
+        }
+
+        if (newSize > TMEM_SIZE && oldSize <= TMEM_SIZE)
+            WAR_LOG_WARNING(CAT_GENERAL, "%s: %u bytes don't fit tmem (%u bytes)", (const char*)path, newSize, TMEM_SIZE);
+
+        C_Vector<uint8> out;
+        out.Resize(aData.Count() - oldSize + newSize);
+
+        uint8* dst = out.GetBuffer();
+        memcpy(dst, aData.GetBuffer(), TEXTURE_HEADER_SIZE);
+        dst[0] = uint8(width);
+        dst[1] = uint8(height);
+
+        N64Texture::Encode(header.mFormat, rgba.GetBuffer(), width, height, dst + TEXTURE_HEADER_SIZE, dst + newHeader.GetTlutOffset());
+
+        const uint32 tail = aData.Count() - header.GetEnd();
+
+        if (tail > 0)
+            memcpy(dst + newHeader.GetEnd(), aData.GetBuffer() + header.GetEnd(), tail);
+
+        aData = out;
+        aOutModified = true;
+        return true;
+    }
+}
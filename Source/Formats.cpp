@@ -9,6 +9,9 @@ namespace FormatsInternal
     bool ExportDLLs(FSTContext*);
     bool CompileDLLs(FSTContext*);
 
+    bool ExportFonts(FSTContext*);
+    bool CompileFonts(FSTContext*);
+
     bool ExportGlobalMap(FSTContext*);
     bool CompileGlobalMap(FSTContext*);
 
@@ -18,12 +21,25 @@ namespace FormatsInternal
     bool ExportMAPINFO(FSTContext*);
     bool CompileMAPINFO(FSTContext*);
 
+    bool ExportWorldGrid(FSTContext*);
+
+    bool ExportIndexTables(FSTContext*);
+    void GetIndexTableDependents(int aFile, C_Vector<int>& aOut);
+    bool CompileIndexTables(FSTContext*);
+
+    bool ExportArchives(FSTContext*);
+    bool CompileArchives(FSTContext*);
+
     static const FormatInfo sFormats[Formats::NUM_FMTS] =
     {
         { ExportDLLs, CompileDLLs },
         { ExportDLLSIMPORTTAB, CompileDLLSIMPORTTAB },
+        { ExportFonts, CompileFonts },
         { ExportGlobalMap, CompileGlobalMap },
-        { ExportMAPINFO, CompileMAPINFO }
+        { ExportMAPINFO, CompileMAPINFO },
+        { ExportWorldGrid, nullptr },
+        { ExportIndexTables, CompileIndexTables },
+        { ExportArchives, CompileArchives }
     };
 }
 
@@ -31,3 +47,8 @@ const FormatInfo& Formats::GetFormatInfo(int aType)
 {
     return FormatsInternal::sFormats[aType];
 }
+
+void Formats::GetDependentFiles(int aFile, C_Vector<int>& aOut)
+{
+    FormatsInternal::GetIndexTableDependents(aFile, aOut);
+}
@@ -1,6 +1,8 @@
 #ifndef _Formats_h_
 #define _Formats_h_
 
+#include "C_Vector.h"
+
 class FSTContext;
 
 typedef bool(*FSTHandleFunc)(FSTContext* aCtx);
@@ -13,6 +15,7 @@ struct FormatInfo
     {}
 
     FSTHandleFunc mExportFunc;
+    // null for formats that are only a view of other files
     FSTHandleFunc mCompileFunc;
 };
 
@@ -33,20 +36,34 @@ namespace Formats
         DLLS,
         DLLSIMPORTTAB,
         //ENVFXACT,
-        //FONTS,
+
+        // FONTS, CACHEFON and CACHEFON2
+        FONTS,
         //GAMETEXT,
         GLOBALMAP,
         //HITS,
         //LACTIONS,
         MAPINFO,
+
+        // where the BLOCKS of every map sit in the world, only a view of GLOBALMAP/MAPS/TRKBLK
+        WORLDGRID,
         //MAPS,
         //MAPSETUP,
         //MODANIM,
 
+        // OBJINDEX/MODELIND/TEXTABLE, they name entries of the archives below
+        INDEXTABLES,
+
+        // generic .tab/.bin archives, after the specific formats so they can claim files first
+        ARCHIVES,
+
         NUM_FMTS
     };
 
     const FormatInfo& GetFormatInfo(int aType);
+
+    // other fst files whose compile reads aFile's extracted input, TEXTABLE reads TEX0/index.json
+    void GetDependentFiles(int aFile, C_Vector<int>& aOut);
 }
 
 
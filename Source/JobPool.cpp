@@ -0,0 +1,113 @@
+#include "JobPool.h"
+#include <atomic>
+
+struct JobPool::Batch
+{
+    const function<void(int)>* mFunc = NULL;
+    int mCount = 0;
+    std::atomic<int> mNext{ 0 };
+    std::atomic<int> mDone{ 0 };
+    std::mutex mDoneMutex;
+    std::condition_variable mDoneCond;
+};
+
+JobPool& JobPool::GetInstance()
+{
+    static JobPool inst(C_Max(0, int(std::thread::hardware_concurrency()) - 1));
+    return inst;
+}
+
+JobPool::JobPool(int aNumWorkers)
+{
+    for (int i = 0; i < aNumWorkers; ++i)
+        mWorkers.push_back(std::thread([this]() { WorkerLoop(); }));
+}
+
+JobPool::~JobPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mQuit = true;
+    }
+
+    mWake.notify_all();
+
+    for (std::thread& t : mWorkers)
+        t.join();
+}
+
+void JobPool::ParallelFor(int aCount, const function<void(int)>& aFunc)
+{
+    if (aCount <= 0)
+        return;
+
+    if (aCount == 1 || mWorkers.empty())
+    {
+        for (int i = 0; i < aCount; ++i)
+            aFunc(i);
+        return;
+    }
+
+    std::shared_ptr<Batch> batch = std::make_shared<Batch>();
+    batch->mFunc = &aFunc;
+    batch->mCount = aCount;
+
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mQueue.push_back(batch);
+    }
+
+    mWake.notify_all();
+
+    RunBatch(*batch);
+
+    // wait for the items other threads picked up
+    std::unique_lock<std::mutex> lock(batch->mDoneMutex);
+    batch->mDoneCond.wait(lock, [&batch]() { return batch->mDone.load() == batch->mCount; });
+}
+
+void JobPool::WorkerLoop()
+{
+    while (true)
+    {
+        std::shared_ptr<Batch> batch;
+
+        {
+            std::unique_lock<std::mutex> lock(mMutex);
+            mWake.wait(lock, [this]() { return mQuit || !mQueue.empty(); });
+
+            if (mQueue.empty())
+                return;
+
+            batch = mQueue.front();
+
+            // the batch stays queued while it has unclaimed items, so idle workers join in
+            if (batch->mNext.load() >= batch->mCount)
+            {
+                mQueue.pop_front();
+                continue;
+            }
+        }
+
+        RunBatch(*batch);
+    }
+}
+
+void JobPool::RunBatch(Batch& aBatch)
+{
+    while (true)
+    {
+        const int i = aBatch.mNext++;
+
+        if (i >= aBatch.mCount)
+            break;
+
+        (*aBatch.mFunc)(i);
+
+        if (++aBatch.mDone == aBatch.mCount)
+        {
+            std::lock_guard<std::mutex> lock(aBatch.mDoneMutex);
+            aBatch.mDoneCond.notify_all();
+        }
+    }
+}
@@ -0,0 +1,44 @@
+#ifndef _JobPool_h_
+#define _JobPool_h_
+
+#include "C_Base.h"
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <vector>
+
+// shared worker threads. ParallelFor may be called from several threads at once and from inside
+// a job, the calling thread always works on its own batch so nesting can't deadlock
+class JobPool
+{
+public:
+    static JobPool& GetInstance();
+
+    ~JobPool();
+
+    // runs aFunc(i) for every i in [0, aCount) and returns when all calls are done
+    void ParallelFor(int aCount, const function<void(int)>& aFunc);
+
+    int GetNumThreads() const { return int(mWorkers.size()) + 1; }
+
+private:
+    struct Batch;
+
+    JobPool(int aNumWorkers);
+    JobPool(const JobPool&) = delete;
+    JobPool& operator=(const JobPool&) = delete;
+
+    void WorkerLoop();
+    static void RunBatch(Batch& aBatch);
+
+    std::vector<std::thread> mWorkers;
+    std::deque<std::shared_ptr<Batch>> mQueue;
+    std::mutex mMutex;
+    std::condition_variable mWake;
+    bool mQuit = false;
+};
+
+#endif // _JobPool_h_
@@ -0,0 +1,265 @@
+#include "LocalSocket.h"
+#include <string.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <winsock2.h>
+#include <afunix.h>
+#include <stdio.h>
+#pragma comment(lib, "ws2_32.lib")
+#else
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <errno.h>
+#endif
+
+namespace LocalSocket_private
+{
+#ifdef _WIN32
+    typedef SOCKET Handle;
+
+    bool Startup()
+    {
+        static const bool sStarted = []()
+        {
+            WSADATA data;
+            return WSAStartup(MAKEWORD(2, 2), &data) == 0;
+        }();
+
+        return sStarted;
+    }
+
+    void CloseHandle(Handle aSocket) { closesocket(aSocket); }
+
+    // unix sockets are reparse points on windows
+    bool RemoveStaleSocket(const char* aPath)
+    {
+        const DWORD attributes = GetFileAttributesA(aPath);
+
+        if (attributes == INVALID_FILE_ATTRIBUTES)
+            return true;
+
+        return (attributes & FILE_ATTRIBUTE_REPARSE_POINT) && !(attributes & FILE_ATTRIBUTE_DIRECTORY) && remove(aPath) == 0;
+    }
+#else
+    typedef int Handle;
+
+    bool Startup() { return true; }
+    void CloseHandle(Handle aSocket) { close(aSocket); }
+
+    bool RemoveStaleSocket(const char* aPath)
+    {
+        struct stat st;
+
+        if (lstat(aPath, &st) != 0)
+            return errno == ENOENT;
+
+        return S_ISSOCK(st.st_mode) && unlink(aPath) == 0;
+    }
+#endif
+
+    bool MakeAddress(const char* aPath, sockaddr_un& aOut)
+    {
+        memset(&aOut, 0, sizeof(aOut));
+        aOut.sun_family = AF_UNIX;
+
+        if (strlen(aPath) >= sizeof(aOut.sun_path))
+            return false;
+
+        strcpy(aOut.sun_path, aPath);
+        return true;
+    }
+
+    intptr_t Open()
+    {
+        if (!Startup())
+            return -1;
+
+        const Handle s = socket(AF_UNIX, SOCK_STREAM, 0);
+
+#ifdef _WIN32
+        return s == INVALID_SOCKET ? -1 : intptr_t(s);
+#else
+        return s < 0 ? -1 : intptr_t(s);
+#endif
+    }
+}
+
+bool LocalSocket::Listen(const char* aPath)
+{
+    using namespace LocalSocket_private;
+
+    Close();
+
+    sockaddr_un addr;
+    if (!MakeAddress(aPath, addr))
+        return false;
+
+    // a live daemon keeps its path, only a stale socket is replaced and any other file is left alone
+    {
+        LocalSocket probe;
+        if (probe.Connect(aPath))
+            return false;
+    }
+
+    if (!RemoveStaleSocket(aPath))
+        return false;
+
+    mSocket = Open();
+    if (mSocket == INVALID)
+        return false;
+
+    // clients can make the daemon read and write any path, only the owner gets to connect
+#ifdef _WIN32
+    const bool bound = bind(Handle(mSocket), (const sockaddr*)&addr, sizeof(addr)) == 0;
+#else
+    const mode_t mask = umask(077);
+    const bool bound = bind(Handle(mSocket), (const sockaddr*)&addr, sizeof(addr)) == 0;
+    umask(mask);
+#endif
+
+    if (!bound || listen(Handle(mSocket), 8) != 0)
+    {
+        Close();
+        return false;
+    }
+
+    mListenPath = aPath;
+    return true;
+}
+
+bool LocalSocket::Accept(LocalSocket& aOut)
+{
+    using namespace LocalSocket_private;
+
+    aOut.Close();
+
+    while (true)
+    {
+        const Handle s = accept(Handle(mSocket), NULL, NULL);
+
+#ifdef _WIN32
+        if (s == INVALID_SOCKET)
+            return false;
+#else
+        if (s < 0)
+        {
+            if (errno == EINTR)
+                continue;
+
+            return false;
+        }
+#endif
+
+        aOut.mSocket = intptr_t(s);
+        return true;
+    }
+}
+
+bool LocalSocket::Connect(const char* aPath)
+{
+    using namespace LocalSocket_private;
+
+    Close();
+
+    sockaddr_un addr;
+    if (!MakeAddress(aPath, addr))
+        return false;
+
+    mSocket = Open();
+    if (mSocket == INVALID)
+        return false;
+
+    if (connect(Handle(mSocket), (const sockaddr*)&addr, sizeof(addr)) != 0)
+    {
+        Close();
+        return false;
+    }
+
+    return true;
+}
+
+void LocalSocket::Close()
+{
+    using namespace LocalSocket_private;
+
+    if (mSocket != INVALID)
+        CloseHandle(Handle(mSocket));
+
+    mSocket = INVALID;
+
+    if (!mListenPath.empty())
+    {
+        RemoveStaleSocket(mListenPath.c_str());
+        mListenPath.clear();
+    }
+}
+
+bool LocalSocket::Send(const void* aData, uint32 aSize)
+{
+    using namespace LocalSocket_private;
+
+    const char* data = (const char*)aData;
+
+    while (aSize > 0)
+    {
+#ifdef _WIN32
+        const int n = send(Handle(mSocket), data, int(aSize), 0);
+#else
+        // a client that went away mustn't take the daemon down with SIGPIPE
+#ifdef MSG_NOSIGNAL
+        const ssize_t n = send(Handle(mSocket), data, aSize, MSG_NOSIGNAL);
+#else
+        const ssize_t n = send(Handle(mSocket), data, aSize, 0);
+#endif
+        if (n < 0 && errno == EINTR)
+            continue;
+#endif
+
+        if (n <= 0)
+            return false;
+
+        data += n;
+        aSize -= uint32(n);
+    }
+
+    return true;
+}
+
+bool LocalSocket::SetReceiveTimeout(int aMs)
+{
+    using namespace LocalSocket_private;
+
+#ifdef _WIN32
+    const DWORD timeout = DWORD(aMs);
+#else
+    timeval timeout;
+    timeout.tv_sec = aMs / 1000;
+    timeout.tv_usec = (aMs % 1000) * 1000;
+#endif
+
+    return setsockopt(Handle(mSocket), SOL_SOCKET, SO_RCVTIMEO, (const char*)&timeout, sizeof(timeout)) == 0;
+}
+
+int LocalSocket::Receive(void* aBuffer, uint32 aSize)
+{
+    using namespace LocalSocket_private;
+
+    while (true)
+    {
+#ifdef _WIN32
+        const int n = recv(Handle(mSocket), (char*)aBuffer, int(aSize), 0);
+#else
+        const ssize_t n = recv(Handle(mSocket), aBuffer, aSize, 0);
+
+        if (n < 0 && errno == EINTR)
+            continue;
+#endif
+
+        return n < 0 ? -1 : int(n);
+    }
+}
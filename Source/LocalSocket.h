@@ -0,0 +1,42 @@
+#ifndef _LocalSocket_h_
+#define _LocalSocket_h_
+
+#include "C_Base.h"
+
+// stream socket on a local path (AF_UNIX), the -serve daemon listens on one and its clients connect to it
+class LocalSocket
+{
+public:
+    LocalSocket() {}
+    ~LocalSocket() { Close(); }
+
+    // replaces a socket file left behind by a daemon that didn't shut down, fails if one is still listening on it
+    // or the path is something else. the socket is only open to its owner
+    bool Listen(const char* aPath);
+    bool Accept(LocalSocket& aOut);
+    bool Connect(const char* aPath);
+    void Close();
+
+    bool Send(const void* aData, uint32 aSize);
+
+    // up to aSize bytes, 0 once the other end is done sending and -1 on errors
+    int Receive(void* aBuffer, uint32 aSize);
+
+    // Receive() fails after waiting aMs for data, 0 waits forever
+    bool SetReceiveTimeout(int aMs);
+
+    bool IsOpen() const { return mSocket != INVALID; }
+
+private:
+    LocalSocket(const LocalSocket&) = delete;
+    LocalSocket& operator=(const LocalSocket&) = delete;
+
+    static const intptr_t INVALID = -1;
+
+    intptr_t mSocket = INVALID;
+
+    // the listener removes its socket file when it closes
+    string mListenPath;
+};
+
+#endif // _LocalSocket_h_
@@ -0,0 +1,197 @@
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+bool MappedFile::OpenRead(const char* aPath)
+{
+    Close();
+
+    mFile = CreateFileA(aPath, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+
+    if (mFile == INVALID_HANDLE_VALUE)
+    {
+        mFile = NULL;
+        return false;
+    }
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(mFile, &size))
+    {
+        Close();
+        return false;
+    }
+
+    mSize = uint64(size.QuadPart);
+    return Map(false);
+}
+
+bool MappedFile::Create(const char* aPath, uint64 aSize)
+{
+    Close();
+
+    mFile = CreateFileA(aPath, GENERIC_READ | GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+
+    if (mFile == INVALID_HANDLE_VALUE)
+    {
+        mFile = NULL;
+        return false;
+    }
+
+    mSize = aSize;
+    return Map(true);
+}
+
+bool MappedFile::Map(bool aWritable)
+{
+    mIsOpen = true;
+
+    // zero sized files can't be mapped
+    if (mSize == 0)
+        return true;
+
+    mMapping = CreateFileMappingA(mFile, NULL, aWritable ? PAGE_READWRITE : PAGE_READONLY, DWORD(mSize >> 32), DWORD(mSize), NULL);
+
+    if (!mMapping)
+    {
+        Close();
+        return false;
+    }
+
+    mData = (uint8*)MapViewOfFile(mMapping, aWritable ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, 0);
+
+    if (!mData)
+    {
+        Close();
+        return false;
+    }
+
+    return true;
+}
+
+void MappedFile::Release(uint64 aOffset, uint64 aSize) const
+{
+    if (!mData || aOffset >= mSize)
+        return;
+
+    // unlocking pages that aren't locked takes them out of the working set
+    VirtualUnlock(mData + aOffset, SIZE_T(C_Min(aSize, mSize - aOffset)));
+}
+
+void MappedFile::Close()
+{
+    if (mData)
+        UnmapViewOfFile(mData);
+
+    if (mMapping)
+        CloseHandle(mMapping);
+
+    if (mFile)
+        CloseHandle(mFile);
+
+    mData = NULL;
+    mMapping = NULL;
+    mFile = NULL;
+    mSize = 0;
+    mIsOpen = false;
+}
+
+#else
+
+bool MappedFile::OpenRead(const char* aPath)
+{
+    Close();
+
+    mFd = open(aPath, O_RDONLY);
+
+    if (mFd < 0)
+        return false;
+
+    struct stat st;
+    if (fstat(mFd, &st) != 0)
+    {
+        Close();
+        return false;
+    }
+
+    mSize = uint64(st.st_size);
+    return Map(false);
+}
+
+bool MappedFile::Create(const char* aPath, uint64 aSize)
+{
+    Close();
+
+    mFd = open(aPath, O_RDWR | O_CREAT | O_TRUNC, 0644);
+
+    if (mFd < 0)
+        return false;
+
+    if (ftruncate(mFd, off_t(aSize)) != 0)
+    {
+        Close();
+        return false;
+    }
+
+    mSize = aSize;
+    return Map(true);
+}
+
+bool MappedFile::Map(bool aWritable)
+{
+    mIsOpen = true;
+
+    // zero sized files can't be mapped
+    if (mSize == 0)
+        return true;
+
+    void* data = mmap(NULL, size_t(mSize), aWritable ? PROT_READ | PROT_WRITE : PROT_READ, aWritable ? MAP_SHARED : MAP_PRIVATE, mFd, 0);
+
+    if (data == MAP_FAILED)
+    {
+        Close();
+        return false;
+    }
+
+    mData = (uint8*)data;
+    return true;
+}
+
+void MappedFile::Release(uint64 aOffset, uint64 aSize) const
+{
+    if (!mData || aOffset >= mSize)
+        return;
+
+    // whole pages around the range, the mapping is private and unmodified so they are only dropped
+    const uint64 pageSize = uint64(sysconf(_SC_PAGESIZE));
+    const uint64 start = aOffset & ~(pageSize - 1);
+    const uint64 end = C_Min(aOffset + aSize, mSize);
+
+    madvise(mData + start, size_t(end - start), MADV_DONTNEED);
+}
+
+void MappedFile::Close()
+{
+    if (mData)
+        munmap(mData, size_t(mSize));
+
+    if (mFd >= 0)
+        close(mFd);
+
+    mData = NULL;
+    mFd = -1;
+    mSize = 0;
+    mIsOpen = false;
+}
+
+#endif
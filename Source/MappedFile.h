@@ -0,0 +1,42 @@
+#ifndef _MappedFile_h_
+#define _MappedFile_h_
+
+#include "C_Base.h"
+
+// memory mapped file, read-only or a newly created file mapped read/write
+class MappedFile
+{
+public:
+    MappedFile() {}
+    ~MappedFile() { Close(); }
+
+    bool OpenRead(const char* aPath);
+    bool Create(const char* aPath, uint64 aSize);
+    void Close();
+
+    // drops the pages of a read-only mapping from the working set, they are read again from the file when touched
+    void Release(uint64 aOffset, uint64 aSize) const;
+
+    uint8* GetData() const { return mData; }
+    uint64 GetSize() const { return mSize; }
+    bool IsOpen() const { return mIsOpen; }
+
+private:
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool Map(bool aWritable);
+
+    uint8* mData = NULL;
+    uint64 mSize = 0;
+    bool mIsOpen = false;
+
+#ifdef _WIN32
+    void* mFile = NULL;
+    void* mMapping = NULL;
+#else
+    int mFd = -1;
+#endif
+};
+
+#endif // _MappedFile_h_
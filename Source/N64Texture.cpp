@@ -0,0 +1,423 @@
+#include "N64Texture.h"
+#include "ColorQuantizer.h"
+#include "C_Vector.h"
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_IX86)
+#include <emmintrin.h>
+#define N64TEXTURE_SSE2
+#endif
+
+namespace N64Texture_private
+{
+    struct FormatInfo
+    {
+        const char* mName;
+        uint32 mBits;
+        int mTlutEntries;
+    };
+
+    static const FormatInfo sFormats[N64Texture::NUM_FORMATS] =
+    {
+        { "RGBA32", 32, 0 },
+        { "RGBA16", 16, 0 },
+        { "IA16", 16, 0 },
+        { "IA8", 8, 0 },
+        { "IA4", 4, 0 },
+        { "I8", 8, 0 },
+        { "I4", 4, 0 },
+        { "CI8", 8, 256 },
+        { "CI4", 4, 16 },
+    };
+
+    inline uint8 Expand5(uint32 v) { return uint8((v << 3) | (v >> 2)); }
+    inline uint8 Expand3(uint32 v) { return uint8((v << 5) | (v << 2) | (v >> 1)); }
+
+    inline void StorePixel(uint8* aOut, uint8 r, uint8 g, uint8 b, uint8 a)
+    {
+        aOut[0] = r;
+        aOut[1] = g;
+        aOut[2] = b;
+        aOut[3] = a;
+    }
+
+    // each kernel converts aCount texels, the simd loops leave the tail to the scalar code
+
+    void DecodeRGBA16(const uint8* aIn, uint32 aCount, uint8* aOut)
+    {
+        uint32 i = 0;
+
+#if defined(N64TEXTURE_SSE2)
+        const __m128i mask5 = _mm_set1_epi16(0x1F);
+        const __m128i mask1 = _mm_set1_epi16(0x01);
+
+        for (; i + 8 <= aCount; i += 8)
+        {
+            __m128i v = _mm_loadu_si128((const __m128i*)(aIn + i * 2));
+            v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+
+            __m128i r = _mm_srli_epi16(v, 11);
+            __m128i g = _mm_and_si128(_mm_srli_epi16(v, 6), mask5);
+            __m128i b = _mm_and_si128(_mm_srli_epi16(v, 1), mask5);
+            __m128i a = _mm_sub_epi16(_mm_setzero_si128(), _mm_and_si128(v, mask1));
+
+            r = _mm_or_si128(_mm_slli_epi16(r, 3), _mm_srli_epi16(r, 2));
+            g = _mm_or_si128(_mm_slli_epi16(g, 3), _mm_srli_epi16(g, 2));
+            b = _mm_or_si128(_mm_slli_epi16(b, 3), _mm_srli_epi16(b, 2));
+
+            const __m128i rg = _mm_or_si128(r, _mm_slli_epi16(g, 8));
+            const __m128i ba = _mm_or_si128(b, _mm_slli_epi16(a, 8));
+
+            _mm_storeu_si128((__m128i*)(aOut + i * 4), _mm_unpacklo_epi16(rg, ba));
+            _mm_storeu_si128((__m128i*)(aOut + i * 4 + 16), _mm_unpackhi_epi16(rg, ba));
+        }
+#endif
+
+        for (; i < aCount; ++i)
+        {
+            const uint32 v = (aIn[i * 2] << 8) | aIn[i * 2 + 1];
+            StorePixel(aOut + i * 4, Expand5(v >> 11), Expand5((v >> 6) & 0x1F), Expand5((v >> 1) & 0x1F), (v & 1) ? 0xFF : 0);
+        }
+    }
+
+    void DecodeIA16(const uint8* aIn, uint32 aCount, uint8* aOut)
+    {
+        uint32 i = 0;
+
+#if defined(N64TEXTURE_SSE2)
+        const __m128i maskLow = _mm_set1_epi16(0xFF);
+
+        for (; i + 8 <= aCount; i += 8)
+        {
+            // bytes are already intensity, alpha
+            const __m128i ia = _mm_loadu_si128((const __m128i*)(aIn + i * 2));
+            const __m128i intensity = _mm_and_si128(ia, maskLow);
+            const __m128i ii = _mm_or_si128(intensity, _mm_slli_epi16(intensity, 8));
+
+            _mm_storeu_si128((__m128i*)(aOut + i * 4), _mm_unpacklo_epi16(ii, ia));
+            _mm_storeu_si128((__m128i*)(aOut + i * 4 + 16), _mm_unpackhi_epi16(ii, ia));
+        }
+#endif
+
+        for (; i < aCount; ++i)
+        {
+            const uint8 intensity = aIn[i * 2];
+            StorePixel(aOut + i * 4, intensity, intensity, intensity, aIn[i * 2 + 1]);
+        }
+    }
+
+#if defined(N64TEXTURE_SSE2)
+    // 16 intensity/alpha byte pairs to rgba
+    inline void StoreIA(__m128i aIntensity, __m128i aAlpha, uint8* aOut)
+    {
+        const __m128i iiLo = _mm_unpacklo_epi8(aIntensity, aIntensity);
+        const __m128i iiHi = _mm_unpackhi_epi8(aIntensity, aIntensity);
+        const __m128i iaLo = _mm_unpacklo_epi8(aIntensity, aAlpha);
+        const __m128i iaHi = _mm_unpackhi_epi8(aIntensity, aAlpha);
+
+        _mm_storeu_si128((__m128i*)(aOut), _mm_unpacklo_epi16(iiLo, iaLo));
+        _mm_storeu_si128((__m128i*)(aOut + 16), _mm_unpackhi_epi16(iiLo, iaLo));
+        _mm_storeu_si128((__m128i*)(aOut + 32), _mm_unpacklo_epi16(iiHi, iaHi));
+        _mm_storeu_si128((__m128i*)(aOut + 48), _mm_unpackhi_epi16(iiHi, iaHi));
+    }
+
+    // 16 4-bit values from the low nibbles of 16 bytes scaled to 8 bits
+    inline __m128i Expand4(__m128i aNibbles)
+    {
+        return _mm_or_si128(aNibbles, _mm_and_si128(_mm_slli_epi16(aNibbles, 4), _mm_set1_epi8((char)0xF0)));
+    }
+
+    // splits 8 bytes into 16 nibbles, high nibble first
+    inline __m128i SplitNibbles(const uint8* aIn)
+    {
+        const __m128i mask4 = _mm_set1_epi8(0x0F);
+        const __m128i v = _mm_loadl_epi64((const __m128i*)aIn);
+        const __m128i hi = _mm_and_si128(_mm_srli_epi16(v, 4), mask4);
+        const __m128i lo = _mm_and_si128(v, mask4);
+        return _mm_unpacklo_epi8(hi, lo);
+    }
+#endif
+
+    void DecodeI8(const uint8* aIn, uint32 aCount, uint8* aOut)
+    {
+        uint32 i = 0;
+
+#if defined(N64TEXTURE_SSE2)
+        for (; i + 16 <= aCount; i += 16)
+        {
+            const __m128i v = _mm_loadu_si128((const __m128i*)(aIn + i));
+            StoreIA(v, v, aOut + i * 4);
+        }
+#endif
+
+        for (; i < aCount; ++i)
+            StorePixel(aOut + i * 4, aIn[i], aIn[i], aIn[i], aIn[i]);
+    }
+
+    void DecodeIA8(const uint8* aIn, uint32 aCount, uint8* aOut)
+    {
+        uint32 i = 0;
+
+#if defined(N64TEXTURE_SSE2)
+        const __m128i mask4 = _mm_set1_epi8(0x0F);
+
+        for (; i + 16 <= aCount; i += 16)
+        {
+            const __m128i v = _mm_loadu_si128((const __m128i*)(aIn + i));
+            const __m128i intensity = Expand4(_mm_and_si128(_mm_srli_epi16(v, 4), mask4));
+            const __m128i alpha = Expand4(_mm_and_si128(v, mask4));
+            StoreIA(intensity, alpha, aOut + i * 4);
+        }
+#endif
+
+        for (; i < aCount; ++i)
+        {
+            const uint8 intensity = uint8((aIn[i] >> 4) * 0x11);
+            StorePixel(aOut + i * 4, intensity, intensity, intensity, uint8((aIn[i] & 0xF) * 0x11));
+        }
+    }
+
+    inline uint8 GetNibble(const uint8* aIn, uint32 aIndex)
+    {
+        return (aIndex & 1) ? (aIn[aIndex >> 1] & 0xF) : (aIn[aIndex >> 1] >> 4);
+    }
+
+    void DecodeI4(const uint8* aIn, uint32 aCount, uint8* aOut)
+    {
+        uint32 i = 0;
+
+#if defined(N64TEXTURE_SSE2)
+        for (; i + 16 <= aCount; i += 16)
+        {
+            const __m128i v = Expand4(SplitNibbles(aIn + i / 2));
+            StoreIA(v, v, aOut + i * 4);
+        }
+#endif
+
+        for (; i < aCount; ++i)
+        {
+            const uint8 intensity = uint8(GetNibble(aIn, i) * 0x11);
+            StorePixel(aOut + i * 4, intensity, intensity, intensity, intensity);
+        }
+    }
+
+    void DecodeIA4(const uint8* aIn, uint32 aCount, uint8* aOut)
+    {
+        uint32 i = 0;
+
+#if defined(N64TEXTURE_SSE2)
+        const __m128i mask1 = _mm_set1_epi8(0x01);
+        const __m128i mask3 = _mm_set1_epi8(0x07);
+
+        for (; i + 16 <= aCount; i += 16)
+        {
+            const __m128i n = SplitNibbles(aIn + i / 2);
+
+            // iii -> iiiiiiii, there are no 8-bit shifts so right shifts get masked
+            const __m128i i3 = _mm_and_si128(_mm_srli_epi16(n, 1), mask3);
+            const __m128i intensity = _mm_or_si128(_mm_or_si128(_mm_slli_epi16(i3, 5), _mm_slli_epi16(i3, 2)),
+                _mm_and_si128(_mm_srli_epi16(i3, 1), _mm_set1_epi8(0x03)));
+            const __m128i alpha = _mm_sub_epi8(_mm_setzero_si128(), _mm_and_si128(n, mask1));
+
+            StoreIA(intensity, alpha, aOut + i * 4);
+        }
+#endif
+
+        for (; i < aCount; ++i)
+        {
+            const uint8 n = GetNibble(aIn, i);
+            const uint8 intensity = Expand3(n >> 1);
+            StorePixel(aOut + i * 4, intensity, intensity, intensity, (n & 1) ? 0xFF : 0);
+        }
+    }
+
+    void DecodeCI(const uint8* aIn, uint32 aCount, bool a4Bit, const uint8* aTlut, uint8* aOut)
+    {
+        // palette decoded once, then a plain gather
+        uint32 palette[256];
+        DecodeRGBA16(aTlut, a4Bit ? 16 : 256, (uint8*)palette);
+
+        uint32* out = (uint32*)aOut;
+
+        if (a4Bit)
+        {
+            for (uint32 i = 0; i < aCount; ++i)
+                memcpy(out + i, palette + GetNibble(aIn, i), 4);
+        }
+        else
+        {
+            for (uint32 i = 0; i < aCount; ++i)
+                memcpy(out + i, palette + aIn[i], 4);
+        }
+    }
+}
+
+namespace N64Texture_private
+{
+    inline uint32 Quantize(uint32 aValue, uint32 aMax) { return (aValue * aMax + 127) / 255; }
+
+    inline uint8 GetIntensity(const uint8* aPixel)
+    {
+        return uint8((aPixel[0] * 77 + aPixel[1] * 150 + aPixel[2] * 29 + 128) >> 8);
+    }
+
+    inline uint16 ToRGBA16(const uint8* aPixel)
+    {
+        return uint16((Quantize(aPixel[0], 31) << 11) | (Quantize(aPixel[1], 31) << 6) | (Quantize(aPixel[2], 31) << 1) | (aPixel[3] >= 0x80 ? 1 : 0));
+    }
+
+    inline void SetNibble(uint8* aOut, uint32 aIndex, uint32 aValue)
+    {
+        if (aIndex & 1)
+            aOut[aIndex >> 1] = uint8((aOut[aIndex >> 1] & 0xF0) | aValue);
+        else
+            aOut[aIndex >> 1] = uint8((aOut[aIndex >> 1] & 0x0F) | (aValue << 4));
+    }
+
+    void EncodeCI(const uint8* aRGBA, uint32 aCount, bool a4Bit, uint8* aOut, uint8* aOutTlut)
+    {
+        C_Vector<uint16> colors;
+        colors.Resize(aCount);
+
+        for (uint32 i = 0; i < aCount; ++i)
+            colors[i] = ToRGBA16(aRGBA + i * 4);
+
+        const int numEntries = a4Bit ? 16 : 256;
+
+        C_Vector<uint16> palette;
+        C_Vector<uint8> indices;
+        ColorQuantizer::Quantize5551(colors.GetBuffer(), int(aCount), numEntries, palette, indices);
+
+        // unused entries are zero
+        memset(aOutTlut, 0, numEntries * 2);
+
+        for (int i = 0; i < palette.Count(); ++i)
+        {
+            aOutTlut[i * 2] = uint8(palette[i] >> 8);
+            aOutTlut[i * 2 + 1] = uint8(palette[i]);
+        }
+
+        for (uint32 i = 0; i < aCount; ++i)
+        {
+            if (a4Bit)
+                SetNibble(aOut, i, indices[i]);
+            else
+                aOut[i] = indices[i];
+        }
+    }
+}
+
+const char* N64Texture::GetFormatName(Format aFormat)
+{
+    return N64Texture_private::sFormats[aFormat].mName;
+}
+
+bool N64Texture::ParseFormatName(const char* aName, Format& aOut)
+{
+    for (int i = 0; i < NUM_FORMATS; ++i)
+    {
+        if (strcmp(N64Texture_private::sFormats[i].mName, aName) == 0)
+        {
+            aOut = Format(i);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+uint32 N64Texture::GetBitsPerTexel(Format aFormat)
+{
+    return N64Texture_private::sFormats[aFormat].mBits;
+}
+
+uint32 N64Texture::GetDataSize(Format aFormat, int aWidth, int aHeight)
+{
+    return (uint32(aWidth) * aHeight * GetBitsPerTexel(aFormat) + 7) / 8;
+}
+
+int N64Texture::GetNumTlutEntries(Format aFormat)
+{
+    return N64Texture_private::sFormats[aFormat].mTlutEntries;
+}
+
+void N64Texture::Decode(Format aFormat, const uint8* aData, int aWidth, int aHeight, const uint8* aTlut, uint8* aOutRGBA)
+{
+    using namespace N64Texture_private;
+
+    const uint32 count = uint32(aWidth) * aHeight;
+
+    switch (aFormat)
+    {
+        case FMT_RGBA32: memcpy(aOutRGBA, aData, count * 4); break;
+        case FMT_RGBA16: DecodeRGBA16(aData, count, aOutRGBA); break;
+        case FMT_IA16: DecodeIA16(aData, count, aOutRGBA); break;
+        case FMT_IA8: DecodeIA8(aData, count, aOutRGBA); break;
+        case FMT_IA4: DecodeIA4(aData, count, aOutRGBA); break;
+        case FMT_I8: DecodeI8(aData, count, aOutRGBA); break;
+        case FMT_I4: DecodeI4(aData, count, aOutRGBA); break;
+        case FMT_CI8: DecodeCI(aData, count, false, aTlut, aOutRGBA); break;
+        case FMT_CI4: DecodeCI(aData, count, true, aTlut, aOutRGBA); break;
+        default: WAR_ASSERT(false, "Invalid texture format"); break;
+    }
+}
+
+void N64Texture::Encode(Format aFormat, const uint8* aRGBA, int aWidth, int aHeight, uint8* aOutData, uint8* aOutTlut)
+{
+    using namespace N64Texture_private;
+
+    const uint32 count = uint32(aWidth) * aHeight;
+
+    // odd sized 4-bit images leave half of the last byte
+    memset(aOutData, 0, GetDataSize(aFormat, aWidth, aHeight));
+
+    if (aFormat == FMT_CI8 || aFormat == FMT_CI4)
+    {
+        EncodeCI(aRGBA, count, aFormat == FMT_CI4, aOutData, aOutTlut);
+        return;
+    }
+
+    for (uint32 i = 0; i < count; ++i)
+    {
+        const uint8* p = aRGBA + i * 4;
+
+        switch (aFormat)
+        {
+            case FMT_RGBA32:
+                memcpy(aOutData + i * 4, p, 4);
+                break;
+
+            case FMT_RGBA16:
+            {
+                const uint16 v = ToRGBA16(p);
+                aOutData[i * 2] = uint8(v >> 8);
+                aOutData[i * 2 + 1] = uint8(v);
+                break;
+            }
+
+            case FMT_IA16:
+                aOutData[i * 2] = GetIntensity(p);
+                aOutData[i * 2 + 1] = p[3];
+                break;
+
+            case FMT_IA8:
+                aOutData[i] = uint8((Quantize(GetIntensity(p), 15) << 4) | Quantize(p[3], 15));
+                break;
+
+            case FMT_IA4:
+                SetNibble(aOutData, i, (Quantize(GetIntensity(p), 7) << 1) | (p[3] >= 0x80 ? 1 : 0));
+                break;
+
+            case FMT_I8:
+                aOutData[i] = GetIntensity(p);
+                break;
+
+            case FMT_I4:
+                SetNibble(aOutData, i, Quantize(GetIntensity(p), 15));
+                break;
+
+            default:
+                break;
+        }
+    }
+}
@@ -0,0 +1,42 @@
+#ifndef _N64Texture_h_
+#define _N64Texture_h_
+
+#include "C_Base.h"
+
+// n64 texel formats, big-endian as stored in rom
+namespace N64Texture
+{
+    enum Format
+    {
+        FMT_RGBA32,
+        FMT_RGBA16,  // 5551
+        FMT_IA16,
+        FMT_IA8,
+        FMT_IA4,
+        FMT_I8,
+        FMT_I4,
+        FMT_CI8,     // rgba16 tlut
+        FMT_CI4,     // rgba16 tlut
+
+        NUM_FORMATS
+    };
+
+    const char* GetFormatName(Format aFormat);
+    bool ParseFormatName(const char* aName, Format& aOut);
+
+    uint32 GetBitsPerTexel(Format aFormat);
+
+    // bytes of texel data, not including the tlut
+    uint32 GetDataSize(Format aFormat, int aWidth, int aHeight);
+
+    // tlut entries for the ci formats, 0 otherwise
+    int GetNumTlutEntries(Format aFormat);
+
+    // decodes to rgba8, aTlut is only used by the ci formats. aData must hold GetDataSize() bytes
+    void Decode(Format aFormat, const uint8* aData, int aWidth, int aHeight, const uint8* aTlut, uint8* aOutRGBA);
+
+    // encodes rgba8, the ci formats also quantise and fill aOutTlut. aOutData must hold GetDataSize() bytes
+    void Encode(Format aFormat, const uint8* aRGBA, int aWidth, int aHeight, uint8* aOutData, uint8* aOutTlut);
+}
+
+#endif // _N64Texture_h_
@@ -0,0 +1,537 @@
+#include "PNG.h"
+#include "BigEndian.h"
+#include "BinUtils.h"
+#include "Deflate.h"
+#include "C_FileSystem.h"
+#include "CL_Log.h"
+#include <stdlib.h>
+
+namespace PNG_private
+{
+    static const uint8 sSignature[8] = { 0x89, 'P', 'N', 'G', 0x0D, 0x0A, 0x1A, 0x0A };
+
+    enum Filter
+    {
+        FILTER_NONE,
+        FILTER_SUB,
+        FILTER_UP,
+        FILTER_AVERAGE,
+        FILTER_PAETH,
+
+        NUM_FILTERS
+    };
+
+    // pass the previous result in aAdler to continue a running checksum
+    uint32 Adler32(const uint8* aData, uint32 aSize, uint32 aAdler = 1)
+    {
+        uint32 a = aAdler & 0xFFFF;
+        uint32 b = aAdler >> 16;
+
+        while (aSize > 0)
+        {
+            // largest block before b can overflow
+            const uint32 n = C_Min(aSize, 5552u);
+
+            for (uint32 i = 0; i < n; ++i)
+            {
+                a += aData[i];
+                b += a;
+            }
+
+            a %= 65521;
+            b %= 65521;
+            aData += n;
+            aSize -= n;
+        }
+
+        return (b << 16) | a;
+    }
+
+    inline uint8 Paeth(int a, int b, int c)
+    {
+        const int p = a + b - c;
+        const int pa = abs(p - a);
+        const int pb = abs(p - b);
+        const int pc = abs(p - c);
+
+        if (pa <= pb && pa <= pc)
+            return uint8(a);
+
+        return uint8(pb <= pc ? b : c);
+    }
+
+    void FilterRow(Filter aFilter, const uint8* aRow, const uint8* aPrev, uint32 aStride, uint8* aOut)
+    {
+        for (uint32 i = 0; i < aStride; ++i)
+        {
+            const int left = i >= 4 ? aRow[i - 4] : 0;
+            const int up = aPrev ? aPrev[i] : 0;
+            const int upLeft = (aPrev && i >= 4) ? aPrev[i - 4] : 0;
+            int pred = 0;
+
+            switch (aFilter)
+            {
+                case FILTER_SUB: pred = left; break;
+                case FILTER_UP: pred = up; break;
+                case FILTER_AVERAGE: pred = (left + up) >> 1; break;
+                case FILTER_PAETH: pred = Paeth(left, up, upLeft); break;
+                default: break;
+            }
+
+            aOut[i] = uint8(aRow[i] - pred);
+        }
+    }
+
+    enum ColorType
+    {
+        COLOR_GRAY = 0,
+        COLOR_RGB = 2,
+        COLOR_PALETTE = 3,
+        COLOR_GRAY_ALPHA = 4,
+        COLOR_RGBA = 6,
+    };
+
+    int GetNumChannels(int aColorType)
+    {
+        switch (aColorType)
+        {
+            case COLOR_GRAY: return 1;
+            case COLOR_RGB: return 3;
+            case COLOR_PALETTE: return 1;
+            case COLOR_GRAY_ALPHA: return 2;
+            case COLOR_RGBA: return 4;
+            default: return 0;
+        }
+    }
+
+    // reverses the row filters in place, aBpp is bytes per pixel rounded up
+    bool Unfilter(uint8* aData, uint32 aRowBytes, int aHeight, uint32 aBpp)
+    {
+        const uint8* prev = NULL;
+
+        for (int y = 0; y < aHeight; ++y)
+        {
+            uint8* line = aData + y * (aRowBytes + 1);
+            const uint8 filter = line[0];
+            uint8* row = line + 1;
+
+            for (uint32 i = 0; i < aRowBytes; ++i)
+            {
+                const int left = i >= aBpp ? row[i - aBpp] : 0;
+                const int up = prev ? prev[i] : 0;
+                const int upLeft = (prev && i >= aBpp) ? prev[i - aBpp] : 0;
+
+                switch (filter)
+                {
+                    case FILTER_NONE: break;
+                    case FILTER_SUB: row[i] = uint8(row[i] + left); break;
+                    case FILTER_UP: row[i] = uint8(row[i] + up); break;
+                    case FILTER_AVERAGE: row[i] = uint8(row[i] + ((left + up) >> 1)); break;
+                    case FILTER_PAETH: row[i] = uint8(row[i] + Paeth(left, up, upLeft)); break;
+                    default: return false;
+                }
+            }
+
+            prev = row;
+        }
+
+        return true;
+    }
+
+    // sample x of a row with aBits per sample, scaled to 8 bits unless it's a palette index
+    inline uint8 GetSample(const uint8* aRow, uint32 aIndex, int aBits, bool aScale)
+    {
+        switch (aBits)
+        {
+            case 8: return aRow[aIndex];
+            case 16: return aRow[aIndex * 2];
+            default:
+            {
+                const uint32 bit = aIndex * aBits;
+                const uint8 v = uint8((aRow[bit >> 3] >> (8 - aBits - (bit & 7))) & ((1 << aBits) - 1));
+                return aScale ? uint8(v * 255 / ((1 << aBits) - 1)) : v;
+            }
+        }
+    }
+
+    // filters aNumRows rows into aOut, each behind its filter byte. aPrev is the row above the first, if any
+    void FilterRows(const uint8* aRGBA, const uint8* aPrev, int aNumRows, uint32 aStride, C_Vector<uint8>& aOut)
+    {
+        // filter per row by the smallest sum of absolute differences, the usual heuristic
+        aOut.Resize((aStride + 1) * aNumRows);
+
+        C_Vector<uint8> candidate;
+        candidate.Resize(aStride);
+
+        for (int y = 0; y < aNumRows; ++y)
+        {
+            const uint8* row = aRGBA + y * aStride;
+            const uint8* prev = y > 0 ? row - aStride : aPrev;
+            uint8* out = aOut.GetBuffer() + y * (aStride + 1);
+            uint32 bestCost = 0xFFFFFFFF;
+
+            for (int f = 0; f < NUM_FILTERS; ++f)
+            {
+                FilterRow(Filter(f), row, prev, aStride, candidate.GetBuffer());
+
+                uint32 cost = 0;
+                for (uint32 i = 0; i < aStride; ++i)
+                    cost += abs(int(int8(candidate[i])));
+
+                if (cost < bestCost)
+                {
+                    bestCost = cost;
+                    out[0] = uint8(f);
+                    memcpy(out + 1, candidate.GetBuffer(), aStride);
+                }
+            }
+        }
+    }
+
+    // zlib header, deflate level 0-9 maps to its 2-bit level hint
+    void AddZlibHeader(int aLevel, C_Vector<uint8>& aOut)
+    {
+        aOut.Add(0x78);
+        aOut.Add(aLevel >= 7 ? 0xDA : aLevel >= 6 ? 0x9C : aLevel >= 2 ? 0x5E : 0x01);
+    }
+
+    void MakeHeader(int aWidth, int aHeight, uint8* aOut)
+    {
+        BigEndian::Store<uint32>(aOut, uint32(aWidth));
+        BigEndian::Store<uint32>(aOut + 4, uint32(aHeight));
+        aOut[8] = 8;   // bit depth
+        aOut[9] = 6;   // rgba
+        aOut[10] = 0;  // deflate
+        aOut[11] = 0;  // adaptive filtering
+        aOut[12] = 0;  // no interlace
+    }
+
+    const uint32 HEADER_SIZE = 13;
+
+    void WriteChunk(const char* aType, const uint8* aData, uint32 aSize, C_Vector<uint8>& aOut)
+    {
+        const int start = aOut.Count();
+        aOut.Resize(start + 12 + aSize);
+        uint8* p = aOut.GetBuffer() + start;
+
+        BigEndian::Store<uint32>(p, aSize);
+        memcpy(p + 4, aType, 4);
+
+        if (aSize > 0)
+            memcpy(p + 8, aData, aSize);
+
+        BigEndian::Store<uint32>(p + 8 + aSize, BinUtils::CRC32(p + 4, aSize + 4));
+    }
+}
+
+void PNG::Encode(const uint8* aRGBA, int aWidth, int aHeight, int aLevel, C_Vector<uint8>& aOut)
+{
+    using namespace PNG_private;
+
+    const uint32 stride = uint32(aWidth) * 4;
+
+    C_Vector<uint8> filtered;
+    FilterRows(aRGBA, NULL, aHeight, stride, filtered);
+
+    C_Vector<uint8> idat;
+    AddZlibHeader(aLevel, idat);
+    Deflate::Compress(filtered.GetBuffer(), filtered.Count(), aLevel, idat);
+
+    const int adlerPos = idat.Count();
+    idat.Resize(adlerPos + 4);
+    BigEndian::Store<uint32>(idat.GetBuffer() + adlerPos, Adler32(filtered.GetBuffer(), filtered.Count()));
+
+    uint8 header[HEADER_SIZE];
+    MakeHeader(aWidth, aHeight, header);
+
+    for (uint8 b : sSignature)
+        aOut.Add(b);
+
+    WriteChunk("IHDR", header, sizeof(header), aOut);
+    WriteChunk("IDAT", idat.GetBuffer(), idat.Count(), aOut);
+    WriteChunk("IEND", NULL, 0, aOut);
+}
+
+bool PNG::Write(const char* aPath, const uint8* aRGBA, int aWidth, int aHeight, int aLevel /*= 6*/)
+{
+    C_Vector<uint8> png;
+    Encode(aRGBA, aWidth, aHeight, aLevel, png);
+
+    return C_FileSystem::WriteFile(aPath, png.GetBuffer(), png.Count());
+}
+
+bool PNG::Writer::Open(const char* aPath, int aWidth, int aHeight, int aLevel /*= 6*/)
+{
+    using namespace PNG_private;
+
+    C_FileHandle handle;
+    if (!C_FileSystem::Open(handle, aPath, C_FileSystem::FileWriteDiscard))
+    {
+        WAR_LOG_ERROR(CAT_GENERAL, "Failed to open file: %s", aPath);
+        return false;
+    }
+
+    mStream = new C_Stream(handle, true);
+    mWidth = aWidth;
+    mHeight = aHeight;
+    mLevel = aLevel;
+    mRow = 0;
+    mAdler = 1;
+    mLastRow.Clear();
+
+    uint8 header[HEADER_SIZE];
+    MakeHeader(aWidth, aHeight, header);
+
+    mOk = uint32(mStream->WriteBytes((void*)sSignature, sizeof(sSignature))) == sizeof(sSignature);
+    mOk = mOk && WriteChunk("IHDR", header, sizeof(header));
+    return mOk;
+}
+
+bool PNG::Writer::WriteRows(const uint8* aRGBA, int aNumRows)
+{
+    using namespace PNG_private;
+
+    if (!mOk || aNumRows <= 0 || mRow + aNumRows > mHeight)
+        return mOk = false;
+
+    const uint32 stride = uint32(mWidth) * 4;
+
+    // filters can look at the row above, the last row of the band before
+    C_Vector<uint8> filtered;
+    FilterRows(aRGBA, mRow > 0 ? mLastRow.GetBuffer() : NULL, aNumRows, stride, filtered);
+
+    mLastRow.Resize(stride);
+    memcpy(mLastRow.GetBuffer(), aRGBA + (aNumRows - 1) * stride, stride);
+    mRow += aNumRows;
+
+    C_Vector<uint8> idat;
+
+    if (mRow == aNumRows)
+        AddZlibHeader(mLevel, idat);
+
+    const bool last = mRow == mHeight;
+    Deflate::Compress(filtered.GetBuffer(), filtered.Count(), mLevel, idat, last);
+    mAdler = Adler32(filtered.GetBuffer(), filtered.Count(), mAdler);
+
+    if (last)
+    {
+        const int adlerPos = idat.Count();
+        idat.Resize(adlerPos + 4);
+        BigEndian::Store<uint32>(idat.GetBuffer() + adlerPos, mAdler);
+    }
+
+    return mOk = WriteChunk("IDAT", idat.GetBuffer(), idat.Count());
+}
+
+bool PNG::Writer::Close()
+{
+    const bool ok = mOk && mRow > 0 && mRow == mHeight && WriteChunk("IEND", NULL, 0);
+
+    mStream = NULL;
+    mLastRow.Clear();
+    mOk = false;
+    return ok;
+}
+
+bool PNG::Writer::WriteChunk(const char* aType, const uint8* aData, uint32 aSize)
+{
+    C_Vector<uint8> chunk;
+    PNG_private::WriteChunk(aType, aData, aSize, chunk);
+
+    return uint32(mStream->WriteBytes(chunk.GetBuffer(), chunk.Count())) == uint32(chunk.Count());
+}
+
+bool PNG::Decode(const uint8* aData, uint32 aSize, C_Vector<uint8>& aOutRGBA, int& aOutWidth, int& aOutHeight)
+{
+    using namespace PNG_private;
+
+    if (aSize < 8 || memcmp(aData, sSignature, 8) != 0)
+    {
+        WAR_LOG_ERROR(CAT_GENERAL, "Not a png file");
+        return false;
+    }
+
+    uint32 width = 0;
+    uint32 height = 0;
+    int bitDepth = 0;
+    int colorType = -1;
+    int interlace = 0;
+    uint8 palette[256][4];
+    C_Vector<uint8> idat;
+
+    for (int i = 0; i < 256; ++i)
+    {
+        palette[i][0] = palette[i][1] = palette[i][2] = 0;
+        palette[i][3] = 0xFF;
+    }
+
+    // color key from tRNS for gray and rgb images
+    int transparent[3] = { -1, -1, -1 };
+
+    uint32 pos = 8;
+
+    while (pos + 12 <= aSize)
+    {
+        const uint32 len = BigEndian::Load<uint32>(aData + pos);
+        const uint8* type = aData + pos + 4;
+        const uint8* body = aData + pos + 8;
+
+        if (len > aSize - pos - 12)
+        {
+            WAR_LOG_ERROR(CAT_GENERAL, "Truncated png chunk");
+            return false;
+        }
+
+        if (BinUtils::CRC32(type, len + 4) != BigEndian::Load<uint32>(body + len))
+        {
+            WAR_LOG_ERROR(CAT_GENERAL, "Png chunk checksum mismatch");
+            return false;
+        }
+
+        if (memcmp(type, "IHDR", 4) == 0 && len >= 13)
+        {
+            width = BigEndian::Load<uint32>(body);
+            height = BigEndian::Load<uint32>(body + 4);
+            bitDepth = body[8];
+            colorType = body[9];
+            interlace = body[12];
+        }
+        else if (memcmp(type, "PLTE", 4) == 0)
+        {
+            for (uint32 i = 0; i < C_Min(len / 3, 256u); ++i)
+            {
+                palette[i][0] = body[i * 3];
+                palette[i][1] = body[i * 3 + 1];
+                palette[i][2] = body[i * 3 + 2];
+            }
+        }
+        else if (memcmp(type, "tRNS", 4) == 0)
+        {
+            if (colorType == COLOR_PALETTE)
+            {
+                for (uint32 i = 0; i < C_Min(len, 256u); ++i)
+                    palette[i][3] = body[i];
+            }
+            else if (colorType == COLOR_GRAY && len >= 2)
+            {
+                transparent[0] = BigEndian::Load<uint16>(body);
+            }
+            else if (colorType == COLOR_RGB && len >= 6)
+            {
+                for (int c = 0; c < 3; ++c)
+                    transparent[c] = BigEndian::Load<uint16>(body + c * 2);
+            }
+        }
+        else if (memcmp(type, "IDAT", 4) == 0)
+        {
+            const int start = idat.Count();
+            idat.Resize(start + len);
+            memcpy(idat.GetBuffer() + start, body, len);
+        }
+        else if (memcmp(type, "IEND", 4) == 0)
+        {
+            break;
+        }
+
+        pos += 12 + len;
+    }
+
+    const int channels = GetNumChannels(colorType);
+
+    if (width == 0 || height == 0 || width > 0x4000 || height > 0x4000 || channels == 0)
+    {
+        WAR_LOG_ERROR(CAT_GENERAL, "Unsupported png header");
+        return false;
+    }
+
+    if (interlace != 0)
+    {
+        WAR_LOG_ERROR(CAT_GENERAL, "Interlaced pngs aren't supported");
+        return false;
+    }
+
+    if (bitDepth != 1 && bitDepth != 2 && bitDepth != 4 && bitDepth != 8 && bitDepth != 16)
+    {
+        WAR_LOG_ERROR(CAT_GENERAL, "Unsupported png bit depth %i", bitDepth);
+        return false;
+    }
+
+    const uint32 rowBytes = (width * channels * bitDepth + 7) / 8;
+    const uint32 bpp = C_Max(1u, uint32(channels * bitDepth / 8));
+
+    // zlib header, then the deflate stream
+    C_Vector<uint8> filtered;
+    filtered.Resize((rowBytes + 1) * height);
+
+    if (idat.Count() < 2 || (idat[0] & 0x0F) != 8 || (idat[1] & 0x20) != 0 ||
+        !Deflate::Inflate(idat.GetBuffer() + 2, idat.Count() - 2, filtered.GetBuffer(), filtered.Count()) ||
+        !Unfilter(filtered.GetBuffer(), rowBytes, int(height), bpp))
+    {
+        WAR_LOG_ERROR(CAT_GENERAL, "Corrupt png image data");
+        return false;
+    }
+
+    aOutWidth = int(width);
+    aOutHeight = int(height);
+    aOutRGBA.Resize(width * height * 4);
+
+    // 16-bit color keys compare against the full sample, lower depths against the raw value
+    auto getKeySample = [&](const uint8* aRow, uint32 aIndex) -> int
+    {
+        if (bitDepth == 16)
+            return (aRow[aIndex * 2] << 8) | aRow[aIndex * 2 + 1];
+
+        return GetSample(aRow, aIndex, bitDepth, false);
+    };
+
+    for (uint32 y = 0; y < height; ++y)
+    {
+        const uint8* row = filtered.GetBuffer() + y * (rowBytes + 1) + 1;
+        uint8* out = aOutRGBA.GetBuffer() + y * width * 4;
+        const bool scale = colorType != COLOR_PALETTE;
+
+        for (uint32 x = 0; x < width; ++x, out += 4)
+        {
+            switch (colorType)
+            {
+                case COLOR_GRAY:
+                {
+                    const uint8 v = GetSample(row, x, bitDepth, scale);
+                    out[0] = out[1] = out[2] = v;
+                    out[3] = getKeySample(row, x) == transparent[0] ? 0 : 0xFF;
+                    break;
+                }
+
+                case COLOR_RGB:
+                {
+                    bool keyed = true;
+
+                    for (int c = 0; c < 3; ++c)
+                    {
+                        out[c] = GetSample(row, x * 3 + c, bitDepth, scale);
+                        keyed = keyed && getKeySample(row, x * 3 + c) == transparent[c];
+                    }
+
+                    out[3] = keyed ? 0 : 0xFF;
+                    break;
+                }
+
+                case COLOR_PALETTE:
+                    memcpy(out, palette[GetSample(row, x, bitDepth, false)], 4);
+                    break;
+
+                case COLOR_GRAY_ALPHA:
+                    out[0] = out[1] = out[2] = GetSample(row, x * 2, bitDepth, scale);
+                    out[3] = GetSample(row, x * 2 + 1, bitDepth, scale);
+                    break;
+
+                case COLOR_RGBA:
+                    for (int c = 0; c < 4; ++c)
+                        out[c] = GetSample(row, x * 4 + c, bitDepth, scale);
+                    break;
+            }
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,46 @@
+#ifndef _PNG_h_
+#define _PNG_h_
+
+#include "C_Base.h"
+#include "C_Vector.h"
+#include "C_Stream.h"
+
+// 8-bit rgba png images
+namespace PNG
+{
+    // encodes to memory, aLevel is the deflate level
+    void Encode(const uint8* aRGBA, int aWidth, int aHeight, int aLevel, C_Vector<uint8>& aOut);
+
+    bool Write(const char* aPath, const uint8* aRGBA, int aWidth, int aHeight, int aLevel = 6);
+
+    // decodes any non-interlaced png to 8-bit rgba, 16-bit channels are truncated
+    bool Decode(const uint8* aData, uint32 aSize, C_Vector<uint8>& aOutRGBA, int& aOutWidth, int& aOutHeight);
+
+    // writes a png a few rows at a time so a big image is never in memory whole. each WriteRows call is one
+    // IDAT chunk, compressed without matches into the rows before it
+    class Writer
+    {
+    public:
+        bool Open(const char* aPath, int aWidth, int aHeight, int aLevel = 6);
+
+        // the next aNumRows rows, top to bottom
+        bool WriteRows(const uint8* aRGBA, int aNumRows);
+
+        // false if the rows didn't add up to the height or a write failed
+        bool Close();
+
+    private:
+        bool WriteChunk(const char* aType, const uint8* aData, uint32 aSize);
+
+        C_Ptr<C_Stream> mStream;
+        C_Vector<uint8> mLastRow;
+        int mWidth = 0;
+        int mHeight = 0;
+        int mLevel = 0;
+        int mRow = 0;
+        uint32 mAdler = 1;
+        bool mOk = false;
+    };
+}
+
+#endif // _PNG_h_
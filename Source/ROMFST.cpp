@@ -8,7 +8,21 @@
 #include "Formats.h"
 #include "C_OS.h"
 #include "n64crc.h"
-
+#include "ROMPatch.h"
+#include "FSTLocator.h"
+#include "BigEndian.h"
+#include "FileFilter.h"
+#include "DirWatcher.h"
+#include "DepFile.h"
+#include "C_Hash.h"
+#include "BinUtils.h"
+#include <mutex>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <memory>
+#include <unordered_map>
+
+// FST location in the known build, other builds are found by FSTLocator
 #define ROM_FST_OFFSET 0xA4970
 
 namespace ROMFST_private
@@ -96,8 +110,12 @@ namespace ROMFST_private
         { "ENVFXACT.bin" }
     };
 
+    // how much of a file is written to disk at a time, the rest of it isn't touched meanwhile
+    const uint32 STREAM_CHUNK_SIZE = 1024 * 1024;
+
     struct FSTInfo
     {
+        uint32 mFstOffset = ROM_FST_OFFSET;
         uint32 mContentOffset = 0;
         C_Vector<uint32> mFileOffsets;
 
@@ -153,14 +171,34 @@ namespace ROMFST_private
                 WAR_LOG_WARNING(CAT_GENERAL, "Unexpected number of files in FST: %i, expected %i", numFiles, ROMFST::NUM_FILES);
             }
 
-            handle.ReadArray(mFileOffsets, numFiles + 1); // +1 for FST size
+            mFileOffsets.Resize(numFiles + 1); // +1 for FST size
+            handle.ReadBytes(mFileOffsets.GetBuffer(), mFileOffsets.Count() * 4);
+            BigEndian::SwapArray(mFileOffsets.GetBuffer(), mFileOffsets.Count());
 
             mContentOffset = handle.GetPosition();
+            return true;
+        }
+
+        // find the FST in a rom, tries ROM_FST_OFFSET first
+        bool Locate(const ROMView& aRom)
+        {
+            mFstOffset = FSTLocator::Find(aRom.GetData(), aRom.GetSize(), ROMFST::NUM_FILES, ROM_FST_OFFSET);
+
+            if (mFstOffset == FSTLocator::NOT_FOUND)
+            {
+                WAR_LOG_ERROR(CAT_GENERAL, "Failed to locate FST in rom");
+                return false;
+            }
+
+            if (mFstOffset != ROM_FST_OFFSET)
+                WAR_LOG_INFO(CAT_GENERAL, "FST located at 0x%08X", mFstOffset);
+
+            return true;
         }
 
         bool ReadROM(C_Stream& handle)
         {
-            handle.Seek(C_FileSystem::SeekSet, ROM_FST_OFFSET);
+            handle.Seek(C_FileSystem::SeekSet, mFstOffset);
             return Read(handle);
         }
 
@@ -187,8 +225,11 @@ namespace ROMFST_private
 
         void Write(C_Stream& handle)
         {
-            handle << uint32(mFileOffsets.Count() - 1);
-            handle.WriteArray(mFileOffsets.GetBuffer(), mFileOffsets.Count());
+            C_Vector<uint8> toc;
+            toc.Resize(4 + mFileOffsets.Count() * 4);
+            BigEndian::Store<uint32>(toc.GetBuffer(), mFileOffsets.Count() - 1);
+            BigEndian::StoreArray(toc.GetBuffer() + 4, mFileOffsets.GetBuffer(), mFileOffsets.Count());
+            handle.WriteBytes(toc.GetBuffer(), toc.Count());
         }
     };
 
@@ -218,33 +259,350 @@ namespace ROMFST_private
         }
     };
 
+    // the rom built by InjectFST: the base rom up to the FST, the new FST, then zero padding.
+    // generated on demand so the whole image never has to be resident
+    struct InjectedROM
+    {
+        static const uint32 PAD_SIZE = 1024 * 1024 * 64;
+        // header plus the area covered by the boot checksum
+        static const uint32 CRC_AREA_SIZE = 0x101000;
+        static const uint32 WRITE_CHUNK_SIZE = 1024 * 1024;
+
+        void Init(const ROMView* aBaseRom, C_MemBlock* aFst, uint32 aFstOffset)
+        {
+            mBaseRom = aBaseRom;
+            mFst = aFst;
+            mFstOffset = aFstOffset;
+
+            mSize = C_Max(mFstOffset + mFst->mSize, PAD_SIZE);
+
+            mCRCArea = WAR_MemBlockAlloc(C_Min(mSize, CRC_AREA_SIZE));
+            ReadUnsigned((uint8*)mCRCArea->mBlock, 0, mCRCArea->mSize);
+            N64CRC::UpdateCRC(mCRCArea->mBlock, mCRCArea->mSize);
+        }
+
+        void Read(uint8* aBuffer, uint32 aOffset, uint32 aSize) const
+        {
+            if (aOffset < mCRCArea->mSize)
+            {
+                const uint32 n = C_Min(aSize, mCRCArea->mSize - aOffset);
+                memcpy(aBuffer, (const uint8*)mCRCArea->mBlock + aOffset, n);
+                aBuffer += n;
+                aOffset += n;
+                aSize -= n;
+            }
+
+            ReadUnsigned(aBuffer, aOffset, aSize);
+        }
+
+        // the base rom is read while writing, through a temp file that replaces aOutPath at the end so the
+        // output can be the base rom itself
+        bool WriteFile(const char* aOutPath, ROMView::ByteOrder aOrder) const
+        {
+            const string tempPath = BinUtils::TempPath(aOutPath);
+            bool ok = true;
+
+            {
+                C_FileHandle oh;
+                if (!C_FileSystem::Open(oh, tempPath.c_str(), C_FileSystem::FileWriteDiscard))
+                {
+                    WAR_LOG_ERROR(CAT_GENERAL, "Failed to open file: %s", tempPath.c_str());
+                    return false;
+                }
+
+                C_Stream strm(oh, true);
+                C_Ptr<C_MemBlock> chunk = WAR_MemBlockAlloc(WRITE_CHUNK_SIZE);
+
+                for (uint32 offset = 0; ok && offset < mSize; offset += WRITE_CHUNK_SIZE)
+                {
+                    const uint32 size = C_Min(WRITE_CHUNK_SIZE, mSize - offset);
+                    Read((uint8*)chunk->mBlock, offset, size);
+                    ROMView::ConvertByteOrder(chunk->mBlock, size, aOrder);
+                    ok = uint32(strm.WriteBytes(chunk->mBlock, size)) == size;
+                }
+            }
+
+            if (!ok || !BinUtils::ReplaceFile(tempPath.c_str(), aOutPath))
+            {
+                remove(tempPath.c_str());
+                WAR_LOG_ERROR(CAT_GENERAL, "Failed to write %s", aOutPath);
+                return false;
+            }
+
+            return true;
+        }
+
+        // rom contents before the checksum is applied
+        void ReadUnsigned(uint8* aBuffer, uint32 aOffset, uint32 aSize) const
+        {
+            const uint32 fstEnd = mFstOffset + mFst->mSize;
+
+            while (aSize > 0)
+            {
+                uint32 n;
+
+                if (aOffset < mFstOffset)
+                {
+                    n = C_Min(aSize, mFstOffset - aOffset);
+                    memcpy(aBuffer, mBaseRom->GetData() + aOffset, n);
+                }
+                else if (aOffset < fstEnd)
+                {
+                    n = C_Min(aSize, fstEnd - aOffset);
+                    memcpy(aBuffer, (const uint8*)mFst->mBlock + (aOffset - mFstOffset), n);
+                }
+                else
+                {
+                    n = aSize;
+                    WAR_ZeroMem(aBuffer, n);
+                }
+
+                aBuffer += n;
+                aOffset += n;
+                aSize -= n;
+            }
+        }
+
+        const ROMView* mBaseRom = NULL;
+        C_Ptr<C_MemBlock> mFst;
+        C_Ptr<C_MemBlock> mCRCArea;
+        uint32 mFstOffset = 0;
+        uint32 mSize = 0;
+    };
+
+    // a rom with its fst read, the jobs of a batch that use the same rom at the same time share one
+    struct LoadedROM
+    {
+        ROMView mRom;
+        FSTInfo mInfo;
+    };
+
+    // size and modification time, a rom that doesn't match its slot's changed on disk since it was loaded
+    struct FileStamp
+    {
+        uint64 mSize = 0;
+        int64 mTime = 0;
+
+        bool operator==(const FileStamp& aOther) const { return mSize == aOther.mSize && mTime == aOther.mTime; }
+        bool operator!=(const FileStamp& aOther) const { return !(*this == aOther); }
+    };
+
+    FileStamp GetFileStamp(const char* aPath)
+    {
+        FileStamp stamp;
+
+#ifdef _WIN32
+        struct _stat64 st;
+        if (_stat64(aPath, &st) == 0)
+        {
+            stamp.mSize = uint64(st.st_size);
+            stamp.mTime = int64(st.st_mtime);
+        }
+#else
+        struct stat st;
+        if (stat(aPath, &st) == 0)
+        {
+            stamp.mSize = uint64(st.st_size);
+            stamp.mTime = int64(st.st_mtim.tv_sec) * 1000000000 + int64(st.st_mtim.tv_nsec);
+        }
+#endif
+
+        return stamp;
+    }
+
+    struct LoadedROMSlot
+    {
+        std::mutex mMutex;
+        std::weak_ptr<LoadedROM> mRom;
+        FileStamp mStamp;
+
+        // set while roms are kept loaded between jobs
+        std::shared_ptr<LoadedROM> mKept;
+    };
+
+    static std::mutex sLoadedROMsMutex;
+    static std::unordered_map<string, std::shared_ptr<LoadedROMSlot>> sLoadedROMs;
+    static bool sKeepROMsLoaded = false;
+
+    std::shared_ptr<const LoadedROM> LoadROM(const char* aPath)
+    {
+        std::shared_ptr<LoadedROMSlot> slot;
+        bool keep;
+
+        const FileStamp stamp = GetFileStamp(aPath);
+
+        {
+            std::lock_guard<std::mutex> lock(sLoadedROMsMutex);
+            keep = sKeepROMsLoaded;
+            std::shared_ptr<LoadedROMSlot>& entry = sLoadedROMs[aPath];
+
+            // a changed rom gets a new slot, jobs still using the old one keep their mapping of the old file
+            if (!entry || entry->mStamp != stamp)
+            {
+                entry = std::make_shared<LoadedROMSlot>();
+                entry->mStamp = stamp;
+            }
+
+            slot = entry;
+        }
+
+        // other roms keep loading meanwhile, a job that wants this one waits for it
+        std::lock_guard<std::mutex> lock(slot->mMutex);
+        std::shared_ptr<LoadedROM> rom = slot->mRom.lock();
+
+        if (rom)
+            return rom;
+
+        rom = std::make_shared<LoadedROM>();
+
+        if (!rom->mRom.Open(aPath))
+            return NULL;
+
+        C_MemoryStream strm((void*)rom->mRom.GetData(), rom->mRom.GetSize());
+        strm.SetEndianSwap(true);
+
+        if (!rom->mInfo.Locate(rom->mRom) || !rom->mInfo.ReadROM(strm))
+            return NULL;
+
+        slot->mRom = rom;
+
+        if (keep)
+            slot->mKept = rom;
+
+        return rom;
+    }
+
+    // a rom about to be written is loaded again by the next job that reads it, even if its stamp comes out the same
+    void ForgetROM(const char* aPath)
+    {
+        std::lock_guard<std::mutex> lock(sLoadedROMsMutex);
+        sLoadedROMs.erase(aPath);
+    }
+
     class ROMFSTExtractContext : public FSTContext
     {
     public:
         struct CachedFile
         {
-            C_Ptr<C_MemBlock> mBlob;
+            bool mOpen = false;
             C_MemoryStream mStream;
+
+            // loaded pages are counted as the whole file until it's evicted
+            bool mLoaded = false;
+            int mRefs = 0;
+            uint64 mLastUse = 0;
         };
 
+        // streams read straight from the mapped rom, opened by whichever handler on the job pool gets there first
         C_Stream& GetFileStream(ROMFST::File aFile) override
         {
-            if (!mStreams[aFile].mBlob)
+            CachedFile& file = mStreams[aFile];
+
             {
-                CachedFile& file = mStreams[aFile];
-                file.mBlob = WAR_MemBlockAlloc(mFstInfo->GetFileSize(aFile));
-                mFileStream->Seek(C_FileSystem::SeekSet, mFstInfo->GetAbsoluteFileOffset(aFile));
-                mFileStream->ReadBytes(file.mBlob->mBlock, file.mBlob->mSize);
-                file.mStream = C_MemoryStream(file.mBlob);
-                file.mStream.SetEndianSwap(true);
+                std::lock_guard<std::mutex> lock(mCacheMutex);
+
+                if (!file.mOpen)
+                {
+                    file.mStream = C_MemoryStream((void*)GetData(aFile), mFstInfo->GetFileSize(aFile));
+                    file.mStream.SetEndianSwap(true);
+                    file.mOpen = true;
+                }
             }
 
-            return mStreams[aFile].mStream;
+            Touch(aFile);
+            return file.mStream;
+        }
+
+        bool GetFileData(ROMFST::File aFile, const uint8*& aOutData, uint32& aOutSize) override
+        {
+            aOutData = GetData(aFile);
+            aOutSize = mFstInfo->GetFileSize(aFile);
+
+            Touch(aFile);
+            return true;
+        }
+
+        void ReleaseFileData(ROMFST::File aFile, uint32 aOffset, uint32 aSize) override
+        {
+            mRom->Release(mFstInfo->GetAbsoluteFileOffset(aFile) + aOffset, aSize);
+        }
+
+        void AddFileRef(ROMFST::File aFile) override
+        {
+            std::lock_guard<std::mutex> lock(mCacheMutex);
+            mStreams[aFile].mRefs++;
+        }
+
+        void RemoveFileRef(ROMFST::File aFile) override
+        {
+            std::lock_guard<std::mutex> lock(mCacheMutex);
+            WAR_ASSERT(mStreams[aFile].mRefs > 0);
+
+            mStreams[aFile].mRefs--;
+            Trim(ROMFST::NUM_FILES);
         }
 
         CachedFile mStreams[ROMFST::NUM_FILES];
-        C_Stream* mFileStream = NULL;
+        const ROMView* mRom = NULL;
         const FSTInfo* mFstInfo = NULL;
+        uint64 mMemBudget = 0;
+
+    private:
+        const uint8* GetData(ROMFST::File aFile) const
+        {
+            return mRom->GetData() + mFstInfo->GetAbsoluteFileOffset(aFile);
+        }
+
+        // most recently used, the job pool reads files from several threads
+        void Touch(ROMFST::File aFile)
+        {
+            if (mMemBudget == 0)
+                return;
+
+            std::lock_guard<std::mutex> lock(mCacheMutex);
+            CachedFile& file = mStreams[aFile];
+            file.mLastUse = ++mUseCounter;
+
+            if (!file.mLoaded)
+            {
+                file.mLoaded = true;
+                mLoadedSize += mFstInfo->GetFileSize(aFile);
+            }
+
+            Trim(aFile);
+        }
+
+        // evicts the least recently used files no handler holds until the budget is met, aKeep is about to be read.
+        // an evicted file stays readable, its pages are read from the rom again
+        void Trim(int aKeep)
+        {
+            while (mLoadedSize > mMemBudget)
+            {
+                int oldest = -1;
+
+                for (int i = 0; i < ROMFST::NUM_FILES; ++i)
+                {
+                    const CachedFile& file = mStreams[i];
+
+                    if (file.mLoaded && file.mRefs == 0 && i != aKeep && (oldest < 0 || file.mLastUse < mStreams[oldest].mLastUse))
+                        oldest = i;
+                }
+
+                // everything left is in use
+                if (oldest < 0)
+                    return;
+
+                const uint32 size = mFstInfo->GetFileSize(oldest);
+                mRom->Release(mFstInfo->GetAbsoluteFileOffset(oldest), size);
+
+                mStreams[oldest].mLoaded = false;
+                mLoadedSize -= size;
+            }
+        }
+
+        std::mutex mCacheMutex;
+        uint64 mLoadedSize = 0;
+        uint64 mUseCounter = 0;
     };
 
     class FSTWriteContext : public FSTContext
@@ -279,26 +637,42 @@ namespace ROMFST_private
     };
 }
 
+void ROMFST::SetKeepROMsLoaded(bool aKeep)
+{
+    using namespace ROMFST_private;
+
+    std::lock_guard<std::mutex> lock(sLoadedROMsMutex);
+    sKeepROMsLoaded = aKeep;
+
+    // jobs that are still running keep theirs until they're done
+    if (!aKeep)
+        sLoadedROMs.clear();
+}
+
+const char* ROMFST::GetFileName(File aFile)
+{
+    return ROMFST_private::sFileInfo[aFile].mName;
+}
+
 bool ROMFST::DumpBin(const char* aInPath, const char* aBinPath)
 {
     using namespace ROMFST_private;
 
-    C_FileHandle handle;
-    if (!C_FileSystem::Open(handle, aInPath, C_FileSystem::FileReadOnly))
+    std::shared_ptr<const LoadedROM> loaded = LoadROM(aInPath);
+    if (!loaded)
         return false;
 
-    C_Stream strm(handle);
-    strm.SetEndianSwap(true);
+    const ROMView& rom = loaded->mRom;
+    const FSTInfo& info = loaded->mInfo;
 
-    FSTInfo info;
-    if (!info.ReadROM(strm))
-        return false;
+    C_MemoryStream strm((void*)rom.GetData(), rom.GetSize());
+    strm.SetEndianSwap(true);
 
     uint32 fstSize = info.GetSizeFull();
 
     C_Ptr<C_MemBlock> fst = WAR_MemBlockAlloc(fstSize);
     
-    strm.Seek(C_FileSystem::SeekSet, ROM_FST_OFFSET);
+    strm.Seek(C_FileSystem::SeekSet, info.mFstOffset);
     strm.ReadBytes(fst->mBlock, int(fstSize));
 
     WAR_LOG_INFO(CAT_GENERAL, "Write %s...", aBinPath);
@@ -316,16 +690,15 @@ bool ROMFST::DumpFiles(const char* aInPath, const char* aOutDir)
         return false;
     }
 
-    C_FileHandle handle;
-    if (!C_FileSystem::Open(handle, aInPath, C_FileSystem::FileReadOnly))
+    std::shared_ptr<const LoadedROM> loaded = LoadROM(aInPath);
+    if (!loaded)
         return false;
 
-    C_Stream strm(handle);
-    strm.SetEndianSwap(true);
+    const ROMView& rom = loaded->mRom;
+    const FSTInfo& info = loaded->mInfo;
 
-    FSTInfo info;
-    if (!info.ReadROM(strm))
-        return false;
+    C_MemoryStream strm((void*)rom.GetData(), rom.GetSize());
+    strm.SetEndianSwap(true);
 
     FSTLegend legend;
     legend.FromFSTInfo(info);
@@ -348,9 +721,11 @@ bool ROMFST::DumpFiles(const char* aInPath, const char* aOutDir)
     C_FilePath legendFile(aOutDir);
     legendFile.Combine("fst.json");
     legend.ToJson(legendFile);
+
+    return true;
 }
 
-bool ROMFST::ExtractFiles(const char* aInPath, const char* aOutDir, const char* aDefsPath)
+bool ROMFST::ExtractFiles(const char* aInPath, const char* aOutDir, const char* aDefsPath, uint64 aMemBudget /*= 0*/, const FileFilter* aFilter /*= NULL*/)
 {
     using namespace ROMFST_private;
 
@@ -360,22 +735,27 @@ bool ROMFST::ExtractFiles(const char* aInPath, const char* aOutDir, const char*
         return false;
     }
 
-    C_FileHandle handle;
-    if (!C_FileSystem::Open(handle, aInPath, C_FileSystem::FileReadOnly))
+    std::shared_ptr<const LoadedROM> loaded = LoadROM(aInPath);
+    if (!loaded)
         return false;
 
-    C_Stream strm(handle);
-    strm.SetEndianSwap(true);
-
-    FSTInfo info;
-    if (!info.ReadROM(strm))
-        return false;
+    const ROMView& rom = loaded->mRom;
+    const FSTInfo& info = loaded->mInfo;
 
     ROMFSTExtractContext ctx;
     ctx.Init(C_FilePath(aOutDir));
-    ctx.mFileStream = &strm;
+    ctx.mRom = &rom;
     ctx.mFstInfo = &info;
     ctx.mDefsPath = aDefsPath;
+    ctx.mMemBudget = aMemBudget;
+    ctx.mFilter = aFilter;
+
+    // a converted rom is in memory as a whole, evicting files from it would only look like it met the budget
+    if (aMemBudget > 0 && !rom.CanRelease())
+    {
+        WAR_LOG_ERROR(CAT_GENERAL, "-mem_budget needs a .z64 rom, %s is converted in memory as a whole", aInPath);
+        return false;
+    }
 
     for (int i = 0; i < C_Min(info.NumFiles(), (int)Formats::NUM_FMTS); ++i)
     {
@@ -386,26 +766,22 @@ bool ROMFST::ExtractFiles(const char* aInPath, const char* aOutDir, const char*
     }
 
     // export unhandled files as raw files
-    C_Ptr<C_MemBlock> buffer = WAR_MemBlockAlloc(info.GetSizeFull());
-
     for (int i = 0; i < info.NumFiles(); ++i)
     {
-        if (ctx.IsFileHandled(i) == false)
+        if (ctx.IsFileHandled(i) == false && ctx.IsFileSelected(i))
         {
-            const uint32 size = info.GetFileSize(i);
-
-            strm.Seek(C_FileSystem::SeekSet, info.GetAbsoluteFileOffset(i));
-            strm.ReadBytes(buffer->mBlock, size);
-
             C_FilePath outPath(aOutDir);
             outPath.Combine(info.GetFileName(i));
 
-            C_FileSystem::WriteFile(outPath, buffer->mBlock, size);
+            if (!ctx.WriteFileData(ROMFST::File(i), 0, info.GetFileSize(i), outPath))
+                return false;
         }
     }
+
+    return true;
 }
 
-bool ROMFST::CompileFiles(const char* aInPath, const char* aOutDir)
+bool ROMFST::CompileFiles(const char* aInPath, const char* aOutDir, int aZipLevel /*= Deflate::DEFAULT_LEVEL*/, const FileFilter* aFilter /*= NULL*/, const char* aBaseRomPath /*= NULL*/, DepFile* aDeps /*= NULL*/)
 {
     using namespace ROMFST_private;
 
@@ -424,12 +800,60 @@ bool ROMFST::CompileFiles(const char* aInPath, const char* aOutDir)
     FSTWriteContext ctx;
     ctx.Init(C_FilePath(aInPath));
     ctx.mOutputDir = aOutDir;
+    ctx.mZipLevel = aZipLevel;
+    ctx.mFilter = aFilter;
+    ctx.mDeps = aDeps;
+
+    // files that aren't selected are the base rom's, or without one the ones an earlier compile left in aOutDir
+    if (aFilter && !aFilter->SelectsAll())
+    {
+        std::shared_ptr<const LoadedROM> loaded;
+
+        if (aBaseRomPath && aBaseRomPath[0])
+        {
+            loaded = LoadROM(aBaseRomPath);
+            if (!loaded)
+                return false;
+
+            ctx.AddDependency(aBaseRomPath);
+        }
+
+        for (int i = 0; i < ROMFST::NUM_FILES; ++i)
+        {
+            if (aFilter->IsSelected(i))
+                continue;
+
+            C_FilePath dstPath(aOutDir);
+            dstPath.Combine(sFileInfo[i].mName);
+
+            if (!loaded)
+            {
+                if (!C_FileSystem::Exists(dstPath))
+                {
+                    WAR_LOG_ERROR(CAT_GENERAL, "%s isn't selected and there's no base -rom or earlier compile to keep it from", sFileInfo[i].mName);
+                    return false;
+                }
+            }
+            else if (i >= loaded->mInfo.NumFiles())
+            {
+                WAR_LOG_ERROR(CAT_GENERAL, "The base rom has no %s to keep", sFileInfo[i].mName);
+                return false;
+            }
+            else if (!C_FileSystem::WriteFile(dstPath, (void*)(loaded->mRom.GetData() + loaded->mInfo.GetAbsoluteFileOffset(i)), loaded->mInfo.GetFileSize(i)))
+            {
+                WAR_LOG_ERROR(CAT_GENERAL, "Failed to write %s", (const char*)dstPath);
+                return false;
+            }
+
+            ctx.MarkFileHandled(i);
+        }
+    }
 
     for (int i = 0; i < Formats::NUM_FMTS; ++i)
     {
         const FormatInfo& fmtInfo = Formats::GetFormatInfo(i);
 
-        if (!fmtInfo.mCompileFunc(&ctx))
+        if (fmtInfo.mCompileFunc && !fmtInfo.mCompileFunc(&ctx))
             return false;
     }
 
@@ -449,6 +873,7 @@ bool ROMFST::CompileFiles(const char* aInPath, const char* aOutDir)
                 return false;
             }
 
+            ctx.AddDependency(srcPath);
             C_FileSystem::Copy(srcPath, dstPath);
         }
     }
@@ -506,68 +931,251 @@ bool ROMFST::CompileFST(const char* aInPath, const char* aOutPath)
     return true;
 }
 
-bool ROMFST::InjectFST(const char* aRomPath, const char* aInPath, const char* aOutPath)
+bool ROMFST::InjectFST(const char* aRomPath, const char* aInPath, const char* aOutPath, const char* aPatchPath /*= NULL*/, ROMView::ByteOrder aOutOrder /*= ROMView::ORDER_AUTO*/)
 {
-    C_Ptr<C_MemBlock> baseRom = C_FileSystem::ReadFile(aRomPath);
-
-    if (!baseRom)
-        return false;
+    using namespace ROMFST_private;
 
-    if (baseRom->mSize < ROM_FST_OFFSET)
+    std::shared_ptr<const LoadedROM> loaded = LoadROM(aRomPath);
+    if (!loaded)
     {
         WAR_LOG_ERROR(CAT_GENERAL, "Invalid source rom");
         return false;
     }
 
+    const ROMView& baseRom = loaded->mRom;
+    const FSTInfo& baseInfo = loaded->mInfo;
+
     C_Ptr<C_MemBlock> fst = C_FileSystem::ReadFile(aInPath);
 
     if (!fst)
         return false;
 
-    const uint32 padSize = 1024 * 1024 * 64;
-    const uint32 unpaddedRomSize = ROM_FST_OFFSET + fst->mSize;
+    InjectedROM newRom;
+    newRom.Init(&baseRom, fst, baseInfo.mFstOffset);
+
+    if (aOutPath && aOutPath[0])
+    {
+        if (aOutOrder == ROMView::ORDER_AUTO)
+            aOutOrder = baseRom.GetByteOrder();
+
+        WAR_LOG_INFO(CAT_GENERAL, "Write %s...", aOutPath);
+        ForgetROM(aOutPath);
+
+        if (!newRom.WriteFile(aOutPath, aOutOrder))
+            return false;
+    }
+
+    if (aPatchPath && aPatchPath[0])
+    {
+        C_FileHandle ph;
+        if (!C_FileSystem::Open(ph, aPatchPath, C_FileSystem::FileWriteDiscard))
+        {
+            WAR_LOG_ERROR(CAT_GENERAL, "Failed to open file: %s", aPatchPath);
+            return false;
+        }
+
+        C_Stream patchStrm(ph, true);
+
+        WAR_LOG_INFO(CAT_GENERAL, "Write %s...", aPatchPath);
+        // patches are always against the big-endian rom
+        return ROMPatch::WritePatch(baseRom.GetData(), baseRom.GetSize(), newRom.mSize, [&newRom](uint8* aBuffer, uint32 aOffset, uint32 aSize)
+            {
+                newRom.Read(aBuffer, aOffset, aSize);
+            }, patchStrm);
+    }
+
+    return true;
+}
+
+namespace ROMFST_private
+{
+    // compile_rom's work dir, one per output so the roms of a batch can be compiled at the same time
+    void GetCompileTempDir(const char* aOutPath, const char* aPatchPath, C_FilePath& aOut)
+    {
+        aOut = C_FilePath(C_OS::GetInstance()->GetWorkingDirectory());
+        aOut.Combine("temp");
+        C_FileSystem::DirectoryCreate(aOut);
 
-    uint32 paddedRomSize = unpaddedRomSize;
+        const string outputs = string(aOutPath ? aOutPath : "") + "|" + (aPatchPath ? aPatchPath : "");
+        aOut.Combine(C_Strfmt<16>("%08X", uint32(C_Hash(outputs.c_str()))));
+        C_FileSystem::DirectoryCreate(aOut);
+    }
 
-    if (unpaddedRomSize < padSize)
-        paddedRomSize = padSize;
+    // the files aFilter doesn't select come from aKeepRomPath, or from the last build in the temp dir without one
+    bool BuildROM(const char* aRomPath, const char* aInPath, const char* aOutPath, const char* aPatchPath, ROMView::ByteOrder aOutOrder, int aZipLevel, const FileFilter* aFilter, const char* aKeepRomPath, DepFile* aDeps)
+    {
+        C_FilePath tempDir;
+        GetCompileTempDir(aOutPath, aPatchPath, tempDir);
 
-    C_Ptr<C_MemBlock> newRom = WAR_MemBlockAlloc(paddedRomSize);
+        C_FilePath tempFilesDir(tempDir);
+        tempFilesDir.Combine("ofst");
+        C_FileSystem::DirectoryCreate(tempFilesDir);
 
-    if (unpaddedRomSize < padSize)
-        WAR_ZeroMem((uint8*)newRom->mBlock + unpaddedRomSize, padSize - unpaddedRomSize);
+        WAR_LOG_INFO(CAT_GENERAL, "Compile files...");
+        if (!ROMFST::CompileFiles(aInPath, tempFilesDir, aZipLevel, aFilter, aKeepRomPath, aDeps))
+            return false;
 
-    memcpy(newRom->mBlock, baseRom->mBlock, ROM_FST_OFFSET);
-    memcpy((uint8*)newRom->mBlock + ROM_FST_OFFSET, fst->mBlock, fst->mSize);
+        C_FilePath tempFstPath(tempDir);
+        tempFstPath.Combine("fst.bin");
+
+        WAR_LOG_INFO(CAT_GENERAL, "Compile fst.bin...");
+        if (!ROMFST::CompileFST(tempFilesDir, tempFstPath))
+            return false;
 
-    N64CRC::UpdateCRC(newRom->mBlock, newRom->mSize);
+        if (aDeps)
+            aDeps->Add(aRomPath);
 
-    return C_FileSystem::WriteFile(aOutPath, newRom->mBlock, newRom->mSize);
+        WAR_LOG_INFO(CAT_GENERAL, "Compile rom...");
+        return ROMFST::InjectFST(aRomPath, tempFstPath, aOutPath, aPatchPath, aOutOrder);
+    }
 }
 
-bool ROMFST::CompileROM(const char* aRomPath, const char* aInPath, const char* aOutPath)
+bool ROMFST::CompileROM(const char* aRomPath, const char* aInPath, const char* aOutPath, const char* aPatchPath /*= NULL*/, ROMView::ByteOrder aOutOrder /*= ROMView::ORDER_AUTO*/, int aZipLevel /*= Deflate::DEFAULT_LEVEL*/, const FileFilter* aFilter /*= NULL*/, DepFile* aDeps /*= NULL*/)
 {
-    C_FilePath tempDir(C_OS::GetInstance()->GetWorkingDirectory());
-    tempDir.Combine("temp");
-    C_FileSystem::DirectoryCreate(tempDir);
+    return ROMFST_private::BuildROM(aRomPath, aInPath, aOutPath, aPatchPath, aOutOrder, aZipLevel, aFilter, aRomPath, aDeps);
+}
 
-    C_FilePath tempFilesDir(tempDir);
-    tempFilesDir.Combine("ofst");
-    C_FileSystem::DirectoryCreate(tempFilesDir);
+bool ROMFST::WatchROM(const char* aRomPath, const char* aInPath, const char* aOutPath, const char* aPatchPath /*= NULL*/, ROMView::ByteOrder aOutOrder /*= ROMView::ORDER_AUTO*/, int aZipLevel /*= Deflate::DEFAULT_LEVEL*/, const FileFilter* aFilter /*= NULL*/)
+{
+    using namespace ROMFST_private;
 
-    WAR_LOG_INFO(CAT_GENERAL, "Compile files...");
-    if (!CompileFiles(aInPath, tempFilesDir))
+    // watching first, a save during the first build is picked up after it
+    DirWatcher watcher;
+    if (!watcher.Start(aInPath))
         return false;
 
-    C_FilePath tempFstPath(tempDir);
-    tempFstPath.Combine("fst.bin");
+    // the first build and the ones after a failed build or lost changes are full, the others start from the last
+    // build's files
+    bool built = BuildROM(aRomPath, aInPath, aOutPath, aPatchPath, aOutOrder, aZipLevel, aFilter, aRomPath, NULL);
 
-    WAR_LOG_INFO(CAT_GENERAL, "Compile fst.bin...");
-    if (!CompileFST(tempFilesDir, tempFstPath))
+    C_Vector<string> changed;
+    bool lost;
+
+    while (true)
+    {
+        WAR_LOG_INFO(CAT_GENERAL, built ? "Watching %s for changes..." : "Build failed, watching %s to try again...", aInPath);
+
+        if (!watcher.Wait(changed, lost))
+            return false;
+
+        // there's no telling what changed, same as after a failed build
+        if (lost)
+        {
+            WAR_LOG_WARNING(CAT_GENERAL, "Changes under %s were lost, rebuilding everything", aInPath);
+            built = BuildROM(aRomPath, aInPath, aOutPath, aPatchPath, aOutOrder, aZipLevel, aFilter, aRomPath, NULL);
+            continue;
+        }
+
+        FileFilter changes;
+        changes.Clear();
+
+        for (int i = 0; i < changed.Count(); ++i)
+            changes.SelectInput(changed[i].c_str());
+
+        if (aFilter)
+            changes.Intersect(*aFilter);
+
+        if (built && changes.SelectsNone())
+            continue;
+
+        for (int i = 0; i < ROMFST::NUM_FILES; ++i)
+        {
+            if (changes.IsSelected(i))
+                WAR_LOG_INFO(CAT_GENERAL, "%s changed", sFileInfo[i].mName);
+        }
+
+        built = built ?
+            BuildROM(aRomPath, aInPath, aOutPath, aPatchPath, aOutOrder, aZipLevel, &changes, NULL, NULL) :
+            BuildROM(aRomPath, aInPath, aOutPath, aPatchPath, aOutOrder, aZipLevel, aFilter, aRomPath, NULL);
+    }
+}
+
+bool ROMFST::ApplyPatch(const char* aRomPath, const char* aPatchPath, const char* aOutPath, ROMView::ByteOrder aOutOrder /*= ROMView::ORDER_AUTO*/)
+{
+    ROMView baseRom;
+    if (!baseRom.Open(aRomPath))
+        return false;
+
+    C_Ptr<C_MemBlock> newRom;
+    if (!ROMPatch::ApplyPatch(baseRom.GetData(), baseRom.GetSize(), aPatchPath, newRom))
+        return false;
+
+    if (aOutOrder == ROMView::ORDER_AUTO)
+        aOutOrder = baseRom.GetByteOrder();
+
+    ROMView::ConvertByteOrder(newRom->mBlock, newRom->mSize, aOutOrder);
+
+    // baseRom is still mapped, the output may be the same file
+    WAR_LOG_INFO(CAT_GENERAL, "Write %s...", aOutPath);
+    ROMFST_private::ForgetROM(aOutPath);
+    return BinUtils::WriteFileAtomic(aOutPath, newRom->mBlock, newRom->mSize);
+}
+
+bool FSTContext::IsFileSelected(int aFileType) const
+{
+    return !mFilter || mFilter->IsSelected(aFileType);
+}
+
+bool FSTContext::WriteFileData(ROMFST::File aFile, uint32 aOffset, uint32 aSize, const char* aPath, bool aRelease /*= true*/)
+{
+    using namespace ROMFST_private;
+
+    C_FileHandle handle;
+    if (!C_FileSystem::Open(handle, aPath, C_FileSystem::FileWriteDiscard))
+    {
+        WAR_LOG_ERROR(CAT_GENERAL, "Failed to open file: %s", aPath);
         return false;
+    }
 
-    WAR_LOG_INFO(CAT_GENERAL, "Compile rom...");
-    return InjectFST(aRomPath, tempFstPath, aOutPath);
+    C_Stream out(handle, true);
+
+    const uint8* data;
+    uint32 size;
+    C_Vector<uint8> chunk;
+
+    // without direct access the stream is read a chunk at a time instead
+    const bool direct = GetFileData(aFile, data, size);
+
+    if (!direct && aSize > 0)
+    {
+        chunk.Resize(C_Min(aSize, STREAM_CHUNK_SIZE));
+        GetFileStream(aFile).Seek(C_FileSystem::SeekSet, aOffset);
+    }
+
+    for (uint32 pos = 0; pos < aSize; pos += STREAM_CHUNK_SIZE)
+    {
+        const uint32 n = C_Min(STREAM_CHUNK_SIZE, aSize - pos);
+
+        if (direct)
+        {
+            const bool written = uint32(out.WriteBytes((void*)(data + aOffset + pos), n)) == n;
+
+            if (aRelease)
+                ReleaseFileData(aFile, aOffset + pos, n);
+
+            if (!written)
+            {
+                WAR_LOG_ERROR(CAT_GENERAL, "Failed to write %s", aPath);
+                return false;
+            }
+        }
+        else
+        {
+            if (uint32(GetFileStream(aFile).ReadBytes(chunk.GetBuffer(), n)) != n)
+            {
+                WAR_LOG_ERROR(CAT_GENERAL, "Failed to read %s for %s", ROMFST_private::sFileInfo[aFile].mName, aPath);
+                return false;
+            }
+
+            if (uint32(out.WriteBytes(chunk.GetBuffer(), n)) != n)
+            {
+                WAR_LOG_ERROR(CAT_GENERAL, "Failed to write %s", aPath);
+                return false;
+            }
+        }
+    }
+
+    return true;
 }
 
 bool FSTContext::ReadJson(C_DataPack& aPack, const char* aRelFileName)
@@ -581,17 +1189,36 @@ bool FSTContext::ReadJson(C_DataPack& aPack, const char* aRelFileName)
         return false;
     }
 
+    AddDependency(fullPath);
     return aPack.FromFileJson(fullPath);
 }
 
+C_Ptr<C_MemBlock> FSTContext::ReadFile(const char* aPath)
+{
+    AddDependency(aPath);
+    return C_FileSystem::ReadFile(aPath);
+}
+
+void FSTContext::AddDependency(const char* aPath)
+{
+    if (mDeps)
+        mDeps->Add(aPath);
+}
+
 bool FSTContext::WriteJson(const C_DataPack& aPack, const char* aRelFileName)
 {
     C_FilePath path;
-    FixFilePath(aRelFileName, path);
+    MakeFilePath(aRelFileName, path);
     return aPack.ToFileJson(path);
 }
 
 void FSTContext::FixFilePath(const char* aRelFileName, C_FilePath& aOut)
+{
+    MakeFilePath(aRelFileName, aOut);
+    AddDependency(aOut);
+}
+
+void FSTContext::MakeFilePath(const char* aRelFileName, C_FilePath& aOut)
 {
     C_FilePath fullPath(mBaseDir);
     fullPath.Combine(aRelFileName);
@@ -2,9 +2,14 @@
 #define _ROMFST_h_
 
 #include "C_FilePath.h"
+#include "ROMView.h"
+#include "Deflate.h"
 
 class C_Stream;
 class C_DataPack;
+class C_MemBlock;
+class FileFilter;
+class DepFile;
 
 namespace ROMFST
 {
@@ -88,20 +93,39 @@ namespace ROMFST
         NUM_FILES
     };
 
+    // roms stay mapped with their fst read after the jobs using them are done, for the -serve daemon. a rom whose
+    // size or modification time changed, or that a job wrote, is loaded again. turning it off lets go of them
+    void SetKeepROMsLoaded(bool aKeep);
+
+    // name of the file in the fst, as written by dump_files
+    const char* GetFileName(File aFile);
+
     // extract fst.bin from rom
     bool DumpBin(const char* aInPath, const char* aBinPath);
 
     bool DumpFiles(const char* aInPath, const char* aOutDir);
 
-    bool ExtractFiles(const char* aInPath, const char* aOutDir, const char* aDefsPath);
+    // aMemBudget caps how much of the rom stays loaded (0 for no cap), files that aren't in use are evicted
+    // least recently used first. with aFilter only the selected files are written and only their formats run
+    bool ExtractFiles(const char* aInPath, const char* aOutDir, const char* aDefsPath, uint64 aMemBudget = 0, const FileFilter* aFilter = NULL);
 
-    bool CompileFiles(const char* aInPath, const char* aOutDir);
+    // aZipLevel is the deflate level for edited compressed entries. files aFilter doesn't select are taken as they
+    // are from the base rom aBaseRomPath, without one they are kept from an earlier compile into aOutDir.
+    // every input that was read is added to aDeps
+    bool CompileFiles(const char* aInPath, const char* aOutDir, int aZipLevel = Deflate::DEFAULT_LEVEL, const FileFilter* aFilter = NULL, const char* aBaseRomPath = NULL, DepFile* aDeps = NULL);
 
     bool CompileFST(const char* aInPath, const char* aOutPath);
 
-    bool InjectFST(const char* aRomPath, const char* aInPath, const char* aOutPath);
+    // writes the new rom to aOutPath and/or a BPS patch against the base rom to aPatchPath
+    bool InjectFST(const char* aRomPath, const char* aInPath, const char* aOutPath, const char* aPatchPath = NULL, ROMView::ByteOrder aOutOrder = ROMView::ORDER_AUTO);
+
+    bool CompileROM(const char* aRomPath, const char* aInPath, const char* aOutPath, const char* aPatchPath = NULL, ROMView::ByteOrder aOutOrder = ROMView::ORDER_AUTO, int aZipLevel = Deflate::DEFAULT_LEVEL, const FileFilter* aFilter = NULL, DepFile* aDeps = NULL);
 
-    bool CompileROM(const char* aRomPath, const char* aInPath, const char* aOutPath);
+    // CompileROM, then again every time the input dir changes. only the files built from what changed are compiled,
+    // the rest are kept from the build before. runs until the process is stopped
+    bool WatchROM(const char* aRomPath, const char* aInPath, const char* aOutPath, const char* aPatchPath = NULL, ROMView::ByteOrder aOutOrder = ROMView::ORDER_AUTO, int aZipLevel = Deflate::DEFAULT_LEVEL, const FileFilter* aFilter = NULL);
+
+    bool ApplyPatch(const char* aRomPath, const char* aPatchPath, const char* aOutPath, ROMView::ByteOrder aOutOrder = ROMView::ORDER_AUTO);
 };
 
 class FSTContext
@@ -113,17 +137,61 @@ public:
     }
 
     bool ReadJson(C_DataPack& aPack, const char* aRelFileName);
+
+    // C_FileSystem::ReadFile for the inputs of a compile, recorded for -depfile
+    C_Ptr<C_MemBlock> ReadFile(const char* aPath);
+
+    // for inputs read some other way, and dirs whose listing is read
+    void AddDependency(const char* aPath);
     bool WriteJson(const C_DataPack& aPack, const char* aRelFileName);
+
+    // the full path of a file in the tree, with its dir created. in a compile the file is an input and recorded
     void FixFilePath(const char* aRelFileName, C_FilePath& aOut);
     bool IsFileHandled(int aFileType) const { return mHandledFlags[aFileType]; }
+
+    // false for files left out by -only/-exclude, formats skip anything that touches them
+    bool IsFileSelected(int aFileType) const;
     const C_FilePath& GetBaseDir() const { return mBaseDir; }
 
     virtual void MarkFileHandled(int aFileType) { mHandledFlags[aFileType] = true; }
     virtual C_Stream& GetFileStream(ROMFST::File aFile) = 0;
 
+    // direct read access when the file is already in memory, false if it isn't
+    virtual bool GetFileData(ROMFST::File aFile, const uint8*& aOutData, uint32& aOutSize) { return false; }
+
+    // a range of GetFileData() that was read and won't be needed soon, its memory may be given back to the os
+    virtual void ReleaseFileData(ROMFST::File aFile, uint32 aOffset, uint32 aSize) {}
+
+    // writes a range of a file to disk a chunk at a time. with aRelease each chunk is released once written so big
+    // files don't stay resident, a caller that reads the range again releases it itself after that
+    bool WriteFileData(ROMFST::File aFile, uint32 aOffset, uint32 aSize, const char* aPath, bool aRelease = true);
+
+    // held by a handler for as long as it reads a file, a context with a memory budget only evicts files nobody holds
+    class FileRef
+    {
+    public:
+        FileRef(FSTContext* aCtx, ROMFST::File aFile) : mCtx(aCtx), mFile(aFile) { mCtx->AddFileRef(mFile); }
+        ~FileRef() { mCtx->RemoveFileRef(mFile); }
+
+    private:
+        FileRef(const FileRef&) = delete;
+        FileRef& operator=(const FileRef&) = delete;
+
+        FSTContext* mCtx;
+        ROMFST::File mFile;
+    };
+
+    virtual void AddFileRef(ROMFST::File aFile) {}
+    virtual void RemoveFileRef(ROMFST::File aFile) {}
+
     string mDefsPath;
+    int mZipLevel = Deflate::DEFAULT_LEVEL;
+    const FileFilter* mFilter = NULL;
+    DepFile* mDeps = NULL;
 
 protected:
+    void MakeFilePath(const char* aRelFileName, C_FilePath& aOut);
+
     C_FilePath mBaseDir;
     bool mHandledFlags[ROMFST::NUM_FILES] = { false };
 };
@@ -0,0 +1,615 @@
+#include "ROMPatch.h"
+#include "C_FileSystem.h"
+#include "C_MemBlock.h"
+#include "C_Stream.h"
+#include "C_Vector.h"
+#include "CL_Log.h"
+#include "BinUtils.h"
+
+namespace ROMPatch_private
+{
+    enum Action
+    {
+        SOURCE_READ,
+        TARGET_READ,
+        SOURCE_COPY,
+        TARGET_COPY
+    };
+
+    static const uint8 sMagic[4] = { 'B', 'P', 'S', '1' };
+
+    // size of the rolling hash window, also the stride at which the source is indexed
+    const uint32 HASH_WINDOW = 32;
+    // shortest same-offset run worth a SourceRead
+    const uint32 MIN_SOURCE_READ = 8;
+    // shortest repeated byte run worth a TargetCopy
+    const uint32 MIN_TARGET_RUN = 32;
+    // max pending literals and max lookahead, the target window holds a few of these
+    const uint32 CHUNK_SIZE = 1024 * 1024;
+    const uint32 WINDOW_SIZE = CHUNK_SIZE * 4;
+
+    const uint32 HASH_PRIME = 0x01000193;
+    const uint32 INVALID_POS = uint32(-1);
+
+    uint32 ReadUInt32LE(const uint8* aData)
+    {
+        return aData[0] | (aData[1] << 8) | (aData[2] << 16) | (uint32(aData[3]) << 24);
+    }
+
+    struct RollingHash
+    {
+        RollingHash()
+        {
+            mOutFactor = 1;
+            for (uint32 i = 0; i < HASH_WINDOW - 1; ++i)
+                mOutFactor *= HASH_PRIME;
+        }
+
+        uint32 Compute(const uint8* aData) const
+        {
+            uint32 h = 0;
+            for (uint32 i = 0; i < HASH_WINDOW; ++i)
+                h = h * HASH_PRIME + aData[i];
+            return h;
+        }
+
+        uint32 Roll(uint32 aHash, uint8 aOut, uint8 aIn) const
+        {
+            return (aHash - aOut * mOutFactor) * HASH_PRIME + aIn;
+        }
+
+        uint32 mOutFactor;
+    };
+
+    // maps window hashes to source offsets, one candidate per slot. source is indexed at HASH_WINDOW
+    // stride, the target is hashed at every byte so any aligned block is found
+    struct SourceIndex
+    {
+        void Build(const RollingHash& aHash, const uint8* aSource, uint32 aSize)
+        {
+            const uint32 numBlocks = aSize / HASH_WINDOW;
+
+            uint32 bits = 10;
+            while ((1u << bits) < numBlocks * 2 && bits < 28)
+                ++bits;
+
+            mShift = 32 - bits;
+            mSlots.Resize(1 << bits, INVALID_POS);
+
+            for (uint32 i = 0; i < numBlocks; ++i)
+            {
+                const uint32 pos = i * HASH_WINDOW;
+                uint32& slot = mSlots[GetSlot(aHash.Compute(aSource + pos))];
+
+                if (slot == INVALID_POS)
+                    slot = pos;
+            }
+        }
+
+        uint32 Find(uint32 aHash) const { return mSlots[GetSlot(aHash)]; }
+
+        int GetSlot(uint32 aHash) const { return int((aHash * 0x9E3779B1) >> mShift); }
+
+        C_Vector<uint32> mSlots;
+        uint32 mShift = 0;
+    };
+
+    // resident part of the target, filled sequentially through the read callback
+    struct TargetWindow
+    {
+        TargetWindow(uint32 aTargetSize, const ROMPatch::TargetReadFunc& aRead)
+            : mRead(aRead)
+            , mTargetSize(aTargetSize)
+        {
+            mBuffer = WAR_MemBlockAlloc(WINDOW_SIZE);
+        }
+
+        // make [aKeepFrom, aEnd) resident, everything before aKeepFrom may be dropped
+        void Require(uint32 aKeepFrom, uint32 aEnd)
+        {
+            aEnd = C_Min(aEnd, mTargetSize);
+
+            if (aEnd <= mBase + mFill)
+                return;
+
+            WAR_CHECK(aKeepFrom >= mBase && aEnd - aKeepFrom <= WINDOW_SIZE);
+
+            uint8* buffer = (uint8*)mBuffer->mBlock;
+            const uint32 keep = mBase + mFill - aKeepFrom;
+            memmove(buffer, buffer + (aKeepFrom - mBase), keep);
+            mBase = aKeepFrom;
+            mFill = keep;
+
+            const uint32 readSize = C_Min(WINDOW_SIZE - mFill, mTargetSize - (mBase + mFill));
+            mRead(buffer + mFill, mBase + mFill, readSize);
+            mCrc = BinUtils::CRC32(buffer + mFill, readSize, mCrc);
+            mFill += readSize;
+        }
+
+        const uint8* Ptr(uint32 aOffset) const
+        {
+            WAR_CHECK(aOffset >= mBase && aOffset <= mBase + mFill);
+            return (const uint8*)mBuffer->mBlock + (aOffset - mBase);
+        }
+
+        const ROMPatch::TargetReadFunc& mRead;
+        C_Ptr<C_MemBlock> mBuffer;
+        uint32 mTargetSize;
+        uint32 mBase = 0;
+        uint32 mFill = 0;
+        uint32 mCrc = 0;
+    };
+
+    // buffered output, keeps a running crc of everything written
+    struct PatchWriter
+    {
+        PatchWriter(C_Stream& aOut)
+            : mOut(aOut)
+        {}
+
+        void WriteByte(uint8 aByte)
+        {
+            if (mUsed == sizeof(mBuffer))
+                Flush();
+
+            mBuffer[mUsed++] = aByte;
+        }
+
+        void WriteBytes(const uint8* aData, uint32 aSize)
+        {
+            while (aSize > 0)
+            {
+                if (mUsed == sizeof(mBuffer))
+                    Flush();
+
+                const uint32 n = C_Min(aSize, uint32(sizeof(mBuffer)) - mUsed);
+                memcpy(mBuffer + mUsed, aData, n);
+                mUsed += n;
+                aData += n;
+                aSize -= n;
+            }
+        }
+
+        void WriteNumber(uint64 aValue)
+        {
+            while (true)
+            {
+                const uint8 x = aValue & 0x7F;
+                aValue >>= 7;
+
+                if (aValue == 0)
+                {
+                    WriteByte(0x80 | x);
+                    break;
+                }
+
+                WriteByte(x);
+                --aValue;
+            }
+        }
+
+        void WriteAction(Action aAction, uint32 aLength)
+        {
+            WriteNumber((uint64(aLength - 1) << 2) | aAction);
+        }
+
+        void WriteRelativeOffset(int64 aDelta)
+        {
+            WriteNumber((uint64(aDelta < 0 ? -aDelta : aDelta) << 1) | (aDelta < 0 ? 1 : 0));
+        }
+
+        void WriteUInt32LE(uint32 aValue)
+        {
+            for (int i = 0; i < 4; ++i)
+                WriteByte(uint8(aValue >> (i * 8)));
+        }
+
+        void Flush()
+        {
+            mCrc = BinUtils::CRC32(mBuffer, mUsed, mCrc);
+            mOut.WriteBytes(mBuffer, mUsed);
+            mUsed = 0;
+        }
+
+        C_Stream& mOut;
+        uint8 mBuffer[64 * 1024];
+        uint32 mUsed = 0;
+        uint32 mCrc = 0;
+    };
+
+    class PatchEncoder
+    {
+    public:
+        PatchEncoder(const uint8* aSource, uint32 aSourceSize, uint32 aTargetSize, const ROMPatch::TargetReadFunc& aTargetRead, C_Stream& aOut)
+            : mSource(aSource)
+            , mSourceSize(aSourceSize)
+            , mTargetSize(aTargetSize)
+            , mWindow(aTargetSize, aTargetRead)
+            , mWriter(aOut)
+        {}
+
+        void Encode()
+        {
+            mIndex.Build(mHash, mSource, mSourceSize);
+
+            mWriter.WriteBytes(sMagic, sizeof(sMagic));
+            mWriter.WriteNumber(mSourceSize);
+            mWriter.WriteNumber(mTargetSize);
+            mWriter.WriteNumber(0); // no metadata
+
+            uint32 hash = 0;
+            uint32 hashPos = INVALID_POS;
+
+            while (mPos < mTargetSize)
+            {
+                if (mPos - mLiteralStart >= CHUNK_SIZE)
+                    FlushLiterals();
+
+                // keep one byte behind for the run check and the rolling hash
+                mWindow.Require(C_Min(mLiteralStart, mPos > 0 ? mPos - 1 : 0), mPos + HASH_WINDOW);
+
+                const uint8* target = mWindow.Ptr(mPos);
+                const uint32 ahead = mTargetSize - mPos;
+
+                // unchanged data at the same offset, the bulk of any rom patch
+                if (ahead >= MIN_SOURCE_READ && mPos + MIN_SOURCE_READ <= mSourceSize
+                    && memcmp(target, mSource + mPos, MIN_SOURCE_READ) == 0)
+                {
+                    FlushLiterals();
+                    const uint32 len = ExtendMatch(mSource + mPos, C_Min(mSourceSize, mTargetSize) - mPos);
+                    mWriter.WriteAction(SOURCE_READ, len);
+                    Advance(len);
+                    hashPos = INVALID_POS;
+                    continue;
+                }
+
+                // repeated byte, i.e. padding past the end of the source
+                if (mPos > 0 && ahead >= MIN_TARGET_RUN && IsRun(target, target[-1], MIN_TARGET_RUN))
+                {
+                    const uint8 value = target[-1];
+                    FlushLiterals();
+                    const uint32 len = ExtendRun(value);
+                    mWriter.WriteAction(TARGET_COPY, len);
+                    mWriter.WriteRelativeOffset(int64(mPos - 1) - int64(mTargetRelOffset));
+                    mTargetRelOffset = mPos - 1 + len;
+                    Advance(len);
+                    hashPos = INVALID_POS;
+                    continue;
+                }
+
+                // data moved around in the source
+                if (ahead >= HASH_WINDOW)
+                {
+                    if (hashPos != INVALID_POS && hashPos + 1 == mPos)
+                        hash = mHash.Roll(hash, target[-1], target[HASH_WINDOW - 1]);
+                    else
+                        hash = mHash.Compute(target);
+
+                    hashPos = mPos;
+
+                    uint32 match = mIndex.Find(hash);
+
+                    if (match != INVALID_POS && memcmp(target, mSource + match, HASH_WINDOW) == 0)
+                    {
+                        // pull pending literals into the match where possible
+                        while (mPos > mLiteralStart && match > 0 && mWindow.Ptr(mPos)[-1] == mSource[match - 1])
+                        {
+                            --mPos;
+                            --match;
+                        }
+
+                        FlushLiterals();
+                        const uint32 len = ExtendMatch(mSource + match, C_Min(mSourceSize - match, mTargetSize - mPos));
+                        mWriter.WriteAction(SOURCE_COPY, len);
+                        mWriter.WriteRelativeOffset(int64(match) - int64(mSourceRelOffset));
+                        mSourceRelOffset = match + len;
+                        Advance(len);
+                        hashPos = INVALID_POS;
+                        continue;
+                    }
+                }
+
+                ++mPos;
+            }
+
+            FlushLiterals();
+
+            mWriter.WriteUInt32LE(BinUtils::CRC32(mSource, mSourceSize));
+            mWriter.WriteUInt32LE(mWindow.mCrc);
+            mWriter.Flush();
+
+            // the patch crc covers everything before it
+            uint8 patchCrc[4];
+            for (int i = 0; i < 4; ++i)
+                patchCrc[i] = uint8(mWriter.mCrc >> (i * 8));
+            mWriter.mOut.WriteBytes(patchCrc, 4);
+        }
+
+    private:
+        void Advance(uint32 aLength)
+        {
+            mPos += aLength;
+            mLiteralStart = mPos;
+        }
+
+        void FlushLiterals()
+        {
+            const uint32 len = mPos - mLiteralStart;
+
+            if (len > 0)
+            {
+                mWriter.WriteAction(TARGET_READ, len);
+                mWriter.WriteBytes(mWindow.Ptr(mLiteralStart), len);
+            }
+
+            mLiteralStart = mPos;
+        }
+
+        static bool IsRun(const uint8* aData, uint8 aValue, uint32 aLength)
+        {
+            for (uint32 i = 0; i < aLength; ++i)
+                if (aData[i] != aValue)
+                    return false;
+            return true;
+        }
+
+        // length of the match between the target at mPos and aCompare, literals must be flushed
+        uint32 ExtendMatch(const uint8* aCompare, uint32 aMaxLength)
+        {
+            uint32 len = 0;
+
+            while (len < aMaxLength)
+            {
+                const uint32 step = C_Min(aMaxLength - len, CHUNK_SIZE);
+                mWindow.Require(mPos + len, mPos + len + step);
+
+                const uint8* target = mWindow.Ptr(mPos + len);
+                uint32 i = 0;
+                while (i < step && target[i] == aCompare[len + i])
+                    ++i;
+
+                len += i;
+
+                if (i < step)
+                    break;
+            }
+
+            return len;
+        }
+
+        uint32 ExtendRun(uint8 aValue)
+        {
+            const uint32 maxLength = mTargetSize - mPos;
+            uint32 len = 0;
+
+            while (len < maxLength)
+            {
+                const uint32 step = C_Min(maxLength - len, CHUNK_SIZE);
+                mWindow.Require(mPos + len, mPos + len + step);
+
+                const uint8* target = mWindow.Ptr(mPos + len);
+                uint32 i = 0;
+                while (i < step && target[i] == aValue)
+                    ++i;
+
+                len += i;
+
+                if (i < step)
+                    break;
+            }
+
+            return len;
+        }
+
+        const uint8* mSource;
+        uint32 mSourceSize;
+        uint32 mTargetSize;
+
+        RollingHash mHash;
+        SourceIndex mIndex;
+        TargetWindow mWindow;
+        PatchWriter mWriter;
+
+        uint32 mPos = 0;
+        uint32 mLiteralStart = 0;
+        uint32 mSourceRelOffset = 0;
+        uint32 mTargetRelOffset = 0;
+    };
+
+    struct PatchReader
+    {
+        PatchReader(const uint8* aData, uint32 aSize)
+            : mData(aData)
+            , mSize(aSize)
+        {}
+
+        bool ReadNumber(uint64& aOut)
+        {
+            aOut = 0;
+            uint64 shift = 1;
+
+            while (mPos < mSize)
+            {
+                const uint8 x = mData[mPos++];
+                aOut += (x & 0x7F) * shift;
+
+                if (x & 0x80)
+                    return true;
+
+                shift <<= 7;
+                aOut += shift;
+
+                if (shift > (uint64(1) << 56))
+                    return false;
+            }
+
+            return false;
+        }
+
+        bool ReadRelativeOffset(int64& aOut)
+        {
+            uint64 data;
+            if (!ReadNumber(data))
+                return false;
+
+            aOut = (data & 1) ? -int64(data >> 1) : int64(data >> 1);
+            return true;
+        }
+
+        const uint8* mData;
+        uint32 mSize;
+        uint32 mPos = 0;
+    };
+}
+
+bool ROMPatch::WritePatch(const uint8* aSource, uint32 aSourceSize, uint32 aTargetSize, const TargetReadFunc& aTargetRead, C_Stream& aOut)
+{
+    using namespace ROMPatch_private;
+
+    PatchEncoder encoder(aSource, aSourceSize, aTargetSize, aTargetRead, aOut);
+    encoder.Encode();
+
+    return true;
+}
+
+bool ROMPatch::ApplyPatch(const uint8* aSource, uint32 aSourceSize, const char* aPatchPath, C_Ptr<C_MemBlock>& aOutTarget)
+{
+    using namespace ROMPatch_private;
+
+    C_Ptr<C_MemBlock> patch = C_FileSystem::ReadFile(aPatchPath);
+
+    if (!patch)
+    {
+        WAR_LOG_ERROR(CAT_GENERAL, "Failed to read patch: %s", aPatchPath);
+        return false;
+    }
+
+    const uint8* patchData = (const uint8*)patch->mBlock;
+    const uint32 footerSize = 12;
+
+    if (patch->mSize < sizeof(sMagic) + footerSize || memcmp(patchData, sMagic, sizeof(sMagic)) != 0)
+    {
+        WAR_LOG_ERROR(CAT_GENERAL, "Not a BPS patch: %s", aPatchPath);
+        return false;
+    }
+
+    const uint8* footer = patchData + patch->mSize - footerSize;
+
+    if (BinUtils::CRC32(patchData, patch->mSize - 4) != ReadUInt32LE(footer + 8))
+    {
+        WAR_LOG_ERROR(CAT_GENERAL, "Patch checksum mismatch, the patch is corrupt: %s", aPatchPath);
+        return false;
+    }
+
+    PatchReader rdr(patchData, patch->mSize - footerSize);
+    rdr.mPos = sizeof(sMagic);
+
+    uint64 sourceSize, targetSize, metadataSize;
+    if (!rdr.ReadNumber(sourceSize) || !rdr.ReadNumber(targetSize) || !rdr.ReadNumber(metadataSize)
+        || metadataSize > rdr.mSize - rdr.mPos || targetSize > 0xFFFFFFFF)
+    {
+        WAR_LOG_ERROR(CAT_GENERAL, "Invalid patch header: %s", aPatchPath);
+        return false;
+    }
+
+    rdr.mPos += uint32(metadataSize);
+
+    if (sourceSize != aSourceSize || BinUtils::CRC32(aSource, aSourceSize) != ReadUInt32LE(footer))
+    {
+        WAR_LOG_ERROR(CAT_GENERAL, "Patch was not made for this rom: %s", aPatchPath);
+        return false;
+    }
+
+    const uint8* src = aSource;
+    C_Ptr<C_MemBlock> target = WAR_MemBlockAlloc(uint32(targetSize));
+    uint8* dst = (uint8*)target->mBlock;
+
+    uint64 outputOffset = 0;
+    int64 sourceRelOffset = 0;
+    int64 targetRelOffset = 0;
+
+    while (rdr.mPos < rdr.mSize)
+    {
+        uint64 data;
+        if (!rdr.ReadNumber(data))
+            break;
+
+        const uint64 length = (data >> 2) + 1;
+
+        if (outputOffset + length > targetSize)
+            break;
+
+        bool valid = true;
+
+        switch (data & 3)
+        {
+            case SOURCE_READ:
+            {
+                valid = outputOffset + length <= sourceSize;
+                if (valid)
+                    memcpy(dst + outputOffset, src + outputOffset, size_t(length));
+                break;
+            }
+
+            case TARGET_READ:
+            {
+                valid = length <= rdr.mSize - rdr.mPos;
+                if (valid)
+                {
+                    memcpy(dst + outputOffset, patchData + rdr.mPos, size_t(length));
+                    rdr.mPos += uint32(length);
+                }
+                break;
+            }
+
+            case SOURCE_COPY:
+            {
+                int64 delta;
+                valid = rdr.ReadRelativeOffset(delta);
+                sourceRelOffset += delta;
+                valid = valid && sourceRelOffset >= 0 && uint64(sourceRelOffset) + length <= sourceSize;
+                if (valid)
+                {
+                    memcpy(dst + outputOffset, src + sourceRelOffset, size_t(length));
+                    sourceRelOffset += length;
+                }
+                break;
+            }
+
+            case TARGET_COPY:
+            {
+                int64 delta;
+                valid = rdr.ReadRelativeOffset(delta);
+                targetRelOffset += delta;
+                valid = valid && targetRelOffset >= 0 && uint64(targetRelOffset) < outputOffset;
+                if (valid)
+                {
+                    // may overlap the output on purpose, so copy bytewise
+                    for (uint64 i = 0; i < length; ++i)
+                        dst[outputOffset + i] = dst[targetRelOffset++];
+                }
+                break;
+            }
+        }
+
+        if (!valid)
+            break;
+
+        outputOffset += length;
+    }
+
+    if (rdr.mPos != rdr.mSize || outputOffset != targetSize)
+    {
+        WAR_LOG_ERROR(CAT_GENERAL, "Corrupt patch data: %s", aPatchPath);
+        return false;
+    }
+
+    if (BinUtils::CRC32(dst, uint32(targetSize)) != ReadUInt32LE(footer + 4))
+    {
+        WAR_LOG_ERROR(CAT_GENERAL, "Patched rom checksum mismatch");
+        return false;
+    }
+
+    aOutTarget = target;
+    return true;
+}
@@ -0,0 +1,23 @@
+#ifndef _ROMPatch_h_
+#define _ROMPatch_h_
+
+#include "C_Base.h"
+#include <functional>
+
+class C_Stream;
+struct C_MemBlock;
+
+// BPS patches (beat patch format), compatible with common patchers like Flips and beat
+namespace ROMPatch
+{
+    // fills aBuffer with aSize bytes of the target image starting at aOffset, called with increasing offsets
+    typedef function<void(uint8* aBuffer, uint32 aOffset, uint32 aSize)> TargetReadFunc;
+
+    // writes a patch from aSource to the target produced by aTargetRead. the target is streamed through a
+    // small window, so only the source has to be resident
+    bool WritePatch(const uint8* aSource, uint32 aSourceSize, uint32 aTargetSize, const TargetReadFunc& aTargetRead, C_Stream& aOut);
+
+    bool ApplyPatch(const uint8* aSource, uint32 aSourceSize, const char* aPatchPath, C_Ptr<C_MemBlock>& aOutTarget);
+}
+
+#endif // _ROMPatch_h_
@@ -0,0 +1,145 @@
+#include "ROMView.h"
+#include "C_MemBlock.h"
+#include "CL_Log.h"
+#include "ByteSwap.h"
+
+namespace ROMView_private
+{
+    struct OrderInfo
+    {
+        const char* mName;
+        uint8 mMagic[4];
+    };
+
+    // the first word of the header, 0x80371240 in big-endian
+    static const OrderInfo sOrderInfo[ROMView::ORDER_AUTO] =
+    {
+        { "z64", { 0x80, 0x37, 0x12, 0x40 } },
+        { "v64", { 0x37, 0x80, 0x40, 0x12 } },
+        { "n64", { 0x40, 0x12, 0x37, 0x80 } }
+    };
+
+    // conversion runs per chunk, straight after the copy while the data is still in cache
+    const uint32 CONVERT_CHUNK_SIZE = 256 * 1024;
+    const uint32 MIN_ROM_SIZE = 0x1000;
+}
+
+ROMView::ByteOrder ROMView::DetectByteOrder(const uint8* aHeader)
+{
+    using namespace ROMView_private;
+
+    for (int i = 0; i < ORDER_AUTO; ++i)
+    {
+        if (memcmp(aHeader, sOrderInfo[i].mMagic, 4) == 0)
+            return ByteOrder(i);
+    }
+
+    return ORDER_AUTO;
+}
+
+bool ROMView::ParseByteOrder(const char* aName, ByteOrder& aOut)
+{
+    using namespace ROMView_private;
+
+    for (int i = 0; i < ORDER_AUTO; ++i)
+    {
+        if (strcmp(aName, sOrderInfo[i].mName) == 0)
+        {
+            aOut = ByteOrder(i);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void ROMView::ConvertByteOrder(void* aData, uint32 aSize, ByteOrder aOrder)
+{
+    switch (aOrder)
+    {
+        case ORDER_V64:
+            ByteSwap::Swap16(aData, aSize / 2);
+            break;
+
+        case ORDER_N64:
+            ByteSwap::Swap32(aData, aSize / 4);
+            break;
+
+        default:
+            break;
+    }
+}
+
+ROMView::~ROMView()
+{
+    Close();
+}
+
+bool ROMView::Open(const char* aPath)
+{
+    using namespace ROMView_private;
+
+    Close();
+
+    if (!mMapping.OpenRead(aPath))
+    {
+        WAR_LOG_ERROR(CAT_GENERAL, "Failed to open rom: %s", aPath);
+        return false;
+    }
+
+    if (mMapping.GetSize() < MIN_ROM_SIZE || mMapping.GetSize() > 0xFFFFFFFF)
+    {
+        WAR_LOG_ERROR(CAT_GENERAL, "Invalid rom size: %s", aPath);
+        Close();
+        return false;
+    }
+
+    mSize = uint32(mMapping.GetSize());
+    mOrder = DetectByteOrder(mMapping.GetData());
+
+    if (mOrder == ORDER_AUTO)
+    {
+        WAR_LOG_WARNING(CAT_GENERAL, "Unknown rom header, assuming big-endian (.z64): %s", aPath);
+        mOrder = ORDER_Z64;
+    }
+
+    if (mOrder == ORDER_Z64)
+    {
+        mData = mMapping.GetData();
+        return true;
+    }
+
+    WAR_LOG_INFO(CAT_GENERAL, "Converting .%s rom to big-endian", sOrderInfo[mOrder].mName);
+
+    mConverted = WAR_MemBlockAlloc(mSize);
+    uint8* dst = (uint8*)mConverted->mBlock;
+    const uint8* src = mMapping.GetData();
+
+    for (uint32 offset = 0; offset < mSize; offset += CONVERT_CHUNK_SIZE)
+    {
+        const uint32 size = C_Min(CONVERT_CHUNK_SIZE, mSize - offset);
+        memcpy(dst + offset, src + offset, size);
+        ConvertByteOrder(dst + offset, size, mOrder);
+    }
+
+    mMapping.Close();
+    mData = dst;
+
+    return true;
+}
+
+void ROMView::Release(uint32 aOffset, uint32 aSize) const
+{
+    // converted roms are a copy that has to stay resident
+    if (mMapping.IsOpen())
+        mMapping.Release(aOffset, aSize);
+}
+
+void ROMView::Close()
+{
+    mMapping.Close();
+    mConverted = NULL;
+    mData = NULL;
+    mSize = 0;
+    mOrder = ORDER_AUTO;
+}
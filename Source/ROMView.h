@@ -0,0 +1,57 @@
+#ifndef _ROMView_h_
+#define _ROMView_h_
+
+#include "C_Base.h"
+#include "MappedFile.h"
+
+struct C_MemBlock;
+
+// a rom in big-endian (.z64) byte order, whatever order the file is stored in.
+// .z64 files are mapped directly, .v64/.n64 files are converted while they are read
+class ROMView
+{
+public:
+    enum ByteOrder
+    {
+        ORDER_Z64, // big-endian
+        ORDER_V64, // byte-swapped halfwords
+        ORDER_N64, // little-endian words
+
+        // unknown when detecting, keep the base rom's order when writing
+        ORDER_AUTO
+    };
+
+    static ByteOrder DetectByteOrder(const uint8* aHeader);
+    static bool ParseByteOrder(const char* aName, ByteOrder& aOut);
+
+    // converts big-endian data to aOrder, or aOrder data to big-endian. sizes must be 4 byte aligned
+    static void ConvertByteOrder(void* aData, uint32 aSize, ByteOrder aOrder);
+
+    ROMView() {}
+    ~ROMView();
+
+    bool Open(const char* aPath);
+    void Close();
+
+    const uint8* GetData() const { return mData; }
+    uint32 GetSize() const { return mSize; }
+
+    // lets the os drop the pages of a range that was read, only a mapped .z64 can. the data stays valid
+    void Release(uint32 aOffset, uint32 aSize) const;
+    bool CanRelease() const { return mMapping.IsOpen(); }
+
+    // order of the file on disk
+    ByteOrder GetByteOrder() const { return mOrder; }
+
+private:
+    ROMView(const ROMView&) = delete;
+    ROMView& operator=(const ROMView&) = delete;
+
+    MappedFile mMapping;
+    C_Ptr<C_MemBlock> mConverted;
+    const uint8* mData = NULL;
+    uint32 mSize = 0;
+    ByteOrder mOrder = ORDER_AUTO;
+};
+
+#endif // _ROMView_h_
@@ -0,0 +1,62 @@
+#include "RareZip.h"
+#include "Deflate.h"
+
+namespace RareZip_private
+{
+    // entries are never this big, stops random data from passing as a header
+    const uint32 MAX_UNCOMPRESSED_SIZE = 16 * 1024 * 1024;
+}
+
+uint32 RareZip::GetUncompressedSize(const uint8* aData, uint32 aSize)
+{
+    using namespace RareZip_private;
+
+    if (aSize <= HEADER_SIZE)
+        return 0;
+
+    const uint32 size = aData[0] | (aData[1] << 8) | (aData[2] << 16) | (uint32(aData[3]) << 24);
+    const uint32 compSize = aSize - HEADER_SIZE;
+
+    if (size == 0 || size > MAX_UNCOMPRESSED_SIZE)
+        return 0;
+
+    // deflate can't expand by more than ~1032:1 and stored blocks only add 5 bytes per 64k
+    if (compSize > size + (size >> 10) + 64 || uint64(compSize) * 1032 < size)
+        return 0;
+
+    // block type 3 is invalid
+    if (((aData[HEADER_SIZE] >> 1) & 3) == 3)
+        return 0;
+
+    return size;
+}
+
+bool RareZip::Decompress(const uint8* aData, uint32 aSize, C_Vector<uint8>& aOut)
+{
+    const uint32 size = GetUncompressedSize(aData, aSize);
+
+    if (size == 0)
+        return false;
+
+    aOut.Resize(size);
+
+    // entries may be padded after the end of the stream
+    if (!Deflate::Inflate(aData + HEADER_SIZE, aSize - HEADER_SIZE, aOut.GetBuffer(), size))
+    {
+        aOut.Clear();
+        return false;
+    }
+
+    return true;
+}
+
+void RareZip::Compress(const uint8* aData, uint32 aSize, uint8 aFlags, int aLevel, C_Vector<uint8>& aOut)
+{
+    aOut.Add(uint8(aSize));
+    aOut.Add(uint8(aSize >> 8));
+    aOut.Add(uint8(aSize >> 16));
+    aOut.Add(uint8(aSize >> 24));
+    aOut.Add(aFlags);
+
+    Deflate::Compress(aData, aSize, aLevel, aOut);
+}
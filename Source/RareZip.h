@@ -0,0 +1,27 @@
+#ifndef _RareZip_h_
+#define _RareZip_h_
+
+#include "C_Base.h"
+#include "C_Vector.h"
+#include "Deflate.h"
+
+// compressed archive entries: little-endian uncompressed size, one flags byte, raw deflate data
+namespace RareZip
+{
+    const uint32 HEADER_SIZE = 5;
+
+    // uncompressed size from the header if aData looks like a compressed entry, 0 otherwise.
+    // cheap check only, Decompress() does the full validation
+    uint32 GetUncompressedSize(const uint8* aData, uint32 aSize);
+
+    // fails if aData isn't a complete compressed entry
+    bool Decompress(const uint8* aData, uint32 aSize, C_Vector<uint8>& aOut);
+
+    // flags byte of a compressed entry's header
+    inline uint8 GetFlags(const uint8* aData) { return aData[4]; }
+
+    // appends a compressed entry to aOut
+    void Compress(const uint8* aData, uint32 aSize, uint8 aFlags, int aLevel, C_Vector<uint8>& aOut);
+}
+
+#endif // _RareZip_h_
@@ -0,0 +1,277 @@
+#ifndef _RecordSchema_h_
+#define _RecordSchema_h_
+
+#include "C_Base.h"
+#include "C_Vector.h"
+#include "C_DataPack.h"
+#include "BigEndian.h"
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+// compile-time field lists for fixed-layout big-endian records. one schema gives binary decode/encode,
+// C_DataPack conversion and whole-table bulk paths (record arrays or struct-of-arrays columns), so record types
+// only list their fields once:
+//
+//  static const auto& GetSchema()
+//  {
+//      static const auto sSchema = RecordSchema::Make<MyEntry>(
+//          RecordSchema::MakeField("Id", &MyEntry::mId),
+//          RecordSchema::MakeFixedString<16>("Name", &MyEntry::mName));
+//      return sSchema;
+//  }
+namespace RecordSchema
+{
+    // plain big-endian value
+    template<typename C, typename T>
+    struct Field
+    {
+        typedef T ValueType;
+        static const uint32 SIZE = sizeof(T);
+
+        const char* mName;
+        T C::* mMember;
+
+        void DecodeValue(const uint8* aData, T& aOut) const { aOut = BigEndian::Load<T>(aData); }
+        void EncodeValue(uint8* aData, const T& aValue) const { BigEndian::Store<T>(aData, aValue); }
+
+        void Decode(const uint8* aData, C& aRec) const { DecodeValue(aData, aRec.*mMember); }
+        void Encode(uint8* aData, const C& aRec) const { EncodeValue(aData, aRec.*mMember); }
+        void Pack(C_DataPack& aPack, const C& aRec) const { aPack.Set(mName, aRec.*mMember); }
+        void Unpack(const C_DataPack& aPack, C& aRec) const { aPack.Get(mName, aRec.*mMember); }
+    };
+
+    // zero padded string of LEN bytes
+    template<typename C, uint32 LEN>
+    struct FixedStringField
+    {
+        typedef string ValueType;
+        static const uint32 SIZE = LEN;
+
+        const char* mName;
+        string C::* mMember;
+
+        void DecodeValue(const uint8* aData, string& aOut) const
+        {
+            char buff[LEN + 1];
+            memcpy(buff, aData, LEN);
+            buff[LEN] = 0;
+            aOut = buff;
+        }
+
+        void EncodeValue(uint8* aData, const string& aValue) const
+        {
+            const uint32 len = C_Min(uint32(aValue.length()), LEN);
+            memcpy(aData, aValue.c_str(), len);
+            WAR_ZeroMem(aData + len, LEN - len);
+        }
+
+        void Decode(const uint8* aData, C& aRec) const { DecodeValue(aData, aRec.*mMember); }
+        void Encode(uint8* aData, const C& aRec) const { EncodeValue(aData, aRec.*mMember); }
+
+        void Pack(C_DataPack& aPack, const C& aRec) const { aPack.Set(mName, aRec.*mMember); }
+        void Unpack(const C_DataPack& aPack, C& aRec) const { aPack.Get(mName, aRec.*mMember); }
+    };
+
+    template<typename... FIELDS> struct TotalSize;
+    template<> struct TotalSize<> { static const uint32 VALUE = 0; };
+    template<typename F, typename... REST> struct TotalSize<F, REST...> { static const uint32 VALUE = F::SIZE + TotalSize<REST...>::VALUE; };
+
+    template<typename C, typename... FIELDS>
+    class Schema
+    {
+    public:
+        static const uint32 SIZE = TotalSize<FIELDS...>::VALUE;
+
+        // struct-of-arrays form of a table, one column per field in declaration order
+        typedef std::tuple<C_Vector<typename FIELDS::ValueType>...> Columns;
+
+        Schema(const FIELDS&... aFields)
+            : mFields(aFields...)
+        {}
+
+        void Decode(const uint8* aData, C& aRec) const
+        {
+            ForEach([&](const auto& aField, uint32 aOffset) { aField.Decode(aData + aOffset, aRec); });
+        }
+
+        void Encode(uint8* aData, const C& aRec) const
+        {
+            ForEach([&](const auto& aField, uint32 aOffset) { aField.Encode(aData + aOffset, aRec); });
+        }
+
+        void Read(BigEndian::Reader& aRdr, C& aRec) const
+        {
+            WAR_CHECK(aRdr.GetRemaining() >= SIZE);
+            Decode(aRdr.GetCurrent(), aRec);
+            aRdr.Skip(SIZE);
+        }
+
+        void Pack(C_DataPack& aPack, const C& aRec) const
+        {
+            ForEach([&](const auto& aField, uint32) { aField.Pack(aPack, aRec); });
+        }
+
+        void Unpack(const C_DataPack& aPack, C& aRec) const
+        {
+            ForEach([&](const auto& aField, uint32) { aField.Unpack(aPack, aRec); });
+        }
+
+        // whole tables, aData holds aCount records back to back
+        void DecodeArray(const uint8* aData, int aCount, C_Vector<C>& aOut) const
+        {
+            aOut.Resize(aCount);
+
+            for (int i = 0; i < aCount; ++i)
+                Decode(aData + i * SIZE, aOut[i]);
+        }
+
+        void EncodeArray(const C_Vector<C>& aRecords, C_Vector<uint8>& aOut) const
+        {
+            const int base = aOut.Count();
+            aOut.Resize(base + aRecords.Count() * SIZE);
+
+            for (int i = 0; i < aRecords.Count(); ++i)
+                Encode(aOut.GetBuffer() + base + i * SIZE, aRecords[i]);
+        }
+
+        void PackArray(C_DataPack& aPack, const C_Vector<C>& aRecords) const
+        {
+            for (int i = 0; i < aRecords.Count(); ++i)
+            {
+                C_DataPack packEntry;
+                Pack(packEntry, aRecords[i]);
+                aPack.Set(i, packEntry);
+            }
+        }
+
+        void UnpackArray(const C_DataPack& aPack, C_Vector<C>& aOut) const
+        {
+            aOut.Resize(aPack.NumEntries());
+
+            for (int i = 0; i < aOut.Count(); ++i)
+            {
+                C_DataPack packEntry;
+                aPack.Get(i, packEntry);
+                Unpack(packEntry, aOut[i]);
+            }
+        }
+
+        // whole tables as columns. each field is walked down the table with a fixed stride, and a pass that only
+        // needs one field (std::get<I>(columns)) doesn't touch the others
+        void DecodeColumns(const uint8* aData, int aCount, Columns& aOut) const
+        {
+            ForEachColumn(aOut, [&](const auto& aField, uint32 aOffset, auto& aColumn)
+            {
+                aColumn.Resize(aCount);
+
+                for (int i = 0; i < aCount; ++i)
+                    aField.DecodeValue(aData + aOffset + i * SIZE, aColumn[i]);
+            });
+        }
+
+        void EncodeColumns(const Columns& aColumns, C_Vector<uint8>& aOut) const
+        {
+            const int count = NumRows(aColumns);
+            const int base = aOut.Count();
+            aOut.Resize(base + count * SIZE);
+
+            uint8* data = aOut.GetBuffer() + base;
+
+            ForEachColumn(aColumns, [&](const auto& aField, uint32 aOffset, const auto& aColumn)
+            {
+                for (int i = 0; i < count; ++i)
+                    aField.EncodeValue(data + aOffset + i * SIZE, aColumn[i]);
+            });
+        }
+
+        void PackColumns(C_DataPack& aPack, const Columns& aColumns) const
+        {
+            for (int i = 0; i < NumRows(aColumns); ++i)
+            {
+                C_DataPack packEntry;
+                ForEachColumn(aColumns, [&](const auto& aField, uint32, const auto& aColumn) { packEntry.Set(aField.mName, aColumn[i]); });
+                aPack.Set(i, packEntry);
+            }
+        }
+
+        // fields missing from an entry keep the record's default
+        void UnpackColumns(const C_DataPack& aPack, Columns& aOut) const
+        {
+            const C defaults;
+            const int count = aPack.NumEntries();
+
+            ForEachColumn(aOut, [&](const auto& aField, uint32, auto& aColumn) { aColumn.Resize(count, defaults.*aField.mMember); });
+
+            for (int i = 0; i < count; ++i)
+            {
+                C_DataPack packEntry;
+                aPack.Get(i, packEntry);
+                ForEachColumn(aOut, [&](const auto& aField, uint32, auto& aColumn) { packEntry.Get(aField.mName, aColumn[i]); });
+            }
+        }
+
+        static int NumRows(const Columns& aColumns) { return std::get<0>(aColumns).Count(); }
+
+        void ResizeColumns(Columns& aColumns, int aCount) const
+        {
+            ForEachColumn(aColumns, [&](const auto&, uint32, auto& aColumn) { aColumn.Resize(aCount); });
+        }
+
+    private:
+        template<typename FUNC>
+        void ForEach(const FUNC& aFunc) const
+        {
+            ForEach(aFunc, std::index_sequence_for<FIELDS...>());
+        }
+
+        template<typename FUNC, size_t... I>
+        void ForEach(const FUNC& aFunc, std::index_sequence<I...>) const
+        {
+            uint32 offset = 0;
+            int expand[] = { 0, (aFunc(std::get<I>(mFields), offset), offset += std::tuple_element<I, std::tuple<FIELDS...>>::type::SIZE, 0)... };
+            (void)expand;
+        }
+
+        // aFunc(field, offset in the record, the field's column)
+        template<typename COLUMNS, typename FUNC>
+        void ForEachColumn(COLUMNS& aColumns, const FUNC& aFunc) const
+        {
+            ForEachColumn(aColumns, aFunc, std::index_sequence_for<FIELDS...>());
+        }
+
+        template<typename COLUMNS, typename FUNC, size_t... I>
+        void ForEachColumn(COLUMNS& aColumns, const FUNC& aFunc, std::index_sequence<I...>) const
+        {
+            uint32 offset = 0;
+            int expand[] = { 0, (aFunc(std::get<I>(mFields), offset, std::get<I>(aColumns)), offset += std::tuple_element<I, std::tuple<FIELDS...>>::type::SIZE, 0)... };
+            (void)expand;
+        }
+
+        std::tuple<FIELDS...> mFields;
+    };
+
+    // RecordSchema::ColumnsOf<decltype(schema)> for the columns of a schema returned by reference
+    template<typename S>
+    using ColumnsOf = typename std::decay_t<S>::Columns;
+
+    template<typename C, typename... FIELDS>
+    Schema<C, FIELDS...> Make(const FIELDS&... aFields)
+    {
+        return Schema<C, FIELDS...>(aFields...);
+    }
+
+    template<typename C, typename T>
+    Field<C, T> MakeField(const char* aName, T C::* aMember)
+    {
+        return Field<C, T>{ aName, aMember };
+    }
+
+    template<uint32 LEN, typename C>
+    FixedStringField<C, LEN> MakeFixedString(const char* aName, string C::* aMember)
+    {
+        return FixedStringField<C, LEN>{ aName, aMember };
+    }
+}
+
+#endif // _RecordSchema_h_
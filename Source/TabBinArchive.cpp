@@ -0,0 +1,814 @@
+#include "TabBinArchive.h"
+#include "C_Stream.h"
+#include "C_DataPack.h"
+#include "C_MemBlock.h"
+#include "CL_Log.h"
+#include "BinUtils.h"
+#include "BigEndian.h"
+#include "JobPool.h"
+#include "RareZip.h"
+#include <atomic>
+#include <unordered_set>
+
+namespace TabBinArchive_private
+{
+    static const char* sIndexFile = "index.json";
+    static const char* sHeadFile = "_head.bin";
+    static const char* sTailFile = "_tail.bin";
+    // recompressed entries keyed by content, kept between builds
+    static const char* sZipCacheDir = ".zcache";
+
+    struct TabEntry
+    {
+        uint32 mOffset = 0;
+        uint32 mFlags = 0;
+        C_Vector<uint8> mExtra;
+
+        void Pack(C_DataPack& aPack) const
+        {
+            if (mFlags != 0)
+                aPack.Set("Flags", mFlags);
+
+            if (mExtra.Count() > 0)
+                aPack.Set("Extra", BinUtils::ToHex(mExtra.GetBuffer(), mExtra.Count()));
+        }
+
+        bool Unpack(const TabBinArchive::Desc& aDesc, const C_DataPack& aPack)
+        {
+            aPack.Get("Flags", mFlags);
+
+            string extra;
+            aPack.Get("Extra", extra);
+
+            if (!BinUtils::FromHex(extra.c_str(), mExtra) || mExtra.Count() > int(aDesc.mStride - 4))
+                return false;
+
+            // short or missing extra bytes are zero filled
+            mExtra.Resize(aDesc.mStride - 4, 0);
+            return true;
+        }
+    };
+
+    // parsed .tab, the last entry holds the end offset
+    struct TabInfo
+    {
+        C_Vector<TabEntry> mEntries;
+        bool mTerminated = false;
+        C_Vector<uint8> mTail;
+
+        bool Read(const TabBinArchive::Desc& aDesc, const uint8* aTab, uint32 aTabSize, uint32 aBinSize)
+        {
+            uint32 pos = 0;
+
+            while (pos + aDesc.mStride <= aTabSize)
+            {
+                const uint32 v = BigEndian::Load<uint32>(aTab + pos);
+
+                if (v == aDesc.mTerminator)
+                {
+                    mTerminated = true;
+                    pos += 4;
+                    break;
+                }
+
+                TabEntry& e = mEntries.Add();
+                e.mOffset = (v & aDesc.mOffsetMask) * aDesc.mOffsetScale;
+                e.mFlags = v & ~aDesc.mOffsetMask;
+                e.mExtra.Resize(aDesc.mStride - 4);
+
+                if (e.mExtra.Count() > 0)
+                    memcpy(e.mExtra.GetBuffer(), aTab + pos + 4, e.mExtra.Count());
+
+                pos += aDesc.mStride;
+            }
+
+            mTail.Resize(aTabSize - pos);
+
+            if (mTail.Count() > 0)
+                memcpy(mTail.GetBuffer(), aTab + pos, mTail.Count());
+
+            if (mEntries.Count() == 0)
+                return false;
+
+            for (int i = 1; i < mEntries.Count(); ++i)
+            {
+                if (mEntries[i].mOffset < mEntries[i - 1].mOffset)
+                    return false;
+            }
+
+            return mEntries[mEntries.Count() - 1].mOffset <= aBinSize;
+        }
+
+        bool Write(const TabBinArchive::Desc& aDesc, C_Stream& aHandle) const
+        {
+            C_Vector<uint8> tab;
+            tab.Resize(mEntries.Count() * aDesc.mStride + (mTerminated ? 4 : 0) + mTail.Count());
+            uint8* dst = tab.GetBuffer();
+
+            for (const TabEntry& e : mEntries)
+            {
+                const uint32 offset = e.mOffset / aDesc.mOffsetScale;
+
+                if (offset > aDesc.mOffsetMask)
+                {
+                    WAR_LOG_ERROR(CAT_GENERAL, "%s: offset 0x%X doesn't fit the .tab", aDesc.mName, e.mOffset);
+                    return false;
+                }
+
+                BigEndian::Store<uint32>(dst, (e.mFlags & ~aDesc.mOffsetMask) | offset);
+
+                if (e.mExtra.Count() > 0)
+                    memcpy(dst + 4, e.mExtra.GetBuffer(), e.mExtra.Count());
+
+                dst += aDesc.mStride;
+            }
+
+            if (mTerminated)
+            {
+                BigEndian::Store<uint32>(dst, aDesc.mTerminator);
+                dst += 4;
+            }
+
+            if (mTail.Count() > 0)
+                memcpy(dst, mTail.GetBuffer(), mTail.Count());
+
+            aHandle.WriteBytes(tab.GetBuffer(), tab.Count());
+            return true;
+        }
+    };
+
+    void GetArchiveDir(FSTContext* aCtx, const TabBinArchive::Desc& aDesc, C_FilePath& aOut)
+    {
+        aOut = aCtx->GetBaseDir();
+        aOut.Combine(aDesc.mName);
+    }
+
+    // maps the file when the context has it in memory, reads it into aStorage otherwise
+    void GetWholeFile(FSTContext* aCtx, ROMFST::File aFile, C_Vector<uint8>& aStorage, const uint8*& aOutData, uint32& aOutSize)
+    {
+        if (aCtx->GetFileData(aFile, aOutData, aOutSize))
+            return;
+
+        C_Stream& handle = aCtx->GetFileStream(aFile);
+        handle.Seek(C_FileSystem::SeekSet, 0);
+        BinUtils::ReadRemaining(handle, aStorage);
+
+        aOutData = aStorage.GetBuffer();
+        aOutSize = aStorage.Count();
+    }
+
+    string GetBaseName(const char* aEntryFile)
+    {
+        C_FilePath name;
+        C_PathUtils::GetFilenameWithoutExtension(aEntryFile, name);
+        return string(name);
+    }
+
+    string GetRawFileName(const char* aEntryFile)
+    {
+        return GetBaseName(aEntryFile) + ".raw";
+    }
+
+    string HashToString(uint64 aHash)
+    {
+        return string(C_Strfmt<32>("%08X%08X", uint32(aHash >> 32), uint32(aHash)));
+    }
+
+    struct RawInfo
+    {
+        uint32 mSize = 0;
+        uint64 mHash = 0;
+        uint8 mFlags = 0;
+    };
+
+    struct CompileEntry
+    {
+        string mFile;
+        TabEntry mTab;
+        C_Ptr<C_MemBlock> mData;
+
+        // compressed entries, rebuilt from the .raw file when it no longer matches its hash
+        string mRawFile;
+        string mRawHash;
+        uint32 mZipFlags = 0;
+        C_Ptr<C_MemBlock> mRaw;
+        string mCacheFile;
+        bool mRecompressed = false;
+
+        // info from the entry converter
+        C_DataPack mConverted;
+        bool mFailed = false;
+    };
+
+    C_Ptr<C_MemBlock> ToMemBlock(const C_Vector<uint8>& aData)
+    {
+        C_Ptr<C_MemBlock> block = WAR_MemBlockAlloc(aData.Count());
+
+        if (aData.Count() > 0)
+            memcpy(block->mBlock, aData.GetBuffer(), aData.Count());
+
+        return block;
+    }
+
+    // picks the entry's data: the extracted file, a cached recompression, or nothing if it has to be recompressed.
+    // false if something failed to load
+    bool LoadEntry(FSTContext* aCtx, const TabBinArchive::Desc& aDesc, const C_FilePath& aDir, int aZipLevel, CompileEntry& aEntry)
+    {
+        const bool compressed = aEntry.mRawFile.length() > 0;
+        const bool convert = aDesc.mCompileEntry && aEntry.mConverted.NumEntries() > 0;
+
+        C_FilePath entryPath(aDir);
+        entryPath.Combine(aEntry.mFile.c_str());
+
+        // edits go through the inflated data for compressed entries
+        C_FilePath basePath(aDir);
+        basePath.Combine(compressed ? aEntry.mRawFile.c_str() : aEntry.mFile.c_str());
+
+        const bool rawMissing = compressed && !C_FileSystem::Exists(basePath);
+
+        // a raw file added later changes the entry
+        if (rawMissing)
+            aCtx->AddDependency(basePath);
+
+        if (!convert && (!compressed || rawMissing))
+        {
+            aEntry.mData = aCtx->ReadFile(entryPath);
+            return !!aEntry.mData;
+        }
+
+        C_Ptr<C_MemBlock> base;
+
+        if (rawMissing)
+        {
+            // without the .raw the converter's files are still edits, they apply to the inflated entry
+            C_Ptr<C_MemBlock> entry = aCtx->ReadFile(entryPath);
+            C_Vector<uint8> inflated;
+
+            if (!entry || !RareZip::Decompress((const uint8*)entry->mBlock, entry->mSize, inflated))
+                return false;
+
+            base = ToMemBlock(inflated);
+        }
+        else
+        {
+            base = aCtx->ReadFile(basePath);
+        }
+
+        if (!base)
+            return false;
+
+        if (convert)
+        {
+            C_Vector<uint8> data;
+            data.Resize(base->mSize);
+            memcpy(data.GetBuffer(), base->mBlock, base->mSize);
+
+            bool modified = false;
+            if (!aDesc.mCompileEntry(aCtx, aEntry.mConverted, aDir, data, modified))
+                return false;
+
+            if (modified)
+                base = ToMemBlock(data);
+        }
+
+        if (!compressed)
+        {
+            aEntry.mData = base;
+            return true;
+        }
+
+        const uint64 hash = BinUtils::Hash64(base->mBlock, base->mSize);
+
+        if (HashToString(hash) == aEntry.mRawHash)
+        {
+            aEntry.mData = aCtx->ReadFile(entryPath);
+            return !!aEntry.mData;
+        }
+
+        // the level and header flags are part of the key
+        const uint64 key = BinUtils::Hash64(base->mBlock, base->mSize, (uint64(aZipLevel) << 8) | aEntry.mZipFlags);
+
+        C_FilePath cachePath(aDir);
+        cachePath.Combine(C_Strfmt<256>("%s/%s.bin", sZipCacheDir, HashToString(key).c_str()));
+        aEntry.mCacheFile = cachePath;
+        aEntry.mRaw = base;
+
+        C_Vector<uint8> cached;
+
+        if (BinUtils::ReadCacheFile(cachePath, cached))
+        {
+            aEntry.mData = ToMemBlock(cached);
+            return true;
+        }
+
+        aEntry.mRecompressed = true;
+        return true;
+    }
+}
+
+bool TabBinArchive::EntryData::Get(C_Vector<uint8>& aStorage, const uint8*& aOutData, uint32& aOutSize) const
+{
+    if (!mCompressed)
+    {
+        aOutData = mData;
+        aOutSize = mSize;
+        return true;
+    }
+
+    if (!RareZip::Decompress(mData, mSize, aStorage))
+        return false;
+
+    aOutData = aStorage.GetBuffer();
+    aOutSize = aStorage.Count();
+    return true;
+}
+
+bool TabBinArchive::Export(FSTContext* aCtx, const Desc& aDesc)
+{
+    using namespace TabBinArchive_private;
+
+    if (aCtx->IsFileHandled(aDesc.mTab) || aCtx->IsFileHandled(aDesc.mBin))
+        return true;
+
+    // both halves have to be selected, a lone .tab or .bin is handled raw
+    if (!aCtx->IsFileSelected(aDesc.mTab) || !aCtx->IsFileSelected(aDesc.mBin))
+        return true;
+
+    FSTContext::FileRef tabRef(aCtx, aDesc.mTab);
+    FSTContext::FileRef binRef(aCtx, aDesc.mBin);
+
+    C_Vector<uint8> tabStorage;
+    C_Vector<uint8> binStorage;
+    const uint8* tab;
+    const uint8* bin;
+    uint32 tabSize;
+    uint32 binSize;
+    GetWholeFile(aCtx, aDesc.mTab, tabStorage, tab, tabSize);
+    GetWholeFile(aCtx, aDesc.mBin, binStorage, bin, binSize);
+
+    TabInfo info;
+
+    if (!info.Read(aDesc, tab, tabSize, binSize))
+    {
+        WAR_LOG_WARNING(CAT_GENERAL, "%s: unexpected .tab layout, exporting raw files", aDesc.mName);
+        return true;
+    }
+
+    C_FilePath dir;
+    GetArchiveDir(aCtx, aDesc, dir);
+    C_FileSystem::DirectoryCreate(dir);
+
+    const int numEntries = info.mEntries.Count() - 1;
+    const uint32 dataStart = info.mEntries[0].mOffset;
+    const uint32 dataEnd = info.mEntries[numEntries].mOffset;
+
+    // uncompressed size is 0 if the entry isn't compressed
+    C_Vector<RawInfo> rawInfos;
+    rawInfos.Resize(numEntries);
+
+    C_Vector<C_DataPack> converted;
+    converted.Resize(numEntries);
+
+    std::atomic<bool> writeOk(true);
+
+    JobPool::GetInstance().ParallelFor(numEntries, [&](int i)
+        {
+            const uint32 offset = info.mEntries[i].mOffset;
+            const uint32 size = info.mEntries[i + 1].mOffset - offset;
+            const C_Strfmt<64> name(aDesc.mEntryFormat, i);
+
+            C_FilePath path(dir);
+            path.Combine(name);
+
+            // straight from the rom a chunk at a time when it's mapped, the shared stream can't be used from here.
+            // the pages are read again below, they're released once the entry is done
+            const bool written = binStorage.Count() == 0 ?
+                aCtx->WriteFileData(aDesc.mBin, offset, size, path, false) :
+                C_FileSystem::WriteFile(path, (void*)(bin + offset), size);
+
+            if (!written)
+            {
+                WAR_LOG_ERROR(CAT_GENERAL, "%s: failed to write %s", aDesc.mName, (const char*)name);
+                writeOk = false;
+                return;
+            }
+
+            C_Vector<uint8> raw;
+
+            if (aDesc.mCompressed && RareZip::Decompress(bin + offset, size, raw))
+            {
+                C_FilePath rawPath(dir);
+                rawPath.Combine(GetRawFileName(name).c_str());
+                if (!C_FileSystem::WriteFile(rawPath, raw.GetBuffer(), raw.Count()))
+                {
+                    WAR_LOG_ERROR(CAT_GENERAL, "%s: failed to write %s", aDesc.mName, (const char*)rawPath);
+                    writeOk = false;
+                    return;
+                }
+
+                rawInfos[i].mSize = raw.Count();
+                rawInfos[i].mHash = BinUtils::Hash64(raw.GetBuffer(), raw.Count());
+                rawInfos[i].mFlags = RareZip::GetFlags(bin + offset);
+            }
+
+            if (aDesc.mExportEntry)
+            {
+                C_FilePath basePath(dir);
+                basePath.Combine(GetBaseName(name).c_str());
+
+                const bool ok = raw.Count() > 0 ?
+                    aDesc.mExportEntry(raw.GetBuffer(), raw.Count(), basePath, converted[i]) :
+                    aDesc.mExportEntry(bin + offset, size, basePath, converted[i]);
+
+                if (!ok)
+                    converted[i] = C_DataPack();
+            }
+
+            // the converters are done with it, only the archive converter reads the entries again
+            if (!aDesc.mExportArchive)
+                aCtx->ReleaseFileData(aDesc.mBin, offset, size);
+        });
+
+    if (!writeOk)
+        return false;
+
+    C_DataPack index;
+    C_DataPack entriesPack;
+    int numCompressed = 0;
+
+    for (int i = 0; i < numEntries; ++i)
+    {
+        const C_Strfmt<64> name(aDesc.mEntryFormat, i);
+
+        C_DataPack entryPack;
+        entryPack.Set("File", string(name));
+        info.mEntries[i].Pack(entryPack);
+
+        if (rawInfos[i].mSize > 0)
+        {
+            entryPack.Set("RawFile", GetRawFileName(name));
+            entryPack.Set("RawSize", rawInfos[i].mSize);
+            entryPack.Set("RawHash", HashToString(rawInfos[i].mHash));
+            entryPack.Set("ZipFlags", uint32(rawInfos[i].mFlags));
+            ++numCompressed;
+        }
+
+        if (converted[i].NumEntries() > 0)
+            entryPack.Set("Converted", converted[i]);
+
+        entriesPack.Set(i, entryPack);
+    }
+
+    if (numCompressed > 0)
+        WAR_LOG_INFO(CAT_GENERAL, "%s: inflated %i of %i entries", aDesc.mName, numCompressed, numEntries);
+
+    C_DataPack endPack;
+    info.mEntries[numEntries].Pack(endPack);
+
+    if (aDesc.mExportArchive)
+    {
+        C_Vector<EntryData> entryData;
+        entryData.Resize(numEntries);
+
+        for (int i = 0; i < numEntries; ++i)
+        {
+            entryData[i].mData = bin + info.mEntries[i].mOffset;
+            entryData[i].mSize = info.mEntries[i + 1].mOffset - info.mEntries[i].mOffset;
+            entryData[i].mCompressed = rawInfos[i].mSize > 0;
+        }
+
+        C_DataPack archiveInfo;
+
+        if (aDesc.mExportArchive(entryData, dir, archiveInfo) && archiveInfo.NumEntries() > 0)
+            index.Set("Converted", archiveInfo);
+
+        // the archive converter was the last to read the entries
+        aCtx->ReleaseFileData(aDesc.mBin, dataStart, dataEnd - dataStart);
+    }
+
+    index.Set("Entries", entriesPack);
+    index.Set("End", endPack);
+    index.Set("Terminated", info.mTerminated);
+    index.Set("TabTail", BinUtils::ToHex(info.mTail.GetBuffer(), info.mTail.Count()));
+
+    // data outside the entries, normally empty
+    if (dataStart > 0)
+    {
+        C_FilePath path(dir);
+        path.Combine(sHeadFile);
+        C_FileSystem::WriteFile(path, (void*)bin, dataStart);
+        index.Set("BinHead", string(sHeadFile));
+    }
+
+    if (dataEnd < binSize)
+    {
+        C_FilePath path(dir);
+        path.Combine(sTailFile);
+        C_FileSystem::WriteFile(path, (void*)(bin + dataEnd), binSize - dataEnd);
+        index.Set("BinTail", string(sTailFile));
+    }
+
+    aCtx->WriteJson(index, C_Strfmt<256>("%s/%s", aDesc.mName, sIndexFile));
+
+    aCtx->MarkFileHandled(aDesc.mTab);
+    aCtx->MarkFileHandled(aDesc.mBin);
+
+    return true;
+}
+
+bool TabBinArchive::Compile(FSTContext* aCtx, const Desc& aDesc)
+{
+    using namespace TabBinArchive_private;
+
+    if (aCtx->IsFileHandled(aDesc.mTab) || aCtx->IsFileHandled(aDesc.mBin))
+        return true;
+
+    // both halves have to be selected, a lone .tab or .bin is handled raw
+    if (!aCtx->IsFileSelected(aDesc.mTab) || !aCtx->IsFileSelected(aDesc.mBin))
+        return true;
+
+    C_FilePath dir;
+    GetArchiveDir(aCtx, aDesc, dir);
+
+    C_FilePath indexPath(dir);
+    indexPath.Combine(sIndexFile);
+
+    // not split, the raw .tab/.bin get copied
+    if (!C_FileSystem::Exists(indexPath))
+    {
+        aCtx->AddDependency(indexPath);
+        return true;
+    }
+
+    C_DataPack index;
+    if (!aCtx->ReadJson(index, C_Strfmt<256>("%s/%s", aDesc.mName, sIndexFile)))
+        return false;
+
+    C_DataPack entriesPack;
+    index.Get("Entries", entriesPack);
+
+    C_Vector<CompileEntry> entries;
+    entries.Resize(entriesPack.NumEntries());
+
+    for (int i = 0; i < entries.Count(); ++i)
+    {
+        C_DataPack entryPack;
+        entriesPack.Get(i, entryPack);
+        entryPack.Get("File", entries[i].mFile);
+        entryPack.Get("RawFile", entries[i].mRawFile);
+        entryPack.Get("RawHash", entries[i].mRawHash);
+        entryPack.Get("ZipFlags", entries[i].mZipFlags);
+        entryPack.Get("Converted", entries[i].mConverted);
+
+        if (entries[i].mFile.length() == 0 || !entries[i].mTab.Unpack(aDesc, entryPack))
+        {
+            WAR_LOG_ERROR(CAT_GENERAL, "%s: invalid entry %i in %s", aDesc.mName, i, sIndexFile);
+            return false;
+        }
+    }
+
+    TabInfo info;
+    TabEntry endEntry;
+    C_DataPack endPack;
+    index.Get("End", endPack);
+    index.Get("Terminated", info.mTerminated);
+
+    string tabTail;
+    index.Get("TabTail", tabTail);
+
+    if (!endEntry.Unpack(aDesc, endPack) || !BinUtils::FromHex(tabTail.c_str(), info.mTail))
+    {
+        WAR_LOG_ERROR(CAT_GENERAL, "%s: invalid %s", aDesc.mName, sIndexFile);
+        return false;
+    }
+
+    std::atomic<bool> readOk(true);
+    std::atomic<int> numCached(0);
+
+    JobPool::GetInstance().ParallelFor(entries.Count(), [&](int i)
+        {
+            CompileEntry& e = entries[i];
+            e.mFailed = !LoadEntry(aCtx, aDesc, dir, aCtx->mZipLevel, e);
+
+            if (e.mFailed)
+                readOk = false;
+            else if (e.mData && e.mRaw)
+                ++numCached;
+        });
+
+    if (!readOk)
+    {
+        for (const CompileEntry& e : entries)
+        {
+            if (e.mFailed)
+                WAR_LOG_ERROR(CAT_GENERAL, "%s: failed to load %s", aDesc.mName, e.mFile.c_str());
+        }
+
+        return false;
+    }
+
+    C_DataPack archiveInfo;
+    index.Get("Converted", archiveInfo);
+
+    if (aDesc.mCompileArchive && archiveInfo.NumEntries() > 0)
+    {
+        WAR_ASSERT(!aDesc.mCompressed);
+
+        C_Vector<EntryData> entryData;
+        entryData.Resize(entries.Count());
+
+        for (int i = 0; i < entries.Count(); ++i)
+        {
+            entryData[i].mData = (const uint8*)entries[i].mData->mBlock;
+            entryData[i].mSize = entries[i].mData->mSize;
+        }
+
+        C_Vector<C_Vector<uint8>> newData;
+        newData.Resize(entries.Count());
+
+        if (!aDesc.mCompileArchive(aCtx, archiveInfo, dir, entryData, newData))
+            return false;
+
+        for (int i = 0; i < entries.Count(); ++i)
+        {
+            if (newData[i].Count() > 0)
+                entries[i].mData = ToMemBlock(newData[i]);
+        }
+    }
+
+    C_Vector<int> toCompress;
+    for (int i = 0; i < entries.Count(); ++i)
+    {
+        if (entries[i].mRecompressed)
+            toCompress.Add(i);
+    }
+
+    std::atomic<bool> zipOk(true);
+
+    JobPool::GetInstance().ParallelFor(toCompress.Count(), [&](int i)
+        {
+            CompileEntry& e = entries[toCompress[i]];
+
+            C_Vector<uint8> compressed;
+            RareZip::Compress((const uint8*)e.mRaw->mBlock, e.mRaw->mSize, uint8(e.mZipFlags), aCtx->mZipLevel, compressed);
+
+            // inflated back before it goes into the rom and the cache, a bad stream would only show in game
+            C_Vector<uint8> check;
+
+            const bool inflated = e.mRaw->mSize == 0 ||
+                (RareZip::Decompress(compressed.GetBuffer(), compressed.Count(), check) && memcmp(check.GetBuffer(), e.mRaw->mBlock, check.Count()) == 0);
+
+            if (!inflated)
+            {
+                WAR_LOG_ERROR(CAT_GENERAL, "%s: %s doesn't inflate back to its data after recompressing", aDesc.mName, e.mFile.c_str());
+                zipOk = false;
+                return;
+            }
+
+            e.mData = ToMemBlock(compressed);
+        });
+
+    if (!zipOk)
+        return false;
+
+    if (toCompress.Count() > 0)
+    {
+        // written serially, identical entries share a cache file. a damaged file already there is replaced
+        C_FilePath cacheDir(dir);
+        cacheDir.Combine(sZipCacheDir);
+        C_FileSystem::DirectoryCreate(cacheDir);
+
+        std::unordered_set<string> written;
+
+        for (int idx : toCompress)
+        {
+            const CompileEntry& e = entries[idx];
+
+            if (written.insert(e.mCacheFile).second)
+                BinUtils::WriteCacheFile(e.mCacheFile.c_str(), e.mData->mBlock, e.mData->mSize);
+        }
+    }
+
+    if (toCompress.Count() > 0 || numCached > 0)
+        WAR_LOG_INFO(CAT_GENERAL, "%s: recompressed %i entries, %i from cache", aDesc.mName, toCompress.Count(), int(numCached));
+
+    C_Stream& handleBin = aCtx->GetFileStream(aDesc.mBin);
+
+    string headFile;
+    string tailFile;
+    index.Get("BinHead", headFile);
+    index.Get("BinTail", tailFile);
+
+    if (headFile.length() > 0)
+    {
+        C_FilePath path(dir);
+        path.Combine(headFile.c_str());
+        C_Ptr<C_MemBlock> head = aCtx->ReadFile(path);
+
+        if (!head)
+        {
+            WAR_LOG_ERROR(CAT_GENERAL, "%s: failed to read %s", aDesc.mName, headFile.c_str());
+            return false;
+        }
+
+        handleBin.WriteBytes(head->mBlock, head->mSize);
+    }
+
+    static const uint8 sPadding[16] = { 0 };
+    WAR_CHECK(aDesc.mOffsetScale <= sizeof(sPadding));
+
+    uint32 offset = uint32(handleBin.GetPosition());
+
+    for (CompileEntry& e : entries)
+    {
+        TabEntry& tabEntry = info.mEntries.Add();
+        tabEntry = e.mTab;
+        tabEntry.mOffset = offset;
+
+        handleBin.WriteBytes(e.mData->mBlock, e.mData->mSize);
+        offset += e.mData->mSize;
+
+        const uint32 pad = (aDesc.mOffsetScale - (offset % aDesc.mOffsetScale)) % aDesc.mOffsetScale;
+        handleBin.WriteBytes(sPadding, pad);
+        offset += pad;
+
+        // data no longer needed once written
+        e.mData = NULL;
+        e.mRaw = NULL;
+    }
+
+    endEntry.mOffset = offset;
+    info.mEntries.Add(endEntry);
+
+    if (tailFile.length() > 0)
+    {
+        C_FilePath path(dir);
+        path.Combine(tailFile.c_str());
+        C_Ptr<C_MemBlock> tail = aCtx->ReadFile(path);
+
+        if (!tail)
+        {
+            WAR_LOG_ERROR(CAT_GENERAL, "%s: failed to read %s", aDesc.mName, tailFile.c_str());
+            return false;
+        }
+
+        handleBin.WriteBytes(tail->mBlock, tail->mSize);
+    }
+
+    if (!info.Write(aDesc, aCtx->GetFileStream(aDesc.mTab)))
+        return false;
+
+    aCtx->MarkFileHandled(aDesc.mTab);
+    aCtx->MarkFileHandled(aDesc.mBin);
+
+    return true;
+}
+
+int TabBinArchive::GetNumEntries(FSTContext* aCtx, const Desc& aDesc)
+{
+    using namespace TabBinArchive_private;
+
+    C_Vector<uint8> tabStorage;
+    C_Vector<uint8> binStorage;
+    const uint8* tab;
+    const uint8* bin;
+    uint32 tabSize;
+    uint32 binSize;
+    GetWholeFile(aCtx, aDesc.mTab, tabStorage, tab, tabSize);
+    GetWholeFile(aCtx, aDesc.mBin, binStorage, bin, binSize);
+
+    TabInfo info;
+
+    if (!info.Read(aDesc, tab, tabSize, binSize))
+        return -1;
+
+    return info.mEntries.Count() - 1;
+}
+
+bool TabBinArchive::GetEntryFiles(FSTContext* aCtx, const Desc& aDesc, C_Vector<string>& aOutFiles)
+{
+    using namespace TabBinArchive_private;
+
+    C_FilePath indexPath;
+    GetArchiveDir(aCtx, aDesc, indexPath);
+    indexPath.Combine(sIndexFile);
+
+    C_DataPack index;
+
+    if (!C_FileSystem::Exists(indexPath) || !aCtx->ReadJson(index, C_Strfmt<256>("%s/%s", aDesc.mName, sIndexFile)))
+        return false;
+
+    C_DataPack entriesPack;
+    index.Get("Entries", entriesPack);
+
+    aOutFiles.Resize(entriesPack.NumEntries());
+
+    for (int i = 0; i < aOutFiles.Count(); ++i)
+    {
+        C_DataPack entryPack;
+        entriesPack.Get(i, entryPack);
+        entryPack.Get("File", aOutFiles[i]);
+    }
+
+    return true;
+}
@@ -0,0 +1,83 @@
+#ifndef _TabBinArchive_h_
+#define _TabBinArchive_h_
+
+#include "ROMFST.h"
+#include "C_Vector.h"
+
+class FSTContext;
+class C_DataPack;
+
+// .tab/.bin pairs, the .tab holds an offset into the .bin per entry followed by the end offset.
+// extracting splits the .bin into one file per entry plus an index.json, compiling joins them again
+namespace TabBinArchive
+{
+    // converts an entry's data (inflated if it was compressed) to editable files, aBasePath is the entry path
+    // without extension. fills aOutInfo with what's needed to convert back, false leaves the entry as is.
+    // called from the job pool
+    typedef bool(*EntryExportFunc)(const uint8* aData, uint32 aSize, const char* aBasePath, C_DataPack& aOutInfo);
+
+    // converts back from the files named in aInfo, aDir is the archive directory. aData holds the extracted
+    // entry (inflated if it was compressed) and is replaced when the files were edited, aOutModified tells if it was.
+    // the files are read through aCtx so they are recorded as inputs. false is an error. called from the job pool
+    typedef bool(*EntryCompileFunc)(FSTContext* aCtx, const C_DataPack& aInfo, const char* aDir, C_Vector<uint8>& aData, bool& aOutModified);
+
+    // an entry's data as the converters see it
+    struct EntryData
+    {
+        const uint8* mData = NULL;
+        uint32 mSize = 0;
+        // mData is still compressed, only Get gives what the converters see
+        bool mCompressed = false;
+
+        // the entry's data, inflated into aStorage if it's compressed. false if it doesn't inflate
+        bool Get(C_Vector<uint8>& aStorage, const uint8*& aOutData, uint32& aOutSize) const;
+    };
+
+    // converts data that spans entries, like a sound bank whose samples are in the next entry. called once after
+    // the entries were exported. entries of a compressed archive are inflated by EntryData::Get as the converter
+    // gets to them so they don't all have to be in memory. fills aOutInfo like EntryExportFunc, aDir is the
+    // archive directory. the samples are spread over the job pool by the converter itself
+    typedef bool(*ArchiveExportFunc)(const C_Vector<EntryData>& aEntries, const char* aDir, C_DataPack& aOutInfo);
+
+    // converts back from the files named in aInfo. aEntries are the entries as they'll be written, aOutData comes
+    // sized to match and gets the new data of each entry the converter changed, the others are left empty.
+    // files are read through aCtx like EntryCompileFunc. false is an error. only for uncompressed archives
+    typedef bool(*ArchiveCompileFunc)(FSTContext* aCtx, const C_DataPack& aInfo, const char* aDir, const C_Vector<EntryData>& aEntries, C_Vector<C_Vector<uint8>>& aOutData);
+
+    struct Desc
+    {
+        // output directory
+        const char* mName;
+        ROMFST::File mTab;
+        ROMFST::File mBin;
+        // bytes per .tab entry, bytes after the offset word are kept as is
+        uint32 mStride;
+        // bits of the offset word holding the offset, other bits are flags that are kept as is
+        uint32 mOffsetMask;
+        // offsets are stored divided by this, entries are padded to it
+        uint32 mOffsetScale;
+        // offset word that ends the table
+        uint32 mTerminator;
+        // file name of entry n
+        const char* mEntryFormat;
+        // entries may be compressed, those are also inflated next to the entry as <name>.raw
+        bool mCompressed;
+        // optional conversion of each entry
+        EntryExportFunc mExportEntry;
+        EntryCompileFunc mCompileEntry;
+        // optional conversion of the whole archive
+        ArchiveExportFunc mExportArchive;
+        ArchiveCompileFunc mCompileArchive;
+    };
+
+    bool Export(FSTContext* aCtx, const Desc& aDesc);
+    bool Compile(FSTContext* aCtx, const Desc& aDesc);
+
+    // entries in the archive's .tab, -1 if its layout isn't understood
+    int GetNumEntries(FSTContext* aCtx, const Desc& aDesc);
+
+    // entry file names of a split archive in .tab order, from its index. false if it isn't split
+    bool GetEntryFiles(FSTContext* aCtx, const Desc& aDesc, C_Vector<string>& aOutFiles);
+}
+
+#endif // _TabBinArchive_h_
@@ -0,0 +1,578 @@
+#include "VADPCM.h"
+#include <math.h>
+
+// VADPCM_NO_SSE2 builds the scalar paths, which the sse2 ones have to match exactly
+#if !defined(VADPCM_NO_SSE2) && (defined(__SSE2__) || defined(_M_X64) || defined(_M_IX86))
+#include <emmintrin.h>
+#define VADPCM_SSE2
+#endif
+
+namespace VADPCM_private
+{
+    // previous samples followed by the 8 residuals of a half frame, padded to pairs for the sse2 path
+    const int MAX_COLUMNS = VADPCM::MAX_ORDER + 8;
+
+    // a predictor as an 8 x (order + 8) matrix, column k weights input k for each of the 8 outputs.
+    // the residual columns fold in the book's last order row so one product gives all 8 outputs
+    struct Predictor
+    {
+        int16 mColumns[MAX_COLUMNS][8];
+        // pairs of columns interleaved per output for _mm_madd_epi16, outputs 0-3 then 4-7
+        int16 mPairs[MAX_COLUMNS / 2][2][8];
+    };
+
+    void Expand(const VADPCM::Book& aBook, C_Vector<Predictor>& aOut)
+    {
+        const int order = aBook.mOrder;
+        aOut.Resize(aBook.mNumPredictors);
+
+        for (int p = 0; p < aBook.mNumPredictors; ++p)
+        {
+            Predictor& pred = aOut[p];
+            WAR_ZeroMem(&pred, sizeof(pred));
+
+            const int16* book = aBook.mCoefs.GetBuffer() + p * order * 8;
+            const int16* last = book + (order - 1) * 8;
+
+            for (int k = 0; k < order; ++k)
+            {
+                for (int i = 0; i < 8; ++i)
+                    pred.mColumns[k][i] = book[k * 8 + i];
+            }
+
+            for (int m = 0; m < 8; ++m)
+            {
+                for (int i = m; i < 8; ++i)
+                    pred.mColumns[order + m][i] = i == m ? 2048 : last[i - m - 1];
+            }
+
+            for (int q = 0; q < MAX_COLUMNS / 2; ++q)
+            {
+                for (int i = 0; i < 8; ++i)
+                {
+                    pred.mPairs[q][i / 4][(i % 4) * 2] = pred.mColumns[q * 2][i];
+                    pred.mPairs[q][i / 4][(i % 4) * 2 + 1] = pred.mColumns[q * 2 + 1][i];
+                }
+            }
+        }
+    }
+
+    inline int16 Clamp16(int32 aValue)
+    {
+        return int16(C_Max(-32768, C_Min(32767, aValue)));
+    }
+
+    // the sums wrap like the rsp's 32-bit accumulators, the result is floored to 16 bits
+    void PredictScalar(const Predictor& aPred, int aNumColumns, const int32* aIn, int16* aOut)
+    {
+        for (int i = 0; i < 8; ++i)
+        {
+            uint32 sum = 0;
+
+            for (int k = 0; k < aNumColumns; ++k)
+                sum += uint32(int32(aPred.mColumns[k][i])) * uint32(aIn[k]);
+
+            aOut[i] = Clamp16(int32(sum) >> 11);
+        }
+    }
+
+#if defined(VADPCM_SSE2)
+    void PredictSSE2(const Predictor& aPred, int aNumColumns, const int16* aIn, int16* aOut)
+    {
+        __m128i lo = _mm_setzero_si128();
+        __m128i hi = _mm_setzero_si128();
+
+        for (int k = 0; k < aNumColumns; k += 2)
+        {
+            const __m128i in = _mm_set1_epi32(int32(uint32(uint16(aIn[k])) | (uint32(uint16(aIn[k + 1])) << 16)));
+            lo = _mm_add_epi32(lo, _mm_madd_epi16(_mm_loadu_si128((const __m128i*)aPred.mPairs[k / 2][0]), in));
+            hi = _mm_add_epi32(hi, _mm_madd_epi16(_mm_loadu_si128((const __m128i*)aPred.mPairs[k / 2][1]), in));
+        }
+
+        lo = _mm_srai_epi32(lo, 11);
+        hi = _mm_srai_epi32(hi, 11);
+        _mm_storeu_si128((__m128i*)aOut, _mm_packs_epi32(lo, hi));
+    }
+#endif
+
+    // training works on the normal equations of each frame, a predictor's squared error over a frame is
+    // mEnergy - 2 a.mCross + a.mCorr.a so frames can be reassigned and predictors refit without touching samples
+    struct FrameStats
+    {
+        double mCorr[VADPCM::MAX_ORDER][VADPCM::MAX_ORDER];
+        double mCross[VADPCM::MAX_ORDER];
+        double mEnergy;
+
+        void Clear() { WAR_ZeroMem(this, sizeof(*this)); }
+
+        void Add(const FrameStats& aOther, int aOrder)
+        {
+            for (int j = 0; j < aOrder; ++j)
+            {
+                for (int k = 0; k < aOrder; ++k)
+                    mCorr[j][k] += aOther.mCorr[j][k];
+
+                mCross[j] += aOther.mCross[j];
+            }
+
+            mEnergy += aOther.mEnergy;
+        }
+
+        double GetError(const double* aCoefs, int aOrder) const
+        {
+            double err = mEnergy;
+
+            for (int j = 0; j < aOrder; ++j)
+            {
+                double corr = 0.0;
+
+                for (int k = 0; k < aOrder; ++k)
+                    corr += mCorr[j][k] * aCoefs[k];
+
+                err += aCoefs[j] * (corr - 2.0 * mCross[j]);
+            }
+
+            return err;
+        }
+
+        // least squares coefficients, coefficient j weights the sample j + 1 back
+        void Solve(int aOrder, double* aOutCoefs) const
+        {
+            double m[VADPCM::MAX_ORDER][VADPCM::MAX_ORDER + 1];
+
+            // a little ridge keeps silent or periodic frames solvable
+            double trace = 0.0;
+            for (int j = 0; j < aOrder; ++j)
+                trace += mCorr[j][j];
+
+            const double ridge = trace * 1e-6 + 1e-9;
+
+            for (int j = 0; j < aOrder; ++j)
+            {
+                for (int k = 0; k < aOrder; ++k)
+                    m[j][k] = mCorr[j][k] + (j == k ? ridge : 0.0);
+
+                m[j][aOrder] = mCross[j];
+            }
+
+            for (int c = 0; c < aOrder; ++c)
+            {
+                int pivot = c;
+                for (int r = c + 1; r < aOrder; ++r)
+                {
+                    if (fabs(m[r][c]) > fabs(m[pivot][c]))
+                        pivot = r;
+                }
+
+                for (int k = 0; k <= aOrder; ++k)
+                {
+                    const double t = m[c][k];
+                    m[c][k] = m[pivot][k];
+                    m[pivot][k] = t;
+                }
+
+                for (int r = c + 1; r < aOrder; ++r)
+                {
+                    const double f = m[r][c] / m[c][c];
+
+                    for (int k = c; k <= aOrder; ++k)
+                        m[r][k] -= f * m[c][k];
+                }
+            }
+
+            for (int c = aOrder - 1; c >= 0; --c)
+            {
+                double v = m[c][aOrder];
+
+                for (int k = c + 1; k < aOrder; ++k)
+                    v -= m[c][k] * aOutCoefs[k];
+
+                aOutCoefs[c] = v / m[c][c];
+            }
+        }
+    };
+
+    struct Cluster
+    {
+        double mCoefs[VADPCM::MAX_ORDER];
+        double mError;
+    };
+
+    // assigns every frame to its best predictor and refits them, returns the total error
+    double Refine(const C_Vector<FrameStats>& aFrames, int aOrder, C_Vector<Cluster>& aClusters)
+    {
+        C_Vector<FrameStats> sums;
+        sums.Resize(aClusters.Count());
+
+        for (FrameStats& sum : sums)
+            sum.Clear();
+
+        for (Cluster& c : aClusters)
+            c.mError = 0.0;
+
+        double total = 0.0;
+
+        for (const FrameStats& frame : aFrames)
+        {
+            int best = 0;
+            double bestError = 0.0;
+
+            for (int c = 0; c < aClusters.Count(); ++c)
+            {
+                const double err = frame.GetError(aClusters[c].mCoefs, aOrder);
+
+                if (c == 0 || err < bestError)
+                {
+                    best = c;
+                    bestError = err;
+                }
+            }
+
+            sums[best].Add(frame, aOrder);
+            aClusters[best].mError += bestError;
+            total += bestError;
+        }
+
+        // empty clusters keep their coefficients
+        for (int c = 0; c < aClusters.Count(); ++c)
+        {
+            if (sums[c].mEnergy > 0.0)
+                sums[c].Solve(aOrder, aClusters[c].mCoefs);
+        }
+
+        return total;
+    }
+
+    // the book holds the predictor's response over a half frame to each previous sample, in 1/2048 units
+    void ToBookRows(const double* aCoefs, int aOrder, int16* aOut)
+    {
+        for (int k = 0; k < aOrder; ++k)
+        {
+            double x[VADPCM::MAX_ORDER + 8] = { 0.0 };
+            x[k] = 1.0;
+
+            for (int i = 0; i < 8; ++i)
+            {
+                double v = 0.0;
+
+                for (int j = 0; j < aOrder; ++j)
+                    v += aCoefs[j] * x[aOrder + i - 1 - j];
+
+                x[aOrder + i] = v;
+
+                const double scaled = floor(v * 2048.0 + 0.5);
+                aOut[k * 8 + i] = int16(C_Max(-32768.0, C_Min(32767.0, scaled)));
+            }
+        }
+    }
+
+    // one frame tried with one predictor and scale
+    struct Trial
+    {
+        int16 mOut[VADPCM::FRAME_SAMPLES];
+        int8 mResiduals[VADPCM::FRAME_SAMPLES];
+        int64 mError;
+    };
+
+    // largest residual of a frame without quantisation, predicted from the input itself
+    int32 GetMaxResidual(const Predictor& aPred, int aOrder, const int16* aHistory, const int16* aIn)
+    {
+        int32 maxResidual = 0;
+        int32 in[MAX_COLUMNS];
+
+        for (int half = 0; half < 2; ++half)
+        {
+            const int16* x = aIn + half * 8;
+
+            for (int k = 0; k < aOrder; ++k)
+                in[k] = half == 0 ? aHistory[VADPCM::MAX_ORDER - aOrder + k] : aIn[8 - aOrder + k];
+
+            for (int i = 0; i < 8; ++i)
+            {
+                int64 sum = 0;
+
+                for (int k = 0; k < aOrder + i; ++k)
+                    sum += int64(aPred.mColumns[k][i]) * in[k];
+
+                const int32 residual = int32(C_Max(int64(-65536), C_Min(int64(65536), int64(x[i]) - (sum >> 11))));
+                in[aOrder + i] = C_Max(-32768, C_Min(32767, residual));
+                maxResidual = C_Max(maxResidual, residual < 0 ? -residual : residual);
+            }
+        }
+
+        return maxResidual;
+    }
+
+    // quantises a frame against the decoder. the 8 outputs of a half start from the previous samples' share,
+    // each quantised residual then adds its column to all of them
+    void RunTrial(const Predictor& aPred, int aOrder, const int16* aHistory, const int16* aIn, int aShift, Trial& aOut)
+    {
+        aOut.mError = 0;
+        const int16* history = aHistory + VADPCM::MAX_ORDER - aOrder;
+
+        for (int half = 0; half < 2; ++half)
+        {
+            const int16* x = aIn + half * 8;
+            int16* out = aOut.mOut + half * 8;
+            int32 acc[8];
+
+            for (int i = 0; i < 8; ++i)
+            {
+                uint32 sum = 0;
+
+                for (int k = 0; k < aOrder; ++k)
+                    sum += uint32(int32(aPred.mColumns[k][i])) * uint32(int32(history[k]));
+
+                acc[i] = int32(sum);
+            }
+
+            for (int i = 0; i < 8; ++i)
+            {
+                const int32 pred = acc[i] >> 11;
+                const int32 diff = int32(x[i]) - pred;
+                const int32 r = C_Max(-8, C_Min(7, (diff + ((1 << aShift) >> 1)) >> aShift));
+                const int32 v = r * (1 << aShift);
+
+                out[i] = Clamp16(pred + v);
+                aOut.mResiduals[half * 8 + i] = int8(r);
+
+                const int32 err = int32(x[i]) - out[i];
+                aOut.mError += int64(err) * err;
+
+                for (int j = i; j < 8; ++j)
+                    acc[j] = int32(uint32(acc[j]) + uint32(int32(aPred.mColumns[aOrder + i][j])) * uint32(v));
+            }
+
+            history = out + 8 - aOrder;
+        }
+    }
+}
+
+bool VADPCM::Book::IsValid() const
+{
+    return mOrder > 0 && mOrder <= MAX_ORDER && mNumPredictors > 0 && mNumPredictors <= MAX_PREDICTORS &&
+        mCoefs.Count() == mOrder * mNumPredictors * 8;
+}
+
+void VADPCM::Decode(const Book& aBook, const uint8* aData, int aNumFrames, int16* aOut)
+{
+    using namespace VADPCM_private;
+
+    WAR_ASSERT(aBook.IsValid());
+
+    C_Vector<Predictor> preds;
+    Expand(aBook, preds);
+
+    const int order = aBook.mOrder;
+    const int numColumns = (order + 8 + 1) & ~1;
+
+    int16 history[MAX_ORDER] = { 0 };
+
+    for (int f = 0; f < aNumFrames; ++f)
+    {
+        const uint8* frame = aData + f * FRAME_SIZE;
+        const int shift = frame[0] >> 4;
+        const int p = frame[0] & 0xF;
+        const Predictor& pred = preds[p < aBook.mNumPredictors ? p : 0];
+
+        int32 residuals[FRAME_SAMPLES];
+
+        for (int i = 0; i < FRAME_SAMPLES; i += 2)
+        {
+            const uint8 b = frame[1 + i / 2];
+            residuals[i] = (int32(int8(b)) >> 4) * (1 << shift);
+            residuals[i + 1] = (int32(int8(b << 4)) >> 4) * (1 << shift);
+        }
+
+        int16* out = aOut + f * FRAME_SAMPLES;
+
+        for (int half = 0; half < 2; ++half)
+        {
+            const int32* res = residuals + half * 8;
+
+#if defined(VADPCM_SSE2)
+            // -8 << 12 is the largest residual that fits the 16-bit lanes
+            if (shift <= 12)
+            {
+                int16 in[MAX_COLUMNS] = { 0 };
+
+                for (int k = 0; k < order; ++k)
+                    in[k] = history[MAX_ORDER - order + k];
+
+                for (int i = 0; i < 8; ++i)
+                    in[order + i] = int16(res[i]);
+
+                PredictSSE2(pred, numColumns, in, out);
+            }
+            else
+#endif
+            {
+                int32 in[MAX_COLUMNS] = { 0 };
+
+                for (int k = 0; k < order; ++k)
+                    in[k] = history[MAX_ORDER - order + k];
+
+                for (int i = 0; i < 8; ++i)
+                    in[order + i] = res[i];
+
+                PredictScalar(pred, numColumns, in, out);
+            }
+
+            memcpy(history, out, sizeof(history));
+            out += 8;
+        }
+    }
+}
+
+void VADPCM::TrainBook(const int16* aSamples, int aNumSamples, int aOrder, int aNumPredictors, Book& aOut)
+{
+    using namespace VADPCM_private;
+
+    WAR_ASSERT(aOrder > 0 && aOrder <= MAX_ORDER && aNumPredictors > 0 && aNumPredictors <= MAX_PREDICTORS);
+
+    const int numFrames = GetNumFrames(aNumSamples);
+
+    C_Vector<FrameStats> frames;
+    frames.Reserve(numFrames);
+
+    FrameStats all;
+    all.Clear();
+
+    for (int f = 0; f < numFrames; ++f)
+    {
+        FrameStats stats;
+        stats.Clear();
+
+        for (int n = f * FRAME_SAMPLES; n < C_Min(aNumSamples, (f + 1) * FRAME_SAMPLES); ++n)
+        {
+            double prev[MAX_ORDER];
+
+            for (int j = 0; j < aOrder; ++j)
+                prev[j] = n - 1 - j >= 0 ? double(aSamples[n - 1 - j]) : 0.0;
+
+            const double x = aSamples[n];
+
+            for (int j = 0; j < aOrder; ++j)
+            {
+                for (int k = 0; k < aOrder; ++k)
+                    stats.mCorr[j][k] += prev[j] * prev[k];
+
+                stats.mCross[j] += x * prev[j];
+            }
+
+            stats.mEnergy += x * x;
+        }
+
+        // silence fits any predictor
+        if (stats.mEnergy > 0.0)
+        {
+            frames.Add(stats);
+            all.Add(stats, aOrder);
+        }
+    }
+
+    // grows from one predictor by splitting the one with the most error, then refining all of them
+    C_Vector<Cluster> clusters;
+    Cluster& first = clusters.Add();
+    WAR_ZeroMem(&first, sizeof(first));
+
+    if (all.mEnergy > 0.0)
+        all.Solve(aOrder, first.mCoefs);
+
+    Refine(frames, aOrder, clusters);
+
+    while (clusters.Count() < aNumPredictors)
+    {
+        int worst = 0;
+        for (int c = 1; c < clusters.Count(); ++c)
+        {
+            if (clusters[c].mError > clusters[worst].mError)
+                worst = c;
+        }
+
+        Cluster split = clusters[worst];
+
+        for (int j = 0; j < aOrder; ++j)
+        {
+            const double delta = C_Max(fabs(split.mCoefs[j]) * 0.01, 0.001);
+            clusters[worst].mCoefs[j] += delta;
+            split.mCoefs[j] -= delta;
+        }
+
+        clusters.Add(split);
+
+        double prevError = -1.0;
+
+        for (int i = 0; i < 16; ++i)
+        {
+            const double error = Refine(frames, aOrder, clusters);
+
+            if (prevError >= 0.0 && prevError - error <= prevError * 1e-4)
+                break;
+
+            prevError = error;
+        }
+    }
+
+    aOut.mOrder = aOrder;
+    aOut.mNumPredictors = aNumPredictors;
+    aOut.mCoefs.Resize(aOrder * aNumPredictors * 8);
+
+    for (int p = 0; p < aNumPredictors; ++p)
+        ToBookRows(clusters[p].mCoefs, aOrder, aOut.mCoefs.GetBuffer() + p * aOrder * 8);
+}
+
+void VADPCM::Encode(const Book& aBook, const int16* aSamples, int aNumSamples, uint8* aOut)
+{
+    using namespace VADPCM_private;
+
+    WAR_ASSERT(aBook.IsValid());
+
+    C_Vector<Predictor> preds;
+    Expand(aBook, preds);
+
+    const int order = aBook.mOrder;
+    const int numFrames = GetNumFrames(aNumSamples);
+
+    int16 history[MAX_ORDER] = { 0 };
+
+    for (int f = 0; f < numFrames; ++f)
+    {
+        int16 in[FRAME_SAMPLES] = { 0 };
+        const int count = C_Min(FRAME_SAMPLES, aNumSamples - f * FRAME_SAMPLES);
+        memcpy(in, aSamples + f * FRAME_SAMPLES, count * sizeof(int16));
+
+        Trial best;
+        Trial trial;
+        int bestHeader = -1;
+
+        for (int p = 0; p < aBook.mNumPredictors; ++p)
+        {
+            // smallest scale that holds the largest residual, one finer and one coarser are tried as well
+            const int32 maxResidual = GetMaxResidual(preds[p], order, history, in);
+
+            int shift = 0;
+            while (shift < 12 && maxResidual > (7 << shift))
+                ++shift;
+
+            for (int s = C_Max(0, shift - 1); s <= C_Min(12, shift + 1); ++s)
+            {
+                RunTrial(preds[p], order, history, in, s, trial);
+
+                if (bestHeader < 0 || trial.mError < best.mError)
+                {
+                    best = trial;
+                    bestHeader = (s << 4) | p;
+                }
+            }
+        }
+
+        uint8* frame = aOut + f * FRAME_SIZE;
+        frame[0] = uint8(bestHeader);
+
+        for (int i = 0; i < FRAME_SAMPLES; i += 2)
+            frame[1 + i / 2] = uint8((uint8(best.mResiduals[i]) << 4) | (uint8(best.mResiduals[i + 1]) & 0xF));
+
+        memcpy(history, best.mOut + FRAME_SAMPLES - MAX_ORDER, sizeof(history));
+    }
+}
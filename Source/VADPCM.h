@@ -0,0 +1,38 @@
+#ifndef _VADPCM_h_
+#define _VADPCM_h_
+
+#include "C_Base.h"
+#include "C_Vector.h"
+
+// n64 vadpcm, frames of 16 samples in 9 bytes predicted from the previous samples with a codebook
+namespace VADPCM
+{
+    const int FRAME_SAMPLES = 16;
+    const int FRAME_SIZE = 9;
+    const int MAX_ORDER = 8;
+    const int MAX_PREDICTORS = 16;
+
+    // coefficients as stored in the bank, [predictor][order][8]
+    struct Book
+    {
+        int mOrder = 0;
+        int mNumPredictors = 0;
+        C_Vector<int16> mCoefs;
+
+        bool IsValid() const;
+    };
+
+    inline int GetNumFrames(int aNumSamples) { return (aNumSamples + FRAME_SAMPLES - 1) / FRAME_SAMPLES; }
+
+    // decodes aNumFrames frames to 16-bit pcm, the first frame is predicted from silence
+    void Decode(const Book& aBook, const uint8* aData, int aNumFrames, int16* aOut);
+
+    // fits aNumPredictors linear predictors of aOrder to the sample's frames and converts them to a book
+    void TrainBook(const int16* aSamples, int aNumSamples, int aOrder, int aNumPredictors, Book& aOut);
+
+    // encodes to GetNumFrames() frames, the last one padded with silence. every frame tries each predictor
+    // with the scales around its largest residual against the decoder and keeps the smallest error
+    void Encode(const Book& aBook, const int16* aSamples, int aNumSamples, uint8* aOut);
+}
+
+#endif // _VADPCM_h_
@@ -0,0 +1,167 @@
+#include "WAV.h"
+#include <string.h>
+
+namespace WAV_private
+{
+    void Put16(C_Vector<uint8>& aOut, uint32 aValue)
+    {
+        aOut.Add(uint8(aValue));
+        aOut.Add(uint8(aValue >> 8));
+    }
+
+    void Put32(C_Vector<uint8>& aOut, uint32 aValue)
+    {
+        Put16(aOut, aValue);
+        Put16(aOut, aValue >> 16);
+    }
+
+    void PutTag(C_Vector<uint8>& aOut, const char* aTag)
+    {
+        for (int i = 0; i < 4; ++i)
+            aOut.Add(uint8(aTag[i]));
+    }
+
+    uint32 Get16(const uint8* aData)
+    {
+        return aData[0] | (aData[1] << 8);
+    }
+
+    uint32 Get32(const uint8* aData)
+    {
+        return Get16(aData) | (Get16(aData + 2) << 16);
+    }
+
+    const uint16 FORMAT_PCM = 1;
+    const uint16 FORMAT_EXTENSIBLE = 0xFFFE;
+}
+
+void WAV::Encode(const int16* aSamples, uint32 aNumSamples, uint32 aSampleRate, const Loop* aLoop, C_Vector<uint8>& aOut)
+{
+    using namespace WAV_private;
+
+    const uint32 dataSize = aNumSamples * 2;
+    const uint32 smplSize = aLoop ? 36 + 24 : 0;
+
+    aOut.Clear();
+    aOut.Reserve(44 + dataSize + (aLoop ? 8 + smplSize : 0));
+
+    PutTag(aOut, "RIFF");
+    Put32(aOut, 4 + (8 + 16) + (8 + dataSize) + (aLoop ? 8 + smplSize : 0));
+    PutTag(aOut, "WAVE");
+
+    PutTag(aOut, "fmt ");
+    Put32(aOut, 16);
+    Put16(aOut, 1);                 // pcm
+    Put16(aOut, 1);                 // channels
+    Put32(aOut, aSampleRate);
+    Put32(aOut, aSampleRate * 2);   // bytes per second
+    Put16(aOut, 2);                 // block align
+    Put16(aOut, 16);                // bits per sample
+
+    PutTag(aOut, "data");
+    Put32(aOut, dataSize);
+
+    const uint32 dataStart = aOut.Count();
+    aOut.Resize(dataStart + dataSize);
+    uint8* dst = aOut.GetBuffer() + dataStart;
+
+    for (uint32 i = 0; i < aNumSamples; ++i)
+    {
+        dst[i * 2] = uint8(aSamples[i]);
+        dst[i * 2 + 1] = uint8(uint16(aSamples[i]) >> 8);
+    }
+
+    if (aLoop)
+    {
+        PutTag(aOut, "smpl");
+        Put32(aOut, smplSize);
+        Put32(aOut, 0);             // manufacturer
+        Put32(aOut, 0);             // product
+        Put32(aOut, aSampleRate > 0 ? 1000000000 / aSampleRate : 0);
+        Put32(aOut, 60);            // unity note
+        Put32(aOut, 0);             // pitch fraction
+        Put32(aOut, 0);             // smpte format
+        Put32(aOut, 0);             // smpte offset
+        Put32(aOut, 1);             // loops
+        Put32(aOut, 0);             // sampler data
+
+        // smpl loop ends are inclusive
+        Put32(aOut, 0);             // cue point
+        Put32(aOut, 0);             // forward
+        Put32(aOut, aLoop->mStart);
+        Put32(aOut, aLoop->mEnd > aLoop->mStart ? aLoop->mEnd - 1 : aLoop->mStart);
+        Put32(aOut, 0);             // fraction
+        Put32(aOut, aLoop->mCount);
+    }
+}
+
+bool WAV::Decode(const uint8* aData, uint32 aSize, C_Vector<int16>& aOutSamples, uint32& aOutSampleRate, Loop& aOutLoop, bool& aOutHasLoop)
+{
+    using namespace WAV_private;
+
+    if (aSize < 12 || memcmp(aData, "RIFF", 4) != 0 || memcmp(aData + 8, "WAVE", 4) != 0)
+        return false;
+
+    const uint8* fmt = NULL;
+    const uint8* data = NULL;
+    uint32 dataSize = 0;
+    aOutHasLoop = false;
+
+    uint32 pos = 12;
+
+    while (pos + 8 <= aSize)
+    {
+        const uint8* chunk = aData + pos + 8;
+        const uint32 size = C_Min(Get32(aData + pos + 4), aSize - pos - 8);
+
+        if (memcmp(aData + pos, "fmt ", 4) == 0 && size >= 16)
+        {
+            fmt = chunk;
+        }
+        else if (memcmp(aData + pos, "data", 4) == 0)
+        {
+            data = chunk;
+            dataSize = size;
+        }
+        else if (memcmp(aData + pos, "smpl", 4) == 0 && size >= 36 + 24 && Get32(chunk + 28) > 0)
+        {
+            aOutLoop.mStart = Get32(chunk + 36 + 8);
+            aOutLoop.mEnd = Get32(chunk + 36 + 12) + 1;
+            aOutLoop.mCount = Get32(chunk + 36 + 20);
+            aOutHasLoop = true;
+        }
+
+        // chunks are padded to even sizes
+        pos += 8 + size + (size & 1);
+    }
+
+    if (!fmt || !data)
+        return false;
+
+    const uint32 format = Get16(fmt);
+    const uint32 channels = Get16(fmt + 2);
+    const uint32 bits = Get16(fmt + 14);
+
+    if ((format != FORMAT_PCM && format != FORMAT_EXTENSIBLE) || channels == 0 || (bits != 8 && bits != 16))
+        return false;
+
+    aOutSampleRate = Get32(fmt + 4);
+
+    const uint32 frameSize = channels * bits / 8;
+    const uint32 numSamples = dataSize / frameSize;
+    aOutSamples.Resize(numSamples);
+
+    for (uint32 i = 0; i < numSamples; ++i)
+    {
+        const uint8* src = data + i * frameSize;
+        int32 sum = 0;
+
+        // 8-bit pcm is unsigned
+        for (uint32 c = 0; c < channels; ++c)
+            sum += bits == 8 ? (int32(src[c]) - 128) * 256 : int32(int16(Get16(src + c * 2)));
+
+        aOutSamples[i] = int16(sum / int32(channels));
+    }
+
+    return true;
+}
@@ -0,0 +1,25 @@
+#ifndef _WAV_h_
+#define _WAV_h_
+
+#include "C_Base.h"
+#include "C_Vector.h"
+
+// mono 16-bit pcm wav files, reading also takes 8-bit and multichannel pcm
+namespace WAV
+{
+    // loop points in samples, aEnd is exclusive. a count of 0 loops forever
+    struct Loop
+    {
+        uint32 mStart = 0;
+        uint32 mEnd = 0;
+        uint32 mCount = 0;
+    };
+
+    // encodes to memory, the loop goes into a smpl chunk
+    void Encode(const int16* aSamples, uint32 aNumSamples, uint32 aSampleRate, const Loop* aLoop, C_Vector<uint8>& aOut);
+
+    // decodes 8 or 16-bit pcm, more than one channel is mixed down. aOutHasLoop tells if there was a smpl loop
+    bool Decode(const uint8* aData, uint32 aSize, C_Vector<int16>& aOutSamples, uint32& aOutSampleRate, Loop& aOutLoop, bool& aOutHasLoop);
+}
+
+#endif // _WAV_h_
@@ -1,57 +1,142 @@
 #include "C_CoreModule.h"
 #include "C_CommandLine.h"
 #include "ROMFST.h"
+#include "FileFilter.h"
 #include "DLLCompiler.h"
+#include "JobPool.h"
+#include "C_DataPack.h"
+#include "C_OS.h"
+#include "DefsFile.h"
+#include "LocalSocket.h"
+#include "DepFile.h"
+#include <atomic>
+#include <algorithm>
+#include <iterator>
+#include <unordered_map>
+
+// the options that are paths. a client sends them absolute since the daemon has its own working directory, and
+// in a -batch manifest they are relative to the manifest
+static const char* sPathOptions[] = { "rom", "o", "i", "defs", "patch_out", "batch", "depfile" };
+
+bool IsPathOption(const string& aName)
+{
+    return std::find(std::begin(sPathOptions), std::end(sPathOptions), aName) != std::end(sPathOptions);
+}
+
+bool IsAbsolutePath(const string& aPath)
+{
+    return aPath[0] == '/' || aPath[0] == '\\' || (aPath.length() > 1 && aPath[1] == ':');
+}
+
+// where the options come from, the command line or a job of a -batch manifest
+struct ArgSource
+{
+    virtual bool HasSwitch(const char* aName) const = 0;
+    virtual bool GetValue(const char* aName, string& aOut) const = 0;
+};
+
+struct CommandLineArgs : public ArgSource
+{
+    bool HasSwitch(const char* aName) const override { return C_CommandLine::GetInstance()->HasSwitch(aName); }
+    bool GetValue(const char* aName, string& aOut) const override { return C_CommandLine::GetInstance()->GetValue(aName, aOut); }
+};
+
+// {"mode": "extract_files", "rom": "a.z64", "o": "out/a"}, the options are named like on the command line.
+// relative paths are from aBaseDir, the manifest's dir
+struct JobArgs : public ArgSource
+{
+    JobArgs(const C_DataPack& aJob, const char* aBaseDir) : mJob(aJob), mBaseDir(aBaseDir) {}
+
+    bool HasSwitch(const char* aName) const override
+    {
+        string mode;
+        return mJob.Get("mode", mode) && mode == aName;
+    }
+
+    bool GetValue(const char* aName, string& aOut) const override
+    {
+        if (mJob.Get(aName, aOut))
+        {
+            if (mBaseDir[0] && aOut.length() > 0 && IsPathOption(aName) && !IsAbsolutePath(aOut))
+            {
+                C_FilePath path(mBaseDir);
+                path.Combine(aOut.c_str());
+                aOut = (const char*)path;
+            }
+
+            return true;
+        }
+
+        // numbers can be written as numbers
+        int value;
+        if (!mJob.Get(aName, value))
+            return false;
+
+        aOut = C_Strfmt<16>("%i", value).GetBuffer();
+        return true;
+    }
+
+    const C_DataPack& mJob;
+    const char* mBaseDir;
+};
 
 struct CommandArgs
 {
-    bool Parse()
+    bool Parse(const ArgSource& aArgs)
     {
         bool needsRomPath = false;
         bool needsOutPath = false;
         bool needsInPath = false;
         bool needsDefsPath = false;
 
-        C_CommandLine* cl = C_CommandLine::GetInstance();
-
-        if (cl->HasSwitch("dump_bin"))
+        if (aArgs.HasSwitch("dump_bin"))
         {
             mMode = MODE_DUMP_BIN;
             needsOutPath = true;
             needsRomPath = true;
         }
-        else if (cl->HasSwitch("dump_files"))
+        else if (aArgs.HasSwitch("dump_files"))
         {
             mMode = MODE_DUMP_FILES;
             needsOutPath = true;
             needsRomPath = true;
         }
-        else if (cl->HasSwitch("extract_files"))
+        else if (aArgs.HasSwitch("extract_files"))
         {
             mMode = MODE_EXTRACT_FILES;
             needsOutPath = true;
             needsRomPath = true;
         }
-        else if (cl->HasSwitch("compile_bin"))
+        else if (aArgs.HasSwitch("compile_bin"))
         {
             mMode = MODE_COMPILE_BIN;
             needsInPath = true;
             needsOutPath = true;
         }
-        else if (cl->HasSwitch("compile_files"))
+        else if (aArgs.HasSwitch("compile_files"))
         {
             mMode = MODE_COMPILE_FILES;
             needsInPath = true;
             needsOutPath = true;
         }
-        else if (cl->HasSwitch("compile_rom"))
+        else if (aArgs.HasSwitch("compile_rom"))
         {
             mMode = MODE_COMPILE_ROM;
             needsInPath = true;
             needsRomPath = true;
+
+            // a patch can be written instead of the full rom
+            needsOutPath = !aArgs.GetValue("patch_out", mPatchOutPath);
+            mWatch = aArgs.HasSwitch("watch");
+        }
+        else if (aArgs.HasSwitch("apply_patch"))
+        {
+            mMode = MODE_APPLY_PATCH;
+            needsInPath = true;
+            needsRomPath = true;
             needsOutPath = true;
         }
-        else if (cl->HasSwitch("elf2dll"))
+        else if (aArgs.HasSwitch("elf2dll"))
         {
             mMode = MODE_ELF2DLL;
             needsInPath = true;
@@ -66,7 +151,7 @@ struct CommandArgs
 
         if (needsRomPath)
         {
-            if (!cl->GetValue("rom", mRomPath))
+            if (!aArgs.GetValue("rom", mRomPath))
             {
                 WAR_LOG_ERROR(CAT_GENERAL, "No -rom path specified");
                 return false;
@@ -75,7 +160,7 @@ struct CommandArgs
 
         if (needsOutPath)
         {
-            if (!cl->GetValue("o", mOutPath))
+            if (!aArgs.GetValue("o", mOutPath))
             {
                 WAR_LOG_ERROR(CAT_GENERAL, "No -o out path specified");
                 return false;
@@ -84,7 +169,7 @@ struct CommandArgs
 
         if (needsInPath)
         {
-            if (!cl->GetValue("i", mInPath))
+            if (!aArgs.GetValue("i", mInPath))
             {
                 WAR_LOG_ERROR(CAT_GENERAL, "No -i in path specified");
                 return false;
@@ -92,7 +177,69 @@ struct CommandArgs
         }
 
         // optional
-        const bool hasDefs = cl->GetValue("defs", mDefsPath);
+        const bool hasDefs = aArgs.GetValue("defs", mDefsPath);
+
+        if (aArgs.GetValue("depfile", mDepPath))
+        {
+            if (mMode != MODE_COMPILE_ROM && mMode != MODE_ELF2DLL)
+            {
+                WAR_LOG_ERROR(CAT_GENERAL, "-depfile is only written by -compile_rom and -elf2dll");
+                return false;
+            }
+
+            if (mWatch)
+            {
+                WAR_LOG_ERROR(CAT_GENERAL, "-depfile can't be used with -watch");
+                return false;
+            }
+        }
+
+        string romOrder;
+        if (aArgs.GetValue("rom_order", romOrder) && !ROMView::ParseByteOrder(romOrder.c_str(), mRomOrder))
+        {
+            WAR_LOG_ERROR(CAT_GENERAL, "Invalid -rom_order %s, expected z64, v64 or n64", romOrder.c_str());
+            return false;
+        }
+
+        string zipLevel;
+        if (aArgs.GetValue("zlevel", zipLevel))
+        {
+            mZipLevel = atoi(zipLevel.c_str());
+
+            if (mZipLevel < Deflate::MIN_LEVEL || mZipLevel > Deflate::MAX_LEVEL)
+            {
+                WAR_LOG_ERROR(CAT_GENERAL, "Invalid -zlevel %s, expected %i to %i", zipLevel.c_str(), Deflate::MIN_LEVEL, Deflate::MAX_LEVEL);
+                return false;
+            }
+        }
+
+        string memBudget;
+        if (aArgs.GetValue("mem_budget", memBudget))
+        {
+            const int mb = atoi(memBudget.c_str());
+
+            if (mb <= 0)
+            {
+                WAR_LOG_ERROR(CAT_GENERAL, "Invalid -mem_budget %s, expected a size in MB", memBudget.c_str());
+                return false;
+            }
+
+            mMemBudget = uint64(mb) * 1024 * 1024;
+        }
+
+        // compile_files only needs the base rom to take the files that aren't selected from
+        if (!needsRomPath)
+            aArgs.GetValue("rom", mRomPath);
+
+        string only;
+        string exclude;
+        const bool hasOnly = aArgs.GetValue("only", only);
+        const bool hasExclude = aArgs.GetValue("exclude", exclude);
+
+        if ((hasOnly || hasExclude) && !mFilter.Parse(only.c_str(), exclude.c_str()))
+            return false;
+
+        mHasFilter = hasOnly || hasExclude;
 
         if (needsDefsPath)
         {
@@ -106,6 +253,44 @@ struct CommandArgs
         return true;
     }
 
+    // one job, the mode's result
+    bool Run() const
+    {
+        // what -compile_rom and -elf2dll read, for -depfile
+        DepFile deps;
+        DepFile* depsOut = mDepPath.length() > 0 ? &deps : NULL;
+
+        switch (mMode)
+        {
+            case MODE_DUMP_BIN:
+                return ROMFST::DumpBin(mRomPath.c_str(), mOutPath.c_str());
+
+            case MODE_DUMP_FILES:
+                return ROMFST::DumpFiles(mRomPath.c_str(), mOutPath.c_str());
+
+            case MODE_EXTRACT_FILES:
+                return ROMFST::ExtractFiles(mRomPath.c_str(), mOutPath.c_str(), mDefsPath.c_str(), mMemBudget, GetFilter());
+
+            case MODE_COMPILE_FILES:
+                return ROMFST::CompileFiles(mInPath.c_str(), mOutPath.c_str(), mZipLevel, GetFilter(), mRomPath.c_str());
+
+            case MODE_COMPILE_ROM:
+                if (mWatch)
+                    return ROMFST::WatchROM(mRomPath.c_str(), mInPath.c_str(), mOutPath.c_str(), mPatchOutPath.c_str(), mRomOrder, mZipLevel, GetFilter());
+
+                return ROMFST::CompileROM(mRomPath.c_str(), mInPath.c_str(), mOutPath.c_str(), mPatchOutPath.c_str(), mRomOrder, mZipLevel, GetFilter(), depsOut) && WriteDepFile(deps);
+
+            case MODE_APPLY_PATCH:
+                return ROMFST::ApplyPatch(mRomPath.c_str(), mInPath.c_str(), mOutPath.c_str(), mRomOrder);
+
+            case MODE_ELF2DLL:
+                return DLLCompiler::ConvertELFtoDLL(mInPath.c_str(), mOutPath.c_str(), mDefsPath.c_str(), depsOut) && WriteDepFile(deps);
+        }
+
+        WAR_LOG_ERROR(CAT_GENERAL, "Mode not supported");
+        return false;
+    }
+
     enum Mode
     {
         // ROM -> fst.bin
@@ -128,6 +313,9 @@ struct CommandArgs
 
         // make a .dll from a .elf
         MODE_ELF2DLL,
+
+        // base ROM + .bps -> ROM
+        MODE_APPLY_PATCH,
     };
 
 
@@ -136,8 +324,293 @@ struct CommandArgs
     string mOutPath;
     string mInPath;
     string mDefsPath;
+    string mPatchOutPath;
+    ROMView::ByteOrder mRomOrder = ROMView::ORDER_AUTO;
+    int mZipLevel = Deflate::DEFAULT_LEVEL;
+    uint64 mMemBudget = 0;
+    FileFilter mFilter;
+    bool mHasFilter = false;
+    bool mWatch = false;
+    string mDepPath;
+
+    const FileFilter* GetFilter() const { return mHasFilter ? &mFilter : NULL; }
+
+    // the outputs as they were given, the way the build that reads the depfile names them
+    bool WriteDepFile(DepFile& aDeps) const
+    {
+        if (mDepPath.length() == 0)
+            return true;
+
+        if (mOutPath.length() > 0)
+            aDeps.AddTarget(mOutPath.c_str());
+
+        if (mPatchOutPath.length() > 0)
+            aDeps.AddTarget(mPatchOutPath.c_str());
+
+        return aDeps.Write(mDepPath.c_str());
+    }
 };
 
+// -batch <manifest.json>: {"Jobs": [job, [job, job], ...]}. jobs run at the same time on the job pool, the jobs
+// of an inner list run one after the other (extract a rom, then compile it) and stop at the first that fails.
+// jobs share the pool, the parsed DLLSIMPORTTAB.def files and the roms that more than one of them reads.
+// relative paths in the manifest are from its own dir, wherever it's run from
+bool RunBatch(const char* aManifestPath)
+{
+    C_DataPack manifest;
+    C_DataPack jobsPack;
+
+    if (!manifest.FromFileJson(aManifestPath) || !manifest.Get("Jobs", jobsPack))
+    {
+        WAR_LOG_ERROR(CAT_GENERAL, "Failed to read batch manifest %s", aManifestPath);
+        return false;
+    }
+
+    C_FilePath baseDir;
+    C_PathUtils::GetDirectoryPath(aManifestPath, baseDir);
+
+    // everything is parsed up front so a typo doesn't show up halfway through
+    C_Vector<C_Vector<CommandArgs>> chains;
+    int numJobs = 0;
+
+    for (int i = 0; i < jobsPack.NumEntries(); ++i)
+    {
+        C_DataPack entry;
+        jobsPack.Get(i, entry);
+
+        string mode;
+        const bool single = entry.Get("mode", mode);
+        const int count = single ? 1 : entry.NumEntries();
+
+        C_Vector<CommandArgs>& chain = chains.Add();
+
+        for (int j = 0; j < count; ++j)
+        {
+            C_DataPack job;
+            if (single)
+                job = entry;
+            else
+                entry.Get(j, job);
+
+            if (!chain.Add().Parse(JobArgs(job, baseDir)))
+            {
+                WAR_LOG_ERROR(CAT_GENERAL, "%s: invalid job %i.%i", aManifestPath, i, j);
+                return false;
+            }
+        }
+
+        numJobs += count;
+    }
+
+    std::atomic<int> numFailed(0);
+
+    JobPool::GetInstance().ParallelFor(chains.Count(), [&](int i)
+        {
+            const C_Vector<CommandArgs>& chain = chains[i];
+
+            for (int j = 0; j < chain.Count(); ++j)
+            {
+                if (!chain[j].Run())
+                {
+                    WAR_LOG_ERROR(CAT_GENERAL, "Job %i.%i failed, skipping the rest of its list", i, j);
+                    numFailed += chain.Count() - j;
+                    break;
+                }
+            }
+        });
+
+    WAR_LOG_INFO(CAT_GENERAL, "%i of %i jobs done", numJobs - numFailed.load(), numJobs);
+    return numFailed == 0;
+}
+
+// options of a -connect client, a "name\tvalue" line each (switches have no value) and an empty line at the end
+struct RequestArgs : public ArgSource
+{
+    bool Parse(const string& aRequest)
+    {
+        size_t start = 0;
+
+        while (start < aRequest.length())
+        {
+            const size_t end = aRequest.find('\n', start);
+            if (end == string::npos || end == start)
+                break;
+
+            const string line = aRequest.substr(start, end - start);
+            const size_t tab = line.find('\t');
+            mValues[line.substr(0, tab)] = tab == string::npos ? string() : line.substr(tab + 1);
+
+            start = end + 1;
+        }
+
+        return !mValues.empty();
+    }
+
+    bool HasSwitch(const char* aName) const override { return mValues.find(aName) != mValues.end(); }
+
+    bool GetValue(const char* aName, string& aOut) const override
+    {
+        auto it = mValues.find(aName);
+        if (it == mValues.end() || it->second.empty())
+            return false;
+
+        aOut = it->second;
+        return true;
+    }
+
+    std::unordered_map<string, string> mValues;
+};
+
+// a whole request, it ends with an empty line
+bool ReceiveRequest(LocalSocket& aSocket, string& aOut)
+{
+    const size_t MAX_REQUEST = 64 * 1024;
+    char buffer[4096];
+
+    while (aOut.find("\n\n") == string::npos)
+    {
+        const int n = aSocket.Receive(buffer, sizeof(buffer));
+
+        if (n <= 0 || aOut.length() + n > MAX_REQUEST)
+            return false;
+
+        aOut.append(buffer, n);
+    }
+
+    return true;
+}
+
+// -serve <socket path>: a daemon that runs the jobs -connect clients send, one at a time. the roms it has read
+// stay mapped with their fst read and .def files stay parsed, so a job doesn't pay for them again. roms that
+// changed on disk or that a job wrote are read again. -reload lets go of all of it and -stop shuts the daemon down
+int Serve(const char* aSocketPath)
+{
+    LocalSocket listener;
+
+    if (!listener.Listen(aSocketPath))
+    {
+        WAR_LOG_ERROR(CAT_GENERAL, "Failed to listen on %s, is a daemon already running on it or is it not a socket?", aSocketPath);
+        return -1;
+    }
+
+    ROMFST::SetKeepROMsLoaded(true);
+    WAR_LOG_INFO(CAT_GENERAL, "Serving on %s", aSocketPath);
+
+    bool running = true;
+
+    while (running)
+    {
+        LocalSocket client;
+
+        if (!listener.Accept(client))
+        {
+            WAR_LOG_ERROR(CAT_GENERAL, "Failed to accept a connection on %s", aSocketPath);
+            break;
+        }
+
+        // the request is sent right after connecting, a client that doesn't send it can't hold up the others
+        const int REQUEST_TIMEOUT_MS = 10000;
+        client.SetReceiveTimeout(REQUEST_TIMEOUT_MS);
+
+        string request;
+        RequestArgs args;
+
+        if (!ReceiveRequest(client, request) || !args.Parse(request))
+        {
+            WAR_LOG_WARNING(CAT_GENERAL, "Dropped a client that didn't send a complete request");
+            continue;
+        }
+
+        bool ok = true;
+        string manifestPath;
+
+        if (args.HasSwitch("stop"))
+        {
+            running = false;
+        }
+        else if (args.HasSwitch("reload"))
+        {
+            ROMFST::SetKeepROMsLoaded(false);
+            ROMFST::SetKeepROMsLoaded(true);
+            DefsFile::ClearShared();
+        }
+        else if (args.GetValue("batch", manifestPath))
+        {
+            ok = RunBatch(manifestPath.c_str());
+        }
+        else if (args.HasSwitch("watch"))
+        {
+            // would never reply and hold up every other client
+            WAR_LOG_ERROR(CAT_GENERAL, "-watch can't be run on a -serve daemon");
+            ok = false;
+        }
+        else
+        {
+            CommandArgs job;
+            ok = job.Parse(args) && job.Run();
+        }
+
+        const char* reply = ok ? "ok\n" : "failed\n";
+        client.Send(reply, uint32(strlen(reply)));
+    }
+
+    ROMFST::SetKeepROMsLoaded(false);
+    return running ? -1 : 0;
+}
+
+// -connect <socket path> [mode] [options]: hands the rest of the command line to a -serve daemon and waits for it
+int RunClient(const char* aSocketPath, int aArgC, char** aArgV)
+{
+    string request;
+
+    for (int i = 1; i < aArgC; ++i)
+    {
+        if (aArgV[i][0] != '-')
+            continue;
+
+        const string name = aArgV[i] + 1;
+        const bool hasValue = i + 1 < aArgC && aArgV[i + 1][0] != '-';
+        string value = hasValue ? aArgV[++i] : "";
+
+        if (name == "connect")
+            continue;
+
+        if (hasValue && IsPathOption(name) && !IsAbsolutePath(value))
+        {
+            C_FilePath path(C_OS::GetInstance()->GetWorkingDirectory());
+            path.Combine(value.c_str());
+            value = (const char*)path;
+        }
+
+        request += name + "\t" + value + "\n";
+    }
+
+    request += "\n";
+
+    LocalSocket socket;
+
+    if (!socket.Connect(aSocketPath) || !socket.Send(request.data(), uint32(request.length())))
+    {
+        WAR_LOG_ERROR(CAT_GENERAL, "No dinofst daemon on %s, start one with -serve", aSocketPath);
+        return -1;
+    }
+
+    string reply;
+    char buffer[64];
+    int n;
+
+    while ((n = socket.Receive(buffer, sizeof(buffer))) > 0)
+        reply.append(buffer, n);
+
+    if (reply != "ok\n")
+    {
+        WAR_LOG_ERROR(CAT_GENERAL, "The job failed, the daemon's log has the details");
+        return -1;
+    }
+
+    return 0;
+}
+
 // minimal runtime
 int main(int argc, char** argv)
 {
@@ -152,14 +625,26 @@ int main(int argc, char** argv)
     C_ModuleManager::GetInstance()->AutoLoadModules();
     WAR_CHECK(C_CorePlatformModule::IsLoadedStatic());
 
+    string socketPath;
+    if (C_CommandLine::GetInstance()->GetValue("connect", socketPath))
+        return RunClient(socketPath.c_str(), argc, argv);
+
+    if (C_CommandLine::GetInstance()->GetValue("serve", socketPath))
+        return Serve(socketPath.c_str());
+
+    string manifestPath;
+    if (C_CommandLine::GetInstance()->GetValue("batch", manifestPath))
+        return RunBatch(manifestPath.c_str()) ? 0 : -1;
+
     CommandArgs args;
 
-    if (!args.Parse())
+    if (!args.Parse(CommandLineArgs()))
     {
         WAR_LOG_INFO(CAT_GENERAL, "Printing usage\n\n");
 
         string help;
         help.append("usage: dpfst [mode] [options]\n");
+        help.append("Roms can be .z64, .v64 or .n64, the byte order is detected from the header.\n");
         help.append("Modes:\n");
         help.append("-dump_bin: extract raw fst.bin from rom. options:\n");
         help.append("  -rom <path>: the path to the rom\n");
@@ -170,59 +655,44 @@ int main(int argc, char** argv)
         help.append("-extract_files: extract files into intermediate formats to given directory. options:\n");
         help.append("  -rom <path>: the path to the rom\n");
         help.append("  -o <dir path>: the output directory\n");
+        help.append("  -mem_budget <MB>: how much of the rom may stay loaded, files not in use are evicted (.z64 roms only)\n");
+        help.append("  -only <files>: comma separated fst file names or globs to extract, e.g. DLLS* or TEX0.bin,TEX0.tab\n");
+        help.append("  -exclude <files>: the same, for files to leave out\n");
         help.append("\n");
         help.append("-compile_rom: compile new FST and build new rom. options:\n");
         help.append("  -i <dir path>: the input dir to the extracted fst\n");
         help.append("  -rom <path>: the path to the base rom\n");
         help.append("  -o <path>: the path to the output rom\n");
+        help.append("  -patch_out <path>: write a .bps patch against the base rom, -o becomes optional\n");
+        help.append("  -rom_order <z64|v64|n64>: byte order of the output rom, defaults to the base rom's order\n");
+        help.append("  -zlevel <0-9>: compression level for edited compressed entries, defaults to 9\n");
+        help.append("  -only <files>, -exclude <files>: compile only some files, the others are taken from the base rom\n");
+        help.append("  -watch: keep running and rebuild the rom every time a file in the input dir changes,\n");
+        help.append("    only the fst files built from what changed are compiled again\n");
+        help.append("  -depfile <path>: write the files that were read as a makefile rule for make or ninja\n");
+        help.append("-apply_patch: apply a .bps patch to a base rom. options:\n");
+        help.append("  -i <path>: the .bps patch\n");
+        help.append("  -rom <path>: the path to the base rom\n");
+        help.append("  -o <path>: the path to the output rom\n");
+        help.append("  -rom_order <z64|v64|n64>: byte order of the output rom, defaults to the base rom's order\n");
         help.append("\n");
         help.append("-elf2dll: converts a .ELF into a DP compatible .DLL. options:\n");
         help.append("  -i <path>: the input .elf\n");
         help.append("  -o <path>: the output .dll\n");
         help.append("  -defs <path>: path to DLLSIMPORTTAB.def (get it by extracting the FST), which is used for resolving symbols\n");
+        help.append("  -depfile <path>: write the .elf and .def as a makefile rule for make or ninja\n");
+        help.append("\n");
+        help.append("-batch <path>: runs the jobs of a .json manifest at the same time, {\"Jobs\": [job, [job, job], ...]}.\n");
+        help.append("  a job is {\"mode\": \"extract_files\", \"rom\": \"a.z64\", \"o\": \"out/a\"} with the options above,\n");
+        help.append("  the jobs of an inner list run in order\n");
+        help.append("\n");
+        help.append("-serve <socket path>: stays up and runs the jobs sent by -connect, keeping roms mapped and .def files parsed\n");
+        help.append("-connect <socket path> [mode] [options]: runs a job on a -serve daemon, -reload makes it drop what it\n");
+        help.append("  keeps (roms that changed on disk are reloaded anyway) and -stop shuts it down\n");
 
         printf(help.c_str());
         return -1;
     }
 
-    switch (args.mMode)
-    {
-        case CommandArgs::MODE_DUMP_BIN:
-        {
-            ROMFST::DumpBin(args.mRomPath.c_str(), args.mOutPath.c_str());
-            break;
-        }
-
-        case CommandArgs::MODE_DUMP_FILES:
-        {
-            ROMFST::DumpFiles(args.mRomPath.c_str(), args.mOutPath.c_str());
-            break;
-        }
-
-        case CommandArgs::MODE_EXTRACT_FILES:
-        {
-            ROMFST::ExtractFiles(args.mRomPath.c_str(), args.mOutPath.c_str(), args.mDefsPath.c_str());
-            break;
-        }
-
-        case CommandArgs::MODE_COMPILE_FILES:
-        {
-            ROMFST::CompileFiles(args.mInPath.c_str(), args.mOutPath.c_str());
-            break;
-        }
-
-        case CommandArgs::MODE_COMPILE_ROM:
-        {
-            ROMFST::CompileROM(args.mRomPath.c_str(), args.mInPath.c_str(), args.mOutPath.c_str());
-            break;
-        }
-
-        case CommandArgs::MODE_ELF2DLL:
-        {
-            DLLCompiler::ConvertELFtoDLL(args.mInPath.c_str(), args.mOutPath.c_str(), args.mDefsPath.c_str());
-            break;
-        }
-    }
-
-    return 0;
+    return args.Run() ? 0 : -1;
 }
\ No newline at end of file